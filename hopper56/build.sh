@@ -10,10 +10,19 @@ LDFLAGS="-lc"
 # Library (decoder) code
 ${CC} ${CFLAGS} -c -o decode56.o      lib/decode56.cpp
 ${CC} ${CFLAGS} -c -o instruction56.o lib/instruction56.cpp
+${CC} ${CFLAGS} -c -o format56.o      lib/format56.cpp
 # Application code
 ${CC} ${CFLAGS} -c -o main.o        main.cpp
 ${CC} ${CFLAGS} -c -o print.o       print.cpp
 ${CC} ${CFLAGS} -c -o symbols.o     symbols.cpp
+${CC} ${CFLAGS} -c -o mapfile.o     mapfile.cpp
+${CC} ${CFLAGS} -c -o stats.o       stats.cpp
 # Link
-${LD} ${LDFLAGS} main.o print.o symbols.o decode56.o instruction56.o -o hopper56
+${LD} ${LDFLAGS} main.o mapfile.o print.o stats.o symbols.o decode56.o format56.o instruction56.o -o hopper56
+
+# Embeddable decoder library with a C interface (see lib/libhop56.h)
+LIB_SRC="lib/libhop56.cpp lib/decode56.cpp lib/format56.cpp lib/instruction56.cpp"
+${CC} ${CFLAGS} -c -o libhop56.o      lib/libhop56.cpp
+ar rcs libhop56.a libhop56.o decode56.o format56.o instruction56.o
+${CC} ${CFLAGS} -fPIC -fvisibility=hidden -shared -o libhop56.so ${LIB_SRC}
 
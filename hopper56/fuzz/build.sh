@@ -0,0 +1,14 @@
+#!/usr/bin/env sh
+# Build the libFuzzer target with clang, plus a standalone version for
+# reproducing crashes (run with the failing input files as arguments).
+set -e
+set -x
+CC=${CC:-clang++}
+CFLAGS="-std=c++11 -g -O1 -Wextra -Wall ${EXTRA_CFLAGS}"
+FUZZ_FLAGS="-fsanitize=fuzzer,address,undefined"
+STANDALONE_FLAGS="-DFUZZ_STANDALONE -fsanitize=address,undefined"
+
+SRC="../lib/decode56.cpp ../lib/format56.cpp ../lib/instruction56.cpp ../print.cpp ../symbols.cpp"
+
+${CC} ${CFLAGS} ${FUZZ_FLAGS} -o fuzz_decode56 fuzz_decode56.cpp ${SRC}
+${CC} ${CFLAGS} ${STANDALONE_FLAGS} -o fuzz_decode56_standalone fuzz_decode56.cpp ${SRC}
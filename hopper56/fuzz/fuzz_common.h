@@ -0,0 +1,96 @@
+// Shared support for the libFuzzer targets.
+//
+// As well as crashes, inputs are flagged if they take longer than a time
+// budget proportional to their size, so that quadratic or runaway parsing
+// is found by the fuzzer rather than in production. The budget can be set
+// with the environment variables FUZZ_NS_PER_BYTE and FUZZ_BASE_MS.
+//
+// Building with -DFUZZ_STANDALONE adds a main() which runs the target over
+// the files given on the command line, for reproducing failures without
+// libFuzzer.
+#ifndef FUZZ_COMMON_H
+#define FUZZ_COMMON_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+// Defaults are generous enough for sanitizer builds
+static const double FUZZ_DEFAULT_NS_PER_BYTE = 20000.0;
+static const double FUZZ_DEFAULT_BASE_MS = 100.0;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// ----------------------------------------------------------------------------
+// Times one input, and aborts (which the fuzzer records as a crash) if it
+// took longer than its budget.
+class fuzz_slow_input_check
+{
+public:
+	explicit fuzz_slow_input_check(size_t size) :
+		m_size(size),
+		m_start(std::chrono::steady_clock::now())
+	{}
+
+	~fuzz_slow_input_check()
+	{
+		double ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - m_start).count();
+		double budget_ms = get_env("FUZZ_BASE_MS", FUZZ_DEFAULT_BASE_MS) +
+			get_env("FUZZ_NS_PER_BYTE", FUZZ_DEFAULT_NS_PER_BYTE) * m_size / 1e6;
+		if (ms > budget_ms)
+		{
+			fprintf(stderr, "Slow input: %u bytes took %.1f ms (budget %.1f ms)\n",
+				(unsigned int)m_size, ms, budget_ms);
+			abort();
+		}
+	}
+
+private:
+	static double get_env(const char* name, double default_value)
+	{
+		const char* value = getenv(name);
+		return value ? atof(value) : default_value;
+	}
+
+	size_t m_size;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+// ----------------------------------------------------------------------------
+// Output stream for targets that print, discarded
+inline FILE* get_fuzz_output()
+{
+	static FILE* pOutput = fopen("/dev/null", "w");
+	return pOutput;
+}
+
+#ifdef FUZZ_STANDALONE
+// ----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		FILE* pFile = fopen(argv[i], "rb");
+		if (!pFile)
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", argv[i]);
+			return 1;
+		}
+		std::vector<uint8_t> data;
+		uint8_t block[4096];
+		size_t count;
+		while ((count = fread(block, 1, sizeof(block), pFile)) != 0)
+			data.insert(data.end(), block, block + count);
+		fclose(pFile);
+
+		fprintf(stderr, "Running: %s (%u bytes)\n", argv[i], (unsigned int)data.size());
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+	return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+// libFuzzer target for hop56::decode.
+// The input is decoded as a stream of 24-bit words, and each instruction is
+// printed, so the operand formatting is covered as well.
+#include "fuzz_common.h"
+
+#include "../lib/buffer56.h"
+#include "../lib/decode56.h"
+#include "../lib/instruction56.h"
+#include "../print.h"
+#include "../symbols.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	fuzz_slow_input_check check(size);
+
+	hop56::decode_settings dsettings;
+	hop56::buffer_reader buf(data, (uint32_t)size, 0);
+	symbols empty_symbols;
+	while (buf.get_remain() >= 1)
+	{
+		hop56::instruction inst;
+		hop56::buffer_reader buf_copy(buf);
+		hop56::decode(inst, buf_copy, dsettings);
+		if (inst.word_count < 1)
+			abort();
+		print(inst, empty_symbols, get_fuzz_output());
+		buf.advance(inst.word_count);
+	}
+	return 0;
+}
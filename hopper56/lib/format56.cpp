@@ -0,0 +1,170 @@
+#include "format56.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#define REGNAME		get_register_string
+
+namespace hop56
+{
+	// ----------------------------------------------------------------------------
+	// Appends text to a fixed-size buffer. Text past the end of the buffer is
+	// dropped but still counted, so the caller can find the size required.
+	class text_writer
+	{
+	public:
+		text_writer(char* buffer, size_t size) :
+			m_pBuffer(buffer),
+			m_size(size),
+			m_length(0)
+		{
+			if (m_size)
+				m_pBuffer[0] = 0;
+		}
+
+		void append(const char* pFormat, ...)
+#ifdef __GNUC__
+			__attribute__((format(printf, 2, 3)))
+#endif
+		{
+			va_list args;
+			va_start(args, pFormat);
+			char* pDest = NULL;
+			size_t space = 0;
+			if (m_length < m_size)
+			{
+				pDest = m_pBuffer + m_length;
+				space = m_size - m_length;
+			}
+			int len = vsnprintf(pDest, space, pFormat, args);
+			va_end(args);
+			if (len > 0)
+				m_length += (size_t)len;
+		}
+
+		size_t get_length() const		{ return m_length; }
+
+	private:
+		char*		m_pBuffer;
+		size_t		m_size;
+		size_t		m_length;			// full length of the text, even if truncated
+	};
+
+	// ----------------------------------------------------------------------------
+	// Format an operand, for all operand types
+	static void format_operand(const operand& operand, const format_symbols* pSymbols, text_writer& out)
+	{
+		out.append("%s", get_memory_string(operand.memory));
+		switch (operand.type)
+		{
+			case operand::IMM_SHORT:
+				out.append("#%d", operand.imm_short.val);
+				break;
+			case operand::REG:
+				out.append("%s", REGNAME(operand.reg.index));
+				break;
+			case operand::POSTDEC_OFFSET:
+				out.append("(%s)-%s",
+						REGNAME(operand.postdec_offset.index_1),
+						REGNAME(operand.postdec_offset.index_2));
+				break;
+			case operand::POSTINC_OFFSET:
+				out.append("(%s)+%s",
+						REGNAME(operand.postinc_offset.index_1),
+						REGNAME(operand.postinc_offset.index_2));
+				break;
+			case operand::POSTDEC:
+				out.append("(%s)-", REGNAME(operand.postdec.index));
+				break;
+			case operand::POSTINC:
+				out.append("(%s)+", REGNAME(operand.postinc.index));
+				break;
+			case operand::NO_UPDATE:
+				out.append("(%s)", REGNAME(operand.no_update.index));
+				break;
+			case operand::INDEX_OFFSET:
+				out.append("(%s+%s)",
+						REGNAME(operand.index_offset.index_1),
+						REGNAME(operand.index_offset.index_2));
+				break;
+			case operand::PREDEC:
+				out.append("-(%s)", REGNAME(operand.predec.index));
+				break;
+			case operand::ABS:
+			{
+				const char* label = NULL;
+				if (pSymbols && pSymbols->find_label)
+					label = pSymbols->find_label(pSymbols->user_data, Memory::MEM_P, operand.abs.address);
+				if (label)
+					out.append("%s", label);
+				else
+					out.append("$%x", operand.abs.address);
+			}
+				break;
+			case operand::ABS_SHORT:
+				out.append(">$%x", operand.abs_short.address);
+				break;
+			case operand::IMM:
+				out.append("#$%x", operand.imm.val);
+				break;
+			case operand::IO_SHORT:
+				out.append("<<$%x", operand.io_short.address);
+				break;
+			default:
+				out.append("unknown %d?", operand.type);
+				break;
+		}
+	}
+
+	// ----------------------------------------------------------------------------
+	size_t format(const instruction& inst, const format_symbols* pSymbols, char* buffer, size_t size)
+	{
+		text_writer out(buffer, size);
+		if (inst.opcode == INVALID)
+		{
+			out.append("DC\t$%06x", inst.header);
+			return out.get_length();
+		}
+
+		out.append("%s", get_opcode_string(inst.opcode));
+		for (int i = 0; i < 3; ++i)
+		{
+			const operand& op = inst.operands[i];
+			if (op.type == operand::NONE)
+				break;
+
+			if (i == 0)
+				out.append("%s", inst.neg_operands ? "\t-" : "\t");
+			else
+				out.append(",");
+
+			format_operand(op, pSymbols, out);
+		}
+
+		for (int i = 0; i < 2; ++i)
+		{
+			const operand& op = inst.operands2[i];
+			if (op.type == operand::NONE)
+				break;
+
+			out.append("%s", i == 0 ? "\t" : ",");
+			format_operand(op, pSymbols, out);
+		}
+
+		for (int i = 0; i < 2; ++i)
+		{
+			const pmove& pmove = inst.pmoves[i];
+			if (pmove.operands[0].type == operand::NONE)
+				continue;	// skip if there is no first operand
+
+			out.append("\t");
+			format_operand(pmove.operands[0], pSymbols, out);
+
+			if (pmove.operands[1].type == operand::NONE)
+				continue;	// next pmove
+			out.append(",");
+			format_operand(pmove.operands[1], pSymbols, out);
+		}
+		return out.get_length();
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef HOPPER56_FORMAT_H
+#define HOPPER56_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "instruction56.h"
+
+namespace hop56
+{
+	// Optional symbol lookup used when formatting.
+	// Returned strings only need to stay valid until the lookup function is
+	// called again, or format() returns.
+	struct format_symbols
+	{
+		// Returns the label at an address in a memory space, or NULL if there is none.
+		const char* (*find_label)(void* user_data, Memory mem, uint32_t address);
+
+		void* user_data;
+	};
+
+	// Write the instruction's opcode and operands as text into 'buffer', which is
+	// always null-terminated if 'size' is non-zero. Text which does not fit is
+	// truncated. No memory is allocated.
+	// 'pSymbols' can be NULL to print all addresses as numbers.
+	// Returns the length of the full text (excluding the terminator), like
+	// snprintf(), so a return value >= size means the text was truncated.
+	size_t format(const instruction& inst, const format_symbols* pSymbols, char* buffer, size_t size);
+}
+
+#endif // HOPPER56_FORMAT_H
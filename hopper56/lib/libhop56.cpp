@@ -0,0 +1,106 @@
+// C interface to the decoder. See libhop56.h.
+#include "libhop56.h"
+
+#include <new>
+
+#include "buffer56.h"
+#include "decode56.h"
+#include "format56.h"
+#include "instruction56.h"
+
+static_assert(sizeof(hop56::instruction) <= HOP56_INST_STORAGE_SIZE,
+	"HOP56_INST_STORAGE_SIZE is too small for hop56::instruction");
+static_assert(alignof(hop56::instruction) <= alignof(uint64_t),
+	"hop56_inst storage is not aligned enough for hop56::instruction");
+
+static_assert((int)HOP56_MEM_X == (int)hop56::MEM_X && (int)HOP56_MEM_Y == (int)hop56::MEM_Y &&
+	(int)HOP56_MEM_P == (int)hop56::MEM_P && (int)HOP56_MEM_L == (int)hop56::MEM_L, "Memory types do not match");
+
+// ----------------------------------------------------------------------------
+static const hop56::instruction& get_instruction(const hop56_inst* inst)
+{
+	return *reinterpret_cast<const hop56::instruction*>(inst->storage);
+}
+
+// ----------------------------------------------------------------------------
+// Decode from the reader's position, and fill in the public fields
+static void decode_inst(hop56::buffer_reader& buf, hop56_inst* inst)
+{
+	hop56::decode_settings dsettings;
+	hop56::instruction& decoded = *new (inst->storage) hop56::instruction;
+	uint32_t address = buf.get_address();
+	hop56::decode(decoded, buf, dsettings);
+	decoded.address = address;
+
+	inst->address = address;
+	inst->header = decoded.header;
+	inst->word_count = (uint16_t)decoded.word_count;
+	inst->valid = decoded.opcode != hop56::INVALID;
+	inst->reserved = 0;
+	inst->opcode = inst->valid ? hop56::get_opcode_string(decoded.opcode) : "DC";
+}
+
+// ----------------------------------------------------------------------------
+// Adapts the C lookup function to hop56::format_symbols
+static const char* find_label(void* user_data, hop56::Memory mem, uint32_t address)
+{
+	const hop56_symbols* symbols = (const hop56_symbols*)user_data;
+	return symbols->find_label(symbols->user_data, (int)mem, address);
+}
+
+// ----------------------------------------------------------------------------
+int hop56_get_api_version(void)
+{
+	return HOP56_API_VERSION;
+}
+
+// ----------------------------------------------------------------------------
+int hop56_decode(const uint8_t* data, uint32_t size, uint32_t address, hop56_inst* inst)
+{
+	if (!data || !inst || size < 3)
+		return 1;
+
+	hop56::buffer_reader buf(data, size, address);
+	decode_inst(buf, inst);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+uint32_t hop56_decode_range(const uint8_t* data, uint32_t size, uint32_t address,
+	hop56_decode_callback callback, void* user_data)
+{
+	if (!data || !callback)
+		return 0;
+
+	hop56::buffer_reader buf(data, size, address);
+	hop56_inst inst;
+	while (buf.get_remain() >= 1)
+	{
+		// decode uses a copy of the buffer state
+		hop56::buffer_reader buf_copy(buf);
+		decode_inst(buf_copy, &inst);
+		buf.advance(inst.word_count);
+		if (callback(&inst, user_data) != 0)
+			break;
+	}
+	return buf.get_pos();
+}
+
+// ----------------------------------------------------------------------------
+size_t hop56_format(const hop56_inst* inst, const hop56_symbols* symbols, char* buffer, size_t size)
+{
+	if (!inst)
+	{
+		if (size)
+			buffer[0] = 0;
+		return 0;
+	}
+
+	hop56::format_symbols lookups = { NULL, NULL };
+	if (symbols && symbols->find_label)
+	{
+		lookups.find_label = find_label;
+		lookups.user_data = (void*)symbols;
+	}
+	return hop56::format(get_instruction(inst), &lookups, buffer, size);
+}
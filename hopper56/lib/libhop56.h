@@ -0,0 +1,105 @@
+/* C interface to the 56000 decoder, for embedding in other programs.
+ *
+ * None of these functions allocate memory. Instructions are decoded into
+ * storage owned by the caller, and text is written to a caller-supplied
+ * buffer, so they are safe to call every frame, e.g. from a debugger.
+ * All functions are thread-safe.
+ *
+ * Program data is passed as packed 24-bit big-endian words (3 bytes per
+ * word), and all addresses and sizes are in words.
+ *
+ * The interface is stable: structures are only ever extended at the end,
+ * and HOP56_API_VERSION is increased when that happens.
+ */
+#ifndef LIBHOP56_H
+#define LIBHOP56_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOP56_API_VERSION		1
+
+/* Only these functions are exported when building a shared library with
+ * -fvisibility=hidden */
+#if defined(__GNUC__)
+#define HOP56_API __attribute__((visibility("default")))
+#else
+#define HOP56_API
+#endif
+
+/* Size of the private decoded form stored in each hop56_inst */
+#define HOP56_INST_STORAGE_SIZE	256
+
+/* Memory spaces, for label lookups */
+enum hop56_memory
+{
+	HOP56_MEM_NONE,
+	HOP56_MEM_X,
+	HOP56_MEM_Y,
+	HOP56_MEM_P,
+	HOP56_MEM_L
+};
+
+/* A decoded instruction. Only the public fields should be read. */
+typedef struct hop56_inst
+{
+	uint32_t	address;		/* address of the first word */
+	uint32_t	header;			/* first word */
+	uint16_t	word_count;		/* size in words; 1 for invalid data */
+	uint8_t		valid;			/* 0 if the data is not a valid instruction */
+	uint8_t		reserved;
+	const char*	opcode;			/* opcode name e.g. "move", or "DC" if invalid */
+
+	/* Private: the full decoded form, used by hop56_format() */
+	uint64_t	storage[HOP56_INST_STORAGE_SIZE / 8];
+} hop56_inst;
+
+/* Called for each instruction by hop56_decode_range().
+ * Return 0 to continue, or non-zero to stop decoding. */
+typedef int (*hop56_decode_callback)(const hop56_inst* inst, void* user_data);
+
+/* Optional label lookup for hop56_format().
+ * Returned strings must stay valid until the next lookup call. */
+typedef struct hop56_symbols
+{
+	/* Returns the label at "address" in memory space "memory" (hop56_memory), or NULL */
+	const char* (*find_label)(void* user_data, int memory, uint32_t address);
+
+	void*		user_data;
+} hop56_symbols;
+
+/* Returns HOP56_API_VERSION of the library, to check against the header. */
+extern HOP56_API int hop56_get_api_version(void);
+
+/* Decode one instruction from "data" ("size" bytes), which is located at
+ * word address "address". Data which is not a valid instruction is returned
+ * as a single word with "valid" set to 0.
+ * Returns 0 for success, 1 if there is less than one word or the arguments
+ * are invalid. */
+extern HOP56_API int hop56_decode(const uint8_t* data, uint32_t size, uint32_t address, hop56_inst* inst);
+
+/* Decode consecutive instructions from "data" ("size" bytes), which is
+ * located at word address "address", calling "callback" for each one until
+ * the data runs out or the callback returns non-zero. A single hop56_inst on
+ * the stack is reused for each call, so callers must copy anything they want
+ * to keep.
+ * Returns the number of words decoded. */
+extern HOP56_API uint32_t hop56_decode_range(const uint8_t* data, uint32_t size, uint32_t address,
+	hop56_decode_callback callback, void* user_data);
+
+/* Write the instruction as text e.g. "move\tx:(r0)+,x0" into "buffer",
+ * which is always null-terminated if "size" is non-zero. "symbols" can be
+ * NULL to show all addresses as numbers.
+ * Returns the length of the full text like snprintf(), so a result >= size
+ * means the text was truncated. */
+extern HOP56_API size_t hop56_format(const hop56_inst* inst, const hop56_symbols* symbols, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
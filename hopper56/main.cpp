@@ -10,6 +10,8 @@
 #include "lib/instruction56.h"
 #include "print.h"
 #include "symbols.h"
+#include "mapfile.h"
+#include "stats.h"
 
 // ----------------------------------------------------------------------------
 // User options for output.
@@ -20,6 +22,7 @@ struct output_settings
 	bool abs_addressing;		// absolute addresses (don't create labels)
 	std::string label_prefix;	// prefix for all auto-labels, normally "L"
 	uint32_t label_start_id;	// starting number of label prefix, normally 0
+	run_stats* pStats;			// timings and counters for --stats, or NULL
 };
 
 // ----------------------------------------------------------------------------
@@ -154,17 +157,33 @@ void add_reference_symbols(const disassembly& disasm, const output_settings& set
 int process_bin_file(const uint8_t* data_ptr, long size, const hop56::decode_settings& dsettings,
 		const output_settings& osettings, FILE* pOutput)
 {
+	run_stats* pStats = osettings.pStats;
+	stats_add_count(pStats, "input bytes", size);
+
 	hop56::buffer_reader buf(data_ptr, size, 0);
 	symbols bin_symbols;
 
+	stats_start_phase(pStats, "decode_buf");
 	disassembly disasm;
 	if (decode_buf(buf, dsettings, disasm))
 		return 1;
+	if (pStats)
+	{
+		uint64_t invalid = 0;
+		for (size_t i = 0; i < disasm.lines.size(); ++i)
+			invalid += (disasm.lines[i].inst.opcode == hop56::Opcode::INVALID);
+		pStats->add_count("instructions", disasm.lines.size());
+		pStats->add_count("invalid opcodes", invalid);
+	}
 
+	stats_start_phase(pStats, "add_reference_symbols");
 	if (!osettings.abs_addressing)
 		add_reference_symbols(disasm, osettings, bin_symbols);
+	stats_add_count(pStats, "symbols", bin_symbols.table.size());
 
+	stats_start_phase(pStats, "print");
 	print(disasm, osettings, bin_symbols, pOutput);
+	stats_end_phase(pStats);
 	return 0;
 }
 
@@ -179,6 +198,7 @@ void usage()
 		"\t--abs                    Don't create autolabels (absolute address mode)\n"
 		"\t--label-prefix <string>  Set prefix for auto-labels\n"
 		"\t--label-start <int>      Set starting suffix number for auto-labels\n"
+		"\t--stats                  Print timings and counts for each stage to stderr\n"
 	);
 }
 
@@ -198,6 +218,8 @@ int main(int argc, char** argv)
 	osettings.abs_addressing = false;
 	osettings.label_prefix = "L";
 	osettings.label_start_id = 0;
+	osettings.pStats = NULL;
+	run_stats stats;
 
 	hop56::decode_settings dsettings = {};
 	const int last_arg = argc - 1;							// last arg is reserved for filename or hex data.
@@ -210,6 +232,8 @@ int main(int argc, char** argv)
 			osettings.show_header = true;
 		else if (strcmp(argv[opt], "--abs") == 0)
 			osettings.abs_addressing = true;
+		else if (strcmp(argv[opt], "--stats") == 0)
+			osettings.pStats = &stats;
 		else if (strcmp(argv[opt], "--label-prefix") == 0)
 		{
 			opt++;
@@ -245,29 +269,19 @@ int main(int argc, char** argv)
 	}
 
 	const char* fname = argv[argc - 1];
-	FILE* pInfile = fopen(fname, "rb");
-	if (!pInfile)
+	mapped_file infile;
+	stats_start_phase(osettings.pStats, "open input");
+	if (infile.open(fname))
 	{
-		fprintf(stderr, "Error: Can't open file: %s\n", fname);
+		fprintf(stderr, "Error: Can't read file: %s\n", fname);
 		return 1;
 	}
-
-	(void) fseek(pInfile, 0, SEEK_END);
-	long size = ftell(pInfile);
-
-	rewind(pInfile);
-	uint8_t* data_ptr = (uint8_t*) malloc(size);
-	long readBytes = fread(data_ptr, 1, size, pInfile);
-	fclose(pInfile);
-	if (readBytes != size)
+	stats_end_phase(osettings.pStats);
+	int ret = process_bin_file(infile.get_data(), infile.get_size(), dsettings, osettings, stdout);
+	if (osettings.pStats)
 	{
-		free(data_ptr);
-		fprintf(stderr, "Error: Failed to read file contents\n");
-		return 1;
+		stats.end_phase();
+		stats.print(stderr);
 	}
-	int ret = 0;
-	ret = process_bin_file(data_ptr, size, dsettings, osettings, stdout);
-
-	free(data_ptr);
 	return ret;
 }
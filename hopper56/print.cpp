@@ -1,137 +1,41 @@
 #include "print.h"
 
-#include <stdlib.h>
-#include <memory.h>
-#include <string>
-#include <cstring>
+#include <vector>
 
+#include "lib/format56.h"
 #include "lib/instruction56.h"
 #include "symbols.h"
 
-#define REGNAME		hop56::get_register_string
-
-// Print an operand, for all operand types
-static void print(const hop56::operand& operand, const symbols& symbols, FILE* pOutput)
+// Symbol lookup for hop56::format(), using the symbol table directly so
+// no labels are copied.
+static const char* find_label(void* user_data, hop56::Memory mem, uint32_t address)
 {
-	fprintf(pOutput, "%s", hop56::get_memory_string(operand.memory));
-	switch (operand.type)
-	{
-		case hop56::operand::IMM_SHORT:
-			fprintf(pOutput, "#%d", operand.imm_short.val);
-			break;
-		case hop56::operand::REG:
-			fprintf(pOutput, "%s",
-					REGNAME(operand.reg.index));
-			break;
-		case hop56::operand::POSTDEC_OFFSET:
-			fprintf(pOutput, "(%s)-%s",
-					REGNAME(operand.postdec_offset.index_1),
-					REGNAME(operand.postdec_offset.index_2));
-			break;
-		case hop56::operand::POSTINC_OFFSET:
-			fprintf(pOutput, "(%s)+%s",
-					REGNAME(operand.postinc_offset.index_1),
-					REGNAME(operand.postinc_offset.index_2));
-			break;
-		case hop56::operand::POSTDEC:
-			fprintf(pOutput, "(%s)-",
-					REGNAME(operand.postdec.index));
-			break;
-		case hop56::operand::POSTINC:
-			fprintf(pOutput, "(%s)+",
-					REGNAME(operand.postinc.index));
-			break;
-		case hop56::operand::NO_UPDATE:
-			fprintf(pOutput, "(%s)",
-					REGNAME(operand.no_update.index));
-			break;
-		case hop56::operand::INDEX_OFFSET:
-			fprintf(pOutput, "(%s+%s)",
-					REGNAME(operand.index_offset.index_1),
-					REGNAME(operand.index_offset.index_2));
-			break;
-		case hop56::operand::PREDEC:
-			fprintf(pOutput, "-(%s)", REGNAME(operand.predec.index));
-			break;
-		case hop56::operand::ABS:
-		{
-			symbol sym;
-			if (find_symbol(symbols, hop56::Memory::MEM_P, operand.abs.address, sym))
-				fprintf(pOutput, "%s", sym.label.c_str());
-			else
-				fprintf(pOutput, "$%x", operand.abs.address);
-		}
-			break;
-		case hop56::operand::ABS_SHORT:
-			fprintf(pOutput, ">$%x", operand.abs_short.address);
-			break;
-		case hop56::operand::IMM:
-			fprintf(pOutput, "#$%x", operand.imm.val);
-			break;
-		case hop56::operand::IO_SHORT:
-			fprintf(pOutput, "<<$%x", operand.io_short.address);
-			break;
-		default:
-			fprintf(pOutput, "unknown %d?", operand.type);
-			break;
-	}
+	const symbols& syms = *(const symbols*)user_data;
+	symbol::addr_t a;
+	a.mem = mem;
+	a.addr = address;
+	std::map<symbol::addr_t, symbol>::const_iterator it = syms.table.find(a);
+	if (it == syms.table.end())
+		return NULL;
+	return it->second.label.c_str();
 }
 
 int print(const hop56::instruction& inst, const symbols& symbols, FILE* pOutput)
 {
-	if (inst.opcode == hop56::INVALID)
-	{
-		fprintf(pOutput, "DC\t$%06x", inst.header);
-		return 0;
-	}
-
-	fprintf(pOutput, "%s", hop56::get_opcode_string(inst.opcode));
-	for (int i = 0; i < 3; ++i)
-	{
-		const hop56::operand& op = inst.operands[i];
-		if (op.type == hop56::operand::NONE)
-			break;
-
-		if (i == 0)
-		{
-			fprintf(pOutput, "\t");
-			if (inst.neg_operands)
-				fprintf(pOutput, "-");
-		}
-		else
-			fprintf(pOutput, ",");
+	hop56::format_symbols lookups = { find_label, (void*)&symbols };
 
-		print(op, symbols, pOutput);
-	}
-
-	for (int i = 0; i < 2; ++i)
+	// Almost all instructions fit, but long labels can need more space
+	char text[256];
+	size_t length = hop56::format(inst, &lookups, text, sizeof(text));
+	if (length < sizeof(text))
 	{
-		const hop56::operand& op = inst.operands2[i];
-		if (op.type == hop56::operand::NONE)
-			break;
-
-		if (i == 0)
-			fprintf(pOutput, "\t");
-		else
-			fprintf(pOutput, ",");
-
-		print(op, symbols, pOutput);
+		fputs(text, pOutput);
 	}
-
-	for (int i = 0; i < 2; ++i)
+	else
 	{
-		const hop56::pmove& pmove = inst.pmoves[i];
-		if (pmove.operands[0].type == hop56::operand::NONE)
-			continue;	// skip if there is no first operand
-
-		fprintf(pOutput, "\t");
-		print(pmove.operands[0], symbols, pOutput);
-
-		if (pmove.operands[1].type == hop56::operand::NONE)
-			continue;	// next pmove
-		fprintf(pOutput, ",");
-		print(pmove.operands[1], symbols, pOutput);
+		std::vector<char> long_text(length + 1);
+		hop56::format(inst, &lookups, long_text.data(), long_text.size());
+		fputs(long_text.data(), pOutput);
 	}
 	return 0;
 }
-
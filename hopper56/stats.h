@@ -0,0 +1,66 @@
+// Timings and counters for each stage of a run, printed with --stats.
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Phases and counters are identified by name, which must be string literals.
+// Phases or counters used more than once (e.g. for each file in a disk image)
+// are added together.
+class run_stats
+{
+public:
+	run_stats();
+
+	// Start timing a phase, ending the current one
+	void start_phase(const char* name);
+	void end_phase();
+
+	void add_count(const char* name, uint64_t count);
+
+	// Print everything recorded, in the order first seen
+	void print(FILE* pOutput) const;
+
+private:
+	struct phase
+	{
+		const char*	name;
+		double		seconds;
+		long		peak_rss_kb;		// peak resident set size at the end of the phase
+	};
+	struct counter
+	{
+		const char*	name;
+		uint64_t	count;
+	};
+
+	std::vector<phase>		m_phases;
+	std::vector<counter>	m_counts;
+	int						m_current;		// index of the running phase, or -1
+	double					m_start;
+};
+
+// ----------------------------------------------------------------------------
+// Helpers which do nothing when stats are disabled (pStats is NULL)
+inline void stats_start_phase(run_stats* pStats, const char* name)
+{
+	if (pStats)
+		pStats->start_phase(name);
+}
+
+inline void stats_end_phase(run_stats* pStats)
+{
+	if (pStats)
+		pStats->end_phase();
+}
+
+inline void stats_add_count(run_stats* pStats, const char* name, uint64_t count)
+{
+	if (pStats)
+		pStats->add_count(name, count);
+}
+
+#endif
@@ -0,0 +1,145 @@
+/* Test of the C interface in lib/libhop56.h.
+ *
+ * Written in C, so it also checks the header compiles as C. On glibc the
+ * allocator functions are replaced with counting versions, to check that
+ * decoding and formatting never allocate.
+ *
+ * Returns 0 if all checks pass.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/libhop56.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); ++g_failures; } } while (0)
+
+/* ------------------------------------------------------------------------- */
+/* Allocation counting */
+#ifdef __GLIBC__
+#define COUNT_ALLOCATIONS 1
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static volatile long g_allocations = 0;
+
+void* malloc(size_t size)					{ ++g_allocations; return __libc_malloc(size); }
+void* calloc(size_t count, size_t size)		{ ++g_allocations; return __libc_calloc(count, size); }
+void* realloc(void* ptr, size_t size)		{ ++g_allocations; return __libc_realloc(ptr, size); }
+#endif
+
+/* ------------------------------------------------------------------------- */
+static const uint8_t g_code[] =
+{
+	0x00, 0x00, 0x00,					/* nop */
+	0x0a, 0xf0, 0x80, 0x00, 0x12, 0x34,	/* jmp $1234 */
+	0x00, 0x00, 0x01,					/* (invalid) */
+	0xff, 0xff, 0xff,					/* macr with parallel moves */
+	0x00, 0x00, 0x0c					/* rts */
+};
+
+static const char* g_expected[] =
+{
+	"nop",
+	"jmp\t$1234",
+	"DC\t$000001",
+	"macr\t-y1,x1,b\tx:(r7)+,b\ty:(r3)+,b",
+	"rts"
+};
+
+#define NUM_EXPECTED	(sizeof(g_expected) / sizeof(g_expected[0]))
+
+/* ------------------------------------------------------------------------- */
+struct range_state
+{
+	unsigned	count;
+	unsigned	stop_after;
+	char		text[64];
+};
+
+static int range_callback(const hop56_inst* inst, void* user_data)
+{
+	struct range_state* state = (struct range_state*)user_data;
+	hop56_format(inst, NULL, state->text, sizeof(state->text));
+	if (state->count < NUM_EXPECTED && strcmp(state->text, g_expected[state->count]) != 0)
+	{
+		fprintf(stderr, "FAIL: instruction %u is '%s', expected '%s'\n",
+			state->count, state->text, g_expected[state->count]);
+		++g_failures;
+	}
+	++state->count;
+	return state->count == state->stop_after;
+}
+
+/* ------------------------------------------------------------------------- */
+static const char* find_label(void* user_data, int memory, uint32_t address)
+{
+	(void)user_data;
+	return (memory == HOP56_MEM_P && address == 0x1234) ? "main_loop" : NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+int main(void)
+{
+	hop56_inst inst;
+	char text[64];
+	struct range_state state;
+	hop56_symbols symbols = { find_label, NULL };
+	uint32_t size;
+
+	CHECK(hop56_get_api_version() == HOP56_API_VERSION);
+
+#ifdef COUNT_ALLOCATIONS
+	g_allocations = 0;
+#endif
+
+	/* Single decode and the public fields */
+	CHECK(hop56_decode(g_code + 3, 6, 0x100, &inst) == 0);
+	CHECK(inst.address == 0x100);
+	CHECK(inst.header == 0x0af080);
+	CHECK(inst.word_count == 2);
+	CHECK(inst.valid == 1);
+	CHECK(strcmp(inst.opcode, "jmp") == 0);
+
+	/* Labels */
+	CHECK(hop56_format(&inst, &symbols, text, sizeof(text)) == strlen("jmp\tmain_loop"));
+	CHECK(strcmp(text, "jmp\tmain_loop") == 0);
+
+	/* Truncation returns the full length, and still terminates */
+	CHECK(hop56_format(&inst, NULL, text, 4) == strlen("jmp\t$1234"));
+	CHECK(strcmp(text, "jmp") == 0);
+
+	/* Invalid data, and a truncated instruction */
+	CHECK(hop56_decode(g_code + 9, 3, 0, &inst) == 0);
+	CHECK(inst.valid == 0);
+	CHECK(inst.word_count == 1);
+	CHECK(strcmp(inst.opcode, "DC") == 0);
+	CHECK(hop56_decode(g_code + 3, 3, 0, &inst) == 0);
+	CHECK(inst.valid == 0);
+
+	/* Not enough data */
+	CHECK(hop56_decode(g_code, 2, 0, &inst) == 1);
+
+	/* Ranges, including stopping early */
+	memset(&state, 0, sizeof(state));
+	size = hop56_decode_range(g_code, sizeof(g_code), 0, range_callback, &state);
+	CHECK(size == sizeof(g_code) / 3);
+	CHECK(state.count == NUM_EXPECTED);
+
+	memset(&state, 0, sizeof(state));
+	state.stop_after = 2;
+	size = hop56_decode_range(g_code, sizeof(g_code), 0, range_callback, &state);
+	CHECK(size == 3);
+	CHECK(state.count == 2);
+
+#ifdef COUNT_ALLOCATIONS
+	CHECK(g_allocations == 0);
+	printf("libhop56_test: %ld allocations\n", (long)g_allocations);
+#endif
+	printf("libhop56_test: %d failures\n", g_failures);
+	return g_failures ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+#!/usr/bin/env sh
+# Build and run the test of the C library interface, against the static
+# library from ../build.sh.
+set -e
+CC=${CC:-gcc}
+CXX=${CXX:-g++}
+CFLAGS="-std=c99 -g -Wextra -Wall ${EXTRA_CFLAGS}"
+
+${CC} ${CFLAGS} -c -o libhop56_test.o libhop56_test.c
+${CXX} -o libhop56_test libhop56_test.o ../libhop56.a -pthread
+./libhop56_test
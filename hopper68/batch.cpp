@@ -0,0 +1,406 @@
+// Disassembly of many files in one process, using a pool of threads.
+#include "batch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <set>
+#include <thread>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "process.h"
+#include "duplicates.h"
+#include "mapfile.h"
+#include "query.h"
+
+// Size of each worker's output buffer
+static const size_t BATCH_OUTPUT_BUFFER_SIZE = 1024 * 1024;
+
+// Extension added to the input filename to make the output filename
+static const char* BATCH_OUTPUT_EXTENSION = ".s";
+
+// ----------------------------------------------------------------------------
+//	INPUT COLLECTION
+#ifndef _WIN32
+// ----------------------------------------------------------------------------
+static bool is_directory(const char* path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// ----------------------------------------------------------------------------
+// True for a listing written by an earlier run, which must not become an input
+static bool is_output_filename(const std::string& name)
+{
+	const size_t ext_len = strlen(BATCH_OUTPUT_EXTENSION);
+	return name.size() > ext_len && name.compare(name.size() - ext_len, ext_len, BATCH_OUTPUT_EXTENSION) == 0;
+}
+
+// ----------------------------------------------------------------------------
+// Recursively add matching files in a directory
+static int scan_directory(const std::string& dir, bool binary, std::vector<std::string>& inputs)
+{
+	DIR* pDir = opendir(dir.c_str());
+	if (!pDir)
+	{
+		fprintf(stderr, "Error: Can't read directory: %s\n", dir.c_str());
+		return 1;
+	}
+
+	int ret = 0;
+	while (struct dirent* pEntry = readdir(pDir))
+	{
+		std::string name = pEntry->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		std::string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			ret |= scan_directory(path, binary, inputs);
+		else if (S_ISREG(st.st_mode) && !is_output_filename(name) &&
+				(binary || is_tos_filename(name) || is_disk_filename(name)))
+			inputs.push_back(path);
+	}
+	closedir(pDir);
+	return ret;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Read a text file of filenames, one per line. Empty lines and lines
+// starting with '#' are ignored.
+static int read_list_file(const char* path, std::vector<std::string>& inputs)
+{
+	FILE* pFile = fopen(path, "r");
+	if (!pFile)
+	{
+		fprintf(stderr, "Error: Can't open file list: %s\n", path);
+		return 1;
+	}
+
+	std::string line;
+	int c;
+	do
+	{
+		c = fgetc(pFile);
+		if (c != EOF && c != '\n')
+		{
+			line += (char)c;
+			continue;
+		}
+
+		// Trim whitespace (including '\r') from both ends
+		size_t start = line.find_first_not_of(" \t\r");
+		size_t end = line.find_last_not_of(" \t\r");
+		if (start != std::string::npos && line[start] != '#')
+			inputs.push_back(line.substr(start, end - start + 1));
+		line.clear();
+	} while (c != EOF);
+
+	fclose(pFile);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int collect_batch_inputs(const char* path, bool binary, std::vector<std::string>& inputs)
+{
+#ifndef _WIN32
+	if (is_directory(path))
+	{
+		std::vector<std::string> found;
+		int ret = scan_directory(path, binary, found);
+		// Sort so that runs are repeatable regardless of directory order
+		std::sort(found.begin(), found.end());
+		inputs.insert(inputs.end(), found.begin(), found.end());
+		return ret;
+	}
+#else
+	(void)binary;
+#endif
+	return read_list_file(path, inputs);
+}
+
+// ----------------------------------------------------------------------------
+//	BATCH PROCESSING
+// ----------------------------------------------------------------------------
+// Create unique output filenames for all the inputs.
+static void make_output_names(const std::vector<std::string>& inputs, const std::string& output_dir,
+	std::vector<std::string>& outputs)
+{
+	std::set<std::string> used;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		std::string name = inputs[i];
+		if (!output_dir.empty())
+		{
+			size_t slash = name.find_last_of("/\\");
+			if (slash != std::string::npos)
+				name = name.substr(slash + 1);
+			name = output_dir + "/" + name;
+		}
+
+		// Different directories might contain inputs with the same name
+		std::string output = name + BATCH_OUTPUT_EXTENSION;
+		for (int suffix = 1; used.count(output); ++suffix)
+			output = name + "_" + std::to_string(suffix) + BATCH_OUTPUT_EXTENSION;
+		used.insert(output);
+		outputs.push_back(output);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Disassemble one file. Returns 0 for success, 1 for failure.
+static int process_batch_file(const std::string& input, const std::string& output,
+	const batch_settings& bsettings, const hop68::decode_settings& dsettings,
+	const output_settings& osettings, std::vector<char>& out_buffer)
+{
+	mapped_file infile;
+	if (infile.open(input.c_str()))
+	{
+		fprintf(stderr, "Error: %s: can't read file\n", input.c_str());
+		return 1;
+	}
+
+	FILE* pOutput = fopen(output.c_str(), "w");
+	if (!pOutput)
+	{
+		fprintf(stderr, "Error: %s: can't create output file %s\n", input.c_str(), output.c_str());
+		return 1;
+	}
+	setvbuf(pOutput, out_buffer.data(), _IOFBF, out_buffer.size());
+
+	int ret;
+	try
+	{
+		if (!bsettings.binary && is_disk_filename(input))
+			ret = process_disk_image(infile.get_data(), infile.get_size(), dsettings, osettings, pOutput);
+		else if (bsettings.binary)
+			ret = process_bin_file(infile.get_data(), infile.get_size(), dsettings, osettings, pOutput);
+		else
+			ret = process_tos_file(infile.get_data(), infile.get_size(), dsettings, osettings, pOutput);
+	}
+	catch (...)
+	{
+		// Reported by run_batch_jobs
+		fclose(pOutput);
+		throw;
+	}
+
+	if (fclose(pOutput) != 0 && ret == 0)
+	{
+		fprintf(stderr, "Error: %s: failed writing %s\n", input.c_str(), output.c_str());
+		return 1;
+	}
+	if (ret)
+		fprintf(stderr, "Error: %s: failed to disassemble\n", input.c_str());
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+// Run "job" for every input index on a pool of threads. Workers take the next
+// index from a shared counter until all are done. "job" returns 0 for
+// success, 1 for failure. An exception (e.g. running out of memory on a
+// damaged file) fails only that input.
+// Returns the number of failures.
+template<typename JOB>
+static size_t run_batch_jobs(const std::vector<std::string>& inputs, unsigned int num_threads, const JOB& job)
+{
+	const size_t input_count = inputs.size();
+	if (num_threads == 0)
+		num_threads = std::max(1U, std::thread::hardware_concurrency());
+	num_threads = (unsigned int)std::min<size_t>(num_threads, std::max<size_t>(1, input_count));
+
+	std::atomic<size_t> next_input(0);
+	std::atomic<size_t> num_failed(0);
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < num_threads; ++t)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			std::vector<char> out_buffer(BATCH_OUTPUT_BUFFER_SIZE);
+			size_t index;
+			while ((index = next_input++) < input_count)
+			{
+				int ret;
+				try
+				{
+					ret = job(index, out_buffer);
+				}
+				catch (const std::exception& e)
+				{
+					fprintf(stderr, "Error: %s: %s\n", inputs[index].c_str(), e.what());
+					ret = 1;
+				}
+				if (ret)
+					++num_failed;
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+	return num_failed.load();
+}
+
+// ----------------------------------------------------------------------------
+size_t process_batch(const std::vector<std::string>& inputs, const batch_settings& bsettings,
+	const hop68::decode_settings& dsettings, const output_settings& osettings)
+{
+#ifndef _WIN32
+	// Otherwise every file would fail in turn
+	if (!bsettings.output_dir.empty() && !is_directory(bsettings.output_dir.c_str()))
+	{
+		fprintf(stderr, "Error: Output directory not found: %s\n", bsettings.output_dir.c_str());
+		return 1;
+	}
+#endif
+	std::vector<std::string> outputs;
+	make_output_names(inputs, bsettings.output_dir, outputs);
+
+	size_t num_failed = run_batch_jobs(inputs, bsettings.num_threads,
+		[&](size_t index, std::vector<char>& out_buffer)
+		{
+			return process_batch_file(inputs[index], outputs[index], bsettings,
+				dsettings, osettings, out_buffer);
+		});
+
+	fprintf(stderr, "Batch: %u files, %u failed\n",
+		(unsigned int)inputs.size(), (unsigned int)num_failed);
+	return num_failed;
+}
+
+// ----------------------------------------------------------------------------
+// Search one file, writing the matches to "result". Returns 0 for success, 1 for failure.
+static int query_batch_file(const std::string& input, const batch_settings& bsettings,
+	const instruction_query& query, const hop68::decode_settings& dsettings,
+	const output_settings& osettings, std::string& result, size_t& match_count)
+{
+	if (!bsettings.binary && is_disk_filename(input))
+	{
+		fprintf(stderr, "Error: %s: disk images can't be searched\n", input.c_str());
+		return 1;
+	}
+
+	mapped_file infile;
+	if (infile.open(input.c_str()))
+	{
+		fprintf(stderr, "Error: %s: can't read file\n", input.c_str());
+		return 1;
+	}
+
+	// Write to a temporary file, so outputs can be printed in input order
+	FILE* pOutput = tmpfile();
+	if (!pOutput)
+	{
+		fprintf(stderr, "Error: %s: can't create temporary file\n", input.c_str());
+		return 1;
+	}
+	int ret = query_file(infile.get_data(), infile.get_size(), bsettings.binary ? PROGRAM_BIN : PROGRAM_TOS,
+		query, dsettings, osettings, input.c_str(), match_count, pOutput);
+	long length = ftell(pOutput);
+	result.resize(length > 0 ? length : 0);
+	rewind(pOutput);
+	if (length > 0 && fread(&result[0], 1, length, pOutput) != (size_t)length)
+		ret = 1;
+	fclose(pOutput);
+
+	if (ret)
+		fprintf(stderr, "Error: %s: failed to disassemble\n", input.c_str());
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+size_t process_batch_query(const std::vector<std::string>& inputs, const batch_settings& bsettings,
+	const instruction_query& query, const hop68::decode_settings& dsettings,
+	const output_settings& osettings, FILE* pOutput)
+{
+	std::vector<std::string> results(inputs.size());
+	std::vector<size_t> match_counts(inputs.size(), 0);
+	size_t num_failed = run_batch_jobs(inputs, bsettings.num_threads,
+		[&](size_t index, std::vector<char>&)
+		{
+			return query_batch_file(inputs[index], bsettings, query, dsettings, osettings,
+				results[index], match_counts[index]);
+		});
+
+	size_t total_matches = 0;
+	size_t matched_files = 0;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		fwrite(results[i].data(), 1, results[i].size(), pOutput);
+		total_matches += match_counts[i];
+		matched_files += (match_counts[i] != 0);
+	}
+
+	fprintf(stderr, "Batch: %u files, %u failed, %u matches in %u files\n",
+		(unsigned int)inputs.size(), (unsigned int)num_failed,
+		(unsigned int)total_matches, (unsigned int)matched_files);
+	return num_failed;
+}
+
+// ----------------------------------------------------------------------------
+// Summarise the routines of one file. Returns 0 for success, 1 for failure.
+static int summarise_batch_file(const std::string& input, uint32_t file_index, const batch_settings& bsettings,
+	bool abstract_registers, const hop68::decode_settings& dsettings, const output_settings& osettings,
+	std::vector<routine_summary>& routines)
+{
+	if (!bsettings.binary && is_disk_filename(input))
+	{
+		fprintf(stderr, "Error: %s: disk images can't be searched\n", input.c_str());
+		return 1;
+	}
+
+	mapped_file infile;
+	if (infile.open(input.c_str()))
+	{
+		fprintf(stderr, "Error: %s: can't read file\n", input.c_str());
+		return 1;
+	}
+
+	loaded_program program;
+	int ret = bsettings.binary ?
+		load_bin_program(infile.get_data(), infile.get_size(), dsettings, osettings, program) :
+		load_tos_program(infile.get_data(), infile.get_size(), dsettings, osettings, program, NULL);
+	if (ret)
+	{
+		fprintf(stderr, "Error: %s: failed to disassemble\n", input.c_str());
+		return ret;
+	}
+	summarise_routines(program, file_index, abstract_registers, routines);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+size_t process_batch_duplicates(const std::vector<std::string>& inputs, const batch_settings& bsettings,
+	bool abstract_registers, const hop68::decode_settings& dsettings, const output_settings& osettings,
+	FILE* pOutput)
+{
+	// Only the summaries are kept, not the programs
+	std::vector<std::vector<routine_summary> > file_routines(inputs.size());
+	size_t num_failed = run_batch_jobs(inputs, bsettings.num_threads,
+		[&](size_t index, std::vector<char>&)
+		{
+			return summarise_batch_file(inputs[index], (uint32_t)index, bsettings, abstract_registers,
+				dsettings, osettings, file_routines[index]);
+		});
+
+	std::vector<routine_summary> routines;
+	for (size_t i = 0; i < file_routines.size(); ++i)
+	{
+		routines.insert(routines.end(), file_routines[i].begin(), file_routines[i].end());
+		std::vector<routine_summary>().swap(file_routines[i]);
+	}
+	print_duplicates(routines, inputs, pOutput);
+
+	fprintf(stderr, "Batch: %u files, %u failed\n", (unsigned int)inputs.size(), (unsigned int)num_failed);
+	return num_failed;
+}
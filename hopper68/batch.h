@@ -0,0 +1,51 @@
+// Disassembly of many files in one process, using a pool of threads.
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "lib/decode68.h"
+
+struct output_settings;
+class instruction_query;
+
+// ----------------------------------------------------------------------------
+// User options for batch runs.
+struct batch_settings
+{
+	unsigned int num_threads;	// number of worker threads, 0 for one per CPU core
+	std::string output_dir;		// directory for outputs. If empty, write next to each input
+	bool binary;				// inputs are binary files rather than TOS executables
+};
+
+// Collect the list of input files. If "path" is a directory, this finds every
+// executable below it (or every file, for binary inputs). Otherwise "path" is a
+// text file listing one input filename per line.
+// Returns 0 for success, 1 for failure.
+extern int collect_batch_inputs(const char* path, bool binary, std::vector<std::string>& inputs);
+
+// Disassemble each input to its own ".s" output file, reporting any failures
+// to stderr as they happen. If the output directory doesn't exist, nothing is
+// processed.
+// Returns the number of files which failed (or 1 if nothing was processed).
+extern size_t process_batch(const std::vector<std::string>& inputs, const batch_settings& bsettings,
+	const hop68::decode_settings& dsettings, const output_settings& osettings);
+
+// Search each input for a query, printing all the matches to pOutput in input
+// order, each line starting with the input's filename.
+// Returns the number of files which failed.
+extern size_t process_batch_query(const std::vector<std::string>& inputs, const batch_settings& bsettings,
+	const instruction_query& query, const hop68::decode_settings& dsettings,
+	const output_settings& osettings, FILE* pOutput);
+
+// Find duplicated routines within and across all the inputs, and print the
+// clusters to pOutput (see duplicates.h).
+// Returns the number of files which failed.
+extern size_t process_batch_duplicates(const std::vector<std::string>& inputs, const batch_settings& bsettings,
+	bool abstract_registers, const hop68::decode_settings& dsettings, const output_settings& osettings,
+	FILE* pOutput);
+
+#endif
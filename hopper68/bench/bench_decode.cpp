@@ -0,0 +1,259 @@
+// Microbenchmark for hop68::decode.
+//
+// Times decoding of every possible 16-bit header word, followed by several
+// representative patterns of extension words, for each CPU type. Timings are
+// also broken down by the top nibble of the header (i.e. by matcher table).
+// Any executables given on the command line are decoded linearly as a
+// realistic mix, e.g. the files assembled by test/run_tests.sh:
+//	bench_decode ../test/tst68000.prg ../test/tst68020.prg ../test/tst68030.prg
+//
+// Usage: bench_decode [--reps <n>] [file.prg|file.bin ...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "../lib/buffer68.h"
+#include "../lib/decode68.h"
+#include "../lib/instruction68.h"
+
+// Each test instruction is a header word plus this many extension words,
+// enough for the longest 68020+ instruction
+static const int NUM_EXTENSION_WORDS = 10;
+static const uint32_t INST_BUFFER_SIZE = 2 + NUM_EXTENSION_WORDS * 2;
+
+static const int NUM_CPUS = 4;
+static const int NUM_TABLES = 16;
+static const uint32_t HEADERS_PER_TABLE = 0x10000 / NUM_TABLES;
+
+// Minimum run time for each file in the instruction mix tests
+static const double MIN_FILE_SECONDS = 0.2;
+
+// ----------------------------------------------------------------------------
+struct extension_pattern
+{
+	const char*	name;
+	uint16_t	words[NUM_EXTENSION_WORDS];
+};
+
+static const extension_pattern g_patterns[] =
+{
+	// Zero immediates/displacements, brief extension word for d0.w
+	{ "zero",   { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 } },
+	// Small positive displacements
+	{ "disp",   { 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010 } },
+	// Brief extension word: 4(an,d7.l)
+	{ "index",  { 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804 } },
+	// 68020 full extension word, long base displacement, memory indirect
+	{ "full",   { 0x0131, 0x0000, 0x1000, 0x0131, 0x0000, 0x1000, 0x0131, 0x0000, 0x1000, 0x0000 } },
+	// All bits set
+	{ "ones",   { 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff } },
+};
+static const int NUM_PATTERNS = sizeof(g_patterns) / sizeof(g_patterns[0]);
+
+static const char* g_cpu_names[NUM_CPUS] = { "68000", "68010", "68020", "68030" };
+
+// Stops the compiler discarding decode results
+static volatile uint32_t g_sink;
+
+// ----------------------------------------------------------------------------
+static double get_seconds()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ----------------------------------------------------------------------------
+// Build the instruction buffers for all headers using one extension pattern
+static void fill_buffers(const extension_pattern& pattern, std::vector<uint8_t>& buffers)
+{
+	buffers.resize(0x10000 * INST_BUFFER_SIZE);
+	for (uint32_t header = 0; header < 0x10000; ++header)
+	{
+		uint8_t* pInst = &buffers[header * INST_BUFFER_SIZE];
+		pInst[0] = (uint8_t)(header >> 8);
+		pInst[1] = (uint8_t)header;
+		for (int i = 0; i < NUM_EXTENSION_WORDS; ++i)
+		{
+			pInst[2 + i * 2] = (uint8_t)(pattern.words[i] >> 8);
+			pInst[3 + i * 2] = (uint8_t)pattern.words[i];
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Decode all the headers in one matcher table. Returns the best time of all
+// repetitions, in seconds, and the number of valid instructions.
+static double time_table(const std::vector<uint8_t>& buffers, int table,
+	const hop68::decode_settings& dsettings, int reps, uint32_t& valid_count)
+{
+	double best = 1e30;
+	hop68::instruction inst;
+	for (int rep = 0; rep < reps; ++rep)
+	{
+		uint32_t valid = 0;
+		uint32_t sum = 0;
+		double start = get_seconds();
+		for (uint32_t i = 0; i < HEADERS_PER_TABLE; ++i)
+		{
+			uint32_t header = table * HEADERS_PER_TABLE + i;
+			hop68::buffer_reader buf(&buffers[header * INST_BUFFER_SIZE], INST_BUFFER_SIZE, 0);
+			hop68::decode(inst, buf, dsettings);
+			sum += inst.byte_count;
+			valid += (inst.opcode != hop68::Opcode::NONE);
+		}
+		double elapsed = get_seconds() - start;
+		g_sink += sum;
+		if (elapsed < best)
+			best = elapsed;
+		valid_count = valid;
+	}
+	return best;
+}
+
+// ----------------------------------------------------------------------------
+static void bench_opcode_space(int reps)
+{
+	// Per-table costs summed over all patterns, in seconds
+	double table_times[NUM_CPUS][NUM_TABLES] = {};
+	std::vector<uint8_t> buffers;
+
+	printf("Opcode space: 65536 headers, best of %d runs\n\n", reps);
+	printf("%-6s %-7s %10s %12s %8s\n", "CPU", "pattern", "ns/inst", "inst/sec", "valid");
+	for (int p = 0; p < NUM_PATTERNS; ++p)
+	{
+		fill_buffers(g_patterns[p], buffers);
+		for (int cpu = 0; cpu < NUM_CPUS; ++cpu)
+		{
+			hop68::decode_settings dsettings = {};
+			dsettings.cpu_type = hop68::CPU_TYPE_68000 + cpu;
+
+			double total = 0.0;
+			uint32_t total_valid = 0;
+			for (int table = 0; table < NUM_TABLES; ++table)
+			{
+				uint32_t valid = 0;
+				double t = time_table(buffers, table, dsettings, reps, valid);
+				table_times[cpu][table] += t;
+				total += t;
+				total_valid += valid;
+			}
+			printf("%-6s %-7s %10.2f %12.0f %8u\n", g_cpu_names[cpu], g_patterns[p].name,
+				total * 1e9 / 0x10000, 0x10000 / total, total_valid);
+		}
+	}
+
+	printf("\nPer-table cost (ns/inst, mean over patterns), by top nibble of header\n\n");
+	printf("%-6s", "CPU");
+	for (int table = 0; table < NUM_TABLES; ++table)
+		printf(" %6x", table);
+	printf("\n");
+	for (int cpu = 0; cpu < NUM_CPUS; ++cpu)
+	{
+		printf("%-6s", g_cpu_names[cpu]);
+		for (int table = 0; table < NUM_TABLES; ++table)
+			printf(" %6.1f", table_times[cpu][table] * 1e9 / (HEADERS_PER_TABLE * NUM_PATTERNS));
+		printf("\n");
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Read a whole file. For TOS executables, only the text section is kept.
+static int read_code(const char* filename, std::vector<uint8_t>& code)
+{
+	FILE* pFile = fopen(filename, "rb");
+	if (!pFile)
+		return 1;
+	code.clear();
+	uint8_t block[4096];
+	size_t count;
+	while ((count = fread(block, 1, sizeof(block), pFile)) != 0)
+		code.insert(code.end(), block, block + count);
+	fclose(pFile);
+
+	// TOS header: branch word $601a, then the text length
+	if (code.size() >= 28 && code[0] == 0x60 && code[1] == 0x1a)
+	{
+		uint32_t tlen = (code[2] << 24) | (code[3] << 16) | (code[4] << 8) | code[5];
+		if (tlen <= code.size() - 28)
+		{
+			code.erase(code.begin(), code.begin() + 28);
+			code.resize(tlen);
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int bench_file(const char* filename)
+{
+	std::vector<uint8_t> code;
+	if (read_code(filename, code))
+	{
+		fprintf(stderr, "Error: Can't read file: %s\n", filename);
+		return 1;
+	}
+
+	for (int cpu = 0; cpu < NUM_CPUS; ++cpu)
+	{
+		hop68::decode_settings dsettings = {};
+		dsettings.cpu_type = hop68::CPU_TYPE_68000 + cpu;
+
+		// Repeat linear passes through the code until enough time has passed
+		uint64_t num_insts = 0;
+		uint32_t num_valid = 0;
+		uint32_t sum = 0;
+		hop68::instruction inst;
+		double start = get_seconds();
+		double elapsed = 0.0;
+		do
+		{
+			hop68::buffer_reader buf(code.data(), (uint32_t)code.size(), 0);
+			num_valid = 0;
+			while (buf.get_remain() >= 2)
+			{
+				hop68::buffer_reader buf_copy(buf);
+				hop68::decode(inst, buf_copy, dsettings);
+				buf.advance(inst.byte_count);
+				sum += inst.byte_count;
+				num_valid += (inst.opcode != hop68::Opcode::NONE);
+				++num_insts;
+			}
+			elapsed = get_seconds() - start;
+		} while (elapsed < MIN_FILE_SECONDS && !code.empty());
+		g_sink += sum;
+
+		if (num_insts == 0)
+			break;
+		printf("%-6s %10.2f %12.0f %8u  %s\n", g_cpu_names[cpu], elapsed * 1e9 / num_insts,
+			num_insts / elapsed, num_valid, filename);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	int reps = 5;
+	int arg = 1;
+	if (arg + 1 < argc && strcmp(argv[arg], "--reps") == 0)
+	{
+		reps = atoi(argv[arg + 1]);
+		if (reps < 1)
+			reps = 1;
+		arg += 2;
+	}
+
+	bench_opcode_space(reps);
+
+	if (arg < argc)
+	{
+		printf("\nInstruction mixes (linear decode of text section)\n\n");
+		printf("%-6s %10s %12s %8s  %s\n", "CPU", "ns/inst", "inst/sec", "valid", "file");
+	}
+	int ret = 0;
+	for (; arg < argc; ++arg)
+		ret |= bench_file(argv[arg]);
+	return ret;
+}
@@ -0,0 +1,16 @@
+#!/usr/bin/env sh
+# Builds the decoder benchmark. Unlike the main build this is optimised,
+# and has asserts disabled, so that timings match release use.
+set -e
+set -x
+# Extra compiler flags can be set in EXTRA_CFLAGS e.g. -DHOPPER68_PROFILE
+CC=g++
+LD=g++
+CFLAGS="-DNDEBUG -std=c++11 -g -Wextra -Wall -O2 -pthread ${EXTRA_CFLAGS}"
+LDFLAGS="-lc -pthread"
+
+${CC} ${CFLAGS} -c -o decode68.o      ../lib/decode68.cpp
+${CC} ${CFLAGS} -c -o instruction68.o ../lib/instruction68.cpp
+${CC} ${CFLAGS} -c -o bench_decode.o  bench_decode.cpp
+
+${LD} ${LDFLAGS} bench_decode.o decode68.o instruction68.o -o bench_decode
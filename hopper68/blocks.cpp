@@ -0,0 +1,94 @@
+#include "blocks.h"
+
+#include <algorithm>
+
+#include "lib/flow68.h"
+#include "process.h"
+#include "symbols.h"
+
+// ----------------------------------------------------------------------------
+// Find the index of the line starting exactly at "address", if any.
+static bool find_line(const disassembly& disasm, uint32_t address, size_t& index)
+{
+	struct compare
+	{
+		bool operator()(const disassembly::line& line, uint32_t addr) const { return line.address < addr; }
+	};
+	std::vector<disassembly::line>::const_iterator it =
+		std::lower_bound(disasm.lines.begin(), disasm.lines.end(), address, compare());
+	if (it == disasm.lines.end() || it->address != address)
+		return false;
+	index = it - disasm.lines.begin();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool basic_blocks::find(uint32_t address, size_t& block_index) const
+{
+	struct compare
+	{
+		bool operator()(uint32_t addr, const basic_block& block) const { return addr < block.address; }
+	};
+	std::vector<basic_block>::const_iterator it =
+		std::upper_bound(blocks.begin(), blocks.end(), address, compare());
+	if (it == blocks.begin())
+		return false;
+	--it;
+	if (address >= it->end_address)
+		return false;
+	block_index = it - blocks.begin();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void find_basic_blocks(const disassembly& disasm, const symbols& symbols, basic_blocks& result)
+{
+	const size_t count = disasm.lines.size();
+	result.blocks.clear();
+	result.line_block.assign(count, 0);
+	if (count == 0)
+		return;
+
+	// Mark the lines which start a block
+	std::vector<bool> leader(count, false);
+	leader[0] = true;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const disassembly::line& line = disasm.lines[i];
+		if (hop68::calc_flow(line.inst) == hop68::FLOW_NONE)
+			continue;
+		if (i + 1 < count)
+			leader[i + 1] = true;
+
+		uint32_t target;
+		size_t target_line;
+		if (hop68::calc_flow_target(line.inst, line.address, target) && find_line(disasm, target, target_line))
+			leader[target_line] = true;
+	}
+
+	symbols::sym_map::const_iterator sym_it = symbols.table.lower_bound(disasm.lines.front().address);
+	for (; sym_it != symbols.table.end(); ++sym_it)
+	{
+		size_t sym_line;
+		if (find_line(disasm, sym_it->first, sym_line))
+			leader[sym_line] = true;
+	}
+
+	// Group lines between leaders
+	for (size_t i = 0; i < count; ++i)
+	{
+		const disassembly::line& line = disasm.lines[i];
+		if (leader[i])
+		{
+			basic_block block;
+			block.address = line.address;
+			block.first_line = i;
+			block.line_count = 0;
+			result.blocks.push_back(block);
+		}
+		basic_block& block = result.blocks.back();
+		block.end_address = line.address + line.inst.byte_count;
+		++block.line_count;
+		result.line_block[i] = (uint32_t)(result.blocks.size() - 1);
+	}
+}
@@ -0,0 +1,39 @@
+// Splitting decoded programs into basic blocks.
+#ifndef BLOCKS_H
+#define BLOCKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class disassembly;
+class symbols;
+
+// ----------------------------------------------------------------------------
+// A run of lines which is only entered at the first line, and only left
+// after the last one.
+struct basic_block
+{
+	uint32_t address;			// address of the first instruction
+	uint32_t end_address;		// address after the last instruction
+	size_t first_line;			// index into disassembly::lines
+	size_t line_count;
+};
+
+class basic_blocks
+{
+public:
+	std::vector<basic_block>	blocks;			// in address order
+	std::vector<uint32_t>		line_block;		// block index for each disassembly line
+
+	// Find the block containing "address". Returns false if it is outside the blocks.
+	bool find(uint32_t address, size_t& block_index) const;
+};
+
+// ----------------------------------------------------------------------------
+// Split decoded lines into blocks. A block starts at the first line, at any
+// symbol or fixed branch/call target, and after any instruction which
+// changes the flow of control.
+extern void find_basic_blocks(const disassembly& disasm, const symbols& symbols, basic_blocks& result);
+
+#endif
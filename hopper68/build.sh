@@ -1,23 +1,50 @@
 #!/usr/bin/env sh
 set -e
 set -x
+# Extra compiler flags can be set in EXTRA_CFLAGS e.g. -DHOPPER68_PROFILE
 SRC_PATH=.
 CC=g++
 LD=g++
-CFLAGS="-DDEBUG -std=c++11 -g  -Wextra -Wall -O0"
-LDFLAGS="-lc"
+CFLAGS="-DDEBUG -std=c++11 -g  -Wextra -Wall -O0 -pthread ${EXTRA_CFLAGS}"
+LDFLAGS="-lc -pthread"
 
 # Just build everything -- this project isn't big
 # lib code
 ${CC} ${CFLAGS} -c -o decode68.o      lib/decode68.cpp
+${CC} ${CFLAGS} -c -o format68.o      lib/format68.cpp
 ${CC} ${CFLAGS} -c -o instruction68.o lib/instruction68.cpp
 ${CC} ${CFLAGS} -c -o timing68.o      lib/timing68.cpp
+${CC} ${CFLAGS} -c -o xref68.o        lib/xref68.cpp
+${CC} ${CFLAGS} -c -o flow68.o        lib/flow68.cpp
+${CC} ${CFLAGS} -c -o regs68.o        lib/regs68.cpp
 
 # Application code
 ${CC} ${CFLAGS} -c -o symbols.o     symbols.cpp
+${CC} ${CFLAGS} -c -o batch.o       batch.cpp
+${CC} ${CFLAGS} -c -o blocks.o      blocks.cpp
+${CC} ${CFLAGS} -c -o database.o    database.cpp
+${CC} ${CFLAGS} -c -o coverage.o    coverage.cpp
+${CC} ${CFLAGS} -c -o diff.o        diff.cpp
+${CC} ${CFLAGS} -c -o disk.o        disk.cpp
+${CC} ${CFLAGS} -c -o liveness.o    liveness.cpp
+${CC} ${CFLAGS} -c -o duplicates.o  duplicates.cpp
 ${CC} ${CFLAGS} -c -o print.o       print.cpp
+${CC} ${CFLAGS} -c -o process.o     process.cpp
+${CC} ${CFLAGS} -c -o profile.o     profile.cpp
+${CC} ${CFLAGS} -c -o query.o       query.cpp
+${CC} ${CFLAGS} -c -o scan.o        scan.cpp
+${CC} ${CFLAGS} -c -o server.o      server.cpp
+${CC} ${CFLAGS} -c -o signatures.o  signatures.cpp
+${CC} ${CFLAGS} -c -o stats.o       stats.cpp
+${CC} ${CFLAGS} -c -o mapfile.o     mapfile.cpp
 ${CC} ${CFLAGS} -c -o main.o        main.cpp
 
-${LD} ${LDFLAGS} main.o print.o symbols.o instruction68.o timing68.o decode68.o -o hopper68
+${LD} ${LDFLAGS} main.o batch.o blocks.o coverage.o database.o diff.o disk.o duplicates.o liveness.o mapfile.o print.o process.o profile.o query.o scan.o server.o signatures.o stats.o symbols.o format68.o instruction68.o timing68.o decode68.o xref68.o flow68.o regs68.o -o hopper68
+
+# Embeddable decoder library with a C interface (see lib/libhop68.h)
+LIB_SRC="lib/libhop68.cpp lib/decode68.cpp lib/format68.cpp lib/instruction68.cpp lib/xref68.cpp"
+${CC} ${CFLAGS} -c -o libhop68.o      lib/libhop68.cpp
+ar rcs libhop68.a libhop68.o decode68.o format68.o instruction68.o xref68.o
+${CC} ${CFLAGS} -fPIC -fvisibility=hidden -shared -o libhop68.so ${LIB_SRC}
 
 
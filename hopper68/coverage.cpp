@@ -0,0 +1,221 @@
+// Code/data separation using execution coverage. See coverage.h.
+#include "coverage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lib/buffer68.h"
+#include "lib/flow68.h"
+#include "lib/instruction68.h"
+#include "mapfile.h"
+#include "process.h"
+
+// ----------------------------------------------------------------------------
+//	COVERAGE INPUT
+// ----------------------------------------------------------------------------
+// Parse an address as decimal, or hex with a "$" or "0x" prefix, moving "pText" past it
+static bool parse_range_address(const char*& pText, uint32_t& address)
+{
+	char* end = NULL;
+	if (*pText == '$')
+		address = (uint32_t)strtoul(pText + 1, &end, 16);
+	else
+		address = (uint32_t)strtoul(pText, &end, 0);
+	if (end == pText || (end == pText + 1 && *pText == '$'))
+		return false;
+	pText = end;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+static void skip_spaces(const char*& pText)
+{
+	while (*pText == ' ' || *pText == '\t')
+		++pText;
+}
+
+// ----------------------------------------------------------------------------
+// Parse one line of a ranges file. Returns false if it is malformed.
+// "empty" is set for blank and comment lines.
+static bool parse_range_line(const char* pText, uint32_t& first, uint32_t& last, bool& empty)
+{
+	skip_spaces(pText);
+	empty = (*pText == 0 || *pText == '\n' || *pText == '\r' || *pText == '#' || *pText == ';');
+	if (empty)
+		return true;
+
+	if (!parse_range_address(pText, first))
+		return false;
+	skip_spaces(pText);
+	if (*pText == '-')
+		++pText;
+	skip_spaces(pText);
+	if (!parse_range_address(pText, last))
+		return false;
+	skip_spaces(pText);
+	if (*pText != 0 && *pText != '\n' && *pText != '\r' && *pText != '#' && *pText != ';')
+		return false;
+	return last >= first;
+}
+
+// ----------------------------------------------------------------------------
+int read_coverage_ranges(const char* filename, uint32_t text_address, uint32_t text_size,
+	coverage_map& coverage)
+{
+	FILE* pFile = fopen(filename, "r");
+	if (!pFile)
+	{
+		fprintf(stderr, "Error: Can't read coverage file: %s\n", filename);
+		return 1;
+	}
+
+	coverage.assign(text_size, COVERAGE_NONE);
+	char line[256];
+	unsigned int line_num = 0;
+	int ret = 0;
+	while (fgets(line, sizeof(line), pFile))
+	{
+		++line_num;
+		uint32_t first, last;
+		bool empty;
+		if (!parse_range_line(line, first, last, empty))
+		{
+			fprintf(stderr, "Error: bad coverage range at %s line %u\n", filename, line_num);
+			ret = 1;
+			break;
+		}
+		if (empty || text_size == 0)
+			continue;
+
+		// Clip to the text section
+		uint32_t text_last = text_address + text_size - 1;
+		if (last < text_address || first > text_last)
+			continue;
+		uint32_t start = (first < text_address ? text_address : first) - text_address;
+		uint32_t end = (last > text_last ? text_last : last) - text_address;
+		for (uint32_t i = start; i <= end; ++i)
+			coverage[i] = COVERAGE_EXECUTED;
+	}
+	fclose(pFile);
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+int read_coverage_bitmap(const char* filename, uint32_t text_size, coverage_map& coverage)
+{
+	mapped_file bitmap;
+	if (bitmap.open(filename))
+	{
+		fprintf(stderr, "Error: Can't read coverage file: %s\n", filename);
+		return 1;
+	}
+
+	coverage.assign(text_size, COVERAGE_NONE);
+	const uint8_t* pBits = bitmap.get_data();
+	uint32_t bitmap_bytes = (uint32_t)bitmap.get_size();
+	for (uint32_t i = 0; i < text_size && i / 8 < bitmap_bytes; ++i)
+		if (pBits[i / 8] & (1 << (i & 7)))
+			coverage[i] = COVERAGE_EXECUTED;
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+//	DECODING
+// ----------------------------------------------------------------------------
+static void decode_at(const uint8_t* text, uint32_t text_size, uint32_t text_address, uint32_t offset,
+	const hop68::decode_settings& dsettings, hop68::instruction& inst)
+{
+	hop68::buffer_reader buf(text, text_size, text_address);
+	buf.set_pos(offset);
+	hop68::decode(inst, buf, dsettings);
+}
+
+// ----------------------------------------------------------------------------
+// Queue the offsets that execution can continue to after an instruction.
+static void add_successors(const hop68::instruction& inst, uint32_t offset, uint32_t text_address,
+	uint32_t text_size, std::vector<uint32_t>& work)
+{
+	hop68::FlowKind flow = hop68::calc_flow(inst);
+	if (flow == hop68::FLOW_NONE || flow == hop68::FLOW_BRANCH || flow == hop68::FLOW_CALL)
+		work.push_back(offset + inst.byte_count);
+
+	uint32_t target;
+	if (hop68::calc_flow_target(inst, text_address + offset, target) && target - text_address < text_size)
+		work.push_back(target - text_address);
+}
+
+// ----------------------------------------------------------------------------
+size_t follow_coverage_flow(const uint8_t* text, uint32_t text_address, const hop68::decode_settings& dsettings,
+	coverage_map& coverage)
+{
+	const uint32_t text_size = (uint32_t)coverage.size();
+	std::vector<uint32_t> work;
+
+	// Start from every executed instruction, walking them the same way as
+	// decode_coverage()
+	hop68::instruction inst;
+	uint32_t offset = 0;
+	while (offset < text_size)
+	{
+		if (coverage[offset] != COVERAGE_EXECUTED || (offset & 1))
+		{
+			++offset;
+			continue;
+		}
+		decode_at(text, text_size, text_address, offset, dsettings, inst);
+		add_successors(inst, offset, text_address, text_size, work);
+		offset += inst.byte_count;
+	}
+
+	size_t reached = 0;
+	while (!work.empty())
+	{
+		offset = work.back();
+		work.pop_back();
+		if (offset >= text_size || (offset & 1) || coverage[offset] != COVERAGE_NONE)
+			continue;
+
+		decode_at(text, text_size, text_address, offset, dsettings, inst);
+		if (inst.opcode == hop68::Opcode::NONE)
+			continue;
+
+		// Don't let a guess overlap code that is known to run
+		uint32_t end = offset + inst.byte_count;
+		if (end > text_size)
+			continue;
+		bool overlaps = false;
+		for (uint32_t i = offset; i < end; ++i)
+			overlaps |= (coverage[i] == COVERAGE_EXECUTED);
+		if (overlaps)
+			continue;
+
+		for (uint32_t i = offset; i < end; ++i)
+			coverage[i] = COVERAGE_REACHED;
+		++reached;
+		add_successors(inst, offset, text_address, text_size, work);
+	}
+	return reached;
+}
+
+// ----------------------------------------------------------------------------
+int decode_coverage(const uint8_t* text, uint32_t text_address, const hop68::decode_settings& dsettings,
+	const coverage_map& coverage, disassembly& disasm)
+{
+	const uint32_t text_size = (uint32_t)coverage.size();
+	uint32_t offset = 0;
+	while (offset + 2 <= text_size)
+	{
+		// Instructions are always at even addresses
+		if (coverage[offset] == COVERAGE_NONE || (offset & 1))
+		{
+			++offset;
+			continue;
+		}
+		disassembly::line line;
+		line.address = text_address + offset;
+		decode_at(text, text_size, text_address, offset, dsettings, line.inst);
+		disasm.lines.push_back(line);
+		offset += line.inst.byte_count;
+	}
+	return 0;
+}
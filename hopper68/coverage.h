@@ -0,0 +1,52 @@
+// Code/data separation using execution coverage from an emulator.
+//
+// Coverage is read either as a text file of executed address ranges, one
+// "first-last" or "first last" pair per line (inclusive, decimal or hex with a
+// "$" or "0x" prefix, '#' or ';' starts a comment), or as a bitmap with one
+// bit per byte of the text section, least significant bit first. Range
+// addresses must match the load address given with --base; the bitmap is
+// relative to the start of the text section.
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "lib/decode68.h"
+
+class disassembly;
+
+// ----------------------------------------------------------------------------
+// State of each byte of the text section
+enum coverage_type
+{
+	COVERAGE_NONE = 0,			// never executed, printed as data
+	COVERAGE_EXECUTED = 1,		// executed, according to the coverage input
+	COVERAGE_REACHED = 2		// not executed, but reached by following flow from executed code
+};
+
+typedef std::vector<uint8_t> coverage_map;		// coverage_type for each byte of text
+
+// ----------------------------------------------------------------------------
+// Read coverage for "text_size" bytes at "text_address".
+// Returns 0 for success, 1 for failure.
+extern int read_coverage_ranges(const char* filename, uint32_t text_address, uint32_t text_size,
+	coverage_map& coverage);
+
+extern int read_coverage_bitmap(const char* filename, uint32_t text_size, coverage_map& coverage);
+
+// Mark code which isn't covered, but which is reached by branches, calls or
+// falling through from covered code, as COVERAGE_REACHED.
+// "coverage" has an entry for each byte of "text".
+// Returns the number of instructions reached.
+extern size_t follow_coverage_flow(const uint8_t* text, uint32_t text_address, const hop68::decode_settings& dsettings,
+	coverage_map& coverage);
+
+// Decode only the covered (or reached) instructions in the text section.
+// Other bytes are skipped, to be printed as data.
+// Returns 0 for success, 1 for failure.
+extern int decode_coverage(const uint8_t* text, uint32_t text_address, const hop68::decode_settings& dsettings,
+	const coverage_map& coverage, disassembly& disasm);
+
+#endif
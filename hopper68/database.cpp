@@ -0,0 +1,249 @@
+// ----------------------------------------------------------------------------
+// Saved analysis databases. See database.h.
+#include "database.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "lib/decode68.h"
+#include "lib/xref68.h"
+#include "process.h"
+
+static const char DB_MAGIC[8] = { 'H', 'O', 'P', '6', '8', 'D', 'B', 0 };
+
+// Size of one record of each DbArray
+static const size_t g_record_sizes[DB_ARRAY_COUNT] =
+{
+	sizeof(uint8_t),			// DB_IMAGE
+	sizeof(uint32_t),			// DB_LINES
+	sizeof(db_symbol),			// DB_SYMBOLS
+	sizeof(db_reloc),			// DB_RELOCS
+	sizeof(db_line_number),		// DB_LINE_NUMBERS
+	sizeof(uint32_t),			// DB_FILENAMES
+	sizeof(uint32_t),			// DB_XREF_TARGETS
+	sizeof(uint32_t),			// DB_XREF_OFFSETS
+	sizeof(db_xref),			// DB_XREF_REFS
+	sizeof(char)				// DB_STRINGS
+};
+
+// ----------------------------------------------------------------------------
+//	READING
+// ----------------------------------------------------------------------------
+analysis_db::analysis_db() :
+	m_pData(NULL),
+	m_size(0),
+	m_pHeader(NULL)
+{
+}
+
+// ----------------------------------------------------------------------------
+int analysis_db::open(const uint8_t* data, size_t size)
+{
+	const db_header* pHeader = (const db_header*)data;
+	if (size < sizeof(db_header) || memcmp(pHeader->magic, DB_MAGIC, sizeof(DB_MAGIC)) != 0)
+	{
+		fprintf(stderr, "Error: Not an analysis database\n");
+		return 1;
+	}
+	if (pHeader->byte_order != DB_BYTE_ORDER)
+	{
+		fprintf(stderr, "Error: Analysis database was saved on a machine with a different byte order\n");
+		return 1;
+	}
+	if (pHeader->version != DB_VERSION)
+	{
+		fprintf(stderr, "Error: Analysis database version %u is not supported\n", pHeader->version);
+		return 1;
+	}
+	if (pHeader->cpu_type > hop68::CPU_TYPE_68030 || (pHeader->flags & ~(uint32_t)DB_FLAG_TEXT_HAS_DATA))
+	{
+		fprintf(stderr, "Error: Analysis database is damaged\n");
+		return 1;
+	}
+
+	for (int i = 0; i < DB_ARRAY_COUNT; ++i)
+	{
+		const db_array& array = pHeader->arrays[i];
+		uint64_t end = (uint64_t)array.offset + (uint64_t)array.count * g_record_sizes[i];
+		if ((array.offset & 7) || array.offset < sizeof(db_header) || end > size)
+		{
+			fprintf(stderr, "Error: Analysis database is damaged\n");
+			return 1;
+		}
+	}
+
+	// Strings must end inside their array, and the image must hold both sections
+	const db_array& strings = pHeader->arrays[DB_STRINGS];
+	const db_array& xref_offsets = pHeader->arrays[DB_XREF_OFFSETS];
+	if ((strings.count && data[strings.offset + strings.count - 1] != 0) ||
+		(uint64_t)pHeader->text_size + pHeader->data_size != pHeader->arrays[DB_IMAGE].count ||
+		xref_offsets.count != pHeader->arrays[DB_XREF_TARGETS].count + 1)
+	{
+		fprintf(stderr, "Error: Analysis database is damaged\n");
+		return 1;
+	}
+
+	m_pData = data;
+	m_size = size;
+	m_pHeader = pHeader;
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+const char* analysis_db::get_string(uint32_t offset) const
+{
+	const db_array& strings = m_pHeader->arrays[DB_STRINGS];
+	if (offset >= strings.count)
+		return "";
+	return (const char*)(m_pData + strings.offset + offset);
+}
+
+// ----------------------------------------------------------------------------
+//	WRITING
+// ----------------------------------------------------------------------------
+// Strings for the database, stored once each.
+class db_string_table
+{
+public:
+	db_string_table()
+	{
+		m_data.push_back(0);		// offset 0 is ""
+	}
+
+	uint32_t add(const std::string& str)
+	{
+		if (str.empty())
+			return 0;
+		uint32_t offset = (uint32_t)m_data.size();
+		m_data.insert(m_data.end(), str.begin(), str.end());
+		m_data.push_back(0);
+		return offset;
+	}
+
+	const std::vector<char>& get_data() const	{ return m_data; }
+
+private:
+	std::vector<char> m_data;
+};
+
+// ----------------------------------------------------------------------------
+int save_analysis_db(loaded_program& program, uint32_t cpu_type, const char* filename)
+{
+	if (!program.has_xrefs)
+	{
+		add_xrefs(program.disasm, program.xrefs);
+		program.has_xrefs = true;
+	}
+
+	// Collect every array before writing, to find their offsets
+	db_string_table strings;
+	std::vector<uint32_t> lines;
+	lines.reserve(program.disasm.lines.size());
+	for (size_t i = 0; i < program.disasm.lines.size(); ++i)
+		lines.push_back(program.disasm.lines[i].address);
+
+	std::vector<db_symbol> syms;
+	syms.reserve(program.exe_symbols.table.size());
+	for (symbols::sym_map::const_iterator it = program.exe_symbols.table.begin();
+			it != program.exe_symbols.table.end(); ++it)
+	{
+		db_symbol sym = { it->first, strings.add(it->second.label), (uint32_t)it->second.section };
+		syms.push_back(sym);
+	}
+
+	std::vector<db_reloc> relocs;
+	relocs.reserve(program.exe_symbols.relocs.size());
+	for (symbols::reloc_map::const_iterator it = program.exe_symbols.relocs.begin();
+			it != program.exe_symbols.relocs.end(); ++it)
+	{
+		db_reloc reloc = { it->first, it->second };
+		relocs.push_back(reloc);
+	}
+
+	std::vector<db_line_number> numbers;
+	for (std::map<uint32_t, line_numbers::line>::const_iterator it = program.lines.lines.begin();
+			it != program.lines.lines.end(); ++it)
+	{
+		db_line_number ln = { it->first, (uint32_t)it->second.file_index, it->second.line };
+		numbers.push_back(ln);
+	}
+	std::vector<uint32_t> filenames;
+	for (size_t i = 0; i < program.lines.filenames.size(); ++i)
+		filenames.push_back(strings.add(program.lines.filenames[i]));
+
+	const hop68::xref_index& xrefs = program.xrefs;
+	std::vector<uint32_t> xref_offsets(xrefs.offsets);
+	if (xref_offsets.empty())
+		xref_offsets.push_back(0);
+	std::vector<db_xref> xref_refs(xrefs.refs.size());
+	for (size_t i = 0; i < xrefs.refs.size(); ++i)
+	{
+		db_xref ref = { xrefs.refs[i].source, xrefs.refs[i].slot, xrefs.refs[i].kind, 0 };
+		xref_refs[i] = ref;
+	}
+
+	const void* array_data[DB_ARRAY_COUNT] =
+	{
+		program.image_ptr, lines.data(), syms.data(), relocs.data(), numbers.data(),
+		filenames.data(), xrefs.targets.data(), xref_offsets.data(), xref_refs.data(),
+		strings.get_data().data()
+	};
+	const size_t array_counts[DB_ARRAY_COUNT] =
+	{
+		(size_t)program.text_size + program.data_size, lines.size(), syms.size(), relocs.size(),
+		numbers.size(), filenames.size(), xrefs.targets.size(), xref_offsets.size(), xref_refs.size(),
+		strings.get_data().size()
+	};
+
+	db_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DB_MAGIC, sizeof(DB_MAGIC));
+	header.version = DB_VERSION;
+	header.byte_order = DB_BYTE_ORDER;
+	header.cpu_type = cpu_type;
+	header.flags = program.text_has_data ? DB_FLAG_TEXT_HAS_DATA : 0;
+	header.text_address = program.text_address;
+	header.text_size = program.text_size;
+	header.data_size = program.data_size;
+	header.bss_size = program.bss_size;
+
+	uint64_t pos = (sizeof(header) + 7) & ~7ULL;
+	for (int i = 0; i < DB_ARRAY_COUNT; ++i)
+	{
+		header.arrays[i].offset = (uint32_t)pos;
+		header.arrays[i].count = (uint32_t)array_counts[i];
+		pos = (pos + array_counts[i] * g_record_sizes[i] + 7) & ~7ULL;
+	}
+	if (pos > UINT32_MAX)
+	{
+		fprintf(stderr, "Error: Analysis database would be larger than 4GB\n");
+		return 1;
+	}
+
+	FILE* pFile = fopen(filename, "wb");
+	if (!pFile)
+	{
+		fprintf(stderr, "Error: Can't write file: %s\n", filename);
+		return 1;
+	}
+	static const uint8_t padding[8] = { 0 };
+	size_t written = fwrite(&header, sizeof(header), 1, pFile);
+	uint64_t file_pos = sizeof(header);
+	for (int i = 0; i < DB_ARRAY_COUNT && written; ++i)
+	{
+		written = fwrite(padding, 1, (size_t)(header.arrays[i].offset - file_pos), pFile) ==
+			header.arrays[i].offset - file_pos;
+		size_t bytes = array_counts[i] * g_record_sizes[i];
+		if (written && bytes)
+			written = fwrite(array_data[i], bytes, 1, pFile);
+		file_pos = header.arrays[i].offset + bytes;
+	}
+	if (fclose(pFile) != 0 || !written)
+	{
+		fprintf(stderr, "Error: Can't write file: %s\n", filename);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+// Saving a finished analysis, so it can be printed or searched again without
+// parsing, decoding and labelling the program from scratch.
+//
+// The file is a header followed by flat arrays of fixed-size records, each
+// found by its offset from the start of the file. Nothing in it is a pointer,
+// so it can be memory-mapped and the arrays used in place. Values are in the
+// byte order of the machine which wrote it; other machines refuse the file.
+//
+// The image (text then data, relocated) is included, so the original program
+// isn't needed. Instructions are stored only as their start addresses, and
+// are decoded again from the image when needed.
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class loaded_program;
+
+// ----------------------------------------------------------------------------
+//	FILE LAYOUT
+// ----------------------------------------------------------------------------
+static const uint32_t DB_VERSION = 1;
+static const uint32_t DB_BYTE_ORDER = 0x01020304;	// reads differently when swapped
+
+// The arrays in the file
+enum DbArray
+{
+	DB_IMAGE,					// uint8_t: text and data sections
+	DB_LINES,					// uint32_t: address of every decoded instruction, in order
+	DB_SYMBOLS,					// db_symbol, in address order
+	DB_RELOCS,					// db_reloc, in address order
+	DB_LINE_NUMBERS,			// db_line_number, in address order
+	DB_FILENAMES,				// uint32_t: string offset for each source file index
+	DB_XREF_TARGETS,			// uint32_t: hop68::xref_index::targets
+	DB_XREF_OFFSETS,			// uint32_t: hop68::xref_index::offsets
+	DB_XREF_REFS,				// db_xref: hop68::xref_index::refs
+	DB_STRINGS,					// char: null-terminated strings
+	DB_ARRAY_COUNT
+};
+
+// Flags for db_header
+enum DbFlags
+{
+	DB_FLAG_TEXT_HAS_DATA = 1	// only parts of the text are in DB_LINES (e.g. from coverage)
+};
+
+struct db_array
+{
+	uint32_t offset;			// from the start of the file, 8-byte aligned
+	uint32_t count;				// number of records
+};
+
+struct db_header
+{
+	char magic[8];				// "HOP68DB" and a 0
+	uint32_t version;			// DB_VERSION
+	uint32_t byte_order;		// DB_BYTE_ORDER
+	uint32_t cpu_type;			// hop68::decode_settings::cpu_type used for decoding
+	uint32_t flags;				// DbFlags
+	uint32_t text_address;
+	uint32_t text_size;
+	uint32_t data_size;
+	uint32_t bss_size;
+	db_array arrays[DB_ARRAY_COUNT];
+};
+
+struct db_symbol
+{
+	uint32_t address;
+	uint32_t label;				// offset in DB_STRINGS
+	uint32_t section;			// symbol::section_type
+};
+
+struct db_reloc
+{
+	uint32_t address;			// address of the relocated longword
+	uint32_t target;			// its value
+};
+
+struct db_line_number
+{
+	uint32_t address;
+	uint32_t file_index;
+	uint32_t line;
+};
+
+struct db_xref
+{
+	uint32_t source;
+	uint8_t slot;
+	uint8_t kind;
+	uint16_t pad;
+};
+
+// ----------------------------------------------------------------------------
+// Checked, read-only access to a database in memory.
+class analysis_db
+{
+public:
+	analysis_db();
+
+	// Check the header and that every array lies inside the data, which must
+	// stay valid while this is used.
+	// Returns 0 for success, 1 for failure (with a message on stderr).
+	int open(const uint8_t* data, size_t size);
+
+	const db_header& get_header() const			{ return *m_pHeader; }
+
+	// The records of an array, and their number in "count".
+	template<typename T>
+	const T* get_array(DbArray array, size_t& count) const
+	{
+		count = m_pHeader->arrays[array].count;
+		return (const T*)(m_pData + m_pHeader->arrays[array].offset);
+	}
+
+	// A string from DB_STRINGS, or "" if the offset is invalid.
+	const char* get_string(uint32_t offset) const;
+
+private:
+	const uint8_t* m_pData;
+	size_t m_size;
+	const db_header* m_pHeader;
+};
+
+// ----------------------------------------------------------------------------
+// Write a loaded program to a database file. Cross-references are built if
+// the program doesn't have them.
+// Returns 0 for success, 1 for failure.
+extern int save_analysis_db(loaded_program& program, uint32_t cpu_type, const char* filename);
+
+#endif
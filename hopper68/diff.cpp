@@ -0,0 +1,429 @@
+// Comparison of two versions of a program. See diff.h.
+#include "diff.h"
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lib/format68.h"
+#include "lib/instruction68.h"
+#include "lib/xref68.h"
+#include "blocks.h"
+#include "print.h"
+#include "process.h"
+#include "stats.h"
+
+// Width of the old program's column in the side-by-side output
+static const int DIFF_COLUMN_WIDTH = 48;
+
+// Deepest nesting of align() before giving up and reporting a difference
+static const int MAX_ALIGN_DEPTH = 32;
+
+// Hash used for label rows, so that labels with different names still match
+static const uint64_t LABEL_ROW_HASH = 0x4c4142454c524f57ull;
+
+// ----------------------------------------------------------------------------
+//	NORMALISED HASHING
+// ----------------------------------------------------------------------------
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ p[i]) * FNV_PRIME;
+	return hash;
+}
+
+// ----------------------------------------------------------------------------
+// Lookups for hop68::format() which show every address inside the program,
+// and every relocated long, as "@". Instructions which only differ because
+// code or data has moved then have the same text.
+struct normalise_context
+{
+	uint32_t start_address;
+	uint32_t end_address;
+	uint32_t text_address;
+	const std::vector<uint32_t>* pRelocs;	// sorted offsets from text_address
+};
+
+static const char* normalise_label(void* user_data, uint32_t address)
+{
+	const normalise_context* pContext = (const normalise_context*)user_data;
+	if (address >= pContext->start_address && address < pContext->end_address)
+		return "@";
+	return NULL;
+}
+
+static const char* normalise_reloc_label(void* user_data, uint32_t reloc_address, uint32_t value)
+{
+	(void)value;
+	const normalise_context* pContext = (const normalise_context*)user_data;
+	uint32_t offset = reloc_address - pContext->text_address;
+	if (std::binary_search(pContext->pRelocs->begin(), pContext->pRelocs->end(), offset))
+		return "@";
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Returns true if an operand's text can depend on where the program is,
+// so it must be normalised.
+static bool is_address_operand(const hop68::operand& op, uint32_t inst_address)
+{
+	uint32_t target;
+	if (hop68::calc_operand_target(op, inst_address, target))
+		return true;
+	return op.type == hop68::OpType::IMMEDIATE && op.imm.size == hop68::Size::LONG;
+}
+
+// ----------------------------------------------------------------------------
+// One side of the comparison
+struct diff_program
+{
+	loaded_program program;
+	basic_blocks blocks;
+	std::vector<uint64_t> line_hashes;		// normalised hash of each disassembly line
+	std::vector<uint64_t> block_hashes;
+};
+
+// ----------------------------------------------------------------------------
+static void hash_program(diff_program& prog)
+{
+	const loaded_program& program = prog.program;
+	normalise_context context;
+	context.start_address = program.text_address;
+	context.end_address = program.text_address + program.text_size + program.data_size + program.bss_size;
+	context.text_address = program.text_address;
+	context.pRelocs = &program.reloc_offsets;
+	hop68::format_symbols lookups = { normalise_label, normalise_reloc_label, &context };
+
+	// Instructions without addresses are hashed from their bytes, which is much
+	// quicker than formatting them. A prefix keeps the two kinds apart.
+	const std::vector<disassembly::line>& lines = program.disasm.lines;
+	prog.line_hashes.resize(lines.size());
+	char text[256];
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		const hop68::instruction& inst = lines[i].inst;
+		uint32_t address = lines[i].address;
+		if (is_address_operand(inst.op0, address) || is_address_operand(inst.op1, address) ||
+			is_address_operand(inst.op2, address))
+		{
+			size_t length = hop68::format(inst, address, &lookups, text, sizeof(text));
+			prog.line_hashes[i] = hash_bytes(hash_bytes(FNV_OFFSET, "T", 1), text,
+				std::min(length, sizeof(text) - 1));
+		}
+		else
+		{
+			prog.line_hashes[i] = hash_bytes(hash_bytes(FNV_OFFSET, "B", 1),
+				program.image_ptr + (address - program.text_address), inst.byte_count);
+		}
+	}
+
+	// Symbols are ignored when splitting, since the two versions can have
+	// different labels for the same code
+	symbols no_symbols;
+	find_basic_blocks(program.disasm, no_symbols, prog.blocks);
+	const std::vector<basic_block>& blocks = prog.blocks.blocks;
+	prog.block_hashes.resize(blocks.size());
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		uint64_t hash = FNV_OFFSET;
+		for (size_t line = blocks[i].first_line; line < blocks[i].first_line + blocks[i].line_count; ++line)
+			hash = hash_bytes(hash, &prog.line_hashes[line], sizeof(uint64_t));
+		prog.block_hashes[i] = hash;
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	ALIGNMENT
+// ----------------------------------------------------------------------------
+// A pair of equal items, by index in each sequence
+struct diff_match
+{
+	size_t old_index;
+	size_t new_index;
+};
+
+// ----------------------------------------------------------------------------
+// Find the matches between a[a0..a1) and b[b0..b1), appending them to "matches"
+// in order. Equal items at each end are matched first. Then items which occur
+// exactly once in both ranges are looked up through a hash index, the longest
+// in-order run of them is kept, and the ranges between them are aligned in
+// the same way.
+static void align(const std::vector<uint64_t>& a, size_t a0, size_t a1,
+	const std::vector<uint64_t>& b, size_t b0, size_t b1, int depth, std::vector<diff_match>& matches)
+{
+	while (a0 < a1 && b0 < b1 && a[a0] == b[b0])
+	{
+		diff_match m = { a0++, b0++ };
+		matches.push_back(m);
+	}
+	size_t tail = 0;
+	while (a1 - tail > a0 && b1 - tail > b0 && a[a1 - 1 - tail] == b[b1 - 1 - tail])
+		++tail;
+	a1 -= tail;
+	b1 -= tail;
+
+	if (a0 < a1 && b0 < b1 && depth < MAX_ALIGN_DEPTH)
+	{
+		struct occurrence
+		{
+			uint32_t old_count;
+			uint32_t new_count;
+			size_t new_index;
+		};
+		std::unordered_map<uint64_t, occurrence> index;
+		index.reserve(b1 - b0);
+		for (size_t i = b0; i < b1; ++i)
+		{
+			occurrence& occ = index[b[i]];
+			++occ.new_count;
+			occ.new_index = i;
+		}
+		for (size_t i = a0; i < a1; ++i)
+		{
+			std::unordered_map<uint64_t, occurrence>::iterator it = index.find(a[i]);
+			if (it != index.end())
+				++it->second.old_count;
+		}
+
+		// Unique in both, in old order
+		std::vector<diff_match> anchors;
+		for (size_t i = a0; i < a1; ++i)
+		{
+			std::unordered_map<uint64_t, occurrence>::const_iterator it = index.find(a[i]);
+			if (it != index.end() && it->second.old_count == 1 && it->second.new_count == 1)
+			{
+				diff_match m = { i, it->second.new_index };
+				anchors.push_back(m);
+			}
+		}
+
+		// Longest run with increasing new indices
+		std::vector<size_t> tails;					// anchor index ending each run length
+		std::vector<size_t> prev(anchors.size());
+		for (size_t i = 0; i < anchors.size(); ++i)
+		{
+			size_t lo = 0, hi = tails.size();
+			while (lo < hi)
+			{
+				size_t mid = (lo + hi) / 2;
+				if (anchors[tails[mid]].new_index < anchors[i].new_index)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			prev[i] = lo ? tails[lo - 1] : (size_t)-1;
+			if (lo == tails.size())
+				tails.push_back(i);
+			else
+				tails[lo] = i;
+		}
+		std::vector<diff_match> chain(tails.size());
+		for (size_t i = tails.size(), at = tails.empty() ? 0 : tails.back(); i > 0; --i, at = prev[at])
+			chain[i - 1] = anchors[at];
+
+		for (size_t i = 0; i < chain.size(); ++i)
+		{
+			align(a, a0, chain[i].old_index, b, b0, chain[i].new_index, depth + 1, matches);
+			matches.push_back(chain[i]);
+			a0 = chain[i].old_index + 1;
+			b0 = chain[i].new_index + 1;
+		}
+		if (!chain.empty())
+			align(a, a0, a1, b, b0, b1, depth + 1, matches);
+	}
+
+	for (size_t i = 0; i < tail; ++i)
+	{
+		diff_match m = { a1 + i, b1 + i };
+		matches.push_back(m);
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	OUTPUT
+// ----------------------------------------------------------------------------
+// A printable row of a changed region: a label or an instruction
+struct diff_row
+{
+	uint64_t hash;
+	std::string text;
+};
+
+// ----------------------------------------------------------------------------
+static void add_rows(const diff_program& prog, size_t first_block, size_t last_block, std::vector<diff_row>& rows)
+{
+	const loaded_program& program = prog.program;
+	const std::vector<basic_block>& blocks = prog.blocks.blocks;
+	char text[256];
+	char row_text[300];
+	for (size_t i = first_block; i < last_block; ++i)
+	{
+		for (size_t line = blocks[i].first_line; line < blocks[i].first_line + blocks[i].line_count; ++line)
+		{
+			const disassembly::line& dline = program.disasm.lines[line];
+			symbols::sym_map::const_iterator it = program.exe_symbols.table.find(dline.address);
+			if (it != program.exe_symbols.table.end())
+			{
+				diff_row row;
+				row.hash = LABEL_ROW_HASH;
+				row.text = it->second.label + ":";
+				rows.push_back(row);
+			}
+			format(dline.inst, program.exe_symbols, dline.address, text, sizeof(text));
+			snprintf(row_text, sizeof(row_text), "%06x  %s", dline.address, text);
+			diff_row row;
+			row.hash = prog.line_hashes[line];
+			row.text = row_text;
+			rows.push_back(row);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void print_row(const char* left, char mark, const char* right, FILE* pOutput)
+{
+	if (*right)
+		fprintf(pOutput, "%-*s %c %s\n", DIFF_COLUMN_WIDTH, left, mark, right);
+	else
+		fprintf(pOutput, "%-*s %c\n", DIFF_COLUMN_WIDTH, left, mark);
+}
+
+// ----------------------------------------------------------------------------
+// Print the address range of some blocks, or "(none)"
+static void print_block_range(const diff_program& prog, size_t first_block, size_t last_block, FILE* pOutput)
+{
+	if (first_block == last_block)
+	{
+		fprintf(pOutput, "(none)");
+		return;
+	}
+	const basic_block& first = prog.blocks.blocks[first_block];
+	const basic_block& last = prog.blocks.blocks[last_block - 1];
+	print_symbol_offset(prog.program.exe_symbols, first.address, pOutput);
+	fprintf(pOutput, " ($%x-$%x)", first.address, last.end_address);
+}
+
+// ----------------------------------------------------------------------------
+// Print one changed region side by side. Rows are aligned in the same way as
+// blocks; unmatched rows are paired up where both sides have some.
+static void print_change(const diff_program& old_prog, size_t old_first, size_t old_last,
+	const diff_program& new_prog, size_t new_first, size_t new_last, FILE* pOutput)
+{
+	fprintf(pOutput, "; ----------------------------------------------------------------------------\n");
+	fprintf(pOutput, "; old: ");
+	print_block_range(old_prog, old_first, old_last, pOutput);
+	fprintf(pOutput, "\n; new: ");
+	print_block_range(new_prog, new_first, new_last, pOutput);
+	fprintf(pOutput, "\n");
+
+	std::vector<diff_row> old_rows, new_rows;
+	add_rows(old_prog, old_first, old_last, old_rows);
+	add_rows(new_prog, new_first, new_last, new_rows);
+	std::vector<uint64_t> old_hashes(old_rows.size()), new_hashes(new_rows.size());
+	for (size_t i = 0; i < old_rows.size(); ++i)
+		old_hashes[i] = old_rows[i].hash;
+	for (size_t i = 0; i < new_rows.size(); ++i)
+		new_hashes[i] = new_rows[i].hash;
+
+	std::vector<diff_match> matches;
+	align(old_hashes, 0, old_hashes.size(), new_hashes, 0, new_hashes.size(), 0, matches);
+	diff_match end = { old_rows.size(), new_rows.size() };
+	matches.push_back(end);
+
+	size_t old_pos = 0, new_pos = 0;
+	for (size_t m = 0; m < matches.size(); ++m)
+	{
+		// Unmatched rows before this match
+		while (old_pos < matches[m].old_index || new_pos < matches[m].new_index)
+		{
+			bool has_old = old_pos < matches[m].old_index;
+			bool has_new = new_pos < matches[m].new_index;
+			print_row(has_old ? old_rows[old_pos].text.c_str() : "",
+				has_old && has_new ? '|' : (has_old ? '<' : '>'),
+				has_new ? new_rows[new_pos].text.c_str() : "", pOutput);
+			old_pos += has_old;
+			new_pos += has_new;
+		}
+		if (m + 1 == matches.size())
+			break;
+		print_row(old_rows[old_pos].text.c_str(), ' ', new_rows[new_pos].text.c_str(), pOutput);
+		++old_pos;
+		++new_pos;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int load_diff_program(const diff_input& input, bool binary, const hop68::decode_settings& dsettings,
+	const output_settings& osettings, diff_program& prog)
+{
+	int ret = binary ?
+		load_bin_program(input.data_ptr, input.size, dsettings, osettings, prog.program) :
+		load_tos_program(input.data_ptr, input.size, dsettings, osettings, prog.program, NULL);
+	if (ret)
+	{
+		fprintf(stderr, "Error: failed to disassemble %s\n", input.name);
+		return ret;
+	}
+	stats_start_phase(osettings.pStats, "hash blocks");
+	hash_program(prog);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int process_diff(const diff_input& old_input, const diff_input& new_input, bool binary,
+	const hop68::decode_settings& dsettings, const output_settings& osettings, FILE* pOutput)
+{
+	run_stats* pStats = osettings.pStats;
+	diff_program old_prog, new_prog;
+	if (load_diff_program(old_input, binary, dsettings, osettings, old_prog))
+		return 1;
+	if (load_diff_program(new_input, binary, dsettings, osettings, new_prog))
+		return 1;
+
+	stats_start_phase(pStats, "align blocks");
+	std::vector<diff_match> matches;
+	align(old_prog.block_hashes, 0, old_prog.block_hashes.size(),
+		new_prog.block_hashes, 0, new_prog.block_hashes.size(), 0, matches);
+	diff_match end = { old_prog.block_hashes.size(), new_prog.block_hashes.size() };
+	matches.push_back(end);
+
+	// Count the changes first, for the summary
+	size_t changes = 0, old_changed = 0, new_changed = 0;
+	size_t old_pos = 0, new_pos = 0;
+	for (size_t m = 0; m < matches.size(); ++m)
+	{
+		if (matches[m].old_index > old_pos || matches[m].new_index > new_pos)
+		{
+			++changes;
+			old_changed += matches[m].old_index - old_pos;
+			new_changed += matches[m].new_index - new_pos;
+		}
+		old_pos = matches[m].old_index + 1;
+		new_pos = matches[m].new_index + 1;
+	}
+	stats_add_count(pStats, "matched blocks", matches.size() - 1);
+
+	stats_start_phase(pStats, "print");
+	fprintf(pOutput, "; old: %s (%u blocks)\n", old_input.name, (unsigned int)old_prog.block_hashes.size());
+	fprintf(pOutput, "; new: %s (%u blocks)\n", new_input.name, (unsigned int)new_prog.block_hashes.size());
+	fprintf(pOutput, "; %u blocks match; %u old and %u new blocks differ, in %u places\n",
+		(unsigned int)(matches.size() - 1), (unsigned int)old_changed, (unsigned int)new_changed,
+		(unsigned int)changes);
+
+	old_pos = new_pos = 0;
+	for (size_t m = 0; m < matches.size(); ++m)
+	{
+		if (matches[m].old_index > old_pos || matches[m].new_index > new_pos)
+			print_change(old_prog, old_pos, matches[m].old_index, new_prog, new_pos, matches[m].new_index, pOutput);
+		old_pos = matches[m].old_index + 1;
+		new_pos = matches[m].new_index + 1;
+	}
+	stats_end_phase(pStats);
+	return 0;
+}
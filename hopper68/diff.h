@@ -0,0 +1,29 @@
+// Comparison of two versions of a program, aligned by basic blocks.
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lib/decode68.h"
+
+struct output_settings;
+
+// ----------------------------------------------------------------------------
+// An input to compare: the file contents, and the name to show for it.
+struct diff_input
+{
+	const uint8_t* data_ptr;
+	long size;
+	const char* name;
+};
+
+// Decode both programs, and print the blocks which differ side by side.
+// Blocks are matched by a hash of their instructions with program addresses
+// and relocated values abstracted, so code which has only moved is not shown.
+// "binary" reads both inputs as binary files rather than TOS executables.
+// Returns 0 for success, 1 for failure.
+extern int process_diff(const diff_input& old_input, const diff_input& new_input, bool binary,
+	const hop68::decode_settings& dsettings, const output_settings& osettings, FILE* pOutput);
+
+#endif
@@ -0,0 +1,352 @@
+// Reading files from Atari floppy disk images (.ST and .MSA) in memory.
+#include "disk.h"
+
+#include <string.h>
+#include <algorithm>
+
+// MSA image header
+static const uint16_t MSA_MAGIC = 0x0e0f;
+static const uint32_t MSA_HEADER_SIZE = 10;
+static const uint8_t MSA_RLE_MARKER = 0xe5;
+static const uint32_t MSA_SECTOR_SIZE = 512;
+
+// Limits on the geometry, well beyond any real floppy
+static const uint32_t MSA_MAX_SECTORS = 40;		// per track
+static const uint32_t MSA_MAX_TRACKS = 255;
+
+// Directory entries
+static const uint32_t DIR_ENTRY_SIZE = 32;
+static const uint8_t DIR_END = 0x00;
+static const uint8_t DIR_DELETED = 0xe5;
+static const uint8_t ATTR_VOLUME = 0x08;
+static const uint8_t ATTR_DIRECTORY = 0x10;
+
+// FAT12 cluster values
+static const uint32_t FIRST_CLUSTER = 2;
+static const uint32_t BAD_CLUSTER = 0xff7;
+static const uint32_t END_OF_CHAIN = 0xff8;
+
+// Limit on directory nesting, in case a damaged disk contains a loop
+static const int MAX_DIRECTORY_DEPTH = 16;
+
+// ----------------------------------------------------------------------------
+static inline uint16_t read_be16(const uint8_t* p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// ----------------------------------------------------------------------------
+static inline uint16_t read_le16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// ----------------------------------------------------------------------------
+static inline uint32_t read_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ----------------------------------------------------------------------------
+disk_image::disk_image() :
+	m_pData(NULL),
+	m_size(0),
+	m_bytes_per_sector(0),
+	m_sectors_per_cluster(0),
+	m_fat_start(0),
+	m_root_start(0),
+	m_root_entries(0),
+	m_data_start(0),
+	m_cluster_count(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+int disk_image::open(const uint8_t* data, uint32_t size)
+{
+	m_msa_image.clear();
+	if (size >= MSA_HEADER_SIZE && read_be16(data) == MSA_MAGIC)
+	{
+		if (decode_msa(data, size))
+			return 1;
+		m_pData = m_msa_image.data();
+		m_size = (uint32_t)m_msa_image.size();
+	}
+	else
+	{
+		m_pData = data;
+		m_size = size;
+	}
+	return read_bpb();
+}
+
+// ----------------------------------------------------------------------------
+// Expand an MSA image into a raw sector image. Each track is stored either
+// raw, or run-length encoded using "E5 <byte> <count.w>" sequences.
+int disk_image::decode_msa(const uint8_t* data, uint32_t size)
+{
+	uint32_t sectors = read_be16(data + 2);
+	uint32_t sides = read_be16(data + 4) + 1;
+	uint32_t start_track = read_be16(data + 6);
+	uint32_t end_track = read_be16(data + 8);
+	if (sectors == 0 || sectors > MSA_MAX_SECTORS || sides > 2 || start_track > end_track ||
+		end_track >= MSA_MAX_TRACKS)
+		return 1;
+
+	// The limits above keep this small, but the image size must fit in 32 bits
+	uint32_t track_size = sectors * MSA_SECTOR_SIZE;
+	uint64_t image_size = (uint64_t)(end_track + 1) * sides * track_size;
+	if (image_size > UINT32_MAX)
+		return 1;
+	m_msa_image.assign((size_t)image_size, 0);
+
+	uint32_t pos = MSA_HEADER_SIZE;
+	for (uint32_t track = start_track; track <= end_track; ++track)
+	{
+		for (uint32_t side = 0; side < sides; ++side)
+		{
+			if (pos + 2 > size)
+				return 1;
+			uint32_t length = read_be16(data + pos);
+			pos += 2;
+			if (length > size - pos)
+				return 1;
+
+			uint8_t* pDest = &m_msa_image[((size_t)track * sides + side) * track_size];
+			const uint8_t* pSrc = data + pos;
+			pos += length;
+			if (length == track_size)
+			{
+				memcpy(pDest, pSrc, track_size);
+				continue;
+			}
+
+			// Compressed track
+			uint32_t out = 0;
+			uint32_t in = 0;
+			while (in < length)
+			{
+				uint8_t val = pSrc[in++];
+				if (val != MSA_RLE_MARKER)
+				{
+					if (out >= track_size)
+						return 1;
+					pDest[out++] = val;
+					continue;
+				}
+				if (in + 3 > length)
+					return 1;
+				uint8_t fill = pSrc[in];
+				uint32_t count = read_be16(pSrc + in + 1);
+				in += 3;
+				if (count > track_size - out)
+					return 1;
+				memset(pDest + out, fill, count);
+				out += count;
+			}
+			if (out != track_size)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Read the filesystem layout from the BIOS parameter block in the boot sector.
+int disk_image::read_bpb()
+{
+	if (m_size < 32)
+		return 1;
+
+	m_bytes_per_sector = read_le16(m_pData + 11);
+	m_sectors_per_cluster = m_pData[13];
+	uint32_t reserved = read_le16(m_pData + 14);
+	uint32_t num_fats = m_pData[16];
+	m_root_entries = read_le16(m_pData + 17);
+	uint32_t total_sectors = read_le16(m_pData + 19);
+	uint32_t fat_sectors = read_le16(m_pData + 22);
+
+	if (m_bytes_per_sector == 0 || (m_bytes_per_sector % DIR_ENTRY_SIZE) != 0 ||
+		m_sectors_per_cluster == 0 || num_fats == 0 || fat_sectors == 0)
+		return 1;
+
+	// Images are often truncated after the last used track, so trust
+	// whichever of the BPB or the image size is smaller
+	uint64_t total_size = (uint64_t)total_sectors * m_bytes_per_sector;
+	if (total_size == 0 || total_size > m_size)
+		total_size = m_size;
+
+	// The BPB fields can describe a layout far larger than 4GB
+	const uint64_t fat_size = (uint64_t)fat_sectors * m_bytes_per_sector;
+	const uint64_t fat_start = (uint64_t)reserved * m_bytes_per_sector;
+	const uint64_t root_start = fat_start + num_fats * fat_size;
+	const uint64_t data_start = root_start + (uint64_t)m_root_entries * DIR_ENTRY_SIZE;
+	if (fat_start + fat_size > m_size || data_start > total_size)
+		return 1;
+	m_fat_start = (uint32_t)fat_start;
+	m_root_start = (uint32_t)root_start;
+	m_data_start = (uint32_t)data_start;
+
+	// Only count clusters which are both in the image and in the FAT
+	const uint64_t cluster_size = (uint64_t)m_bytes_per_sector * m_sectors_per_cluster;
+	m_cluster_count = (uint32_t)((total_size - data_start) / cluster_size);
+
+	// FAT12 holds 1.5 bytes per entry
+	const uint64_t max_clusters = (fat_size * 2) / 3;
+	if (m_cluster_count + (uint64_t)FIRST_CLUSTER > max_clusters)
+		m_cluster_count = max_clusters > FIRST_CLUSTER ? (uint32_t)(max_clusters - FIRST_CLUSTER) : 0;
+	m_cluster_count = std::min(m_cluster_count, (uint32_t)((m_size - data_start) / cluster_size));
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+uint32_t disk_image::get_fat_entry(uint32_t cluster) const
+{
+	const uint8_t* pEntry = m_pData + m_fat_start + cluster + cluster / 2;
+	uint32_t val = read_le16(pEntry);
+	return (cluster & 1) ? (val >> 4) : (val & 0xfff);
+}
+
+// ----------------------------------------------------------------------------
+const uint8_t* disk_image::get_cluster(uint32_t cluster) const
+{
+	uint32_t cluster_size = m_bytes_per_sector * m_sectors_per_cluster;
+	return m_pData + m_data_start + (cluster - FIRST_CLUSTER) * cluster_size;
+}
+
+// ----------------------------------------------------------------------------
+// Follow a cluster chain through the FAT. Fails if the chain leaves the disk
+// or is longer than the disk (which means it loops).
+int disk_image::read_chain(uint32_t start_cluster, std::vector<uint32_t>& clusters) const
+{
+	clusters.clear();
+	uint32_t cluster = start_cluster;
+	while (cluster < END_OF_CHAIN)
+	{
+		if (cluster < FIRST_CLUSTER || cluster == BAD_CLUSTER ||
+			cluster - FIRST_CLUSTER >= m_cluster_count ||
+			clusters.size() >= m_cluster_count)
+			return 1;
+		clusters.push_back(cluster);
+		cluster = get_fat_entry(cluster);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int disk_image::read_directory(const uint8_t* data, uint32_t size, const std::string& prefix,
+	int depth, std::vector<disk_entry>& entries) const
+{
+	int ret = 0;
+	for (uint32_t offset = 0; offset + DIR_ENTRY_SIZE <= size; offset += DIR_ENTRY_SIZE)
+	{
+		const uint8_t* pEntry = data + offset;
+		if (pEntry[0] == DIR_END)
+			break;
+		if (pEntry[0] == DIR_DELETED || pEntry[0] == '.')
+			continue;
+		uint8_t attr = pEntry[11];
+		if (attr & ATTR_VOLUME)
+			continue;
+
+		// Build "NAME.EXT" from the space-padded 8.3 fields
+		std::string name;
+		for (int i = 0; i < 8 && pEntry[i] != ' '; ++i)
+			name += (char)pEntry[i];
+		if (pEntry[8] != ' ')
+		{
+			name += '.';
+			for (int i = 8; i < 11 && pEntry[i] != ' '; ++i)
+				name += (char)pEntry[i];
+		}
+
+		disk_entry entry;
+		entry.path = prefix + name;
+		entry.start_cluster = read_le16(pEntry + 26);
+		entry.is_dir = (attr & ATTR_DIRECTORY) != 0;
+		entry.size = entry.is_dir ? 0 : read_le32(pEntry + 28);
+		entries.push_back(entry);
+
+		if (!entry.is_dir)
+			continue;
+		if (depth >= MAX_DIRECTORY_DEPTH)
+		{
+			ret = 1;
+			continue;
+		}
+
+		std::vector<uint8_t> storage;
+		const uint8_t* pDir;
+		uint32_t dir_size;
+		std::vector<uint32_t> clusters;
+		if (read_chain(entry.start_cluster, clusters))
+		{
+			ret = 1;
+			continue;
+		}
+		dir_size = (uint32_t)clusters.size() * m_bytes_per_sector * m_sectors_per_cluster;
+		disk_entry dir_entry = entry;
+		dir_entry.size = dir_size;
+		if (read_file(dir_entry, storage, pDir))
+		{
+			ret = 1;
+			continue;
+		}
+		ret |= read_directory(pDir, dir_size, entry.path + "\\", depth + 1, entries);
+	}
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+int disk_image::list_files(std::vector<disk_entry>& entries) const
+{
+	uint32_t root_size = m_root_entries * DIR_ENTRY_SIZE;
+	return read_directory(m_pData + m_root_start, root_size, "", 0, entries);
+}
+
+// ----------------------------------------------------------------------------
+int disk_image::read_file(const disk_entry& entry, std::vector<uint8_t>& storage,
+	const uint8_t*& data) const
+{
+	data = NULL;
+	storage.clear();
+	if (entry.size == 0)
+	{
+		data = m_pData;
+		return 0;
+	}
+
+	std::vector<uint32_t> clusters;
+	if (read_chain(entry.start_cluster, clusters))
+		return 1;
+
+	uint32_t cluster_size = m_bytes_per_sector * m_sectors_per_cluster;
+	if ((uint64_t)clusters.size() * cluster_size < entry.size)
+		return 1;
+
+	// Files written to a fresh disk are nearly always in one run of
+	// clusters, so can be used directly from the image
+	size_t num_needed = (entry.size + cluster_size - 1) / cluster_size;
+	bool contiguous = true;
+	for (size_t i = 1; i < num_needed; ++i)
+	{
+		if (clusters[i] != clusters[0] + i)
+		{
+			contiguous = false;
+			break;
+		}
+	}
+	if (contiguous)
+	{
+		data = get_cluster(clusters[0]);
+		return 0;
+	}
+
+	storage.resize(num_needed * cluster_size);
+	for (size_t i = 0; i < num_needed; ++i)
+		memcpy(&storage[i * cluster_size], get_cluster(clusters[i]), cluster_size);
+	storage.resize(entry.size);
+	data = storage.data();
+	return 0;
+}
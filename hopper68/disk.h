@@ -0,0 +1,67 @@
+// Reading files from Atari floppy disk images (.ST and .MSA) in memory.
+#ifndef DISK_H
+#define DISK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// A file or directory found in the image
+struct disk_entry
+{
+	std::string	path;				// full path, using '\' separators e.g. "AUTO\FOO.PRG"
+	uint16_t	start_cluster;
+	uint32_t	size;				// size in bytes (0 for directories)
+	bool		is_dir;
+};
+
+// ----------------------------------------------------------------------------
+// A FAT12 filesystem image. Raw .ST images are used in place; .MSA images are
+// decompressed into memory owned by this object.
+class disk_image
+{
+public:
+	disk_image();
+
+	// Set up from the contents of an image file. The data must stay valid
+	// while this object is used. Returns 0 for success, 1 for failure.
+	int open(const uint8_t* data, uint32_t size);
+
+	// Find every file and directory on the disk, in directory order.
+	// Returns 0 for success, 1 if the directory structure is damaged (any
+	// entries found before the damage are still returned).
+	int list_files(std::vector<disk_entry>& entries) const;
+
+	// Get a file's contents. If the file is stored in contiguous clusters
+	// then "data" points into the image; otherwise it is copied into "storage".
+	// Returns 0 for success, 1 for failure.
+	int read_file(const disk_entry& entry, std::vector<uint8_t>& storage,
+		const uint8_t*& data) const;
+
+	bool is_msa() const		{ return !m_msa_image.empty(); }
+
+private:
+	int decode_msa(const uint8_t* data, uint32_t size);
+	int read_bpb();
+	uint32_t get_fat_entry(uint32_t cluster) const;
+	const uint8_t* get_cluster(uint32_t cluster) const;
+	int read_chain(uint32_t start_cluster, std::vector<uint32_t>& clusters) const;
+	int read_directory(const uint8_t* data, uint32_t size, const std::string& prefix,
+		int depth, std::vector<disk_entry>& entries) const;
+
+	const uint8_t*			m_pData;			// filesystem image
+	uint32_t				m_size;
+	std::vector<uint8_t>	m_msa_image;		// decompressed MSA data
+
+	// Filesystem layout from the boot sector
+	uint32_t	m_bytes_per_sector;
+	uint32_t	m_sectors_per_cluster;
+	uint32_t	m_fat_start;				// byte offsets in the image
+	uint32_t	m_root_start;
+	uint32_t	m_root_entries;
+	uint32_t	m_data_start;
+	uint32_t	m_cluster_count;
+};
+
+#endif
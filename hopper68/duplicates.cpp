@@ -0,0 +1,346 @@
+// Finding duplicated routines. See duplicates.h.
+#include "duplicates.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "lib/flow68.h"
+#include "lib/instruction68.h"
+#include "process.h"
+#include "query.h"
+
+// Instructions in each hashed window. Routines shorter than this are ignored.
+static const size_t WINDOW_SIZE = 8;
+
+// MinHash values are split into bands; routines which share any whole band
+// are compared. More rows per band finds fewer, closer candidates.
+static const size_t BAND_ROWS = 4;
+static const size_t BAND_COUNT = DUPLICATE_MINHASH_SIZE / BAND_ROWS;
+
+// Lowest estimated similarity (fraction of equal MinHash values) for two
+// routines to count as duplicates
+static const double SIMILARITY_THRESHOLD = 0.8;
+
+// Multiplier for the rolling window hash
+static const uint64_t ROLLING_PRIME = 0x100000001b3ULL;
+
+// ----------------------------------------------------------------------------
+//	HASHING
+// ----------------------------------------------------------------------------
+// Mix the bits of a 64-bit value (the splitmix64 finaliser)
+static uint64_t mix64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// ----------------------------------------------------------------------------
+// The registers an operand uses, packed into one value
+static uint32_t get_operand_registers(const hop68::operand& op)
+{
+	switch (op.type)
+	{
+		case hop68::D_DIRECT:			return op.d_register.reg;
+		case hop68::A_DIRECT:			return op.a_register.reg;
+		case hop68::INDIRECT:			return op.indirect.reg;
+		case hop68::INDIRECT_POSTINC:	return op.indirect_postinc.reg;
+		case hop68::INDIRECT_PREDEC:	return op.indirect_predec.reg;
+		case hop68::INDIRECT_DISP:		return op.indirect_disp.reg;
+		case hop68::INDIRECT_INDEX:
+			return op.indirect_index.a_reg | (op.indirect_index.indirect_info.index_reg << 4);
+		case hop68::PC_DISP_INDEX:		return op.pc_disp_index.indirect_info.index_reg;
+		case hop68::MOVEM_REG:			return op.movem_reg.reg_mask;
+		case hop68::D_REGISTER_PAIR:	return op.d_register_pair.dreg1 | (op.d_register_pair.dreg2 << 4);
+		default:
+			break;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Normalised form of an instruction: its shape, and optionally its registers
+static uint64_t get_token(const hop68::instruction& inst, bool abstract_registers)
+{
+	uint64_t token = mix64(instruction_index::make_key(inst));
+	if (!abstract_registers)
+	{
+		token = mix64(token ^ get_operand_registers(inst.op0));
+		token = mix64(token ^ get_operand_registers(inst.op1));
+		token = mix64(token ^ get_operand_registers(inst.op2));
+	}
+	return token;
+}
+
+// ----------------------------------------------------------------------------
+// Summarise the lines [first, end) as a routine. Returns false if it has no
+// windows worth hashing.
+static bool summarise_routine(const disassembly& disasm, size_t first, size_t end, bool abstract_registers,
+	routine_summary& routine)
+{
+	if (end - first < WINDOW_SIZE)
+		return false;
+
+	// ROLLING_PRIME to the power WINDOW_SIZE, to remove the oldest token
+	uint64_t drop_factor = 1;
+	for (size_t i = 0; i < WINDOW_SIZE; ++i)
+		drop_factor *= ROLLING_PRIME;
+
+	for (size_t k = 0; k < DUPLICATE_MINHASH_SIZE; ++k)
+		routine.minhash[k] = 0xffffffff;
+
+	std::vector<uint64_t> tokens(end - first);
+	uint64_t exact = 0;
+	uint64_t rolling = 0;
+	size_t same_run = 0;			// number of identical tokens ending here
+	bool any_window = false;
+	for (size_t i = 0; i < tokens.size(); ++i)
+	{
+		tokens[i] = get_token(disasm.lines[first + i].inst, abstract_registers);
+		exact = mix64(exact ^ tokens[i]);
+		same_run = (i > 0 && tokens[i] == tokens[i - 1]) ? same_run + 1 : 1;
+
+		rolling = rolling * ROLLING_PRIME + tokens[i];
+		if (i >= WINDOW_SIZE)
+			rolling -= tokens[i - WINDOW_SIZE] * drop_factor;
+		if (i + 1 < WINDOW_SIZE)
+			continue;
+
+		// A window of one repeated instruction is usually padding or data
+		if (same_run >= WINDOW_SIZE)
+			continue;
+
+		// One hash function per MinHash value. The window hash is already
+		// well mixed, so a multiply by a different odd constant is enough.
+		uint64_t window = mix64(rolling);
+		for (size_t k = 0; k < DUPLICATE_MINHASH_SIZE; ++k)
+		{
+			uint32_t value = (uint32_t)((window * (0x9e3779b97f4a7c15ULL + 2 * k)) >> 32);
+			routine.minhash[k] = std::min(routine.minhash[k], value);
+		}
+		any_window = true;
+	}
+	if (!any_window)
+		return false;
+
+	const disassembly::line& last = disasm.lines[end - 1];
+	routine.address = disasm.lines[first].address;
+	routine.end_address = last.address + last.inst.byte_count;
+	routine.instruction_count = (uint32_t)tokens.size();
+	routine.exact_hash = mix64(exact ^ tokens.size());
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Find the line at an address, if there is one
+static bool find_line(const disassembly& disasm, uint32_t address, size_t& line_index)
+{
+	struct compare
+	{
+		bool operator()(const disassembly::line& line, uint32_t address) const
+		{
+			return line.address < address;
+		}
+	};
+	std::vector<disassembly::line>::const_iterator it =
+		std::lower_bound(disasm.lines.begin(), disasm.lines.end(), address, compare());
+	if (it == disasm.lines.end() || it->address != address)
+		return false;
+	line_index = it - disasm.lines.begin();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void summarise_routines(const loaded_program& program, uint32_t file_index, bool abstract_registers,
+	std::vector<routine_summary>& routines)
+{
+	const disassembly& disasm = program.disasm;
+	const size_t line_count = disasm.lines.size();
+
+	// Routines start at call targets and after returns. Invalid instructions
+	// and gaps in the disassembly end them too.
+	std::vector<bool> starts(line_count + 1, false);
+	starts[0] = true;
+	starts[line_count] = true;
+	for (size_t i = 0; i < line_count; ++i)
+	{
+		const disassembly::line& line = disasm.lines[i];
+		hop68::FlowKind flow = hop68::calc_flow(line.inst);
+		uint32_t target;
+		size_t target_line;
+		if (flow == hop68::FLOW_CALL && hop68::calc_flow_target(line.inst, line.address, target) &&
+				find_line(disasm, target, target_line))
+			starts[target_line] = true;
+		if (flow == hop68::FLOW_RETURN || flow == hop68::FLOW_STOP)
+			starts[i + 1] = true;
+		if (i + 1 < line_count && line.address + line.inst.byte_count != disasm.lines[i + 1].address)
+			starts[i + 1] = true;
+	}
+
+	size_t first = 0;
+	for (size_t i = 1; i <= line_count; ++i)
+	{
+		if (!starts[i])
+			continue;
+
+		// Leave out a trailing invalid instruction
+		size_t end = i;
+		if (disasm.lines[end - 1].inst.opcode == hop68::Opcode::NONE)
+			--end;
+
+		routine_summary routine;
+		if (end > first && summarise_routine(disasm, first, end, abstract_registers, routine))
+		{
+			routine.file_index = file_index;
+			symbols::sym_map::const_iterator it = program.exe_symbols.table.find(routine.address);
+			if (it != program.exe_symbols.table.end())
+				routine.label = it->second.label;
+			routines.push_back(routine);
+		}
+		first = i;
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	CLUSTERING
+// ----------------------------------------------------------------------------
+static double get_similarity(const routine_summary& a, const routine_summary& b)
+{
+	if (a.exact_hash == b.exact_hash)
+		return 1.0;
+	size_t same = 0;
+	for (size_t k = 0; k < DUPLICATE_MINHASH_SIZE; ++k)
+		same += (a.minhash[k] == b.minhash[k]);
+	return (double)same / DUPLICATE_MINHASH_SIZE;
+}
+
+// ----------------------------------------------------------------------------
+static size_t find_root(std::vector<size_t>& parents, size_t index)
+{
+	while (parents[index] != index)
+	{
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+	return index;
+}
+
+// ----------------------------------------------------------------------------
+static void join(std::vector<size_t>& parents, size_t a, size_t b)
+{
+	a = find_root(parents, a);
+	b = find_root(parents, b);
+	if (a != b)
+		parents[std::max(a, b)] = std::min(a, b);
+}
+
+// ----------------------------------------------------------------------------
+struct duplicate_cluster
+{
+	std::vector<size_t> members;	// routine indices, in input order
+	uint32_t wasted_bytes;			// size of every member after the first
+};
+
+// ----------------------------------------------------------------------------
+static void print_routine(const routine_summary& routine, const std::vector<std::string>& filenames,
+	FILE* pOutput)
+{
+	if (!filenames.empty())
+		fprintf(pOutput, "%s: ", filenames[routine.file_index].c_str());
+	if (!routine.label.empty())
+		fprintf(pOutput, "%s ", routine.label.c_str());
+	fprintf(pOutput, "($%x-$%x, %u instructions)\n", routine.address, routine.end_address,
+		routine.instruction_count);
+}
+
+// ----------------------------------------------------------------------------
+void print_duplicates(const std::vector<routine_summary>& routines,
+	const std::vector<std::string>& filenames, FILE* pOutput)
+{
+	// Each routine is compared with the first routine seen in each of its
+	// bands. Identical routines always share every band.
+	std::vector<size_t> parents(routines.size());
+	for (size_t i = 0; i < routines.size(); ++i)
+		parents[i] = i;
+
+	std::unordered_map<uint64_t, size_t> buckets;
+	buckets.reserve(routines.size() * BAND_COUNT);
+	for (size_t i = 0; i < routines.size(); ++i)
+	{
+		const routine_summary& routine = routines[i];
+		for (size_t band = 0; band < BAND_COUNT; ++band)
+		{
+			uint64_t key = mix64(band);
+			for (size_t row = 0; row < BAND_ROWS; ++row)
+				key = mix64(key ^ routine.minhash[band * BAND_ROWS + row]);
+
+			std::pair<std::unordered_map<uint64_t, size_t>::iterator, bool> result =
+				buckets.insert(std::make_pair(key, i));
+			if (!result.second &&
+					get_similarity(routines[result.first->second], routine) >= SIMILARITY_THRESHOLD)
+				join(parents, result.first->second, i);
+		}
+	}
+
+	// Roots are always the lowest index, so clusters come out in input order
+	std::vector<duplicate_cluster> clusters;
+	std::vector<size_t> cluster_index(routines.size(), (size_t)-1);
+	for (size_t i = 0; i < routines.size(); ++i)
+	{
+		size_t root = find_root(parents, i);
+		if (root == i)
+			continue;
+		if (cluster_index[root] == (size_t)-1)
+		{
+			cluster_index[root] = clusters.size();
+			duplicate_cluster cluster;
+			cluster.members.push_back(root);
+			cluster.wasted_bytes = 0;
+			clusters.push_back(cluster);
+		}
+		duplicate_cluster& cluster = clusters[cluster_index[root]];
+		cluster.members.push_back(i);
+		cluster.wasted_bytes += routines[i].end_address - routines[i].address;
+	}
+
+	struct compare
+	{
+		bool operator()(const duplicate_cluster& a, const duplicate_cluster& b) const
+		{
+			if (a.wasted_bytes != b.wasted_bytes)
+				return a.wasted_bytes > b.wasted_bytes;
+			return a.members[0] < b.members[0];
+		}
+	};
+	std::sort(clusters.begin(), clusters.end(), compare());
+
+	uint64_t total_wasted = 0;
+	for (size_t i = 0; i < clusters.size(); ++i)
+		total_wasted += clusters[i].wasted_bytes;
+
+	fprintf(pOutput, "; Duplicate routines\n");
+	fprintf(pOutput, "; %u routines compared, %u clusters of duplicates, %llu bytes in extra copies\n",
+		(unsigned int)routines.size(), (unsigned int)clusters.size(), (unsigned long long)total_wasted);
+	for (size_t i = 0; i < clusters.size(); ++i)
+	{
+		const duplicate_cluster& cluster = clusters[i];
+		fprintf(pOutput, ";\n; cluster %u: %u routines, %u bytes in extra copies\n",
+			(unsigned int)(i + 1), (unsigned int)cluster.members.size(), cluster.wasted_bytes);
+
+		// Similarity is estimated against the first member
+		const routine_summary& first = routines[cluster.members[0]];
+		for (size_t j = 0; j < cluster.members.size(); ++j)
+		{
+			const routine_summary& routine = routines[cluster.members[j]];
+			double similarity = get_similarity(first, routine);
+			if (routine.exact_hash == first.exact_hash)
+				fprintf(pOutput, ";   same  ");
+			else
+				fprintf(pOutput, ";   %3d%%  ", (int)(similarity * 100.0 + 0.5));
+			print_routine(routine, filenames, pOutput);
+		}
+	}
+}
@@ -0,0 +1,50 @@
+// Finding duplicated and nearly-duplicated routines, in one program or
+// across many.
+//
+// Each routine (code from a call target, or after a return, to the next one)
+// is reduced to the set of hashes of every window of consecutive
+// instructions. Instructions are normalised to their opcode, suffix, operand
+// types and (optionally) registers, so addresses, displacements and
+// immediate values don't matter. Only a fixed-size MinHash signature of each
+// set is kept, and signatures are bucketed by bands (locality-sensitive
+// hashing), so memory stays bounded however many programs are compared.
+#ifndef DUPLICATES_H
+#define DUPLICATES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class loaded_program;
+
+// Number of MinHash values kept for each routine
+static const size_t DUPLICATE_MINHASH_SIZE = 32;
+
+// ----------------------------------------------------------------------------
+// What is kept about each routine.
+struct routine_summary
+{
+	uint32_t	file_index;				// which input this came from
+	uint32_t	address;
+	uint32_t	end_address;
+	uint32_t	instruction_count;
+	std::string	label;					// symbol at the address, if there is one
+	uint64_t	exact_hash;				// hash of every normalised instruction in order
+	uint32_t	minhash[DUPLICATE_MINHASH_SIZE];
+};
+
+// ----------------------------------------------------------------------------
+// Split a program into routines and summarise each one that is long enough
+// to compare. "abstract_registers" ignores register numbers, so code that
+// only differs in register allocation still matches.
+extern void summarise_routines(const loaded_program& program, uint32_t file_index, bool abstract_registers,
+	std::vector<routine_summary>& routines);
+
+// Cluster the routines and print each cluster of duplicates as comments,
+// largest waste first. "filenames" gives the name of each file_index, or is
+// empty to leave filenames out for a single program.
+extern void print_duplicates(const std::vector<routine_summary>& routines,
+	const std::vector<std::string>& filenames, FILE* pOutput);
+
+#endif
@@ -0,0 +1,22 @@
+#!/usr/bin/env sh
+# Build the libFuzzer targets with clang, plus standalone versions for
+# reproducing crashes (run with the failing input files as arguments).
+#
+# Example:
+#   mkdir corpus && cp ../test/*.prg corpus
+#   ./fuzz_tos -max_len=65536 corpus
+set -e
+set -x
+CC=${CC:-clang++}
+CFLAGS="-std=c++11 -g -O1 -Wextra -Wall ${EXTRA_CFLAGS}"
+FUZZ_FLAGS="-fsanitize=fuzzer,address,undefined"
+STANDALONE_FLAGS="-DFUZZ_STANDALONE -fsanitize=address,undefined"
+
+LIB_SRC="../lib/decode68.cpp ../lib/flow68.cpp ../lib/format68.cpp ../lib/instruction68.cpp ../lib/regs68.cpp ../lib/timing68.cpp ../lib/xref68.cpp"
+APP_SRC="../blocks.cpp ../coverage.cpp ../database.cpp ../disk.cpp ../liveness.cpp ../mapfile.cpp ../print.cpp ../process.cpp ../profile.cpp ../scan.cpp ../signatures.cpp ../stats.cpp ../symbols.cpp"
+
+for TARGET in fuzz_decode68 fuzz_tos fuzz_hex fuzz_disk
+do
+	${CC} ${CFLAGS} ${FUZZ_FLAGS} -o ${TARGET} ${TARGET}.cpp ${LIB_SRC} ${APP_SRC}
+	${CC} ${CFLAGS} ${STANDALONE_FLAGS} -o ${TARGET}_standalone ${TARGET}.cpp ${LIB_SRC} ${APP_SRC}
+done
@@ -0,0 +1,35 @@
+// libFuzzer target for hop68::decode.
+// The first byte selects the CPU type; the rest is decoded as a stream of
+// instructions with both decode() and decode_reference(), which must agree.
+#include "fuzz_common.h"
+
+#include "../lib/buffer68.h"
+#include "../lib/decode68.h"
+#include "../lib/instruction68.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size < 1)
+		return 0;
+	fuzz_slow_input_check check(size);
+
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000 + (data[0] & 3);
+	hop68::buffer_reader buf(data + 1, (uint32_t)(size - 1), 0);
+	while (buf.get_remain() >= 2)
+	{
+		hop68::instruction inst;
+		hop68::instruction ref;
+		hop68::buffer_reader buf_copy(buf);
+		hop68::buffer_reader ref_copy(buf);
+		hop68::decode(inst, buf_copy, dsettings);
+		hop68::decode_reference(ref, ref_copy, dsettings);
+		if (inst.opcode != ref.opcode || inst.byte_count != ref.byte_count ||
+			inst.byte_count < 2 || inst.byte_count > buf.get_remain())
+		{
+			abort();
+		}
+		buf.advance(inst.byte_count);
+	}
+	return 0;
+}
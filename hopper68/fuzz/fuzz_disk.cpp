@@ -0,0 +1,30 @@
+// libFuzzer target for disk_image: MSA decompression, the boot sector layout,
+// directories and FAT chains, then reading every file found.
+#include "fuzz_common.h"
+
+#include "../disk.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	fuzz_slow_input_check check(size);
+
+	disk_image image;
+	if (image.open(data, (uint32_t)size))
+		return 0;
+
+	std::vector<disk_entry> entries;
+	image.list_files(entries);
+
+	// Touch every byte returned, so reads outside the image are caught
+	volatile uint8_t sum = 0;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		std::vector<uint8_t> storage;
+		const uint8_t* pData;
+		if (entries[i].is_dir || image.read_file(entries[i], storage, pData))
+			continue;
+		for (uint32_t j = 0; j < entries[i].size; ++j)
+			sum = sum + pData[j];
+	}
+	return 0;
+}
@@ -0,0 +1,24 @@
+// libFuzzer target for process_hex_string.
+// The input is used as the (null-terminated) hex string argument.
+#include "fuzz_common.h"
+
+#include <string>
+
+#include "../process.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	fuzz_slow_input_check check(size);
+
+	std::string hex_string((const char*)data, size);
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68030;
+
+	output_settings osettings = {};
+	osettings.autolabel = true;
+	osettings.label_prefix = "L";
+	osettings.pStats = NULL;
+
+	process_hex_string(hex_string.c_str(), dsettings, osettings, get_fuzz_output());
+	return 0;
+}
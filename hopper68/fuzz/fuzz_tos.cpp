@@ -0,0 +1,32 @@
+// libFuzzer target for process_tos_file: header, symbol, relocation and
+// debug hunk parsing, then labelling and printing.
+// The last byte selects the options; the rest is the executable.
+#include "fuzz_common.h"
+
+#include "../process.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size < 1)
+		return 0;
+	fuzz_slow_input_check check(size);
+
+	const uint8_t options = data[size - 1];
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000 + (options & 3);
+
+	output_settings osettings = {};
+	osettings.show_address = (options & 0x04) != 0;
+	osettings.show_timings = (options & 0x08) != 0;
+	osettings.autolabel = (options & 0x10) == 0;
+	osettings.show_xrefs = (options & 0x20) != 0;
+	osettings.xref_report = (options & 0x40) != 0;
+	osettings.label_prefix = "L";
+	osettings.label_start_id = 0;
+	osettings.base_address = (options & 0x80) ? 0x12340 : 0;
+	osettings.stream = false;
+	osettings.pStats = NULL;
+
+	process_tos_file(data, (long)(size - 1), dsettings, osettings, get_fuzz_output());
+	return 0;
+}
@@ -1,5 +1,12 @@
 #include <assert.h>
 #include <cstddef>
+#include <mutex>
+#ifdef HOPPER68_PROFILE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#endif
 
 #include "instruction68.h"
 #include "buffer68.h"
@@ -347,6 +354,7 @@ int read_immediate(buffer_reader& buffer, operand& operand, Size size)
 	uint16_t val16;
 	uint32_t val32;
 	operand.type = OpType::IMMEDIATE;
+	operand.imm.is_signed = false;
 	switch (size)
 	{
 		case Size::BYTE:
@@ -2159,8 +2167,137 @@ const matcher_entry* g_matcher_tables[16] =
 	g_matcher_table_1111,
 };
 
+#ifdef HOPPER68_PROFILE
+// ===========================================================
+//   DECODER PROFILING
+// ===========================================================
+//
+//	Counts how often each matcher entry is tested and matched, and how many
+//	entries each decode has to test before finding a match. Enable by
+//	building with -DHOPPER68_PROFILE. The counters are not thread-safe, so
+//	profile single-threaded runs.
+static const uint32_t PROFILE_MAX_PROBES = 64;			// larger counts go in the last bucket
+
+struct decode_profile
+{
+	bool					initialised;
+	std::vector<uint64_t>	tested[16];					// per matcher entry
+	std::vector<uint64_t>	cpu_rejected[16];
+	std::vector<uint64_t>	matched[16];
+	uint64_t				probes[16][PROFILE_MAX_PROBES + 1];	// histogram of tests per decode
+	uint64_t				unmatched[16];				// decodes finding no entry
+};
+static decode_profile g_profile;
+
 // ----------------------------------------------------------------------------
-void decode(instruction& inst, buffer_reader& buffer, const decode_settings& dsettings)
+static void write_profile_at_exit()
+{
+	const char* prefix = getenv("HOPPER68_PROFILE_CSV");
+	write_decode_profile(prefix ? prefix : "decode_profile");
+}
+
+// ----------------------------------------------------------------------------
+static void init_profile()
+{
+	for (int table = 0; table < 16; ++table)
+	{
+		size_t count = 0;
+		while (g_matcher_tables[table][count].mask != 0)
+			++count;
+		g_profile.tested[table].assign(count, 0);
+		g_profile.cpu_rejected[table].assign(count, 0);
+		g_profile.matched[table].assign(count, 0);
+	}
+	g_profile.initialised = true;
+	atexit(write_profile_at_exit);
+}
+
+// ----------------------------------------------------------------------------
+static inline void add_profile_probes(uint16_t table, uint32_t probes)
+{
+	if (probes > PROFILE_MAX_PROBES)
+		probes = PROFILE_MAX_PROBES;
+	++g_profile.probes[table][probes];
+}
+
+// ----------------------------------------------------------------------------
+int write_decode_profile(const char* prefix)
+{
+	if (!g_profile.initialised)
+		return 0;
+
+	std::string filename = std::string(prefix) + "_entries.csv";
+	FILE* pFile = fopen(filename.c_str(), "w");
+	if (!pFile)
+		return 1;
+	fprintf(pFile, "table,index,opcode,mask,val,cpu_mask,tested,cpu_rejected,matched\n");
+	for (int table = 0; table < 16; ++table)
+	{
+		for (size_t i = 0; i < g_profile.tested[table].size(); ++i)
+		{
+			const matcher_entry& entry = g_matcher_tables[table][i];
+			fprintf(pFile, "%x,%u,%s,$%04x,$%04x,%u,%llu,%llu,%llu\n", table, (unsigned int)i,
+				get_opcode_string(entry.opcode), entry.mask, entry.val, entry.cpu_mask,
+				(unsigned long long)g_profile.tested[table][i],
+				(unsigned long long)g_profile.cpu_rejected[table][i],
+				(unsigned long long)g_profile.matched[table][i]);
+		}
+	}
+	fclose(pFile);
+
+	// One row per table and probe count, then the totals over all tables
+	filename = std::string(prefix) + "_probes.csv";
+	pFile = fopen(filename.c_str(), "w");
+	if (!pFile)
+		return 1;
+	fprintf(pFile, "table,probes,decodes,unmatched\n");
+	uint64_t totals[PROFILE_MAX_PROBES + 1] = {};
+	for (int table = 0; table < 16; ++table)
+	{
+		for (uint32_t p = 0; p <= PROFILE_MAX_PROBES; ++p)
+		{
+			totals[p] += g_profile.probes[table][p];
+			if (g_profile.probes[table][p])
+				fprintf(pFile, "%x,%u,%llu,\n", table, p, (unsigned long long)g_profile.probes[table][p]);
+		}
+		fprintf(pFile, "%x,,,%llu\n", table, (unsigned long long)g_profile.unmatched[table]);
+	}
+	for (uint32_t p = 0; p <= PROFILE_MAX_PROBES; ++p)
+		if (totals[p])
+			fprintf(pFile, "all,%u,%llu,\n", p, (unsigned long long)totals[p]);
+	fclose(pFile);
+	return 0;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Run the decoder for a matching table entry. "reader_tmp" is positioned
+// after the header word.
+static void decode_entry(const matcher_entry* pEntry, instruction& inst, buffer_reader& reader_tmp,
+	const decode_settings& dsettings, uint16_t header0, uint32_t start_pos)
+{
+	// Do specialised decoding
+	// Set the opcode early, so the function can override.
+	// This is used in some esoteric 68020+ instructions (e.g CHK2), where a bit in the
+	// successive word decides the final opcode.
+	inst.opcode = pEntry->opcode;
+	int res = 0;
+	if (pEntry->func)
+		res = pEntry->func(reader_tmp, dsettings, inst, header0);
+
+	if (res)
+	{
+		// Handle decode func being partway through and failing
+		inst.reset();
+		return;	// failed to decode
+	}
+
+	// Successful decode, fill in the remaining data.
+	inst.byte_count = reader_tmp.get_pos() - start_pos;
+}
+
+// ----------------------------------------------------------------------------
+void decode_reference(instruction& inst, buffer_reader& buffer, const decode_settings& dsettings)
 {
 	inst.reset();
 
@@ -2179,40 +2316,115 @@ void decode(instruction& inst, buffer_reader& buffer, const decode_settings& dse
 	// Make a temp copy of the reader to pass to the decoder, after the first word
 	buffer_reader reader_tmp = buffer;
 	uint16_t table = (header0 >> 12) & 0xf;
+#ifdef HOPPER68_PROFILE
+	if (!g_profile.initialised)
+		init_profile();
+	uint32_t probes = 0;
+#endif
 	for (const matcher_entry* pEntry = g_matcher_tables[table];
 		pEntry->mask!= 0;
 		++pEntry)
 	{
 		assert(((pEntry->val >> 12) & 0xf) == table);
 		assert((pEntry->mask & pEntry->val) == pEntry->val);
+#ifdef HOPPER68_PROFILE
+		const size_t entry_index = pEntry - g_matcher_tables[table];
+		++probes;
+		++g_profile.tested[table][entry_index];
+#endif
 		if ((cpu_mask & pEntry->cpu_mask) == 0)
+		{
+#ifdef HOPPER68_PROFILE
+			++g_profile.cpu_rejected[table][entry_index];
+#endif
 			continue;
+		}
 
 		// Choose 16 or 32 bits for the check
 		uint32_t header = header0;
 		if ((header & pEntry->mask) != pEntry->val)
 			continue;
 
-		// Do specialised decoding
-		// Set the opcode early, so the function can override.
-		// This is used in some esoteric 68020+ instructions (e.g CHK2), where a bit in the
-		// successive word decides the final opcode.
-		inst.opcode = pEntry->opcode;
-		int res = 0;
-		if (pEntry->func)
-			res = pEntry->func(reader_tmp, dsettings, inst, header);
+#ifdef HOPPER68_PROFILE
+		++g_profile.matched[table][entry_index];
+		add_profile_probes(table, probes);
+#endif
+		decode_entry(pEntry, inst, reader_tmp, dsettings, header0, start_pos);
+		return;
+	}
+#ifdef HOPPER68_PROFILE
+	add_profile_probes(table, probes);
+	++g_profile.unmatched[table];
+#endif
+}
 
-		if (res)
+// ===========================================================
+//   DISPATCH TABLES
+// ===========================================================
+//
+//	The first matching entry only depends on the header word and CPU type,
+//	so it is looked up once per header and stored in a table per CPU.
+//	Tables are built on first use for each CPU type.
+static const int NUM_DISPATCH_CPUS = CPU_TYPE_68030 + 1;
+static const uint8_t DISPATCH_NO_MATCH = 0xff;
+
+static uint8_t g_dispatch_tables[NUM_DISPATCH_CPUS][0x10000];
+static std::once_flag g_dispatch_once[NUM_DISPATCH_CPUS];
+
+// ----------------------------------------------------------------------------
+static void build_dispatch_table(int cpu_type)
+{
+	uint8_t* pTable = g_dispatch_tables[cpu_type];
+	const uint32_t cpu_mask = 1U << cpu_type;
+	for (uint32_t header = 0; header < 0x10000; ++header)
+	{
+		const matcher_entry* pFirst = g_matcher_tables[header >> 12];
+		uint8_t index = DISPATCH_NO_MATCH;
+		for (const matcher_entry* pEntry = pFirst; pEntry->mask != 0; ++pEntry)
 		{
-			// Handle decode func being partway through and failing
-			inst.reset();
-			return;	// failed to decode
+			if ((cpu_mask & pEntry->cpu_mask) != 0 && (header & pEntry->mask) == pEntry->val)
+			{
+				assert(pEntry - pFirst < DISPATCH_NO_MATCH);
+				index = (uint8_t)(pEntry - pFirst);
+				break;
+			}
 		}
+		pTable[header] = index;
+	}
+}
 
-		// Successful decode, fill in the remaining data.
-		inst.byte_count = reader_tmp.get_pos() - start_pos;
+// ----------------------------------------------------------------------------
+void decode(instruction& inst, buffer_reader& buffer, const decode_settings& dsettings)
+{
+#ifdef HOPPER68_PROFILE
+	// Profile the matcher tables rather than the dispatch tables
+	decode_reference(inst, buffer, dsettings);
+#else
+	const int cpu_type = dsettings.cpu_type;
+	if (cpu_type < 0 || cpu_type >= NUM_DISPATCH_CPUS)
+	{
+		decode_reference(inst, buffer, dsettings);
 		return;
 	}
+	std::call_once(g_dispatch_once[cpu_type], build_dispatch_table, cpu_type);
+
+	inst.reset();
+	if (buffer.get_remain() < 2)
+		return;
+
+	uint16_t header0 = 0;
+	uint32_t start_pos = buffer.get_pos();
+	inst.address = buffer.get_address();
+	buffer.read_word(header0);
+	inst.header = header0;
+
+	uint8_t index = g_dispatch_tables[cpu_type][header0];
+	if (index == DISPATCH_NO_MATCH)
+		return;
+
+	// Make a temp copy of the reader to pass to the decoder, after the first word
+	buffer_reader reader_tmp = buffer;
+	decode_entry(&g_matcher_tables[header0 >> 12][index], inst, reader_tmp, dsettings, header0, start_pos);
+#endif
 }
 }
-
@@ -23,5 +23,18 @@ struct decode_settings
 // size of 2, if no match was found.
 extern void decode(instruction& inst, buffer_reader& buffer, const decode_settings& dsettings);
 
+// Decode by testing each matcher table entry in turn. This gives the same
+// results as decode(), which uses a precalculated lookup of the matching entry,
+// so is used as the reference for checking it.
+extern void decode_reference(instruction& inst, buffer_reader& buffer, const decode_settings& dsettings);
+
+#ifdef HOPPER68_PROFILE
+// Write the decoder profile counters to "<prefix>_entries.csv" and "<prefix>_probes.csv".
+// This happens automatically at exit, using the HOPPER68_PROFILE_CSV environment
+// variable as the prefix (default "decode_profile").
+// Returns 0 for success, 1 for failure.
+extern int write_decode_profile(const char* prefix);
+#endif
+
 }
 #endif
@@ -0,0 +1,80 @@
+#include "flow68.h"
+
+#include "instruction68.h"
+#include "xref68.h"
+
+namespace hop68
+{
+// ----------------------------------------------------------------------------
+FlowKind calc_flow(const instruction& inst)
+{
+	if (inst.opcode >= Opcode::DBCC && inst.opcode <= Opcode::DBVS)
+		return FLOW_BRANCH;
+
+	switch (inst.opcode)
+	{
+		case Opcode::BCC:
+		case Opcode::BCS:
+		case Opcode::BEQ:
+		case Opcode::BGE:
+		case Opcode::BGT:
+		case Opcode::BHI:
+		case Opcode::BLE:
+		case Opcode::BLS:
+		case Opcode::BLT:
+		case Opcode::BMI:
+		case Opcode::BNE:
+		case Opcode::BPL:
+		case Opcode::BVC:
+		case Opcode::BVS:
+			return FLOW_BRANCH;
+		case Opcode::BRA:
+		case Opcode::JMP:
+			return FLOW_JUMP;
+		case Opcode::BSR:
+		case Opcode::JSR:
+			return FLOW_CALL;
+		case Opcode::RTD:
+		case Opcode::RTE:
+		case Opcode::RTM:
+		case Opcode::RTR:
+		case Opcode::RTS:
+			return FLOW_RETURN;
+		case Opcode::NONE:
+		case Opcode::ILLEGAL:
+		case Opcode::STOP:
+			return FLOW_STOP;
+		default:
+			break;
+	}
+	return FLOW_NONE;
+}
+
+// ----------------------------------------------------------------------------
+bool calc_flow_target(const instruction& inst, uint32_t inst_address, uint32_t& target_address)
+{
+	switch (calc_flow(inst))
+	{
+		case FLOW_BRANCH:
+			// DBcc has the register first
+			if (inst.op0.type == OpType::RELATIVE_BRANCH)
+				return calc_operand_target(inst.op0, inst_address, target_address);
+			if (inst.op1.type == OpType::RELATIVE_BRANCH)
+				return calc_operand_target(inst.op1, inst_address, target_address);
+			return false;
+		case FLOW_JUMP:
+		case FLOW_CALL:
+			// Indexed modes are jump tables, where the operand is only the base
+			if (inst.op0.type == OpType::RELATIVE_BRANCH ||
+				inst.op0.type == OpType::PC_DISP ||
+				inst.op0.type == OpType::ABSOLUTE_WORD ||
+				inst.op0.type == OpType::ABSOLUTE_LONG)
+				return calc_operand_target(inst.op0, inst_address, target_address);
+			return false;
+		default:
+			break;
+	}
+	return false;
+}
+
+}
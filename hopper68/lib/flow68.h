@@ -0,0 +1,31 @@
+#ifndef HOPPER68_FLOW_H
+#define HOPPER68_FLOW_H
+
+#include <cstdint>
+
+namespace hop68
+{
+struct instruction;
+
+// ----------------------------------------------------------------------------
+//	CONTROL FLOW
+// ----------------------------------------------------------------------------
+// How an instruction affects the flow of execution.
+enum FlowKind
+{
+	FLOW_NONE,			// continues to the next instruction
+	FLOW_BRANCH,		// conditional: Bcc and DBcc, can continue or branch
+	FLOW_JUMP,			// unconditional: BRA and JMP
+	FLOW_CALL,			// BSR and JSR, expected to return to the next instruction
+	FLOW_RETURN,		// RTS, RTE, RTR, RTD, RTM
+	FLOW_STOP			// never continues: ILLEGAL, STOP, and invalid data
+};
+
+// Classify an instruction's effect on control flow.
+extern FlowKind calc_flow(const instruction& inst);
+
+// Calculate the fixed destination of a branch, jump or call, if there is one.
+// Returns false for computed destinations such as "jmp (a0)" or "jmp 2(pc,d0.w)".
+extern bool calc_flow_target(const instruction& inst, uint32_t inst_address, uint32_t& target_address);
+}
+#endif
@@ -0,0 +1,436 @@
+#include "format68.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "instruction68.h"
+
+namespace hop68
+{
+// ----------------------------------------------------------------------------
+//	TEXT OUTPUT
+// ----------------------------------------------------------------------------
+// Appends text to a fixed-size buffer. Text past the end of the buffer is
+// dropped but still counted, so the caller can find the size required.
+class text_writer
+{
+public:
+	text_writer(char* buffer, size_t size) :
+		m_pBuffer(buffer),
+		m_size(size),
+		m_length(0)
+	{
+		if (m_size)
+			m_pBuffer[0] = 0;
+	}
+
+	void append(const char* pFormat, ...)
+#ifdef __GNUC__
+		__attribute__((format(printf, 2, 3)))
+#endif
+	{
+		va_list args;
+		va_start(args, pFormat);
+		char* pDest = NULL;
+		size_t space = 0;
+		if (m_length < m_size)
+		{
+			pDest = m_pBuffer + m_length;
+			space = m_size - m_length;
+		}
+		int len = vsnprintf(pDest, space, pFormat, args);
+		va_end(args);
+		if (len > 0)
+			m_length += (size_t)len;
+	}
+
+	void append_char(char c)
+	{
+		if (m_length + 1 < m_size)
+		{
+			m_pBuffer[m_length] = c;
+			m_pBuffer[m_length + 1] = 0;
+		}
+		++m_length;
+	}
+
+	size_t get_length() const		{ return m_length; }
+
+private:
+	char*		m_pBuffer;
+	size_t		m_size;
+	size_t		m_length;				// full length of the text, even if truncated
+};
+
+// ----------------------------------------------------------------------------
+static const char* find_label(const format_symbols* pSymbols, uint32_t address)
+{
+	if (!pSymbols || !pSymbols->find_label)
+		return NULL;
+	return pSymbols->find_label(pSymbols->user_data, address);
+}
+
+// ----------------------------------------------------------------------------
+static const char* find_reloc_label(const format_symbols* pSymbols, uint32_t reloc_address, uint32_t value)
+{
+	if (!pSymbols || !pSymbols->find_reloc_label)
+		return NULL;
+	return pSymbols->find_reloc_label(pSymbols->user_data, reloc_address, value);
+}
+
+// ----------------------------------------------------------------------------
+//	INSTRUCTION DISPLAY FORMATTING
+// ----------------------------------------------------------------------------
+bool calc_relative_address(const operand& op, uint32_t inst_address, uint32_t& target_address)
+{
+	if (op.type == PC_DISP)
+	{
+		target_address = inst_address + op.pc_disp.inst_disp;
+		return true;
+	}
+	else if (op.type == PC_DISP_INDEX)
+	{
+		target_address = inst_address + op.pc_disp_index.inst_disp;
+		return true;
+	}
+	else if (op.type == RELATIVE_BRANCH)
+	{
+		target_address = inst_address + op.relative_branch.inst_disp;
+		return true;
+	}
+	else if (op.type == INDIRECT_POSTINDEXED || op.type == INDIRECT_PREINDEXED ||
+			 op.type == MEMORY_INDIRECT || op.type == NO_MEMORY_INDIRECT)
+	{
+		if (op.indirect_index_68020.base_register == INDEX_REG_PC)
+		{
+			target_address = inst_address + op.indirect_index_68020.base_displacement;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+static void format_index_indirect(const index_indirect& ind, text_writer& out)
+{
+	if (ind.index_reg == INDEX_REG_NONE)
+		return;
+	out.append("%s.%s%s",
+		get_index_register_string(ind.index_reg),
+		ind.is_long ? "l" : "w",
+		get_scale_shift_string(ind.scale_shift));
+}
+
+// ----------------------------------------------------------------------------
+static void format_bitfield_number(uint8_t is_reg, uint8_t offset, text_writer& out)
+{
+	if (is_reg)
+		out.append("d%u", offset & 7);
+	else
+		out.append("%u", offset);
+}
+
+// ----------------------------------------------------------------------------
+static void format_bitfield(const bitfield& bf, text_writer& out)
+{
+	out.append_char('{');
+	format_bitfield_number(bf.offset_is_dreg, bf.offset, out);
+	out.append_char(':');
+	format_bitfield_number(bf.width_is_dreg, bf.width, out);
+	out.append_char('}');
+}
+
+// ----------------------------------------------------------------------------
+enum LastOutput
+{
+	kNone,			// start token
+	kValue,			// number or similar
+	kComma,			// ','
+	kOpenBrace,		// '['
+	kCloseBrace		// ']'
+};
+
+// ----------------------------------------------------------------------------
+static void open_brace(LastOutput& last, bool& is_brace_open, text_writer& out)
+{
+	if (!is_brace_open)
+	{
+		is_brace_open = true;
+		last = kOpenBrace;
+		out.append_char('[');
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void close_brace(LastOutput& last, bool& is_brace_open, text_writer& out)
+{
+	if (is_brace_open)
+	{
+		last = kCloseBrace;
+		out.append_char(']');
+		return;
+	}
+	is_brace_open = false;
+}
+
+// ----------------------------------------------------------------------------
+static void insert_comma(LastOutput& last, text_writer& out)
+{
+	if (last == kValue || last == kCloseBrace)
+	{
+		last = kComma;
+		out.append_char(',');
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void format_indexed_68020(const indirect_index_full& ref, const format_symbols* pSymbols,
+	int brace_open, int brace_close, uint32_t inst_address, text_writer& out)
+{
+	out.append_char('(');
+	LastOutput last = kNone;
+	bool is_brace_open = false;
+	for (int index = 0; index < 4; ++index)
+	{
+		if (ref.used[index])
+		{
+			// if an item is printed, we might need to open a brace or
+			// insert a separating comma
+			if (index >= brace_open && index <= brace_close)
+				open_brace(last, is_brace_open, out);
+			insert_comma(last, out);
+			switch (index)
+			{
+				case 0:
+					if (ref.base_register == IndexRegister::INDEX_REG_PC)
+					{
+						// Decode PC-relative addresses
+						uint32_t address = ref.base_displacement + inst_address;
+						const char* label = find_label(pSymbols, address);
+						if (label)
+							out.append("%s", label);
+						else
+							out.append("$%x", address);
+					}
+					else
+						out.append("$%x", ref.base_displacement);
+					break;
+				case 1:
+					out.append("%s", get_index_register_string(ref.base_register)); break;
+				case 2:
+					format_index_indirect(ref.index, out); break;
+				case 3:
+					out.append("$%x", ref.outer_displacement); break;
+			}
+			last = kValue;
+		}
+		// Brace might need to be closed whether even if a new value wasn't printed
+		if (index == brace_close)
+			close_brace(last, is_brace_open, out);
+	}
+	out.append_char(')');
+}
+
+// ----------------------------------------------------------------------------
+static void format_operand(const operand& operand, const format_symbols* pSymbols, uint32_t inst_address,
+	text_writer& out)
+{
+	switch (operand.type)
+	{
+		case OpType::D_DIRECT:
+			out.append("d%d", operand.d_register.reg);
+			return;
+		case OpType::A_DIRECT:
+			out.append("a%d", operand.a_register.reg);
+			return;
+		case OpType::INDIRECT:
+			out.append("(a%d)", operand.indirect.reg);
+			return;
+		case INDIRECT_POSTINC:
+			out.append("(a%d)+", operand.indirect_postinc.reg);
+			return;
+		case OpType::INDIRECT_PREDEC:
+			out.append("-(a%d)", operand.indirect_predec.reg);
+			return;
+		case OpType::INDIRECT_DISP:
+			out.append("%d(a%d)", operand.indirect_disp.disp, operand.indirect_disp.reg);
+			return;
+		case OpType::INDIRECT_INDEX:
+			out.append("%d(a%d,", operand.indirect_index.disp, operand.indirect_index.a_reg);
+			format_index_indirect(operand.indirect_index.indirect_info, out);
+			out.append_char(')');
+			return;
+		case OpType::ABSOLUTE_WORD:
+			if (operand.absolute_word.wordaddr & 0x8000)
+				out.append("$ffff%x.w", operand.absolute_word.wordaddr);
+			else
+				out.append("$%x.w", operand.absolute_word.wordaddr);
+			return;
+		case OpType::ABSOLUTE_LONG:
+		{
+			const char* label = find_label(pSymbols, operand.absolute_long.longaddr);
+			if (label)
+				out.append("%s", label);
+			else
+				out.append("$%x.l", operand.absolute_long.longaddr);
+			return;
+		}
+		case OpType::PC_DISP:
+		{
+			uint32_t target_address;
+			calc_relative_address(operand, inst_address, target_address);
+			const char* label = find_label(pSymbols, target_address);
+			if (label)
+				out.append("%s(pc)", label);
+			else
+				out.append("$%x(pc)", target_address);
+			return;
+		}
+		case OpType::PC_DISP_INDEX:
+		{
+			uint32_t target_address;
+			calc_relative_address(operand, inst_address, target_address);
+			const char* label = find_label(pSymbols, target_address);
+			if (label)
+				out.append("%s(pc,", label);
+			else
+				out.append("$%x(pc,", target_address);
+			out.append("%s.%s%s)",
+				get_index_register_string(operand.pc_disp_index.indirect_info.index_reg),
+				operand.pc_disp_index.indirect_info.is_long ? "l" : "w",
+				get_scale_shift_string(operand.pc_disp_index.indirect_info.scale_shift));
+			return;
+		}
+		case OpType::MOVEM_REG:
+		{
+			bool first = true;
+			for (int i = 0; i < 16; ++i)
+				if (operand.movem_reg.reg_mask & (1 << i))
+				{
+					if (!first)
+						out.append_char('/');
+					out.append("%s", get_movem_reg_string(i));
+					first = false;
+				}
+			return;
+		}
+		case OpType::RELATIVE_BRANCH:
+		{
+			uint32_t target_address;
+			calc_relative_address(operand, inst_address, target_address);
+			const char* label = find_label(pSymbols, target_address);
+			if (label)
+				out.append("%s", label);
+			else
+				out.append("$%x", target_address);
+			return;
+		}
+		case OpType::INDIRECT_POSTINDEXED:
+			format_indexed_68020(operand.indirect_index_68020, pSymbols, 0, 1, inst_address, out);
+			return;
+		case OpType::INDIRECT_PREINDEXED:
+			format_indexed_68020(operand.indirect_index_68020, pSymbols, 0, 2, inst_address, out);
+			return;
+		case OpType::MEMORY_INDIRECT:
+			// This is the same as postindexed, except IS is suppressed!
+			format_indexed_68020(operand.indirect_index_68020, pSymbols, 0, 1, inst_address, out);
+			return;
+		case OpType::NO_MEMORY_INDIRECT:
+			format_indexed_68020(operand.indirect_index_68020, pSymbols, -1, -1, inst_address, out);
+			return;
+		case OpType::IMMEDIATE:
+		{
+			// Special case: show long immediates as labels, if we know a reloc
+			// has taken place here.
+			// We know the reloc has to be at +2 in the instruction, since it is
+			// always a source operand for immediates.
+			if (operand.imm.size == Size::LONG)
+			{
+				const char* label = find_reloc_label(pSymbols, inst_address + 2, operand.imm.val0);
+				if (label)
+				{
+					out.append("#%s", label);
+					return;
+				}
+			}
+			if (operand.imm.is_signed && (int32_t)operand.imm.val0 < 0)
+				out.append("#-$%x", -(int32_t)operand.imm.val0);
+			else
+				out.append("#$%x", operand.imm.val0);
+			return;
+		}
+		case OpType::D_REGISTER_PAIR:
+			out.append("d%u:d%u", operand.d_register_pair.dreg1, operand.d_register_pair.dreg2);
+			return;
+		case OpType::INDIRECT_REGISTER_PAIR:
+			out.append("(%s):(%s)",
+				get_index_register_string(operand.indirect_register_pair.reg1),
+				get_index_register_string(operand.indirect_register_pair.reg2));
+			return;
+		case OpType::SR:
+			out.append("sr");
+			return;
+		case OpType::USP:
+			out.append("usp");
+			return;
+		case OpType::CCR:
+			out.append("ccr");
+			return;
+		case OpType::CONTROL_REGISTER:
+			out.append("%s", get_control_register_string(operand.control_register.cr));
+			return;
+		default:
+			out.append("???");
+			return;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static char interpret_ascii(unsigned char i)
+{
+	if (i >= 32 && i < 128)
+		return (char)i;
+	return '.';
+}
+
+// ----------------------------------------------------------------------------
+size_t format(const instruction& inst, uint32_t inst_address, const format_symbols* pSymbols,
+	char* buffer, size_t size)
+{
+	text_writer out(buffer, size);
+	if (inst.opcode == Opcode::NONE)
+	{
+		out.append("dc.w     $%04x  ; %c%c", inst.header,
+			interpret_ascii(inst.header >> 8),
+			interpret_ascii(inst.header & 0xff));
+		return out.get_length();
+	}
+	out.append("%s%s", get_opcode_string(inst.opcode), get_suffix_string(inst.suffix));
+	if (inst.op0.type == OpType::INVALID)
+		return out.get_length(); // early out with no operands, avoids trailing spaces
+
+	while (out.get_length() < 9)
+		out.append_char(' ');
+
+	format_operand(inst.op0, pSymbols, inst_address, out);
+
+	if (inst.bf0.valid)
+		format_bitfield(inst.bf0, out);
+
+	if (inst.op1.type != OpType::INVALID)
+	{
+		out.append_char(',');
+		format_operand(inst.op1, pSymbols, inst_address, out);
+	}
+	if (inst.bf1.valid)
+		format_bitfield(inst.bf1, out);
+
+	if (inst.op2.type != OpType::INVALID)
+	{
+		out.append_char(',');
+		format_operand(inst.op2, pSymbols, inst_address, out);
+	}
+	return out.get_length();
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef HOPPER68_FORMAT_H
+#define HOPPER68_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hop68
+{
+struct instruction;
+struct operand;
+
+// ----------------------------------------------------------------------------
+//	INSTRUCTION TEXT FORMATTING
+// ----------------------------------------------------------------------------
+// Optional symbol lookups used when formatting. Either function can be NULL.
+// Returned strings only need to stay valid until the lookup function is
+// called again, or format() returns.
+struct format_symbols
+{
+	// Returns the label at an address, or NULL if there is none.
+	const char* (*find_label)(void* user_data, uint32_t address);
+
+	// Returns the label to use for a long immediate "value" that was relocated
+	// at "reloc_address", or NULL to print the value as a number.
+	const char* (*find_reloc_label)(void* user_data, uint32_t reloc_address, uint32_t value);
+
+	void* user_data;
+};
+
+// Calculate the address used by a PC-relative operand or branch.
+// Returns false if the operand is not PC-relative.
+extern bool calc_relative_address(const operand& op, uint32_t inst_address, uint32_t& target_address);
+
+// Write the instruction's opcode and operands as text into "buffer", which is
+// always null-terminated if "size" is non-zero. Text which does not fit is
+// truncated. No memory is allocated.
+// "pSymbols" can be NULL to print all addresses as numbers.
+// Returns the length of the full text (excluding the terminator), like
+// snprintf(), so a return value >= size means the text was truncated.
+extern size_t format(const instruction& inst, uint32_t inst_address, const format_symbols* pSymbols,
+	char* buffer, size_t size);
+
+}
+#endif
@@ -0,0 +1,142 @@
+// C interface to the decoder. See libhop68.h.
+#include "libhop68.h"
+
+#include <new>
+
+#include "buffer68.h"
+#include "decode68.h"
+#include "format68.h"
+#include "instruction68.h"
+#include "xref68.h"
+
+static_assert(sizeof(hop68::instruction) <= HOP68_INST_STORAGE_SIZE,
+	"HOP68_INST_STORAGE_SIZE is too small for hop68::instruction");
+static_assert(alignof(hop68::instruction) <= alignof(uint64_t),
+	"hop68_inst storage is not aligned enough for hop68::instruction");
+
+static_assert(HOP68_CPU_68030 - HOP68_CPU_68000 == hop68::CPU_TYPE_68030 - hop68::CPU_TYPE_68000,
+	"CPU types do not match");
+static_assert(HOP68_TARGET_READ - 1 == hop68::XREF_READ && HOP68_TARGET_CALL - 1 == hop68::XREF_CALL,
+	"Target kinds do not match");
+
+// ----------------------------------------------------------------------------
+static bool is_valid_cpu(int cpu_type)
+{
+	return cpu_type >= HOP68_CPU_68000 && cpu_type <= HOP68_CPU_68030;
+}
+
+// ----------------------------------------------------------------------------
+static const hop68::instruction& get_instruction(const hop68_inst* inst)
+{
+	return *reinterpret_cast<const hop68::instruction*>(inst->storage);
+}
+
+// ----------------------------------------------------------------------------
+// Decode from the reader's position, and fill in the public fields
+static void decode_inst(hop68::buffer_reader& buf, const hop68::decode_settings& dsettings, hop68_inst* inst)
+{
+	hop68::instruction& decoded = *new (inst->storage) hop68::instruction;
+	hop68::decode(decoded, buf, dsettings);
+
+	inst->address = decoded.address;
+	inst->byte_count = decoded.byte_count;
+	inst->valid = decoded.opcode != hop68::Opcode::NONE;
+	inst->target_kind = HOP68_TARGET_NONE;
+	inst->target = 0;
+	if (!inst->valid)
+	{
+		inst->opcode = "dc.w";
+		inst->suffix = "";
+		return;
+	}
+	inst->opcode = hop68::get_opcode_string(decoded.opcode);
+	inst->suffix = hop68::get_suffix_string(decoded.suffix);
+
+	const hop68::operand* ops[3] = { &decoded.op0, &decoded.op1, &decoded.op2 };
+	for (int slot = 0; slot < 3; ++slot)
+	{
+		uint32_t target;
+		if (hop68::calc_operand_target(*ops[slot], decoded.address, target))
+		{
+			inst->target_kind = (uint8_t)(HOP68_TARGET_READ + hop68::calc_xref_kind(decoded, slot));
+			inst->target = target;
+			break;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+int hop68_get_api_version(void)
+{
+	return HOP68_API_VERSION;
+}
+
+// ----------------------------------------------------------------------------
+int hop68_init(int cpu_type)
+{
+	if (!is_valid_cpu(cpu_type))
+		return 1;
+
+	// Decoding anything builds the table
+	static const uint8_t nop[2] = { 0x4e, 0x71 };
+	hop68_inst inst;
+	return hop68_decode(nop, sizeof(nop), 0, cpu_type, &inst);
+}
+
+// ----------------------------------------------------------------------------
+int hop68_decode(const uint8_t* data, uint32_t size, uint32_t address, int cpu_type,
+	hop68_inst* inst)
+{
+	if (!data || !inst || size < 2 || !is_valid_cpu(cpu_type))
+		return 1;
+
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000 + (cpu_type - HOP68_CPU_68000);
+	hop68::buffer_reader buf(data, size, address);
+	decode_inst(buf, dsettings, inst);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+uint32_t hop68_decode_range(const uint8_t* data, uint32_t size, uint32_t address, int cpu_type,
+	hop68_decode_callback callback, void* user_data)
+{
+	if (!data || !callback || !is_valid_cpu(cpu_type))
+		return 0;
+
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000 + (cpu_type - HOP68_CPU_68000);
+	hop68::buffer_reader buf(data, size, address);
+	hop68_inst inst;
+	while (buf.get_remain() >= 2)
+	{
+		// decode uses a copy of the buffer state
+		hop68::buffer_reader buf_copy(buf);
+		decode_inst(buf_copy, dsettings, &inst);
+		buf.advance(inst.byte_count);
+		if (callback(&inst, user_data) != 0)
+			break;
+	}
+	return buf.get_pos();
+}
+
+// ----------------------------------------------------------------------------
+size_t hop68_format(const hop68_inst* inst, const hop68_symbols* symbols, char* buffer, size_t size)
+{
+	if (!inst)
+	{
+		if (size)
+			buffer[0] = 0;
+		return 0;
+	}
+
+	hop68::format_symbols lookups = { NULL, NULL, NULL };
+	if (symbols)
+	{
+		lookups.find_label = symbols->find_label;
+		lookups.find_reloc_label = symbols->find_reloc_label;
+		lookups.user_data = symbols->user_data;
+	}
+	const hop68::instruction& decoded = get_instruction(inst);
+	return hop68::format(decoded, decoded.address, &lookups, buffer, size);
+}
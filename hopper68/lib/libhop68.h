@@ -0,0 +1,120 @@
+/* C interface to the 68000 decoder, for embedding in other programs.
+ *
+ * None of these functions allocate memory. Instructions are decoded into
+ * storage owned by the caller, and text is written to a caller-supplied
+ * buffer, so they are safe to call every frame, e.g. from a debugger.
+ * All functions are thread-safe.
+ *
+ * The interface is stable: structures are only ever extended at the end,
+ * and HOP68_API_VERSION is increased when that happens.
+ */
+#ifndef LIBHOP68_H
+#define LIBHOP68_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOP68_API_VERSION		1
+
+/* Only these functions are exported when building a shared library with
+ * -fvisibility=hidden */
+#if defined(__GNUC__)
+#define HOP68_API __attribute__((visibility("default")))
+#else
+#define HOP68_API
+#endif
+
+/* Size of the private decoded form stored in each hop68_inst */
+#define HOP68_INST_STORAGE_SIZE	256
+
+enum hop68_cpu
+{
+	HOP68_CPU_68000,
+	HOP68_CPU_68010,
+	HOP68_CPU_68020,
+	HOP68_CPU_68030
+};
+
+/* How an instruction uses its target address */
+enum hop68_target_kind
+{
+	HOP68_TARGET_NONE,
+	HOP68_TARGET_READ,
+	HOP68_TARGET_WRITE,
+	HOP68_TARGET_BRANCH,
+	HOP68_TARGET_CALL
+};
+
+/* A decoded instruction. Only the public fields should be read. */
+typedef struct hop68_inst
+{
+	uint32_t	address;		/* address of the first byte */
+	uint16_t	byte_count;		/* size in bytes; 2 for invalid data */
+	uint8_t		valid;			/* 0 if the data is not a valid instruction */
+	uint8_t		target_kind;	/* hop68_target_kind of the first fixed address used */
+	uint32_t	target;			/* that address, when target_kind is not HOP68_TARGET_NONE */
+	const char*	opcode;			/* opcode name e.g. "move", or "dc.w" if invalid */
+	const char*	suffix;			/* size suffix e.g. ".l", or "" */
+
+	/* Private: the full decoded form, used by hop68_format() */
+	uint64_t	storage[HOP68_INST_STORAGE_SIZE / 8];
+} hop68_inst;
+
+/* Called for each instruction by hop68_decode_range().
+ * Return 0 to continue, or non-zero to stop decoding. */
+typedef int (*hop68_decode_callback)(const hop68_inst* inst, void* user_data);
+
+/* Optional label lookups for hop68_format(). Either function can be NULL.
+ * Returned strings must stay valid until the next lookup call. */
+typedef struct hop68_symbols
+{
+	/* Returns the label at "address", or NULL */
+	const char* (*find_label)(void* user_data, uint32_t address);
+
+	/* Returns the label for a long immediate "value" which was relocated at
+	 * "reloc_address", or NULL to print the number */
+	const char* (*find_reloc_label)(void* user_data, uint32_t reloc_address, uint32_t value);
+
+	void*		user_data;
+} hop68_symbols;
+
+/* Returns HOP68_API_VERSION of the library, to check against the header. */
+extern HOP68_API int hop68_get_api_version(void);
+
+/* Build the decoder's lookup tables for a CPU type. Decoding does this on
+ * first use, so calling this is optional, but it avoids a one-off delay.
+ * Returns 0 for success, 1 for an unknown CPU type. */
+extern HOP68_API int hop68_init(int cpu_type);
+
+/* Decode one instruction from "data", which is located at "address".
+ * Data which is not a valid instruction is returned as a single
+ * 2-byte word with "valid" set to 0.
+ * Returns 0 for success, 1 if there are fewer than 2 bytes or the
+ * arguments are invalid. */
+extern HOP68_API int hop68_decode(const uint8_t* data, uint32_t size, uint32_t address, int cpu_type,
+	hop68_inst* inst);
+
+/* Decode consecutive instructions from "data", which is located at
+ * "address", calling "callback" for each one until the data runs out or
+ * the callback returns non-zero. A single hop68_inst on the stack is reused
+ * for each call, so callers must copy anything they want to keep.
+ * Returns the number of bytes decoded. */
+extern HOP68_API uint32_t hop68_decode_range(const uint8_t* data, uint32_t size, uint32_t address, int cpu_type,
+	hop68_decode_callback callback, void* user_data);
+
+/* Write the instruction as text e.g. "move.l   d0,$10(a0)" into "buffer",
+ * which is always null-terminated if "size" is non-zero. "symbols" can be
+ * NULL to show all addresses as numbers.
+ * Returns the length of the full text like snprintf(), so a result >= size
+ * means the text was truncated. */
+extern HOP68_API size_t hop68_format(const hop68_inst* inst, const hop68_symbols* symbols, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
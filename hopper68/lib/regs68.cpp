@@ -0,0 +1,516 @@
+#include "regs68.h"
+
+#include "instruction68.h"
+
+namespace hop68
+{
+// How an instruction uses each operand
+enum Access
+{
+	ACCESS_NONE,
+	ACCESS_READ,
+	ACCESS_WRITE,
+	ACCESS_READ_WRITE,
+	ACCESS_ADDRESS			// only the effective address is used, e.g. LEA, JMP
+};
+
+// ----------------------------------------------------------------------------
+// What each opcode does, apart from the registers named in its operands.
+struct opcode_use
+{
+	uint8_t access[3];			// Access for op0, op1, op2
+	uint32_t flags_read;
+	uint32_t flags_written;
+	uint32_t implicit_read;		// e.g. the stack pointer
+	uint32_t implicit_written;
+	bool full_write;			// data registers are written in full whatever the suffix
+	bool memory_read;			// implicit memory use, e.g. RTS reading the stack
+	bool memory_written;
+};
+
+// ----------------------------------------------------------------------------
+uint32_t calc_condition_flags(const instruction& inst)
+{
+	switch (inst.opcode)
+	{
+		case Opcode::BHI: case Opcode::DBHI: case Opcode::SHI: case Opcode::TRAPHI:
+		case Opcode::BLS: case Opcode::DBLS: case Opcode::SLS: case Opcode::TRAPLS:
+			return FLAG_C | FLAG_Z;
+		case Opcode::BCC: case Opcode::DBCC: case Opcode::SCC: case Opcode::TRAPCC:
+		case Opcode::BCS: case Opcode::DBCS: case Opcode::SCS: case Opcode::TRAPCS:
+			return FLAG_C;
+		case Opcode::BNE: case Opcode::DBNE: case Opcode::SNE: case Opcode::TRAPNE:
+		case Opcode::BEQ: case Opcode::DBEQ: case Opcode::SEQ: case Opcode::TRAPEQ:
+			return FLAG_Z;
+		case Opcode::BVC: case Opcode::DBVC: case Opcode::SVC: case Opcode::TRAPVC:
+		case Opcode::BVS: case Opcode::DBVS: case Opcode::SVS: case Opcode::TRAPVS:
+		case Opcode::TRAPV:
+			return FLAG_V;
+		case Opcode::BPL: case Opcode::DBPL: case Opcode::SPL: case Opcode::TRAPPL:
+		case Opcode::BMI: case Opcode::DBMI: case Opcode::SMI: case Opcode::TRAPMI:
+			return FLAG_N;
+		case Opcode::BGE: case Opcode::DBGE: case Opcode::SGE: case Opcode::TRAPGE:
+		case Opcode::BLT: case Opcode::DBLT: case Opcode::SLT: case Opcode::TRAPLT:
+			return FLAG_N | FLAG_V;
+		case Opcode::BGT: case Opcode::DBGT: case Opcode::SGT: case Opcode::TRAPGT:
+		case Opcode::BLE: case Opcode::DBLE: case Opcode::SLE: case Opcode::TRAPLE:
+			return FLAG_N | FLAG_V | FLAG_Z;
+		default:
+			break;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static void set_access(opcode_use& use, Access op0, Access op1 = ACCESS_NONE, Access op2 = ACCESS_NONE)
+{
+	use.access[0] = op0;
+	use.access[1] = op1;
+	use.access[2] = op2;
+}
+
+// ----------------------------------------------------------------------------
+// Code on the other side of a call or exception can use anything.
+static void set_call(opcode_use& use)
+{
+	use.implicit_read |= REGS_ALL | FLAGS_ALL;
+	use.implicit_written |= REG_SP;
+	use.memory_written = true;
+}
+
+// ----------------------------------------------------------------------------
+// The caller can use any register after a return.
+static void set_return(opcode_use& use)
+{
+	use.implicit_read |= REGS_ALL;
+	use.implicit_written |= REG_SP;
+	use.memory_read = true;
+}
+
+// ----------------------------------------------------------------------------
+static bool is_status_register(const operand& op)
+{
+	return op.type == OpType::SR || op.type == OpType::CCR;
+}
+
+// ----------------------------------------------------------------------------
+static void get_opcode_use(const instruction& inst, opcode_use& use)
+{
+	use = opcode_use();
+	use.flags_read = calc_condition_flags(inst);
+
+	const uint32_t XNZVC = FLAGS_NZVC | FLAG_X;
+	switch (inst.opcode)
+	{
+		case Opcode::ABCD:
+		case Opcode::SBCD:
+		case Opcode::ADDX:
+		case Opcode::SUBX:
+			// Z is only cleared, so multi-precision results can be tested
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_read = FLAG_X | FLAG_Z;
+			use.flags_written = XNZVC;
+			break;
+		case Opcode::NBCD:
+		case Opcode::NEGX:
+			set_access(use, ACCESS_READ_WRITE);
+			use.flags_read = FLAG_X | FLAG_Z;
+			use.flags_written = XNZVC;
+			break;
+		case Opcode::ADD:
+		case Opcode::ADDI:
+		case Opcode::SUB:
+		case Opcode::SUBI:
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = XNZVC;
+			break;
+		case Opcode::ADDQ:
+		case Opcode::SUBQ:
+			// No flags change when the destination is an address register
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = inst.op1.type == OpType::A_DIRECT ? 0 : XNZVC;
+			break;
+		case Opcode::ADDA:
+		case Opcode::SUBA:
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			break;
+		case Opcode::AND:
+		case Opcode::ANDI:
+		case Opcode::OR:
+		case Opcode::ORI:
+		case Opcode::EOR:
+		case Opcode::EORI:
+			// To CCR or SR, the flags are handled as an operand
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			if (!is_status_register(inst.op1))
+				use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::ASL:
+		case Opcode::ASR:
+		case Opcode::LSL:
+		case Opcode::LSR:
+		case Opcode::ROL:
+		case Opcode::ROR:
+		case Opcode::ROXL:
+		case Opcode::ROXR:
+			// Memory shifts have a single operand
+			if (inst.op1.type == OpType::INVALID)
+				set_access(use, ACCESS_READ_WRITE);
+			else
+				set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			if (inst.opcode == Opcode::ROL || inst.opcode == Opcode::ROR)
+				use.flags_written = FLAGS_NZVC;
+			else
+				use.flags_written = XNZVC;
+			if (inst.opcode == Opcode::ROXL || inst.opcode == Opcode::ROXR)
+				use.flags_read = FLAG_X;
+			break;
+		case Opcode::BCHG:
+		case Opcode::BCLR:
+		case Opcode::BSET:
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = FLAG_Z;
+			break;
+		case Opcode::BTST:
+			set_access(use, ACCESS_READ, ACCESS_READ);
+			use.flags_written = FLAG_Z;
+			break;
+		case Opcode::BFTST:
+			set_access(use, ACCESS_READ);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::BFCHG:
+		case Opcode::BFCLR:
+		case Opcode::BFSET:
+			set_access(use, ACCESS_READ_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::BFEXTS:
+		case Opcode::BFEXTU:
+		case Opcode::BFFFO:
+			set_access(use, ACCESS_READ, ACCESS_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			use.full_write = true;
+			break;
+		case Opcode::BFINS:
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::BSR:
+		case Opcode::CALLM:
+			set_access(use, ACCESS_NONE, ACCESS_ADDRESS);
+			set_call(use);
+			break;
+		case Opcode::JSR:
+			set_access(use, ACCESS_ADDRESS);
+			set_call(use);
+			break;
+		case Opcode::JMP:
+			set_access(use, ACCESS_ADDRESS);
+			break;
+		case Opcode::BKPT:
+		case Opcode::ILLEGAL:
+		case Opcode::TRAP:
+		case Opcode::TRAPV:
+		case Opcode::TRAPCC: case Opcode::TRAPCS: case Opcode::TRAPEQ: case Opcode::TRAPF:
+		case Opcode::TRAPGE: case Opcode::TRAPGT: case Opcode::TRAPHI: case Opcode::TRAPLE:
+		case Opcode::TRAPLS: case Opcode::TRAPLT: case Opcode::TRAPMI: case Opcode::TRAPNE:
+		case Opcode::TRAPPL: case Opcode::TRAPT: case Opcode::TRAPVC: case Opcode::TRAPVS:
+			set_access(use, ACCESS_READ);
+			set_call(use);
+			break;
+		case Opcode::CAS:
+			set_access(use, ACCESS_READ_WRITE, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::CAS2:
+			set_access(use, ACCESS_READ_WRITE, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::CHK:
+		case Opcode::CHK2:
+		case Opcode::CMP2:
+		case Opcode::CMP:
+		case Opcode::CMPA:
+		case Opcode::CMPI:
+		case Opcode::CMPM:
+			set_access(use, ACCESS_READ, ACCESS_READ);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::CLR:
+			set_access(use, ACCESS_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::DIVS:
+		case Opcode::DIVSL:
+		case Opcode::DIVU:
+		case Opcode::DIVUL:
+		case Opcode::MULS:
+		case Opcode::MULU:
+			set_access(use, ACCESS_READ, ACCESS_READ_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			use.full_write = true;
+			break;
+		case Opcode::EXG:
+			set_access(use, ACCESS_READ_WRITE, ACCESS_READ_WRITE);
+			use.full_write = true;
+			break;
+		case Opcode::EXT:
+		case Opcode::EXTB:
+		case Opcode::NEG:
+		case Opcode::NOT:
+		case Opcode::SWAP:
+		case Opcode::TAS:
+			set_access(use, ACCESS_READ_WRITE);
+			use.flags_written = inst.opcode == Opcode::NEG ? XNZVC : FLAGS_NZVC;
+			break;
+		case Opcode::LEA:
+			set_access(use, ACCESS_ADDRESS, ACCESS_WRITE);
+			break;
+		case Opcode::PEA:
+			set_access(use, ACCESS_ADDRESS);
+			use.implicit_read = REG_SP;
+			use.implicit_written = REG_SP;
+			use.memory_written = true;
+			break;
+		case Opcode::LINK:
+			set_access(use, ACCESS_READ_WRITE, ACCESS_READ);
+			use.implicit_read = REG_SP;
+			use.implicit_written = REG_SP;
+			use.memory_written = true;
+			break;
+		case Opcode::UNLK:
+			set_access(use, ACCESS_READ_WRITE);
+			use.implicit_written = REG_SP;
+			use.memory_read = true;
+			break;
+		case Opcode::MOVE:
+			// Moves to and from CCR, SR and USP don't set the flags
+			set_access(use, ACCESS_READ, ACCESS_WRITE);
+			if (!is_status_register(inst.op0) && !is_status_register(inst.op1) &&
+				inst.op0.type != OpType::USP && inst.op1.type != OpType::USP)
+				use.flags_written = FLAGS_NZVC;
+			break;
+		case Opcode::MOVEQ:
+			set_access(use, ACCESS_READ, ACCESS_WRITE);
+			use.flags_written = FLAGS_NZVC;
+			use.full_write = true;
+			break;
+		case Opcode::MOVEM:
+			// MOVEM.W sign-extends into the whole register
+			set_access(use, ACCESS_READ, ACCESS_WRITE);
+			use.full_write = true;
+			break;
+		case Opcode::MOVEA:
+		case Opcode::MOVEC:
+		case Opcode::MOVEP:
+		case Opcode::MOVES:
+			set_access(use, ACCESS_READ, ACCESS_WRITE);
+			break;
+		case Opcode::PACK:
+		case Opcode::UNPK:
+			set_access(use, ACCESS_READ, ACCESS_WRITE, ACCESS_READ);
+			break;
+		case Opcode::RTS:
+		case Opcode::RTD:
+		case Opcode::RTM:
+			// Results can be returned in the flags
+			set_access(use, ACCESS_READ);
+			set_return(use);
+			use.implicit_read |= FLAGS_ALL;
+			break;
+		case Opcode::RTE:
+		case Opcode::RTR:
+			set_return(use);
+			use.flags_written = FLAGS_ALL;
+			break;
+		case Opcode::SCC: case Opcode::SCS: case Opcode::SEQ: case Opcode::SF:
+		case Opcode::SGE: case Opcode::SGT: case Opcode::SHI: case Opcode::SLE:
+		case Opcode::SLS: case Opcode::SLT: case Opcode::SMI: case Opcode::SNE:
+		case Opcode::SPL: case Opcode::ST: case Opcode::SVC: case Opcode::SVS:
+			set_access(use, ACCESS_WRITE);
+			break;
+		case Opcode::STOP:
+			set_access(use, ACCESS_READ);
+			use.flags_written = FLAGS_ALL;
+			break;
+		case Opcode::TST:
+			set_access(use, ACCESS_READ);
+			use.flags_written = FLAGS_NZVC;
+			break;
+		default:
+			// Bcc, BRA, DBcc etc. only have registers and branch targets
+			if (inst.opcode >= Opcode::DBCC && inst.opcode <= Opcode::DBVS)
+				set_access(use, ACCESS_READ_WRITE, ACCESS_READ);
+			else
+				set_access(use, ACCESS_READ, ACCESS_READ, ACCESS_READ);
+			break;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static uint32_t get_index_register_bit(IndexRegister reg)
+{
+	return reg < INDEX_REG_PC ? (1U << reg) : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Add the registers and memory used by one operand.
+static void add_operand_use(const operand& op, const bitfield& bf, Access access, bool full_write,
+	register_use& use)
+{
+	if (access == ACCESS_NONE)
+		return;
+	const bool reads = (access == ACCESS_READ || access == ACCESS_READ_WRITE);
+	const bool writes = (access == ACCESS_WRITE || access == ACCESS_READ_WRITE);
+
+	// Registers in a bitfield's offset and width
+	if (bf.valid && bf.offset_is_dreg)
+		use.read |= REG_D0 << bf.offset;
+	if (bf.valid && bf.width_is_dreg)
+		use.read |= REG_D0 << bf.width;
+
+	bool memory = false;
+	switch (op.type)
+	{
+		case OpType::D_DIRECT:
+			if (reads)
+				use.read |= REG_D0 << op.d_register.reg;
+			if (writes)
+			{
+				use.written |= REG_D0 << op.d_register.reg;
+				if (!full_write)
+					use.read |= REG_D0 << op.d_register.reg;
+			}
+			break;
+		case OpType::A_DIRECT:
+			// Address registers are always written in full
+			if (reads)
+				use.read |= REG_A0 << op.a_register.reg;
+			if (writes)
+				use.written |= REG_A0 << op.a_register.reg;
+			break;
+		case OpType::D_REGISTER_PAIR:
+		{
+			uint32_t regs = (REG_D0 << op.d_register_pair.dreg1) | (REG_D0 << op.d_register_pair.dreg2);
+			if (reads)
+				use.read |= regs;
+			if (writes)
+				use.written |= regs;
+			break;
+		}
+		case OpType::MOVEM_REG:
+			if (reads)
+				use.read |= op.movem_reg.reg_mask;
+			if (writes)
+				use.written |= op.movem_reg.reg_mask;
+			break;
+		case OpType::SR:
+		case OpType::CCR:
+			if (reads)
+				use.read |= FLAGS_ALL;
+			if (writes)
+				use.written |= FLAGS_ALL;
+			break;
+		case OpType::INDIRECT:
+			use.read |= REG_A0 << op.indirect.reg;
+			memory = true;
+			break;
+		case OpType::INDIRECT_POSTINC:
+			use.read |= REG_A0 << op.indirect_postinc.reg;
+			use.written |= REG_A0 << op.indirect_postinc.reg;
+			memory = true;
+			break;
+		case OpType::INDIRECT_PREDEC:
+			use.read |= REG_A0 << op.indirect_predec.reg;
+			use.written |= REG_A0 << op.indirect_predec.reg;
+			memory = true;
+			break;
+		case OpType::INDIRECT_DISP:
+			use.read |= REG_A0 << op.indirect_disp.reg;
+			memory = true;
+			break;
+		case OpType::INDIRECT_INDEX:
+			use.read |= (REG_A0 << op.indirect_index.a_reg) |
+				get_index_register_bit(op.indirect_index.indirect_info.index_reg);
+			memory = true;
+			break;
+		case OpType::PC_DISP_INDEX:
+			use.read |= get_index_register_bit(op.pc_disp_index.indirect_info.index_reg);
+			memory = true;
+			break;
+		case OpType::INDIRECT_PREINDEXED:
+		case OpType::INDIRECT_POSTINDEXED:
+		case OpType::MEMORY_INDIRECT:
+		case OpType::NO_MEMORY_INDIRECT:
+		{
+			const indirect_index_full& full = op.indirect_index_68020;
+			if (full.used[1])
+				use.read |= get_index_register_bit(full.base_register);
+			if (full.used[2])
+				use.read |= get_index_register_bit(full.index.index_reg);
+			memory = true;
+			break;
+		}
+		case OpType::INDIRECT_REGISTER_PAIR:
+			use.read |= get_index_register_bit(op.indirect_register_pair.reg1) |
+				get_index_register_bit(op.indirect_register_pair.reg2);
+			memory = true;
+			break;
+		case OpType::ABSOLUTE_WORD:
+		case OpType::ABSOLUTE_LONG:
+		case OpType::PC_DISP:
+			memory = true;
+			break;
+		default:
+			break;
+	}
+
+	if (memory && access != ACCESS_ADDRESS)
+	{
+		use.memory_read |= reads;
+		use.memory_written |= writes;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void calc_register_use(const instruction& inst, register_use& use)
+{
+	use.read = 0;
+	use.written = 0;
+	use.memory_read = false;
+	use.memory_written = false;
+	if (inst.opcode == Opcode::NONE)
+		return;
+
+	opcode_use op_use;
+	get_opcode_use(inst, op_use);
+	const bool full_write = op_use.full_write || inst.suffix == Suffix::LONG;
+	add_operand_use(inst.op0, inst.bf0, (Access)op_use.access[0], full_write, use);
+	add_operand_use(inst.op1, inst.bf1, (Access)op_use.access[1], full_write, use);
+	add_operand_use(inst.op2, bitfield(), (Access)op_use.access[2], full_write, use);
+
+	use.read |= op_use.flags_read | op_use.implicit_read;
+	use.written |= op_use.flags_written | op_use.implicit_written;
+	use.memory_read |= op_use.memory_read;
+	use.memory_written |= op_use.memory_written;
+}
+
+// ----------------------------------------------------------------------------
+static const char* g_register_set_names[] =
+{
+	"d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7",
+	"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+	"c", "v", "z", "n", "x"
+};
+
+// ----------------------------------------------------------------------------
+const char* get_register_set_string(uint32_t register_bit)
+{
+	for (uint32_t i = 0; i < sizeof(g_register_set_names) / sizeof(g_register_set_names[0]); ++i)
+		if (register_bit == (1U << i))
+			return g_register_set_names[i];
+	return "?";
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef HOPPER68_REGS_H
+#define HOPPER68_REGS_H
+
+#include <cstdint>
+
+namespace hop68
+{
+struct instruction;
+
+// ----------------------------------------------------------------------------
+//	REGISTER AND FLAG USE
+// ----------------------------------------------------------------------------
+// Bits for a set of registers and condition code flags. D0-D7 and A0-A7 are
+// in the same order as MOVEM register masks.
+enum RegisterSet : uint32_t
+{
+	REG_D0 = 1 << 0,
+	REG_A0 = 1 << 8,
+	REG_SP = 1 << 15,					// A7
+
+	FLAG_C = 1 << 16,
+	FLAG_V = 1 << 17,
+	FLAG_Z = 1 << 18,
+	FLAG_N = 1 << 19,
+	FLAG_X = 1 << 20,
+
+	REGS_DATA = 0x000000ff,
+	REGS_ADDRESS = 0x0000ff00,
+	REGS_ALL = 0x0000ffff,
+	FLAGS_NZVC = FLAG_N | FLAG_Z | FLAG_V | FLAG_C,
+	FLAGS_ALL = 0x001f0000
+};
+
+// What an instruction reads and writes. A register which is only partly
+// written (e.g. the low byte by "move.b") is also counted as read, since the
+// rest of its value is kept.
+struct register_use
+{
+	uint32_t read;			// RegisterSet bits
+	uint32_t written;
+	bool memory_read;		// reads memory through an operand
+	bool memory_written;	// writes memory through an operand, or the stack
+};
+
+// Find the registers and flags read and written by an instruction, including
+// address registers changed by (An)+ and -(An), and the stack pointer
+// changed by calls, returns, PEA, LINK etc.
+// Calls and exceptions (BSR, JSR, TRAP...) are assumed to read every
+// register and flag, and returns to read every register, because the code
+// on the other side isn't known.
+extern void calc_register_use(const instruction& inst, register_use& use);
+
+// The flags read by a condition code test (Bcc, DBcc, Scc, TRAPcc),
+// or 0 for other instructions.
+extern uint32_t calc_condition_flags(const instruction& inst);
+
+// String for a single register bit e.g. "d3", "a7" or "z", for comments.
+extern const char* get_register_set_string(uint32_t register_bit);
+}
+#endif
@@ -0,0 +1,231 @@
+#include "xref68.h"
+
+#include <algorithm>
+#include "instruction68.h"
+
+namespace hop68
+{
+// ----------------------------------------------------------------------------
+bool calc_operand_target(const operand& op, uint32_t inst_address, uint32_t& target_address)
+{
+	switch (op.type)
+	{
+		case OpType::PC_DISP:
+			target_address = inst_address + op.pc_disp.inst_disp;
+			return true;
+		case OpType::PC_DISP_INDEX:
+			target_address = inst_address + op.pc_disp_index.inst_disp;
+			return true;
+		case OpType::RELATIVE_BRANCH:
+			target_address = inst_address + op.relative_branch.inst_disp;
+			return true;
+		case OpType::ABSOLUTE_LONG:
+			target_address = op.absolute_long.longaddr;
+			return true;
+		case OpType::ABSOLUTE_WORD:
+			// Word addresses are sign-extended
+			target_address = (uint32_t)(int32_t)(int16_t)op.absolute_word.wordaddr;
+			return true;
+		case OpType::INDIRECT_POSTINDEXED:
+		case OpType::INDIRECT_PREINDEXED:
+		case OpType::MEMORY_INDIRECT:
+		case OpType::NO_MEMORY_INDIRECT:
+			if (op.indirect_index_68020.base_register == INDEX_REG_PC)
+			{
+				target_address = inst_address + op.indirect_index_68020.base_displacement;
+				return true;
+			}
+			break;
+		default:
+			break;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+// Instructions which only read their destination operand
+static bool is_compare(Opcode opcode)
+{
+	switch (opcode)
+	{
+		case Opcode::BTST:
+		case Opcode::BFTST:
+		case Opcode::BFEXTS:
+		case Opcode::BFEXTU:
+		case Opcode::BFFFO:
+		case Opcode::CHK:
+		case Opcode::CHK2:
+		case Opcode::CMP:
+		case Opcode::CMP2:
+		case Opcode::CMPA:
+		case Opcode::CMPI:
+		case Opcode::CMPM:
+		case Opcode::TST:
+		case Opcode::LEA:
+		case Opcode::PEA:
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+// Instructions with a single operand which is modified
+static bool is_single_write(Opcode opcode)
+{
+	if (opcode >= Opcode::SCC && opcode <= Opcode::SPL)
+		return true;
+	switch (opcode)
+	{
+		case Opcode::BFCHG:
+		case Opcode::BFCLR:
+		case Opcode::BFSET:
+		case Opcode::CLR:
+		case Opcode::NBCD:
+		case Opcode::NEG:
+		case Opcode::NEGX:
+		case Opcode::NOT:
+		case Opcode::ST:
+		case Opcode::SVC:
+		case Opcode::SVS:
+		case Opcode::TAS:
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+XrefKind calc_xref_kind(const instruction& inst, int slot)
+{
+	switch (inst.opcode)
+	{
+		case Opcode::BSR:
+		case Opcode::JSR:
+			return XREF_CALL;
+		case Opcode::JMP:
+			return XREF_BRANCH;
+		default:
+			break;
+	}
+
+	// Conditional branches, DBcc and BRA use a relative branch operand
+	const operand* ops[3] = { &inst.op0, &inst.op1, &inst.op2 };
+	if (ops[slot]->type == OpType::RELATIVE_BRANCH)
+		return XREF_BRANCH;
+
+	if (is_compare(inst.opcode))
+		return XREF_READ;
+
+	if (slot == 0)
+		return is_single_write(inst.opcode) ? XREF_WRITE : XREF_READ;
+
+	// The final operand is the destination
+	return XREF_WRITE;
+}
+
+// ----------------------------------------------------------------------------
+const char* get_xref_kind_string(XrefKind kind)
+{
+	switch (kind)
+	{
+		case XREF_READ:		return "read";
+		case XREF_WRITE:	return "write";
+		case XREF_BRANCH:	return "branch";
+		case XREF_CALL:		return "call";
+	}
+	return "?";
+}
+
+// ----------------------------------------------------------------------------
+xref_index::xref_index()
+{
+	offsets.push_back(0);
+}
+
+// ----------------------------------------------------------------------------
+void xref_index::add_instruction(const instruction& inst, uint32_t inst_address)
+{
+	if (inst.opcode == Opcode::NONE)
+		return;
+
+	const operand* ops[3] = { &inst.op0, &inst.op1, &inst.op2 };
+	for (int slot = 0; slot < 3; ++slot)
+	{
+		uint32_t target;
+		if (calc_operand_target(*ops[slot], inst_address, target))
+			add(target, inst_address, (uint8_t)slot, calc_xref_kind(inst, slot));
+	}
+}
+
+// ----------------------------------------------------------------------------
+void xref_index::add(uint32_t target, uint32_t source, uint8_t slot, XrefKind kind)
+{
+	xref ref;
+	ref.source = source;
+	ref.slot = slot;
+	ref.kind = (uint8_t)kind;
+	m_pending_targets.push_back(target);
+	m_pending_refs.push_back(ref);
+}
+
+// ----------------------------------------------------------------------------
+void xref_index::finalize()
+{
+	// Merge in any existing rows, so finalize() can be called more than once
+	for (size_t row = 0; row < targets.size(); ++row)
+		for (uint32_t i = offsets[row]; i < offsets[row + 1]; ++i)
+		{
+			m_pending_targets.push_back(targets[row]);
+			m_pending_refs.push_back(refs[i]);
+		}
+
+	// Unique, sorted row keys
+	targets = m_pending_targets;
+	std::sort(targets.begin(), targets.end());
+	targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+	// Count the references per row, then convert to start offsets
+	std::vector<uint32_t> row_of(m_pending_targets.size());
+	offsets.assign(targets.size() + 1, 0);
+	for (size_t i = 0; i < m_pending_targets.size(); ++i)
+	{
+		row_of[i] = (uint32_t)(std::lower_bound(targets.begin(), targets.end(),
+			m_pending_targets[i]) - targets.begin());
+		++offsets[row_of[i] + 1];
+	}
+	for (size_t row = 0; row < targets.size(); ++row)
+		offsets[row + 1] += offsets[row];
+
+	// Scatter into the rows, then put each row into source order
+	refs.resize(m_pending_refs.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < m_pending_refs.size(); ++i)
+		refs[fill[row_of[i]]++] = m_pending_refs[i];
+
+	for (size_t row = 0; row < targets.size(); ++row)
+		std::stable_sort(refs.begin() + offsets[row], refs.begin() + offsets[row + 1],
+			[](const xref& a, const xref& b) { return a.source < b.source; });
+
+	m_pending_targets.clear();
+	m_pending_refs.clear();
+}
+
+// ----------------------------------------------------------------------------
+size_t xref_index::find(uint32_t target, const xref*& first) const
+{
+	std::vector<uint32_t>::const_iterator it =
+		std::lower_bound(targets.begin(), targets.end(), target);
+	if (it == targets.end() || *it != target)
+	{
+		first = NULL;
+		return 0;
+	}
+	size_t row = it - targets.begin();
+	first = refs.data() + offsets[row];
+	return offsets[row + 1] - offsets[row];
+}
+
+}
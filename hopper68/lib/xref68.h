@@ -0,0 +1,85 @@
+#ifndef HOPPER68_XREF_H
+#define HOPPER68_XREF_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace hop68
+{
+struct instruction;
+struct operand;
+
+// ----------------------------------------------------------------------------
+//	CROSS-REFERENCES
+// ----------------------------------------------------------------------------
+// How an instruction uses the address held in one of its operands.
+enum XrefKind
+{
+	XREF_READ,
+	XREF_WRITE,
+	XREF_BRANCH,
+	XREF_CALL
+};
+
+// A single reference from an instruction to a target address.
+struct xref
+{
+	uint32_t	source;			// address of the referring instruction
+	uint8_t		slot;			// operand index (0-2) that holds the reference
+	uint8_t		kind;			// XrefKind
+};
+
+// Calculate the fixed address that an operand refers to, if there is one.
+// This covers PC-relative modes, branches and absolute addresses.
+extern bool calc_operand_target(const operand& op, uint32_t inst_address, uint32_t& target_address);
+
+// Decide whether the operand in "slot" is read, written, branched or called to.
+extern XrefKind calc_xref_kind(const instruction& inst, int slot);
+
+// String name of an XrefKind e.g. "call"
+extern const char* get_xref_kind_string(XrefKind kind);
+
+// ----------------------------------------------------------------------------
+// All references in a program, stored as compressed sparse rows.
+// "targets" is sorted, and the references to targets[i] are
+// refs[offsets[i]] ... refs[offsets[i + 1] - 1], in source address order.
+//
+// Usage: call add_instruction() for every decoded instruction, then
+// finalize() once before calling find().
+class xref_index
+{
+public:
+	xref_index();
+
+	// Record any references made by an instruction.
+	void add_instruction(const instruction& inst, uint32_t inst_address);
+
+	// Record a single reference.
+	void add(uint32_t target, uint32_t source, uint8_t slot, XrefKind kind);
+
+	// Build the sorted rows from the recorded references.
+	void finalize();
+
+	// Find all references to "target". Returns the number of references
+	// and sets "first" to point at the first of them.
+	size_t find(uint32_t target, const xref*& first) const;
+
+	// Accessors for iterating over every row
+	size_t get_target_count() const				{ return targets.size(); }
+	uint32_t get_target(size_t row) const		{ return targets[row]; }
+	size_t get_ref_count(size_t row) const		{ return offsets[row + 1] - offsets[row]; }
+	const xref* get_refs(size_t row) const		{ return refs.data() + offsets[row]; }
+
+	std::vector<uint32_t>	targets;	// unique target addresses, sorted
+	std::vector<uint32_t>	offsets;	// row start positions in "refs", plus a final end marker
+	std::vector<xref>		refs;		// references grouped by target
+
+private:
+	// Unsorted (target, ref) pairs collected before finalize()
+	std::vector<uint32_t>	m_pending_targets;
+	std::vector<xref>		m_pending_refs;
+};
+
+}
+#endif
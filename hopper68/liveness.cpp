@@ -0,0 +1,279 @@
+// ----------------------------------------------------------------------------
+// Register liveness and the comments built on it. See liveness.h.
+#include "liveness.h"
+
+#include <string>
+
+#include "lib/flow68.h"
+#include "lib/instruction68.h"
+#include "lib/regs68.h"
+#include "blocks.h"
+#include "process.h"
+
+using hop68::Opcode;
+using hop68::OpType;
+
+// Everything is live where the code that follows isn't known
+static const uint32_t LIVE_ALL = hop68::REGS_ALL | hop68::FLAGS_ALL;
+
+// ----------------------------------------------------------------------------
+//	LIVENESS
+// ----------------------------------------------------------------------------
+// Registers live at the start of a known branch target block.
+static uint32_t get_target_live(const disassembly::line& line, const basic_blocks& blocks,
+	const std::vector<uint32_t>& live_in)
+{
+	uint32_t target;
+	size_t target_block;
+	if (!hop68::calc_flow_target(line.inst, line.address, target) ||
+		!blocks.find(target, target_block) || blocks.blocks[target_block].address != target)
+		return LIVE_ALL;
+	return live_in[target_block];
+}
+
+// ----------------------------------------------------------------------------
+// Registers live at the start of the block that follows on in memory.
+static uint32_t get_next_live(size_t block_index, const basic_blocks& blocks,
+	const std::vector<uint32_t>& live_in)
+{
+	if (block_index + 1 >= blocks.blocks.size() ||
+		blocks.blocks[block_index + 1].address != blocks.blocks[block_index].end_address)
+		return LIVE_ALL;
+	return live_in[block_index + 1];
+}
+
+// ----------------------------------------------------------------------------
+// Registers live after the last line of a block.
+static uint32_t calc_live_out(const disassembly& disasm, const basic_blocks& blocks, size_t block_index,
+	const std::vector<uint32_t>& live_in)
+{
+	const basic_block& block = blocks.blocks[block_index];
+	const disassembly::line& last = disasm.lines[block.first_line + block.line_count - 1];
+	switch (hop68::calc_flow(last.inst))
+	{
+		case hop68::FLOW_NONE:
+		case hop68::FLOW_CALL:
+			return get_next_live(block_index, blocks, live_in);
+		case hop68::FLOW_BRANCH:
+			return get_target_live(last, blocks, live_in) | get_next_live(block_index, blocks, live_in);
+		case hop68::FLOW_JUMP:
+			return get_target_live(last, blocks, live_in);
+		case hop68::FLOW_RETURN:
+			// The return itself reads everything the caller could use
+			return 0;
+		case hop68::FLOW_STOP:
+		default:
+			// STOP continues after an interrupt, and invalid data might not be
+			break;
+	}
+	return LIVE_ALL;
+}
+
+// ----------------------------------------------------------------------------
+void calc_liveness(const disassembly& disasm, const basic_blocks& blocks, register_liveness& result)
+{
+	const size_t line_count = disasm.lines.size();
+	result.live_after.assign(line_count, 0);
+
+	std::vector<hop68::register_use> uses(line_count);
+	for (size_t i = 0; i < line_count; ++i)
+		hop68::calc_register_use(disasm.lines[i].inst, uses[i]);
+
+	// Live sets only grow, so this finishes. Going backwards means most
+	// blocks see their successors' final values on the first pass.
+	std::vector<uint32_t> live_in(blocks.blocks.size(), 0);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (size_t b = blocks.blocks.size(); b-- > 0;)
+		{
+			const basic_block& block = blocks.blocks[b];
+			uint32_t live = calc_live_out(disasm, blocks, b, live_in);
+			for (size_t i = block.first_line + block.line_count; i-- > block.first_line;)
+			{
+				result.live_after[i] = live;
+				live = (live & ~uses[i].written) | uses[i].read;
+			}
+			if (live != live_in[b])
+			{
+				live_in[b] = live;
+				changed = true;
+			}
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	COMMENTS
+// ----------------------------------------------------------------------------
+static bool is_system_operand(const hop68::operand& op)
+{
+	return op.type == OpType::SR || op.type == OpType::CCR || op.type == OpType::USP ||
+		op.type == OpType::CONTROL_REGISTER;
+}
+
+// ----------------------------------------------------------------------------
+// True if the only effect of an instruction is to write registers and flags
+// which are all dead afterwards.
+static bool is_dead_store(const hop68::instruction& inst, const hop68::register_use& use, uint32_t live_after)
+{
+	if (hop68::calc_flow(inst) != hop68::FLOW_NONE)
+		return false;
+	if (use.memory_read || use.memory_written)
+		return false;
+	if ((use.written & hop68::REGS_ALL) == 0 || (use.written & hop68::REG_SP))
+		return false;
+	if (is_system_operand(inst.op0) || is_system_operand(inst.op1))
+		return false;
+	return (use.written & live_after) == 0;
+}
+
+// ----------------------------------------------------------------------------
+// How an instruction leaves the flags for a TST of its result.
+enum FlagResult
+{
+	FLAGS_UNRELATED,		// not set from the tested register
+	FLAGS_AS_TEST,			// N and Z from the result, V and C cleared, just like TST
+	FLAGS_NZ_ONLY			// N and Z from the result, V and C from the operation
+};
+
+// ----------------------------------------------------------------------------
+static bool is_data_register(const hop68::operand& op, uint8_t reg)
+{
+	return op.type == OpType::D_DIRECT && op.d_register.reg == reg;
+}
+
+// ----------------------------------------------------------------------------
+// Find whether "inst" set N and Z from data register "reg" at "size".
+static FlagResult get_flag_result(const hop68::instruction& inst, uint8_t reg, hop68::Suffix size)
+{
+	hop68::register_use use;
+	hop68::calc_register_use(inst, use);
+	if ((use.written & hop68::FLAGS_NZVC) != hop68::FLAGS_NZVC)
+		return FLAGS_UNRELATED;
+
+	// The result operand is the last one, except where the size changes
+	const hop68::operand& result = inst.op1.type != OpType::INVALID ? inst.op1 : inst.op0;
+	hop68::Suffix result_size = inst.suffix;
+	switch (inst.opcode)
+	{
+		case Opcode::MOVE:
+			// Flags come from the data moved, so the source counts too
+			if (inst.suffix == size && (is_data_register(inst.op0, reg) || is_data_register(inst.op1, reg)))
+				return FLAGS_AS_TEST;
+			return FLAGS_UNRELATED;
+		case Opcode::MOVEQ:
+		case Opcode::SWAP:
+		case Opcode::MULS:
+		case Opcode::MULU:
+			result_size = hop68::Suffix::LONG;
+			// fall through
+		case Opcode::AND:
+		case Opcode::ANDI:
+		case Opcode::OR:
+		case Opcode::ORI:
+		case Opcode::EOR:
+		case Opcode::EORI:
+		case Opcode::NOT:
+		case Opcode::CLR:
+		case Opcode::EXT:
+		case Opcode::EXTB:
+			if (result_size == size && is_data_register(result, reg))
+				return FLAGS_AS_TEST;
+			return FLAGS_UNRELATED;
+		case Opcode::ADD:
+		case Opcode::ADDI:
+		case Opcode::ADDQ:
+		case Opcode::SUB:
+		case Opcode::SUBI:
+		case Opcode::SUBQ:
+		case Opcode::NEG:
+		case Opcode::ASL:
+		case Opcode::ASR:
+		case Opcode::LSL:
+		case Opcode::LSR:
+		case Opcode::ROL:
+		case Opcode::ROR:
+		case Opcode::ROXL:
+		case Opcode::ROXR:
+			if (result_size == size && is_data_register(result, reg))
+				return FLAGS_NZ_ONLY;
+			return FLAGS_UNRELATED;
+		default:
+			break;
+	}
+	return FLAGS_UNRELATED;
+}
+
+// ----------------------------------------------------------------------------
+// Find the data register tested by TST or CMP #0, if this is one.
+static bool get_tested_register(const hop68::instruction& inst, uint8_t& reg)
+{
+	const hop68::operand* pOp = NULL;
+	if (inst.opcode == Opcode::TST)
+		pOp = &inst.op0;
+	else if ((inst.opcode == Opcode::CMP || inst.opcode == Opcode::CMPI) &&
+			inst.op0.type == OpType::IMMEDIATE && inst.op0.imm.val0 == 0)
+		pOp = &inst.op1;
+	if (!pOp || pOp->type != OpType::D_DIRECT)
+		return false;
+	reg = pOp->d_register.reg;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Make e.g. "d0/d3/a1" from a set of register bits.
+static std::string get_register_list(uint32_t regs)
+{
+	std::string list;
+	for (uint32_t i = 0; i < 32; ++i)
+	{
+		if (!(regs & (1U << i)))
+			continue;
+		if (!list.empty())
+			list += "/";
+		list += hop68::get_register_set_string(1U << i);
+	}
+	return list;
+}
+
+// ----------------------------------------------------------------------------
+void add_liveness_comments(const disassembly& disasm, const basic_blocks& blocks,
+	const register_liveness& liveness, line_comments& comments, liveness_counts& counts)
+{
+	counts.dead_stores = 0;
+	counts.redundant_tests = 0;
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+	{
+		const disassembly::line& line = disasm.lines[i];
+		const uint32_t live_after = liveness.live_after[i];
+
+		hop68::register_use use;
+		hop68::calc_register_use(line.inst, use);
+		if (is_dead_store(line.inst, use, live_after))
+		{
+			comments.append(line.address,
+				"dead store: " + get_register_list(use.written & hop68::REGS_ALL));
+			++counts.dead_stores;
+			continue;
+		}
+
+		// The test must follow straight on, with no way in from elsewhere
+		uint8_t reg;
+		if (i == 0 || !get_tested_register(line.inst, reg) ||
+			blocks.line_block[i] != blocks.line_block[i - 1])
+			continue;
+		const disassembly::line& prev = disasm.lines[i - 1];
+		if (prev.address + prev.inst.byte_count != line.address)
+			continue;
+
+		FlagResult result = get_flag_result(prev.inst, reg, line.inst.suffix);
+		const uint32_t VC = hop68::FLAG_V | hop68::FLAG_C;
+		if (result == FLAGS_AS_TEST || (result == FLAGS_NZ_ONLY && (live_after & VC) == 0))
+		{
+			comments.append(line.address, "redundant test: flags already set");
+			++counts.redundant_tests;
+		}
+	}
+}
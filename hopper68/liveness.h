@@ -0,0 +1,47 @@
+// Register and flag liveness over basic blocks, and the comments built on it.
+//
+// A register or flag is live after an instruction if some path from there
+// can read it before writing it. Calls, exceptions, returns and jumps to
+// unknown targets are assumed to read everything (see lib/regs68.h), so the
+// results only err towards keeping values alive.
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class basic_blocks;
+class disassembly;
+class line_comments;
+
+// ----------------------------------------------------------------------------
+class register_liveness
+{
+public:
+	std::vector<uint32_t>	live_after;		// hop68::RegisterSet bits live after each disassembly line
+};
+
+// Totals for the liveness comments.
+struct liveness_counts
+{
+	size_t dead_stores;
+	size_t redundant_tests;
+};
+
+// ----------------------------------------------------------------------------
+// Find the registers and flags live after every line, iterating over the
+// blocks until nothing changes.
+extern void calc_liveness(const disassembly& disasm, const basic_blocks& blocks, register_liveness& result);
+
+// Add comments for
+// - "dead store": register-only instructions whose results are all overwritten
+//   before use. Instructions touching memory, the stack pointer or the status
+//   register are never reported, since they can have other effects.
+// - "redundant test": TST or CMP #0 of a data register straight after an
+//   instruction which already set N and Z from it (and V and C, unless they
+//   are not used afterwards).
+extern void add_liveness_comments(const disassembly& disasm, const basic_blocks& blocks,
+	const register_liveness& liveness, line_comments& comments, liveness_counts& counts);
+
+#endif
@@ -1,893 +1,695 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <memory.h>
-#include <assert.h>
-#include <vector>
-#include <string>
 #include <cstring>
 
-#include "lib/buffer68.h"
 #include "lib/decode68.h"
-#include "lib/instruction68.h"
-#include "lib/timing68.h"
-#include "symbols.h"
-#include "print.h"
+#include "process.h"
+#include "mapfile.h"
+#include "batch.h"
+#include "database.h"
+#include "diff.h"
+#include "duplicates.h"
+#include "query.h"
+#include "server.h"
+#include "signatures.h"
+#include "stats.h"
 
 // ----------------------------------------------------------------------------
-// User options for output.
-struct output_settings
+// Parse an address as decimal, or hex with a "$" or "0x" prefix
+static bool parse_address(const char* str, uint32_t& address)
 {
-	bool show_address;			// print address for each line before opcode
-	bool show_timings;			// print (guessed) timings for each line (valid for 68000 only)
-	bool autolabel;				// autolabelling on/off
-	std::string label_prefix;	// prefix for all auto-labels, normally "L"
-	uint32_t label_start_id;	// starting number of label prefix, normally 0
-};
+	char* end = NULL;
+	if (str[0] == '$')
+		address = (uint32_t)strtoul(str + 1, &end, 16);
+	else
+		address = (uint32_t)strtoul(str, &end, 0);
+	return end != str && *end == 0;
+}
 
 // ----------------------------------------------------------------------------
-//	HIGHER-LEVEL DISASSEMBLY CREATION
-// ----------------------------------------------------------------------------
-
-// Storage for line numbers
-class line_numbers
+// Operating mode: .prg file, binary file, or cmdline input
+enum DECODE_MODE
 {
-public:
-	struct line
-	{
-		size_t file_index;
-		uint32_t line;
-	};
-
-	std::vector<std::string>	filenames;
-
-	typedef std::pair<uint32_t, line> pair;
-	std::map<uint32_t, line>	lines;
-
-	void add(size_t file_index, uint32_t line_num, uint32_t pc)
-	{
-		pair p;
-		p.first = pc;
-		p.second.file_index = file_index;
-		p.second.line = line_num;
-		lines.insert(p);
-	}
-
-	bool find(uint32_t address, line& result) const
-	{
-		std::map<uint32_t, line>::const_iterator it = lines.find(address);
-		if (it != lines.end())
-		{
-			result = it->second;
-			return true;
-		}
-		return false;
-	}
-
-	size_t add_filename(const char* filename)
-	{
-		size_t index = filenames.size();
-		filenames.push_back(filename);
-		return index;
-	}
+	MODE_TOS = 0,
+	MODE_BIN = 1,
+	MODE_HEX = 2,
+	MODE_DISK = 3,
+	MODE_SERVER = 4,
+	MODE_DB = 5
 };
 
 // ----------------------------------------------------------------------------
-// Storage for an attempt at tokenising the memory
-class disassembly
+void usage()
 {
-public:
-	struct line
-	{
-		uint32_t address;
-		hop68::instruction inst;
-	};
-
-	std::vector<line>    lines;
-};
+	fprintf(stdout, "hopper68\n\n"
+		"Usage: hopper68 [options] input_filename|hexstring\n"
+		"       hopper68 --server <socket path>|-\n\n"
+		"options:\n"
+		"\t--hex       Input argument is hex string rather than filename\n"
+		"\t--bin       Read binary file rather than .prg\n"
+		"\t--disk      Read .ST or .MSA disk image and disassemble every executable on it\n"
+		"\t--stream    With --bin, decode with constant memory use (filename \"-\" reads stdin)\n"
+		"\t--address   Print instruction addresses\n"
+		"\t--timings   Print estimated timings (Atari ST 68000 only)\n"
+		"\t--no-labels Do not add automatically-detected labels\n"
+		"\t--xrefs     Print cross-references under each label\n"
+		"\t--xref-report  Print a cross-reference report after the disassembly\n"
+		"\t--liveness  Comment dead register stores, and TST/CMP #0 after instructions which\n"
+		"\t            already set the flags\n"
+		"\t--m68010\n"
+		"\t--m68020\n"
+		"\t--m68030    Select CPU type (default m68000)\n"
+		"\t--label-prefix <string>   Set prefix for auto-labels\n"
+		"\t--label-start <int>       Set starting suffix number for auto-labels\n"
+		"\t--base <address>          Relocate and disassemble at a load address (e.g. $12345)\n"
+		"\t--stats                   Print timings and counts for each stage to stderr\n"
+		"\nwindow options:\n"
+		"\t--start <address>         Only disassemble the text section from this address...\n"
+		"\t--end <address>           ...up to (not including) this one\n"
+		"\t--symbol <name>           Only disassemble from a symbol up to the next named symbol\n"
+		"\ncoverage options:\n"
+		"\t--coverage <file>         Only decode code executed according to a list of address\n"
+		"\t                          ranges (\"first-last\" per line), printing the rest as data\n"
+		"\t--coverage-bitmap <file>  As --coverage, with one bit per byte of the text section\n"
+		"\t--follow                  With coverage, also decode code reached by branches, calls\n"
+		"\t                          and fall-through from the executed code\n"
+		"\nsignature options:\n"
+		"\t--signatures <file>       Name the functions matching a file of signatures (a name\n"
+		"\t                          and hex bytes per line, \"..\" matches any byte)\n"
+		"\t--make-signatures         Print signatures for the named functions in the input\n"
+		"\t                          rather than disassembling it\n"
+		"\nsearch options:\n"
+		"\t--query <pattern>         Print the instruction sequences matching a pattern rather\n"
+		"\t                          than disassembling, e.g. \"lea *,a?; move.w #*,d0; dbf\"\n"
+		"\t                          (see query.h). Works with --batch\n"
+		"\t--duplicates              Print clusters of duplicated and nearly-duplicated routines\n"
+		"\t                          rather than disassembling. With --batch, across all inputs\n"
+		"\t--abstract-registers      With --duplicates, match routines that only differ in\n"
+		"\t                          which registers they use\n"
+		"\ncomparison options:\n"
+		"\t--diff <old file>         Compare the old file with the input, printing only the\n"
+		"\t                          basic blocks which changed, side by side\n"
+		"\nprofile options:\n"
+		"\t--trace <file>            Annotate the disassembly with execution counts and cycles\n"
+		"\t                          from a PC trace (32-bit addresses, one per instruction\n"
+		"\t                          executed), then print the hottest blocks. Cycles use the\n"
+		"\t                          --timings estimates\n"
+		"\t--trace-le                Trace addresses are little-endian\n"
+		"\t--top <int>               Number of blocks in the hot-spot table (default 20)\n"
+		"\nbatch options:\n"
+		"\t--batch                   Input is a directory, or a file listing one input per line.\n"
+		"\t                          Each input is written to its own \".s\" file\n"
+		"\t--out-dir <dir>           Write batch outputs to a directory rather than next to inputs\n"
+		"\t--jobs <int>              Number of batch threads (default one per CPU core)\n"
+		"\ndatabase options:\n"
+		"\t--save-db <file>          Save the finished analysis of a .prg or --bin file to a\n"
+		"\t                          database file rather than disassembling it\n"
+		"\t--load-db                 Input is a database from --save-db. Prints much faster, and\n"
+		"\t                          works with --query and the window options. The CPU type\n"
+		"\t                          and labels saved in the database are used\n"
+		"\nserver options:\n"
+		"\t--server                  Answer framed decode requests (see server.h) on a Unix\n"
+		"\t                          socket at the given path, or on stdin/stdout for \"-\"\n"
+	);
+}
 
 // ----------------------------------------------------------------------------
-// Read the buffer in a simple single pass.
-int decode_buf(hop68::buffer_reader& buf, const hop68::decode_settings& dsettings, disassembly& disasm)
+int main(int argc, char** argv)
 {
-	while (buf.get_remain() >= 2)
+	if (argc < 2)
 	{
-		disassembly::line line;
-		line.address = buf.get_pos();
-
-		// decode uses a copy of the buffer state
-		hop68::buffer_reader buf_copy(buf);
-
-		// We can ignore the return code, since it just says "this instruction is valid"
-		// rather than "something catastrophic happened"
-		hop68::decode(line.inst, buf_copy, dsettings);
+		fprintf(stderr, "Error: No filename or hexstring\n");
+		usage();
+		return 1;
+	}
 
-		// Handle failure
-		disasm.lines.push_back(line);
 
-		buf.advance(line.inst.byte_count);
-	}
-	return 0;
-}
+	DECODE_MODE mode = MODE_TOS;
+	output_settings osettings = {};
+	osettings.show_address = false;
+	osettings.show_timings = false;
+	osettings.autolabel = true;
+	osettings.show_xrefs = false;
+	osettings.xref_report = false;
+	osettings.label_prefix = "L";
+	osettings.label_start_id = 0;
+	osettings.base_address = 0;
+	osettings.stream = false;
+	osettings.trace_filename = NULL;
+	osettings.trace_little_endian = false;
+	osettings.hotspot_count = 20;
+	osettings.coverage_filename = NULL;
+	osettings.coverage_bitmap = false;
+	osettings.coverage_follow = false;
+	osettings.pSignatures = NULL;
+	osettings.liveness = false;
+	osettings.window = false;
+	osettings.window_start = 0;
+	osettings.window_end = UINT32_MAX;
+	osettings.window_symbol = NULL;
+	osettings.pStats = NULL;
+	run_stats stats;
+
+	const char* diff_filename = NULL;
+	signature_db signatures;
+	bool make_signatures = false;
+	const char* save_db_filename = NULL;
+	const char* query_text = NULL;
+	bool duplicates = false;
+	bool abstract_registers = false;
+	bool batch = false;
+	batch_settings bsettings = {};
+	bsettings.num_threads = 0;
 
-// ----------------------------------------------------------------------------
-// Print a set of diassembled lines.
-int print(const symbols& symbols, const line_numbers& lines,
-	const disassembly& disasm, const output_settings& osettings, FILE* pOutput)
-{
-	// previous flag for timing pairs
-	uint8_t prev_flag = 0;
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000;
+	const int last_arg = argc - 1;							// last arg is reserved for filename or hex data.
 
-	size_t last_file_index = (size_t)-1;
-	symbols::sym_map::const_iterator sym_it = symbols.table.begin();
-	for (size_t i = 0; i < disasm.lines.size(); ++i)
+	for (int opt = 1; opt < last_arg; ++opt)
 	{
-		const disassembly::line& line = disasm.lines[i];
-		const hop68::instruction& inst = line.inst;
-
-		// TODO very naive label check
-		while (sym_it != symbols.table.end())
+		if (strcmp(argv[opt], "--bin") == 0)
+			mode = MODE_BIN;
+		else if (strcmp(argv[opt], "--disk") == 0)
+			mode = MODE_DISK;
+		else if (strcmp(argv[opt], "--server") == 0)
+			mode = MODE_SERVER;
+		else if (strcmp(argv[opt], "--load-db") == 0)
+			mode = MODE_DB;
+		else if (strcmp(argv[opt], "--save-db") == 0)
 		{
-			if (sym_it->first >= line.inst.address + line.inst.byte_count)
-				break;
-
-			const symbol& sym = sym_it->second;
-			uint32_t sym_off = sym.address - line.address;
-			if (sym_off)
-				fprintf(pOutput, "%s: = *+%u\n", sym.label.c_str(), sym_off);
+			opt++;
+			if (opt < last_arg)
+				save_db_filename = argv[opt];
 			else
-				fprintf(pOutput, "%s:\n", sym.label.c_str());
-			++sym_it;
+			{
+				fprintf(stderr, "Error: --save-db misses parameter\n");
+				return 1;
+			}
 		}
-
-		// Debug line-number checks
-		line_numbers::line ln;
-		if (lines.find(line.address, ln))
+		else if (strcmp(argv[opt], "--stream") == 0)
+			osettings.stream = true;
+		else if (strcmp(argv[opt], "--hex") == 0)
+			mode = MODE_HEX;							// Hex is now just a mode switch like --bin
+		else if (strcmp(argv[opt], "--address") == 0)
+			osettings.show_address = true;
+		else if (strcmp(argv[opt], "--timings") == 0)
+			osettings.show_timings = true;
+		else if (strcmp(argv[opt], "--no-labels") == 0)
+			osettings.autolabel = false;
+		else if (strcmp(argv[opt], "--xrefs") == 0)
+			osettings.show_xrefs = true;
+		else if (strcmp(argv[opt], "--xref-report") == 0)
+			osettings.xref_report = true;
+		else if (strcmp(argv[opt], "--liveness") == 0)
+			osettings.liveness = true;
+		else if (strcmp(argv[opt], "--m68010") == 0)
+			dsettings.cpu_type = hop68::CPU_TYPE_68010;
+		else if (strcmp(argv[opt], "--m68020") == 0)
+			dsettings.cpu_type = hop68::CPU_TYPE_68020;
+		else if (strcmp(argv[opt], "--m68030") == 0)
+			dsettings.cpu_type = hop68::CPU_TYPE_68030;
+		else if (strcmp(argv[opt], "--label-prefix") == 0)
 		{
-			if (ln.file_index != last_file_index)
+			opt++;
+			if (opt < last_arg)
+			{
+				osettings.label_prefix = argv[opt];
+			}
+			else
 			{
-				// Change of active file
-				std::string filename = lines.filenames[ln.file_index];
-				fprintf(pOutput, "; File: %s\n", filename.c_str());
-				last_file_index = ln.file_index;
+				fprintf(stderr, "Error: --label-prefix misses parameter\n");
+				return 1;
 			}
-			fprintf(pOutput, "; line %04u:\n", ln.line);
 		}
-
-		fprintf(pOutput, "\t");
-		int count = print(inst, symbols, line.address, pOutput);
-
-		// Insert tabs up to 32 characters
-		// NOTE: assumes tab size of 8
-		if (osettings.show_address)
+		else if (strcmp(argv[opt], "--base") == 0)
 		{
-			while (count < 32)
+			opt++;
+			if (opt >= last_arg || !parse_address(argv[opt], osettings.base_address))
 			{
-				fprintf(pOutput, "\t");
-				count = ((count + 8) / 8) * 8;
+				fprintf(stderr, "Error: --base misses parameter or is not a number\n");
+				return 1;
 			}
-			fprintf(pOutput, "; %x", inst.address);
 		}
-
-		if (osettings.show_timings && inst.opcode != hop68::Opcode::NONE)
+		else if (strcmp(argv[opt], "--start") == 0 || strcmp(argv[opt], "--end") == 0)
+		{
+			const char* name = argv[opt];
+			uint32_t& address = strcmp(name, "--start") == 0 ? osettings.window_start : osettings.window_end;
+			opt++;
+			if (opt >= last_arg || !parse_address(argv[opt], address))
+			{
+				fprintf(stderr, "Error: %s misses parameter or is not a number\n", name);
+				return 1;
+			}
+			osettings.window = true;
+		}
+		else if (strcmp(argv[opt], "--symbol") == 0)
 		{
-			hop68::timing timing;
-			if (calc_timing(inst, timing) != 0)
+			opt++;
+			if (opt < last_arg)
 			{
-				fprintf(pOutput, "\t; ?");
+				osettings.window_symbol = argv[opt];
+				osettings.window = true;
 			}
 			else
 			{
-				// Adjust timing for pairing.
-				// By default, round up to a multiple of four.
-				uint16_t time = (timing.min + 3) & 0xfffc;
-				const char* comment = "";
-
-				// Exception: previous inst has pair_back and we have pair_front,
-				// in which case we subtract 4
-				if ((prev_flag & PAIR_BACK) && (timing.flags & PAIR_FRONT))
-				{
-					time -= 4;
-					comment = " (pair)";
-				}
-				fprintf(pOutput, "\t; %d%s", time, comment);
+				fprintf(stderr, "Error: --symbol misses parameter\n");
+				return 1;
 			}
-			prev_flag = timing.flags;
 		}
-		else
+		else if (strcmp(argv[opt], "--stats") == 0)
+			osettings.pStats = &stats;
+		else if (strcmp(argv[opt], "--trace") == 0)
 		{
-			prev_flag = 0;
+			opt++;
+			if (opt < last_arg)
+			{
+				osettings.trace_filename = argv[opt];
+			}
+			else
+			{
+				fprintf(stderr, "Error: --trace misses parameter\n");
+				return 1;
+			}
 		}
-
-		fprintf(pOutput, "\n");
-	}
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-// Find addresses referenced by disasm instructions and add them to the
-// symbol table
-void add_reference_symbols(const disassembly& disasm, const output_settings& settings, symbols& symbols)
-{
-	uint32_t label_id = settings.label_start_id;
-	uint32_t last_address = disasm.lines.back().address;
-
-	for (size_t i = 0; i < disasm.lines.size(); ++i)
-	{
-		const disassembly::line& line = disasm.lines[i];
-		uint32_t target_address;
-
-		if (calc_relative_address(line.inst.op0, line.address, target_address))
+		else if (strcmp(argv[opt], "--coverage") == 0 || strcmp(argv[opt], "--coverage-bitmap") == 0)
 		{
-			symbol sym;
-			if (!find_symbol(symbols, target_address, sym))
+			osettings.coverage_bitmap = strcmp(argv[opt], "--coverage-bitmap") == 0;
+			opt++;
+			if (opt < last_arg)
 			{
-				sym.address = target_address;
-				sym.section = symbol::section_type::TEXT;
-				add_symbol(symbols, sym);
-				++label_id;
+				osettings.coverage_filename = argv[opt];
+			}
+			else
+			{
+				fprintf(stderr, "Error: %s misses parameter\n", argv[opt - 1]);
+				return 1;
 			}
 		}
-
-		if (line.inst.op0.type == hop68::ABSOLUTE_LONG)
+		else if (strcmp(argv[opt], "--diff") == 0)
 		{
-			target_address = line.inst.op0.absolute_long.longaddr;
-			symbol sym;
-			if (target_address <= last_address && !find_symbol(symbols, target_address, sym))
+			opt++;
+			if (opt < last_arg)
+			{
+				diff_filename = argv[opt];
+			}
+			else
 			{
-				sym.address = target_address;
-				sym.section = symbol::section_type::TEXT;
-				add_symbol(symbols, sym);
-				++label_id;
+				fprintf(stderr, "Error: --diff misses parameter\n");
+				return 1;
 			}
 		}
-
-		if (calc_relative_address(line.inst.op1, line.address, target_address))
+		else if (strcmp(argv[opt], "--signatures") == 0)
 		{
-			symbol sym;
-			if (!find_symbol(symbols, target_address, sym))
+			opt++;
+			if (opt < last_arg)
+			{
+				if (signatures.load(argv[opt]))
+					return 1;
+				osettings.pSignatures = &signatures;
+			}
+			else
 			{
-				sym.address = target_address;
-				sym.section = symbol::section_type::TEXT;
-				add_symbol(symbols, sym);
-				++label_id;
+				fprintf(stderr, "Error: --signatures misses parameter\n");
+				return 1;
 			}
 		}
-	}
-}
-
-// ----------------------------------------------------------------------------
-//	TOS EXECUTABLE READING
-// ----------------------------------------------------------------------------
-struct tos_header
-{
-   //  See http://toshyp.atari.org/en/005005.html for TOS header details
-	uint16_t  ph_branch;	  /* Branch to start of the program  */
-							  /* (must be 0x601a!)			   */
-
-	uint32_t  ph_tlen;		  /* Length of the TEXT segment	  */
-	uint32_t  ph_dlen;		  /* Length of the DATA segment	  */
-	uint32_t  ph_blen;		  /* Length of the BSS segment	   */
-	uint32_t  ph_slen;		  /* Length of the symbol table	  */
-	uint32_t  ph_res1;		  /* Reserved, should be 0;		  */
-							  /* Required by PureC			   */
-	uint32_t  ph_prgflags;	  /* Program flags				   */
-	uint16_t  ph_absflag;	  /* 0 = Relocation info present	 */
-};
-
-// ----------------------------------------------------------------------------
-//	DRI SYMBOL READING
-// ----------------------------------------------------------------------------
-static const int DRI_TABLE_SIZE = 14;
-static const uint16_t DRI_EXT_SYMBOL_FLAG = 0x0048;
-static const uint16_t DRI_SECT_TEXT = 0x0200;
-static const uint16_t DRI_SECT_DATA = 0x0400;
-static const uint16_t DRI_SECT_BSS  = 0x0100;
-
-int read_symbols(hop68::buffer_reader& buf, const tos_header& header, symbols& symbols)
-{
-	// Calculate text, data and bss addresses
-	uint32_t text_address = 0;
-	uint32_t data_address = text_address + header.ph_tlen;
-	uint32_t bss_address  = data_address + header.ph_dlen;
-
-	while (buf.get_remain() >= DRI_TABLE_SIZE)
-	{
-		uint8_t name[8 + 14 + 1];
-		uint16_t symbol_id;
-		uint32_t symbol_address;
-
-		// Name (8 bytes) -> ID (2 bytes) -> address (4 bytes)
-		memset(name, 0, sizeof(name));
-		if (buf.read(name, 8))
-			return 1;
-		if (buf.read_word(symbol_id))
-			return 1;
-		if (buf.read_long(symbol_address))
-			return 1;
-
-		// Looks like either bit denotes an extended symbol??
-		if ((symbol_id & DRI_EXT_SYMBOL_FLAG) != 0)
+		else if (strcmp(argv[opt], "--query") == 0)
 		{
-			// 14 bytes: symbol name extended
-			if (buf.read(name + 8, 14))
+			opt++;
+			if (opt < last_arg)
+			{
+				query_text = argv[opt];
+			}
+			else
+			{
+				fprintf(stderr, "Error: --query misses parameter\n");
 				return 1;
+			}
 		}
-
-		printf("; Symbol %s addr: %d id:%x\n", (const char*)name, symbol_address, symbol_id);
-
-		symbol sym;
-		sym.label = std::string((const char*)name);
-		sym.address = symbol_address;
-		sym.section = symbol::section_type::UNKNOWN;
-
-		// Parse the flags to work out which section, then resolve an address
-		switch (symbol_id & 0xf00)
+		else if (strcmp(argv[opt], "--duplicates") == 0)
+			duplicates = true;
+		else if (strcmp(argv[opt], "--abstract-registers") == 0)
+			abstract_registers = true;
+		else if (strcmp(argv[opt], "--make-signatures") == 0)
+			make_signatures = true;
+		else if (strcmp(argv[opt], "--follow") == 0)
+			osettings.coverage_follow = true;
+		else if (strcmp(argv[opt], "--trace-le") == 0)
+			osettings.trace_little_endian = true;
+		else if (strcmp(argv[opt], "--top") == 0)
 		{
-			case DRI_SECT_TEXT: sym.section = symbol::section_type::TEXT; sym.address += text_address; break;
-			case DRI_SECT_DATA: sym.section = symbol::section_type::DATA; sym.address += data_address; break;
-			case DRI_SECT_BSS:  sym.section = symbol::section_type::BSS;  sym.address += bss_address;  break;
-			default:
-				break;
+			opt++;
+			if (opt < last_arg)
+			{
+				osettings.hotspot_count = atoi(argv[opt]);
+			}
+			else
+			{
+				fprintf(stderr, "Error: --top misses parameter\n");
+				return 1;
+			}
 		}
-		if (sym.section != symbol::section_type::UNKNOWN)
-			add_symbol(symbols, sym);
-	}
-
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-//	DEBUG LINE READING
-// ----------------------------------------------------------------------------
-// Read N bytes of string data in to a std::string, omitting pad bytes
-static int read_string(hop68::buffer_reader& buf, uint32_t length, std::string& str)
-{
-	uint8_t ch;
-	for (uint32_t i = 0; i < length; ++i)
-	{
-		if (buf.read_byte(ch))
+		else if (strcmp(argv[opt], "--batch") == 0)
+			batch = true;
+		else if (strcmp(argv[opt], "--out-dir") == 0)
+		{
+			opt++;
+			if (opt < last_arg)
+			{
+				bsettings.output_dir = argv[opt];
+			}
+			else
+			{
+				fprintf(stderr, "Error: --out-dir misses parameter\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[opt], "--jobs") == 0)
+		{
+			opt++;
+			if (opt < last_arg)
+			{
+				bsettings.num_threads = atoi(argv[opt]);
+			}
+			else
+			{
+				fprintf(stderr, "Error: --jobs misses parameter\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[opt], "--label-start") == 0)
+		{
+			opt++;
+			if (opt < last_arg)
+			{
+				osettings.label_start_id = atoi(argv[opt]);
+			}
+			else
+			{
+				fprintf(stderr, "Error: --label-start misses parameter\n");
+				return 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Error: Unknown option: '%s'\n", argv[opt]);
+			usage();
 			return 1;
-		if (ch)	// Don't add any padded zero bytes
-			str += (char)ch;
+		}
 	}
-	return 0;
-}
 
-// ----------------------------------------------------------------------------
-// Read hunk of "LINE" format line information.
-// This is a simple set of "line", "pc" 8-byte structures
-static int read_debug_line_info(hop68::buffer_reader& buf, line_numbers& lines, uint32_t offset)
-{
-	// Filename length is stored as divided by 4
-	uint32_t flen;
-	if (buf.read_long(flen))
-		return 1;
-	flen <<= 2;
-	std::string fname;
-	if (read_string(buf, flen, fname))
-		return 1;
-	size_t file_index = lines.add_filename(fname.c_str());
-
-	// Calculate remaining number of structures to read
-	uint32_t numlines = buf.get_remain() / 8;
-	while (numlines)
+	if ((osettings.trace_filename || osettings.coverage_filename) &&
+		(batch || osettings.stream || (mode != MODE_TOS && mode != MODE_BIN)))
 	{
-		uint32_t line, pc;
-		if (buf.read_long(line))
-			return 1;
-		if (buf.read_long(pc))
-			return 1;
-
-		lines.add(file_index, line, pc + offset);
-		--numlines;
-	}
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-// Read a single compressed HCLN value (line or PC)
-// The format is a simple prefix compression:
-// 		 1 byte: return value if != 0
-// 	else 2 byte word: return value if != 0
-//  else 4 byte long.
-static int read_hcln_long(hop68::buffer_reader& buf, uint32_t& val)
-{
-	uint8_t tmpB;
-	if (buf.read_byte(tmpB))
+		fprintf(stderr, "Error: --trace and --coverage can only be used with a single .prg or --bin file\n");
 		return 1;
-	if (tmpB)
+	}
+	if (osettings.coverage_follow && !osettings.coverage_filename)
 	{
-		val = tmpB; return 0;
+		fprintf(stderr, "Error: --follow needs --coverage or --coverage-bitmap\n");
+		return 1;
 	}
 
-	uint16_t tmpW;
-	if (buf.read_word(tmpW))
-		return 1;
-	if (tmpW)
+	if (osettings.pSignatures && (osettings.stream || mode == MODE_HEX || mode == MODE_SERVER || mode == MODE_DB))
 	{
-		val = tmpW; return 0;
+		fprintf(stderr, "Error: --signatures can't be used with --stream, --hex, --server or --load-db\n");
+		return 1;
 	}
 
-	return buf.read_long(val);
-}
-
-// ----------------------------------------------------------------------------
-// Read hunk of "HCLN" (HiSoft Compressed Line Number) format line information.
-static int read_debug_hcln_info(hop68::buffer_reader& buf, line_numbers& lines, uint32_t offset)
-{
-	uint32_t flen, numlines;
-	// Filename length is stored as divided by 4
-	if (buf.read_long(flen))
-		return 1;
-	std::string fname;
-	flen <<= 2;
-	if (read_string(buf, flen, fname))
+	if (osettings.liveness && (osettings.stream || mode == MODE_HEX || mode == MODE_SERVER))
+	{
+		fprintf(stderr, "Error: --liveness can't be used with --stream, --hex or --server\n");
 		return 1;
-	size_t file_index = lines.add_filename(fname.c_str());
+	}
 
-	if (buf.read_long(numlines))
-		return 1;
-	uint32_t curr_line = 0;
-	uint32_t curr_pc = offset;
-	while (numlines)
+	if (osettings.window)
 	{
-		uint32_t line, pc;
-		if (read_hcln_long(buf, line))
+		if (batch || osettings.stream || diff_filename || query_text || duplicates || make_signatures ||
+			osettings.trace_filename || osettings.coverage_filename || save_db_filename ||
+			(mode != MODE_TOS && mode != MODE_BIN && mode != MODE_DB))
+		{
+			fprintf(stderr, "Error: --start, --end and --symbol can only be used to disassemble a single .prg, --bin or --load-db file\n");
 			return 1;
-		if (read_hcln_long(buf, pc))
+		}
+		if (osettings.window_symbol && (osettings.window_start != 0 || osettings.window_end != UINT32_MAX))
+		{
+			fprintf(stderr, "Error: --symbol can't be used with --start or --end\n");
 			return 1;
-		// Accumulate current position
-		curr_line += line;
-		curr_pc += pc;
-		lines.add(file_index, curr_line, curr_pc);
-		--numlines;
+		}
 	}
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-static int add_reloc_label(uint32_t addr, hop68::buffer_reader& text_buf,
-	symbols& symbols)
-{
-	text_buf.set_pos(0);
-	if (addr + 4 > text_buf.get_remain())
-		return 0;
-
-	// This longword is relocated, so can be treated as a symbol.
-	// Read the longword value, then create a text symbol
-	uint32_t data;
-	text_buf.set_pos(addr);
-	if (text_buf.read_long(data))
-		return 1;
-	text_buf.set_pos(0);
 
-	symbol sym;
-	sym.address = data;
-	sym.section = symbol::section_type::TEXT;
-	sym.label = "";
-	add_symbol(symbols, sym);
-
-	// Flag that a relocation address existed
-	symbols.relocs[addr] = data;
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-// Read relocation information and debug line number information.
-static int read_reloc(hop68::buffer_reader& buf, hop68::buffer_reader& text_buf,
-	symbols& symbols, line_numbers& lines, bool autolabel)
-{
-	uint32_t addr;
-	if (buf.read_long(addr))
-		return 1;
-
-	// 0 at start meeans "no reloc info"
-	if (addr)
+	if (make_signatures)
 	{
-		if (autolabel)
-			add_reloc_label(addr, text_buf, symbols);
-		while (1)
+		if (batch || osettings.stream || diff_filename || query_text || duplicates || (mode != MODE_TOS && mode != MODE_BIN))
 		{
-			uint8_t offset;
-			if (buf.read_byte(offset))
-				return 1;
-			if (offset == 0)
-				break;
-
-			if (offset == 1)
-			{
-				addr += 254;
-				continue;
-			}
-			else
-			{
-				addr += offset;
-				if (autolabel)
-					add_reloc_label(addr, text_buf, symbols);
-			}
+			fprintf(stderr, "Error: --make-signatures can only be used with a single .prg or --bin file\n");
+			return 1;
+		}
+		const char* fname = argv[argc - 1];
+		mapped_file infile;
+		if (infile.open(fname))
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", fname);
+			return 1;
 		}
-	}
 
-	// Read debugging information
-	// Align to word
-	if (buf.get_pos() & 1)
-		buf.advance(1);
+		// Only the names from the symbol table are wanted
+		osettings.autolabel = false;
+		osettings.pSignatures = NULL;
+		loaded_program program;
+		int ret = mode == MODE_TOS ?
+			load_tos_program(infile.get_data(), infile.get_size(), dsettings, osettings, program, NULL) :
+			load_bin_program(infile.get_data(), infile.get_size(), dsettings, osettings, program);
+		if (ret == 0)
+			ret = write_signatures(program, stdout);
+		if (osettings.pStats)
+			stats.print(stderr);
+		return ret;
+	}
 
-	// Debug information is a set of blocks ("hunks"?) with a
-	// type and size, similar to IFF.
-	bool got_header = false;
-	while (buf.get_remain() >= 4)
+	if (save_db_filename)
 	{
-		uint32_t hunk_header;
-		uint32_t hlen, hstart, offset, htype;
-
-		if (buf.read_long(hunk_header))
+		if (batch || osettings.stream || diff_filename || query_text || duplicates || osettings.trace_filename ||
+			(mode != MODE_TOS && mode != MODE_BIN))
+		{
+			fprintf(stderr, "Error: --save-db can only be used with a single .prg or --bin file\n");
 			return 1;
-		if ( (hunk_header==0) && got_header)
-			break;			// zero might mean padded, so stop without error
-
-		// Expect the magic "this is a hunk" value
-		if (hunk_header != 0x3F1)
-			return 1;			// (bad file)
-
-		// Read hunk length, which is number of 32-byte longs
-		if (buf.read_long(hlen))
+		}
+		const char* fname = argv[argc - 1];
+		mapped_file infile;
+		if (infile.open(fname))
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", fname);
 			return 1;
-		// Convert header length to bytes
-		hlen <<= 2;
-		hstart = buf.get_pos();	// record position for jumping
+		}
+		loaded_program program;
+		int ret = load_program(mode == MODE_BIN ? PROGRAM_BIN : PROGRAM_TOS, infile.get_data(), infile.get_size(),
+			dsettings, osettings, program);
+		if (ret == 0)
+		{
+			stats_start_phase(osettings.pStats, "save database");
+			ret = save_analysis_db(program, dsettings.cpu_type, save_db_filename);
+			stats_end_phase(osettings.pStats);
+		}
+		if (osettings.pStats)
+			stats.print(stderr);
+		return ret;
+	}
 
-		// Create a sub-reader so we don't read off end of the hunk
-		hop68::buffer_reader hunk_buffer(buf.get_data(), hlen, buf.get_address());
-		// This appears to be an offset to apply to the PC values
-		if (hunk_buffer.read_long(offset))
+	if (query_text)
+	{
+		if (osettings.stream || diff_filename || duplicates || osettings.trace_filename ||
+			(mode != MODE_TOS && mode != MODE_BIN && mode != MODE_DB) || (batch && mode == MODE_DB))
+		{
+			fprintf(stderr, "Error: --query can only be used with .prg, --bin or --load-db files\n");
 			return 1;
-		if (hunk_buffer.read_long(htype))
+		}
+		instruction_query query;
+		if (query.parse(query_text))
 			return 1;
 
-		switch (htype)
-		{
-			// NOTE: the X-Debug example does stricter checks on format here.
-			// We just record that a header is found before the per-file hunks
-			// are encountered.
-			case 0x48454144: // "HEAD"
-				got_header = true;
-				break;
-			case 0x4c494e45: // "LINE"
-				read_debug_line_info(hunk_buffer, lines, offset);
-				break;
-			case 0x48434c4e: // "HCLN"
-				read_debug_hcln_info(hunk_buffer, lines, offset);
-				break;
-			default:
+		if (batch)
+		{
+			if (osettings.pStats)
+			{
+				fprintf(stderr, "Error: --stats can't be used with --batch\n");
+				return 1;
+			}
+			bsettings.binary = (mode == MODE_BIN);
+			std::vector<std::string> inputs;
+			if (collect_batch_inputs(argv[argc - 1], bsettings.binary, inputs))
 				return 1;
+			return process_batch_query(inputs, bsettings, query, dsettings, osettings, stdout) ? 1 : 0;
 		}
 
-		// Jump to next hunk
-		buf.set_pos(hstart + hlen);
-	}
-
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-int process_tos_file(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
-		const output_settings& osettings, FILE* pOutput)
-{
-	hop68::buffer_reader buf(data_ptr, size, 0);
-	tos_header header = {};
-
-	if (buf.read_word(header.ph_branch))
-		return 1;
-	if (buf.read_long(header.ph_tlen))
-		return 1;
-	if (buf.read_long(header.ph_dlen))
-		return 1;
-	if (buf.read_long(header.ph_blen))
-		return 1;
-	if (buf.read_long(header.ph_slen))
-		return 1;
-	if (buf.read_long(header.ph_res1))
-		return 1;
-	if (buf.read_long(header.ph_prgflags))
-		return 1;
-	if (buf.read_word(header.ph_absflag))
-		return 1;
-
-	if (header.ph_branch != 0x601a)
-		return 1;
-
-	fprintf(pOutput, "; Text size %d...\n", header.ph_tlen);
-	fprintf(pOutput, "; Data size %d...\n", header.ph_dlen);
-	fprintf(pOutput, "; BSS size  %d...\n", header.ph_blen);
-	fprintf(pOutput, "; Symbol size  %d...\n", header.ph_slen);
-
-	// Next section is text
-	fprintf(pOutput, "; Reading text section\n");
-	hop68::buffer_reader text_buf(buf.get_data(), header.ph_tlen, 0);
-
-	// Skip the text
-	buf.advance(header.ph_tlen);
-	hop68::buffer_reader data_buf(buf.get_data(), header.ph_dlen, 0);
-
-	// Skip the data
-	buf.advance(header.ph_dlen);
-
-	// (No BSS in the file, so symbols should be next)
-	hop68::buffer_reader symbol_buf(buf.get_data(), header.ph_slen, 0);
-
-	symbols exe_symbols;
-	line_numbers lines;
-
-	fprintf(pOutput, "; Reading symbols...\n");
-	int ret = read_symbols(symbol_buf, header, exe_symbols);
-	if (ret)
-	{
-		fprintf(stderr, "Error reading symbol table\n");
+		const char* fname = argv[argc - 1];
+		mapped_file infile;
+		if (infile.open(fname))
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", fname);
+			return 1;
+		}
+		size_t match_count = 0;
+		program_format format = mode == MODE_BIN ? PROGRAM_BIN : (mode == MODE_DB ? PROGRAM_DATABASE : PROGRAM_TOS);
+		int ret = query_file(infile.get_data(), infile.get_size(), format, query, dsettings,
+			osettings, NULL, match_count, stdout);
+		if (osettings.pStats)
+			stats.print(stderr);
 		return ret;
 	}
 
-	buf.advance(header.ph_slen);
-	hop68::buffer_reader reloc_buf(buf.get_data(), buf.get_remain(), 0);
-
-	// Read relocations (and autolabel them if necessary)
-	// Read line-information data from Hisoft tools
-	read_reloc(reloc_buf, text_buf, exe_symbols, lines, osettings.autolabel);
-
-	disassembly disasm;
-	if (decode_buf(text_buf, dsettings, disasm))
-		return 1;
-
-	// Scan decoded instructions and add labels from operands
-	if (osettings.autolabel)
-		add_reference_symbols(disasm, osettings, exe_symbols);
-
-	// Rename auto-labelled symbols to be in address-order
-	uint32_t id = osettings.label_start_id;
-	for (symbols::sym_map::iterator it = exe_symbols.table.begin();
-			it != exe_symbols.table.end();
-			++it)
+	if (abstract_registers && !duplicates)
 	{
-		if (it->second.label.size() == 0)
-			it->second.label = osettings.label_prefix + std::to_string(id++);
-	}
-
-	print(exe_symbols, lines, disasm, osettings, pOutput);
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-int process_bin_file(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
-		const output_settings& osettings, FILE* pOutput)
-{
-	hop68::buffer_reader buf(data_ptr, size, 0);
-	symbols bin_symbols;
-	line_numbers dummy_lines;
-
-	disassembly disasm;
-	if (decode_buf(buf, dsettings, disasm))
+		fprintf(stderr, "Error: --abstract-registers needs --duplicates\n");
 		return 1;
-
-	add_reference_symbols(disasm, osettings, bin_symbols);
-
-	print(bin_symbols, dummy_lines, disasm, osettings, pOutput);
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-static bool get_hex_value(char c, uint8_t& val)
-{
-	if (c >= '0' && c <= '9')
-	{
-		val = c - '0';
-		return true;
-	}
-	if (c >= 'A' && c <= 'F')
-	{
-		val = 10 + c - 'A';
-		return true;
 	}
-	if (c >= 'a' && c <= 'f')
+	if (duplicates)
 	{
-		val = 10 + c - 'a';
-		return true;
-	}
-	return false;
-}
-
-// ----------------------------------------------------------------------------
-static bool is_whitespace(char c)
-{
-	return c == ' ' || c == '\t';
-}
-
-// ----------------------------------------------------------------------------
-int process_hex_string(const char* hex_string, const hop68::decode_settings& dsettings, const output_settings& osettings, FILE* pOutput)
-{
-	size_t strsize = strlen(hex_string);
-	// Allocate maximum bound for data
-	size_t max_byte_count = strsize / 2;
-	uint8_t* data_ptr = (uint8_t*)malloc(max_byte_count);
-
-	size_t num_written = 0;
-	size_t read_index = 0;
-	// We need at least 2 chars left to parse a hex byte.
-	while (read_index <= strsize - 2)
-	{
-		uint8_t val1, val2;
-		// Get the next two bytes
-		bool success = get_hex_value(hex_string[read_index], val1);
-		success &= get_hex_value(hex_string[read_index + 1], val2);
-		read_index += 2;
-
-		if (!success)
+		if (osettings.stream || diff_filename || osettings.trace_filename ||
+			(mode != MODE_TOS && mode != MODE_BIN))
 		{
-			fprintf(stderr, "Not a valid hex string '%s'\n", hex_string);
-			free(data_ptr);
+			fprintf(stderr, "Error: --duplicates can only be used with .prg or --bin files\n");
 			return 1;
 		}
-		data_ptr[num_written++] = (val1 << 4) | val2;
-		// Skip any trailing whitespace
-		while (read_index < strsize && is_whitespace(hex_string[read_index]))
-			++read_index;
-	}
-	if (read_index != strsize)
-	{
-		// characters left at end of buffer
-		fprintf(stderr, "Not a valid hex string '%s'\n", hex_string);
-		free(data_ptr);
-		return 1;
-	}
 
-	// Wrap it up and decode
-	hop68::buffer_reader buf(data_ptr, num_written, 0);
-	disassembly disasm;
-	int ret = decode_buf(buf, dsettings, disasm);
-	free(data_ptr);
+		if (batch)
+		{
+			if (osettings.pStats)
+			{
+				fprintf(stderr, "Error: --stats can't be used with --batch\n");
+				return 1;
+			}
+			bsettings.binary = (mode == MODE_BIN);
+			std::vector<std::string> inputs;
+			if (collect_batch_inputs(argv[argc - 1], bsettings.binary, inputs))
+				return 1;
+			return process_batch_duplicates(inputs, bsettings, abstract_registers, dsettings, osettings,
+				stdout) ? 1 : 0;
+		}
 
-	if (ret)
+		const char* fname = argv[argc - 1];
+		mapped_file infile;
+		if (infile.open(fname))
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", fname);
+			return 1;
+		}
+		loaded_program program;
+		int ret = mode == MODE_TOS ?
+			load_tos_program(infile.get_data(), infile.get_size(), dsettings, osettings, program, NULL) :
+			load_bin_program(infile.get_data(), infile.get_size(), dsettings, osettings, program);
+		if (ret == 0)
+		{
+			stats_start_phase(osettings.pStats, "duplicates");
+			std::vector<routine_summary> routines;
+			summarise_routines(program, 0, abstract_registers, routines);
+			print_duplicates(routines, std::vector<std::string>(), stdout);
+			stats_end_phase(osettings.pStats);
+		}
+		if (osettings.pStats)
+			stats.print(stderr);
 		return ret;
+	}
 
-	// Print it out
-	symbols dummy_symbols;
-	line_numbers dummy_lines;
-
-	print(dummy_symbols, dummy_lines, disasm, osettings, pOutput);
-	return 0;
-}
-
-// ----------------------------------------------------------------------------
-// Operating mode: .prg file, binary file, or cmdline input
-enum DECODE_MODE
-{
-	MODE_TOS = 0,
-	MODE_BIN = 1,
-	MODE_HEX = 2
-};
-
-// ----------------------------------------------------------------------------
-void usage()
-{
-	fprintf(stdout, "hopper68\n\n"
-		"Usage: hopper68 [options] input_filename|hexstring\n\n"
-		"options:\n"
-		"\t--hex       Input argument is hex string rather than filename\n"
-		"\t--bin       Read binary file rather than .prg\n"
-		"\t--address   Print instruction addresses\n"
-		"\t--timings   Print estimated timings (Atari ST 68000 only)\n"
-		"\t--no-labels Do not add automatically-detected labels\n"
-		"\t--m68010\n"
-		"\t--m68020\n"
-		"\t--m68030    Select CPU type (default m68000)\n"
-		"\t--label-prefix <string>   Set prefix for auto-labels\n"
-		"\t--label-start <int>       Set starting suffix number for auto-labels\n"
-	);
-}
-
-// ----------------------------------------------------------------------------
-int main(int argc, char** argv)
-{
-	if (argc < 2)
+	if (diff_filename)
 	{
-		fprintf(stderr, "Error: No filename or hexstring\n");
-		usage();
-		return 1;
+		if (batch || osettings.stream || osettings.trace_filename || osettings.coverage_filename ||
+			(mode != MODE_TOS && mode != MODE_BIN))
+		{
+			fprintf(stderr, "Error: --diff can only be used with two .prg or --bin files\n");
+			return 1;
+		}
+		const char* fname = argv[argc - 1];
+		mapped_file old_file, new_file;
+		if (old_file.open(diff_filename))
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", diff_filename);
+			return 1;
+		}
+		if (new_file.open(fname))
+		{
+			fprintf(stderr, "Error: Can't read file: %s\n", fname);
+			return 1;
+		}
+		diff_input old_input = { old_file.get_data(), old_file.get_size(), diff_filename };
+		diff_input new_input = { new_file.get_data(), new_file.get_size(), fname };
+		int ret = process_diff(old_input, new_input, mode == MODE_BIN, dsettings, osettings, stdout);
+		if (osettings.pStats)
+			stats.print(stderr);
+		return ret;
 	}
 
-
-	DECODE_MODE mode = MODE_TOS;
-	output_settings osettings = {};
-	osettings.show_address = false;
-	osettings.show_timings = false;
-	osettings.autolabel = true;
-	osettings.label_prefix = "L";
-	osettings.label_start_id = 0;
-
-	hop68::decode_settings dsettings = {};
-	dsettings.cpu_type = hop68::CPU_TYPE_68000;
-	const int last_arg = argc - 1;							// last arg is reserved for filename or hex data.
-
-	for (int opt = 1; opt < last_arg; ++opt)
+	if (mode == MODE_SERVER)
 	{
-		if (strcmp(argv[opt], "--bin") == 0)
-			mode = MODE_BIN;
-		else if (strcmp(argv[opt], "--hex") == 0)
-			mode = MODE_HEX;							// Hex is now just a mode switch like --bin
-		else if (strcmp(argv[opt], "--address") == 0)
-			osettings.show_address = true;
-		else if (strcmp(argv[opt], "--timings") == 0)
-			osettings.show_timings = true;
-		else if (strcmp(argv[opt], "--no-labels") == 0)
-			osettings.autolabel = false;
-		else if (strcmp(argv[opt], "--m68010") == 0)
-			dsettings.cpu_type = hop68::CPU_TYPE_68010;
-		else if (strcmp(argv[opt], "--m68020") == 0)
-			dsettings.cpu_type = hop68::CPU_TYPE_68020;
-		else if (strcmp(argv[opt], "--m68030") == 0)
-			dsettings.cpu_type = hop68::CPU_TYPE_68030;
-		else if (strcmp(argv[opt], "--label-prefix") == 0)
+		if (batch)
 		{
-			opt++;
-			if (opt < last_arg)
-			{
-				osettings.label_prefix = argv[opt];
-			}
-			else
-			{
-				fprintf(stderr, "Error: --label-prefix misses parameter\n");
-				return 1;
-			}
+			fprintf(stderr, "Error: --batch can't be used with --server\n");
+			return 1;
 		}
-		else if (strcmp(argv[opt], "--label-start") == 0)
+		const char* path = argv[argc - 1];
+		if (strcmp(path, "-") == 0)
+			return serve_stream(stdin, stdout);
+		return serve_socket(path);
+	}
+	else if (batch)
+	{
+		if (mode == MODE_HEX || mode == MODE_DISK || mode == MODE_DB)
 		{
-			opt++;
-			if (opt < last_arg)
-			{
-				osettings.label_start_id = atoi(argv[opt]);
-			}
-			else
-			{
-				fprintf(stderr, "Error: --label-start misses parameter\n");
-				return 1;
-			}
+			fprintf(stderr, "Error: --batch can't be used with --hex, --disk or --load-db\n");
+			return 1;
 		}
-		else
+		if (osettings.pStats)
 		{
-			fprintf(stderr, "Error: Unknown option: '%s'\n", argv[opt]);
-			usage();
+			fprintf(stderr, "Error: --stats can't be used with --batch\n");
 			return 1;
 		}
+		bsettings.binary = (mode == MODE_BIN);
+		std::vector<std::string> inputs;
+		if (collect_batch_inputs(argv[argc - 1], bsettings.binary, inputs))
+			return 1;
+		return process_batch(inputs, bsettings, dsettings, osettings) ? 1 : 0;
 	}
-
-	if (mode != MODE_HEX)
+	else if (mode == MODE_BIN && osettings.stream)
 	{
 		const char* fname = argv[argc - 1];
-		FILE* pInfile = fopen(fname, "rb");
+		FILE* pInfile = strcmp(fname, "-") == 0 ? stdin : fopen(fname, "rb");
 		if (!pInfile)
 		{
 			fprintf(stderr, "Error: Can't open file: %s\n", fname);
 			return 1;
 		}
-
-		(void) fseek(pInfile, 0, SEEK_END);
-		long size = ftell(pInfile);
-
-		rewind(pInfile);
-		uint8_t* data_ptr = (uint8_t*) malloc(size);
-		long readBytes = fread(data_ptr, 1, size, pInfile);
-		fclose(pInfile);
-		if (readBytes != size)
+		int ret = process_bin_stream(pInfile, dsettings, osettings, stdout);
+		if (pInfile != stdin)
+			fclose(pInfile);
+		if (osettings.pStats)
+			stats.print(stderr);
+		return ret;
+	}
+	else if (mode != MODE_HEX)
+	{
+		const char* fname = argv[argc - 1];
+		mapped_file infile;
+		stats_start_phase(osettings.pStats, "open input");
+		if (infile.open(fname))
 		{
-			fprintf(stderr, "Error: Failed to read file contents\n");
+			fprintf(stderr, "Error: Can't read file: %s\n", fname);
 			return 1;
 		}
+		stats_end_phase(osettings.pStats);
 		int ret = 0;
 		if (mode == MODE_TOS)
-			ret = process_tos_file(data_ptr, size, dsettings, osettings, stdout);
+			ret = process_tos_file(infile.get_data(), infile.get_size(), dsettings, osettings, stdout);
 		else if (mode == MODE_BIN)
-			ret = process_bin_file(data_ptr, size, dsettings, osettings, stdout);
-
-		free(data_ptr);
+			ret = process_bin_file(infile.get_data(), infile.get_size(), dsettings, osettings, stdout);
+		else if (mode == MODE_DB)
+			ret = process_database_file(infile.get_data(), infile.get_size(), osettings, stdout);
+		else if (mode == MODE_DISK)
+			ret = process_disk_image(infile.get_data(), infile.get_size(), dsettings, osettings, stdout);
+		if (osettings.pStats)
+		{
+			stats.end_phase();
+			stats.print(stderr);
+		}
 		return ret;
 	}
 	else if (mode == MODE_HEX)
@@ -0,0 +1,128 @@
+// Read-only access to the whole contents of an input file.
+#include "mapfile.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPFILE_USE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Used for empty files, so get_data() is never NULL after a successful open
+static const uint8_t g_empty_file[1] = { 0 };
+
+// First buffer size when reading, doubled as needed
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+
+// ----------------------------------------------------------------------------
+mapped_file::mapped_file() :
+	m_pData(NULL),
+	m_size(0),
+	m_mapped(false)
+{
+}
+
+// ----------------------------------------------------------------------------
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+// ----------------------------------------------------------------------------
+int mapped_file::open(const char* filename)
+{
+	close();
+#ifdef MAPFILE_USE_MMAP
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		void* pMap = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (pMap != MAP_FAILED)
+		{
+#ifdef MADV_SEQUENTIAL
+			// Decoding mostly walks forwards through the file
+			madvise(pMap, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+			::close(fd);
+			m_pData = (const uint8_t*)pMap;
+			m_size = (long)st.st_size;
+			m_mapped = true;
+			return 0;
+		}
+	}
+	::close(fd);
+#endif
+	// Mapping isn't possible (e.g. empty file, pipe), so read it instead
+	return read_file(filename);
+}
+
+// ----------------------------------------------------------------------------
+void mapped_file::close()
+{
+#ifdef MAPFILE_USE_MMAP
+	if (m_mapped)
+		munmap((void*)m_pData, (size_t)m_size);
+#endif
+	if (!m_mapped && m_pData != g_empty_file)
+		free((void*)m_pData);
+	m_pData = NULL;
+	m_size = 0;
+	m_mapped = false;
+}
+
+// ----------------------------------------------------------------------------
+int mapped_file::read_file(const char* filename)
+{
+	FILE* pInfile = fopen(filename, "rb");
+	if (!pInfile)
+		return 1;
+
+	// Pipes have no size to ask for, so read until the end, growing the buffer
+	size_t capacity = 0;
+	size_t size = 0;
+	uint8_t* data_ptr = NULL;
+	for (;;)
+	{
+		if (size == capacity)
+		{
+			capacity = capacity ? capacity * 2 : READ_CHUNK_SIZE;
+			uint8_t* new_ptr = (uint8_t*) realloc(data_ptr, capacity);
+			if (!new_ptr)
+			{
+				free(data_ptr);
+				fclose(pInfile);
+				return 1;
+			}
+			data_ptr = new_ptr;
+		}
+		size_t readBytes = fread(data_ptr + size, 1, capacity - size, pInfile);
+		size += readBytes;
+		if (readBytes == 0)
+			break;
+	}
+	bool failed = ferror(pInfile) != 0;
+	fclose(pInfile);
+	if (failed || size > (size_t)LONG_MAX)
+	{
+		free(data_ptr);
+		return 1;
+	}
+	if (size == 0)
+	{
+		free(data_ptr);
+		m_pData = g_empty_file;
+		return 0;
+	}
+	m_pData = data_ptr;
+	m_size = (long)size;
+	return 0;
+}
@@ -0,0 +1,36 @@
+// Read-only access to the whole contents of an input file.
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+// Uses a read-only memory mapping where the platform supports it, so large
+// files are paged in on demand and shared between processes. Falls back to
+// reading the file into allocated memory.
+class mapped_file
+{
+public:
+	mapped_file();
+	~mapped_file();
+
+	// Returns 0 for success, 1 for failure
+	int open(const char* filename);
+	void close();
+
+	const uint8_t* get_data() const		{ return m_pData; }
+	long get_size() const				{ return m_size; }
+	bool is_mapped() const				{ return m_mapped; }
+
+private:
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+
+	int read_file(const char* filename);
+
+	const uint8_t*	m_pData;
+	long			m_size;
+	bool			m_mapped;		// true if m_pData is a mapping rather than malloc'ed
+};
+
+#endif
@@ -4,6 +4,7 @@
 #ifndef PRINT_H
 #define PRINT_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -11,14 +12,17 @@ namespace hop68
 {
 // Forward declarations
 struct instruction;
-struct operand;
 }
 class symbols;
 
-// Check if an opcode jumps to another known address, and return that address
-extern bool calc_relative_address(const hop68::operand& op, uint32_t inst_address, uint32_t& target_address);
+// Write an instruction's opcode and operands into "buffer", using hop68::format()
+// with labels from the symbol table.
+// Returns the length of the full text, which was truncated if >= size.
+extern size_t format(const hop68::instruction& inst, const symbols& symbols, uint32_t inst_address,
+	char* buffer, size_t size);
 
-// Write out an instruction's opcode and operands to the file stream.
+// Write out an instruction's opcode and operands to the file stream, using
+// hop68::format() with labels from the symbol table.
 // Returns number of chars written
 extern int print(const hop68::instruction& inst, const symbols& symbols, uint32_t inst_address, FILE* pFile);
 
@@ -0,0 +1,1903 @@
+#include "process.h"
+
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include <cstring>
+#include <ctype.h>
+#include <algorithm>
+
+#include "lib/buffer68.h"
+#include "lib/flow68.h"
+#include "lib/format68.h"
+#include "lib/regs68.h"
+#include "lib/timing68.h"
+#include "lib/xref68.h"
+#include "blocks.h"
+#include "coverage.h"
+#include "database.h"
+#include "print.h"
+#include "profile.h"
+#include "scan.h"
+#include "signatures.h"
+#include "disk.h"
+#include "liveness.h"
+#include "stats.h"
+
+// ----------------------------------------------------------------------------
+// Read the buffer in a simple single pass.
+int decode_buf(hop68::buffer_reader& buf, const hop68::decode_settings& dsettings, disassembly& disasm)
+{
+	while (buf.get_remain() >= 2)
+	{
+		disassembly::line line;
+		line.address = buf.get_address();
+
+		// decode uses a copy of the buffer state
+		hop68::buffer_reader buf_copy(buf);
+
+		// We can ignore the return code, since it just says "this instruction is valid"
+		// rather than "something catastrophic happened"
+		hop68::decode(line.inst, buf_copy, dsettings);
+
+		// Handle failure
+		disasm.lines.push_back(line);
+
+		buf.advance(line.inst.byte_count);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Print an address as an offset from the nearest preceding symbol, if possible.
+void print_symbol_offset(const symbols& symbols, uint32_t address, FILE* pOutput)
+{
+	symbols::sym_map::const_iterator it = symbols.table.upper_bound(address);
+	if (it == symbols.table.begin())
+	{
+		fprintf(pOutput, "$%x", address);
+		return;
+	}
+	--it;
+	uint32_t offset = address - it->first;
+	if (offset)
+		fprintf(pOutput, "%s+$%x", it->second.label.c_str(), offset);
+	else
+		fprintf(pOutput, "%s", it->second.label.c_str());
+}
+
+// ----------------------------------------------------------------------------
+// Print all the references to an address as comments.
+static void print_xrefs(const symbols& symbols, const hop68::xref_index& xrefs,
+	uint32_t address, FILE* pOutput)
+{
+	const hop68::xref* refs;
+	size_t count = xrefs.find(address, refs);
+	for (size_t i = 0; i < count; ++i)
+	{
+		fprintf(pOutput, "; xref: ");
+		print_symbol_offset(symbols, refs[i].source, pOutput);
+		fprintf(pOutput, " (%s)\n", hop68::get_xref_kind_string((hop68::XrefKind)refs[i].kind));
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Print the labels for all symbols from "sym_it" up to "end_address".
+// Symbols after "address" are printed as offsets from the current position.
+static void print_labels(const symbols& symbols, const hop68::xref_index& xrefs,
+	const output_settings& osettings, symbols::sym_map::const_iterator& sym_it,
+	uint32_t address, uint32_t end_address, FILE* pOutput)
+{
+	while (sym_it != symbols.table.end())
+	{
+		if (sym_it->first >= end_address)
+			break;
+
+		const symbol& sym = sym_it->second;
+		int32_t sym_off = (int32_t)(sym.address - address);
+		if (sym_off)
+			fprintf(pOutput, "%s: = *%+d\n", sym.label.c_str(), sym_off);
+		else
+			fprintf(pOutput, "%s:\n", sym.label.c_str());
+		if (osettings.show_xrefs)
+			print_xrefs(symbols, xrefs, sym.address, pOutput);
+		++sym_it;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Print a single disassembled line, plus any labels and line numbers.
+void print_line(const symbols& symbols, const line_numbers& lines, const hop68::xref_index& xrefs,
+	const disassembly::line& line, const output_settings& osettings, print_state& state, FILE* pOutput)
+{
+	const hop68::instruction& inst = line.inst;
+
+	// TODO very naive label check
+	print_labels(symbols, xrefs, osettings, state.sym_it, line.address,
+		line.inst.address + line.inst.byte_count, pOutput);
+
+	// Debug line-number checks
+	line_numbers::line ln;
+	if (lines.find(line.address, ln))
+	{
+		if (ln.file_index != state.last_file_index)
+		{
+			// Change of active file
+			std::string filename = lines.filenames[ln.file_index];
+			fprintf(pOutput, "; File: %s\n", filename.c_str());
+			state.last_file_index = ln.file_index;
+		}
+		fprintf(pOutput, "; line %04u:\n", ln.line);
+	}
+
+	fprintf(pOutput, "\t");
+	int count = print(inst, symbols, line.address, pOutput);
+
+	// Insert tabs up to 32 characters
+	// NOTE: assumes tab size of 8
+	if (osettings.show_address)
+	{
+		while (count < 32)
+		{
+			fprintf(pOutput, "\t");
+			count = ((count + 8) / 8) * 8;
+		}
+		fprintf(pOutput, "; %x", inst.address);
+	}
+
+	if (osettings.show_timings && inst.opcode != hop68::Opcode::NONE)
+	{
+		hop68::timing timing;
+		if (calc_timing(inst, timing) != 0)
+		{
+			fprintf(pOutput, "\t; ?");
+		}
+		else
+		{
+			// Adjust timing for pairing.
+			// By default, round up to a multiple of four.
+			uint16_t time = (timing.min + 3) & 0xfffc;
+			const char* comment = "";
+
+			// Exception: previous inst has pair_back and we have pair_front,
+			// in which case we subtract 4
+			if ((state.prev_flag & PAIR_BACK) && (timing.flags & PAIR_FRONT))
+			{
+				time -= 4;
+				comment = " (pair)";
+			}
+			fprintf(pOutput, "\t; %d%s", time, comment);
+		}
+		state.prev_flag = timing.flags;
+	}
+	else
+	{
+		state.prev_flag = 0;
+	}
+
+	if (state.pComments)
+	{
+		const std::string* comment = state.pComments->find(line.address);
+		if (comment)
+			fprintf(pOutput, "\t; %s", comment->c_str());
+	}
+
+	fprintf(pOutput, "\n");
+}
+
+// ----------------------------------------------------------------------------
+// Print a set of diassembled lines, with optional extra comments.
+int print(const symbols& symbols, const line_numbers& lines, const hop68::xref_index& xrefs,
+	const disassembly& disasm, const output_settings& osettings, FILE* pOutput,
+	const line_comments* pComments)
+{
+	print_state state(symbols, pComments);
+	// A window leaves out the labels before it
+	if (osettings.window && !disasm.lines.empty())
+		state.sym_it = symbols.table.lower_bound(disasm.lines.front().address);
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+		print_line(symbols, lines, xrefs, disasm.lines[i], osettings, state, pOutput);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+//	DATA SECTION OUTPUT
+// ----------------------------------------------------------------------------
+static const size_t MIN_STRING_LENGTH = 4;		// shortest run printed as a string
+static const size_t MIN_FILL_LENGTH = 8;		// shortest run printed with "dcb.b"
+static const size_t MAX_STRING_LINE = 64;		// most characters in one string line
+static const size_t MAX_DATA_ITEMS = 8;			// most values in one dc.b/dc.w line
+static const size_t MAX_STRING_TERMINATORS = 3;	// e.g. 13,10,0 after a string
+
+// ----------------------------------------------------------------------------
+// Returns true if a string or a fill starts at "data"
+static bool is_run_start(const uint8_t* data, size_t count)
+{
+	return scan_fill_run(data, std::min(count, MIN_FILL_LENGTH)) >= MIN_FILL_LENGTH ||
+		scan_string_run(data, std::min(count, MIN_STRING_LENGTH)) >= MIN_STRING_LENGTH;
+}
+
+// ----------------------------------------------------------------------------
+// Print a single line of data, using no more than "count" bytes.
+// Returns the number of bytes used.
+static size_t print_data_line(const uint8_t* data, size_t count, uint32_t address, FILE* pOutput)
+{
+	// Repeated bytes
+	size_t length = scan_fill_run(data, count);
+	if (length >= MIN_FILL_LENGTH)
+	{
+		fprintf(pOutput, "\tdcb.b    %u,$%02x\n", (unsigned int)length, data[0]);
+		return length;
+	}
+
+	// Printable text, with any trailing line-ending or null terminator. Only
+	// scan one line's worth, so long text stays linear to print.
+	length = scan_string_run(data, std::min(count, MAX_STRING_LINE));
+	if (length >= MIN_STRING_LENGTH)
+	{
+		fprintf(pOutput, "\tdc.b     \"%.*s\"", (int)length, (const char*)data);
+		for (size_t i = 0; i < MAX_STRING_TERMINATORS && length < count; ++i)
+		{
+			uint8_t c = data[length];
+			if (c != 0 && c != 10 && c != 13)
+				break;
+			if (is_run_start(data + length, count - length))
+				break;
+			fprintf(pOutput, ",%u", c);
+			++length;
+		}
+		fprintf(pOutput, "\n");
+		return length;
+	}
+
+	// Plain values. Use words where aligned.
+	bool words = ((address & 1) == 0) && count >= 2;
+	size_t item_size = words ? 2 : 1;
+	fprintf(pOutput, words ? "\tdc.w     " : "\tdc.b     ");
+	length = 0;
+	for (size_t item = 0; item < MAX_DATA_ITEMS; ++item)
+	{
+		if (length + item_size > count)
+			break;
+		if (length && is_run_start(data + length, count - length))
+			break;
+		if (length)
+			fprintf(pOutput, ",");
+		if (words)
+			fprintf(pOutput, "$%04x", (data[length] << 8) | data[length + 1]);
+		else
+			fprintf(pOutput, "$%02x", data[length]);
+		length += item_size;
+	}
+	fprintf(pOutput, "\n");
+	return length;
+}
+
+// ----------------------------------------------------------------------------
+// Print a range of memory as dc.b/dc.w/dc.l statements, with labels.
+// Relocated longwords are printed as labels.
+static void print_data_range(const symbols& symbols, const hop68::xref_index& xrefs,
+	const output_settings& osettings, const uint8_t* data, uint32_t size,
+	uint32_t data_address, FILE* pOutput)
+{
+	symbols::sym_map::const_iterator sym_it = symbols.table.lower_bound(data_address);
+	uint32_t pos = 0;
+	while (pos < size)
+	{
+		uint32_t address = data_address + pos;
+		uint32_t target;
+		if (pos + 4 <= size && find_reloc(symbols, address, target))
+		{
+			print_labels(symbols, xrefs, osettings, sym_it, address, address + 4, pOutput);
+			symbol sym;
+			if (find_symbol(symbols, target, sym))
+				fprintf(pOutput, "\tdc.l     %s\n", sym.label.c_str());
+			else
+				fprintf(pOutput, "\tdc.l     $%x\t; relocated\n", target);
+			pos += 4;
+			continue;
+		}
+
+		print_labels(symbols, xrefs, osettings, sym_it, address, address + 1, pOutput);
+
+		// Stop the line at the next label or relocation
+		uint32_t end = size;
+		if (sym_it != symbols.table.end() && sym_it->first - data_address < end)
+			end = sym_it->first - data_address;
+		symbols::reloc_map::const_iterator reloc_it = symbols.relocs.upper_bound(address);
+		if (reloc_it != symbols.relocs.end() && reloc_it->first - data_address < end)
+			end = reloc_it->first - data_address;
+
+		pos += print_data_line(data + pos, end - pos, address, pOutput);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Print the DATA section.
+static void print_data(const symbols& symbols, const hop68::xref_index& xrefs,
+	const output_settings& osettings, const uint8_t* data, uint32_t size,
+	uint32_t data_address, FILE* pOutput)
+{
+	if (size == 0)
+		return;
+
+	fprintf(pOutput, "\n\tdata\n");
+	print_data_range(symbols, xrefs, osettings, data, size, data_address, pOutput);
+}
+
+// ----------------------------------------------------------------------------
+// Print the text section when only some of it was decoded: the decoded lines,
+// with the bytes between them printed as data.
+static void print_code_and_data(const symbols& symbols, const line_numbers& lines,
+	const hop68::xref_index& xrefs, const disassembly& disasm, const output_settings& osettings,
+	const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	const line_comments* pComments, FILE* pOutput)
+{
+	print_state state(symbols, pComments);
+	uint32_t pos = 0;
+	for (size_t i = 0; i <= disasm.lines.size(); ++i)
+	{
+		uint32_t next = text_size;
+		if (i < disasm.lines.size())
+			next = disasm.lines[i].address - text_address;
+		if (next > pos)
+		{
+			print_data_range(symbols, xrefs, osettings, text + pos, next - pos, text_address + pos, pOutput);
+			state.sym_it = symbols.table.lower_bound(text_address + next);
+			state.prev_flag = 0;
+		}
+		if (i == disasm.lines.size())
+			break;
+
+		const disassembly::line& line = disasm.lines[i];
+		print_line(symbols, lines, xrefs, line, osettings, state, pOutput);
+		pos = next + line.inst.byte_count;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Print the BSS section as labels and "ds.b" statements.
+static void print_bss(const symbols& symbols, const hop68::xref_index& xrefs,
+	const output_settings& osettings, uint32_t size, uint32_t bss_address, FILE* pOutput)
+{
+	if (size == 0)
+		return;
+
+	fprintf(pOutput, "\n\tbss\n");
+	symbols::sym_map::const_iterator sym_it = symbols.table.lower_bound(bss_address);
+	uint32_t address = bss_address;
+	uint32_t end_address = bss_address + size;
+	while (address < end_address)
+	{
+		print_labels(symbols, xrefs, osettings, sym_it, address, address + 1, pOutput);
+		uint32_t next = end_address;
+		if (sym_it != symbols.table.end() && sym_it->first < next)
+			next = sym_it->first;
+		fprintf(pOutput, "\tds.b     %u\n", next - address);
+		address = next;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Print any remaining symbols past the end of the program, relative to the end.
+static void print_trailing_labels(const symbols& symbols, const hop68::xref_index& xrefs,
+	const output_settings& osettings, uint32_t end_address, FILE* pOutput)
+{
+	symbols::sym_map::const_iterator sym_it = symbols.table.lower_bound(end_address);
+	print_labels(symbols, xrefs, osettings, sym_it, end_address, UINT32_MAX, pOutput);
+}
+
+// ----------------------------------------------------------------------------
+// Add symbols for the addresses referenced by a single line. Absolute
+// addresses are only used if they are between "first_address" and "last_address".
+void add_line_reference_symbols(const disassembly::line& line, uint32_t first_address,
+	uint32_t last_address, symbols& symbols)
+{
+	uint32_t target_address;
+	if (hop68::calc_relative_address(line.inst.op0, line.address, target_address))
+	{
+		symbol sym;
+		if (!find_symbol(symbols, target_address, sym))
+		{
+			sym.address = target_address;
+			sym.section = symbol::section_type::TEXT;
+			add_symbol(symbols, sym);
+		}
+	}
+
+	if (line.inst.op0.type == hop68::ABSOLUTE_LONG)
+	{
+		target_address = line.inst.op0.absolute_long.longaddr;
+		symbol sym;
+		if (target_address >= first_address && target_address <= last_address &&
+			!find_symbol(symbols, target_address, sym))
+		{
+			sym.address = target_address;
+			sym.section = symbol::section_type::TEXT;
+			add_symbol(symbols, sym);
+		}
+	}
+
+	if (hop68::calc_relative_address(line.inst.op1, line.address, target_address))
+	{
+		symbol sym;
+		if (!find_symbol(symbols, target_address, sym))
+		{
+			sym.address = target_address;
+			sym.section = symbol::section_type::TEXT;
+			add_symbol(symbols, sym);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Find addresses referenced by disasm instructions and add them to the
+// symbol table
+void add_reference_symbols(const disassembly& disasm, symbols& symbols)
+{
+	if (disasm.lines.empty())
+		return;
+
+	uint32_t first_address = disasm.lines.front().address;
+	uint32_t last_address = disasm.lines.back().address;
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+		add_line_reference_symbols(disasm.lines[i], first_address, last_address, symbols);
+}
+
+// ----------------------------------------------------------------------------
+// Address register values known while scanning forward through a block.
+struct base_registers
+{
+	uint32_t value[8];
+	uint8_t known;				// bit per register
+};
+
+// ----------------------------------------------------------------------------
+// Decide whether a long address at "field_address" in the code can be
+// trusted: it must be relocated, or in a program without relocations, inside it.
+static bool is_base_address(const symbols& symbols, uint32_t field_address, uint32_t value,
+	uint32_t first_address, uint32_t end_address)
+{
+	if (symbols.relocs.empty())
+		return value >= first_address && value <= end_address;
+	uint32_t target;
+	return find_reloc(symbols, field_address, target) && target == value;
+}
+
+// ----------------------------------------------------------------------------
+// Find the address given by an operand, if it is known.
+static bool calc_base_address(const disassembly::line& line, const hop68::operand& op,
+	const base_registers& regs, const symbols& symbols, uint32_t first_address, uint32_t end_address,
+	uint32_t& result)
+{
+	// The source of LEA/MOVEA is the first extension word
+	const uint32_t field_address = line.address + 2;
+	switch (op.type)
+	{
+		case hop68::PC_DISP:
+			return hop68::calc_relative_address(op, line.address, result);
+		case hop68::ABSOLUTE_LONG:
+			result = op.absolute_long.longaddr;
+			return is_base_address(symbols, field_address, result, first_address, end_address);
+		case hop68::IMMEDIATE:
+			result = op.imm.val0;
+			return line.inst.suffix == hop68::Suffix::LONG &&
+				is_base_address(symbols, field_address, result, first_address, end_address);
+		case hop68::A_DIRECT:
+			result = regs.value[op.a_register.reg];
+			return (regs.known >> op.a_register.reg) & 1;
+		case hop68::INDIRECT:
+			result = regs.value[op.indirect.reg];
+			return (regs.known >> op.indirect.reg) & 1;
+		case hop68::INDIRECT_DISP:
+			result = regs.value[op.indirect_disp.reg] + op.indirect_disp.disp;
+			return (regs.known >> op.indirect_disp.reg) & 1;
+		default:
+			break;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+// Record the target of a (d16,An) or (d8,An,Xn) operand with a known base.
+static void add_base_target(const hop68::operand& op, const base_registers& regs,
+	uint32_t first_address, uint32_t end_address, std::vector<uint32_t>& targets)
+{
+	uint32_t target;
+	if (op.type == hop68::INDIRECT_DISP && ((regs.known >> op.indirect_disp.reg) & 1))
+		target = regs.value[op.indirect_disp.reg] + op.indirect_disp.disp;
+	else if (op.type == hop68::INDIRECT_INDEX && ((regs.known >> op.indirect_index.a_reg) & 1))
+		target = regs.value[op.indirect_index.a_reg] + op.indirect_index.disp;		// start of the table
+	else
+		return;
+	if (target >= first_address && target <= end_address)
+		targets.push_back(target);
+}
+
+// ----------------------------------------------------------------------------
+// Update the known registers for the effect of one instruction.
+static void update_base_registers(const disassembly::line& line, const symbols& symbols,
+	uint32_t first_address, uint32_t end_address, base_registers& regs)
+{
+	const hop68::instruction& inst = line.inst;
+	uint32_t value = 0;
+	bool known = false;
+	uint8_t reg = 0;
+	switch (inst.opcode)
+	{
+		case hop68::Opcode::LEA:
+			reg = inst.op1.a_register.reg;
+			known = calc_base_address(line, inst.op0, regs, symbols, first_address, end_address, value);
+			break;
+		case hop68::Opcode::MOVEA:
+			// Other sources load the longword stored at an address, not the address
+			reg = inst.op1.a_register.reg;
+			if (inst.suffix == hop68::Suffix::LONG &&
+				(inst.op0.type == hop68::A_DIRECT || inst.op0.type == hop68::IMMEDIATE))
+				known = calc_base_address(line, inst.op0, regs, symbols, first_address, end_address, value);
+			break;
+		case hop68::Opcode::ADDA:
+		case hop68::Opcode::SUBA:
+		case hop68::Opcode::ADDQ:
+		case hop68::Opcode::SUBQ:
+		{
+			if (inst.op1.type != hop68::A_DIRECT)
+				break;
+			// e.g. ADDA.W D0,An leaves An unknown
+			reg = inst.op1.a_register.reg;
+			if (inst.op0.type != hop68::IMMEDIATE)
+				break;
+			// Word sizes are sign-extended for address registers
+			int32_t offset = inst.op0.imm.val0;
+			if (inst.op0.imm.size == hop68::Size::WORD)
+				offset = (int16_t)inst.op0.imm.val0;
+			if (inst.opcode == hop68::Opcode::SUBA || inst.opcode == hop68::Opcode::SUBQ)
+				offset = -offset;
+			known = (regs.known >> reg) & 1;
+			value = regs.value[reg] + offset;
+			break;
+		}
+		default:
+		{
+			// Anything else writing an address register loses its value
+			hop68::register_use use;
+			hop68::calc_register_use(inst, use);
+			regs.known &= ~(uint8_t)((use.written & hop68::REGS_ADDRESS) >> 8);
+			return;
+		}
+	}
+
+	if (inst.op1.type != hop68::A_DIRECT)
+	{
+		// e.g. ADDQ to a data register; LEA and MOVEA always write An
+		hop68::register_use use;
+		hop68::calc_register_use(inst, use);
+		regs.known &= ~(uint8_t)((use.written & hop68::REGS_ADDRESS) >> 8);
+		return;
+	}
+	regs.value[reg] = value;
+	if (known)
+		regs.known |= 1 << reg;
+	else
+		regs.known &= ~(1 << reg);
+}
+
+// ----------------------------------------------------------------------------
+void add_base_reference_symbols(const disassembly& disasm, uint32_t first_address, uint32_t data_address,
+	uint32_t bss_address, uint32_t end_address, symbols& symbols)
+{
+	// Blocks start at labels, including every branch target found so far,
+	// and after any change of flow. Nothing is carried between blocks.
+	std::vector<uint32_t> targets;
+	base_registers regs = {};
+	symbols::sym_map::const_iterator sym_it = symbols.table.begin();
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+	{
+		const disassembly::line& line = disasm.lines[i];
+		while (sym_it != symbols.table.end() && sym_it->first < line.address)
+			++sym_it;
+		if (i == 0 || (sym_it != symbols.table.end() && sym_it->first == line.address))
+			regs.known = 0;
+		else
+		{
+			const disassembly::line& prev = disasm.lines[i - 1];
+			if (prev.address + prev.inst.byte_count != line.address ||
+				hop68::calc_flow(prev.inst) != hop68::FLOW_NONE)
+				regs.known = 0;
+		}
+
+		if (regs.known)
+		{
+			add_base_target(line.inst.op0, regs, first_address, end_address, targets);
+			add_base_target(line.inst.op1, regs, first_address, end_address, targets);
+			update_base_registers(line, symbols, first_address, end_address, regs);
+		}
+		else if (line.inst.opcode == hop68::Opcode::LEA || line.inst.opcode == hop68::Opcode::MOVEA)
+		{
+			// Nothing to lose, so only these can change anything
+			update_base_registers(line, symbols, first_address, end_address, regs);
+		}
+	}
+
+	for (size_t i = 0; i < targets.size(); ++i)
+	{
+		symbol sym;
+		if (find_symbol(symbols, targets[i], sym))
+			continue;
+		sym.address = targets[i];
+		if (targets[i] < data_address)
+			sym.section = symbol::section_type::TEXT;
+		else if (targets[i] < bss_address)
+			sym.section = symbol::section_type::DATA;
+		else
+			sym.section = symbol::section_type::BSS;
+		add_symbol(symbols, sym);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Give auto-labelled symbols names, in address order
+void rename_auto_labels(const output_settings& osettings, symbols& symbols)
+{
+	uint32_t id = osettings.label_start_id;
+	for (symbols::sym_map::iterator it = symbols.table.begin();
+			it != symbols.table.end();
+			++it)
+	{
+		if (it->second.label.size() == 0)
+			it->second.label = osettings.label_prefix + std::to_string(id++);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Build the cross-reference index for all decoded instructions.
+void add_xrefs(const disassembly& disasm, hop68::xref_index& xrefs)
+{
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+		xrefs.add_instruction(disasm.lines[i].inst, disasm.lines[i].address);
+	xrefs.finalize();
+}
+
+// ----------------------------------------------------------------------------
+// Print every referenced address which has a symbol, with its referrers.
+static void print_xref_report(const symbols& symbols, const hop68::xref_index& xrefs, FILE* pOutput)
+{
+	fprintf(pOutput, "\n; Cross-references\n");
+	for (size_t row = 0; row < xrefs.get_target_count(); ++row)
+	{
+		symbol sym;
+		if (!find_symbol(symbols, xrefs.get_target(row), sym))
+			continue;
+		fprintf(pOutput, "; %s:\n", sym.label.c_str());
+		const hop68::xref* refs = xrefs.get_refs(row);
+		for (size_t i = 0; i < xrefs.get_ref_count(row); ++i)
+		{
+			fprintf(pOutput, ";\t");
+			print_symbol_offset(symbols, refs[i].source, pOutput);
+			fprintf(pOutput, " (%s, op%u)\n",
+				hop68::get_xref_kind_string((hop68::XrefKind)refs[i].kind), refs[i].slot);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	TOS EXECUTABLE READING
+// ----------------------------------------------------------------------------
+struct tos_header
+{
+   //  See http://toshyp.atari.org/en/005005.html for TOS header details
+	uint16_t  ph_branch;	  /* Branch to start of the program  */
+							  /* (must be 0x601a!)			   */
+
+	uint32_t  ph_tlen;		  /* Length of the TEXT segment	  */
+	uint32_t  ph_dlen;		  /* Length of the DATA segment	  */
+	uint32_t  ph_blen;		  /* Length of the BSS segment	   */
+	uint32_t  ph_slen;		  /* Length of the symbol table	  */
+	uint32_t  ph_res1;		  /* Reserved, should be 0;		  */
+							  /* Required by PureC			   */
+	uint32_t  ph_prgflags;	  /* Program flags				   */
+	uint16_t  ph_absflag;	  /* 0 = Relocation info present	 */
+};
+
+// ----------------------------------------------------------------------------
+//	DRI SYMBOL READING
+// ----------------------------------------------------------------------------
+static const int DRI_TABLE_SIZE = 14;
+static const uint16_t DRI_EXT_SYMBOL_FLAG = 0x0048;
+static const uint16_t DRI_SECT_TEXT = 0x0200;
+static const uint16_t DRI_SECT_DATA = 0x0400;
+static const uint16_t DRI_SECT_BSS  = 0x0100;
+
+static int read_symbols(hop68::buffer_reader& buf, const tos_header& header, uint32_t base,
+	symbols& symbols, FILE* pOutput)
+{
+	// Calculate text, data and bss addresses
+	uint32_t text_address = base;
+	uint32_t data_address = text_address + header.ph_tlen;
+	uint32_t bss_address  = data_address + header.ph_dlen;
+
+	while (buf.get_remain() >= DRI_TABLE_SIZE)
+	{
+		uint8_t name[8 + 14 + 1];
+		uint16_t symbol_id;
+		uint32_t symbol_address;
+
+		// Name (8 bytes) -> ID (2 bytes) -> address (4 bytes)
+		memset(name, 0, sizeof(name));
+		if (buf.read(name, 8))
+			return 1;
+		if (buf.read_word(symbol_id))
+			return 1;
+		if (buf.read_long(symbol_address))
+			return 1;
+
+		// Looks like either bit denotes an extended symbol??
+		if ((symbol_id & DRI_EXT_SYMBOL_FLAG) != 0)
+		{
+			// 14 bytes: symbol name extended
+			if (buf.read(name + 8, 14))
+				return 1;
+		}
+
+		if (pOutput)
+			fprintf(pOutput, "; Symbol %s addr: %d id:%x\n", (const char*)name, symbol_address, symbol_id);
+
+		symbol sym;
+		sym.label = std::string((const char*)name);
+		sym.address = symbol_address;
+		sym.section = symbol::section_type::UNKNOWN;
+
+		// Parse the flags to work out which section, then resolve an address
+		switch (symbol_id & 0xf00)
+		{
+			case DRI_SECT_TEXT: sym.section = symbol::section_type::TEXT; sym.address += text_address; break;
+			case DRI_SECT_DATA: sym.section = symbol::section_type::DATA; sym.address += data_address; break;
+			case DRI_SECT_BSS:  sym.section = symbol::section_type::BSS;  sym.address += bss_address;  break;
+			default:
+				break;
+		}
+		if (sym.section != symbol::section_type::UNKNOWN)
+			add_symbol(symbols, sym);
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+//	DEBUG LINE READING
+// ----------------------------------------------------------------------------
+// Read N bytes of string data in to a std::string, omitting pad bytes
+static int read_string(hop68::buffer_reader& buf, uint32_t length, std::string& str)
+{
+	uint8_t ch;
+	for (uint32_t i = 0; i < length; ++i)
+	{
+		if (buf.read_byte(ch))
+			return 1;
+		if (ch)	// Don't add any padded zero bytes
+			str += (char)ch;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Read hunk of "LINE" format line information.
+// This is a simple set of "line", "pc" 8-byte structures
+static int read_debug_line_info(hop68::buffer_reader& buf, line_numbers& lines, uint32_t offset)
+{
+	// Filename length is stored as divided by 4
+	uint32_t flen;
+	if (buf.read_long(flen))
+		return 1;
+	flen <<= 2;
+	std::string fname;
+	if (read_string(buf, flen, fname))
+		return 1;
+	size_t file_index = lines.add_filename(fname.c_str());
+
+	// Calculate remaining number of structures to read
+	uint32_t numlines = buf.get_remain() / 8;
+	while (numlines)
+	{
+		uint32_t line, pc;
+		if (buf.read_long(line))
+			return 1;
+		if (buf.read_long(pc))
+			return 1;
+
+		lines.add(file_index, line, pc + offset);
+		--numlines;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Read a single compressed HCLN value (line or PC)
+// The format is a simple prefix compression:
+// 		 1 byte: return value if != 0
+// 	else 2 byte word: return value if != 0
+//  else 4 byte long.
+static int read_hcln_long(hop68::buffer_reader& buf, uint32_t& val)
+{
+	uint8_t tmpB;
+	if (buf.read_byte(tmpB))
+		return 1;
+	if (tmpB)
+	{
+		val = tmpB; return 0;
+	}
+
+	uint16_t tmpW;
+	if (buf.read_word(tmpW))
+		return 1;
+	if (tmpW)
+	{
+		val = tmpW; return 0;
+	}
+
+	return buf.read_long(val);
+}
+
+// ----------------------------------------------------------------------------
+// Read hunk of "HCLN" (HiSoft Compressed Line Number) format line information.
+static int read_debug_hcln_info(hop68::buffer_reader& buf, line_numbers& lines, uint32_t offset)
+{
+	uint32_t flen, numlines;
+	// Filename length is stored as divided by 4
+	if (buf.read_long(flen))
+		return 1;
+	std::string fname;
+	flen <<= 2;
+	if (read_string(buf, flen, fname))
+		return 1;
+	size_t file_index = lines.add_filename(fname.c_str());
+
+	if (buf.read_long(numlines))
+		return 1;
+	// Each entry is at least 2 bytes, so don't trust a larger count
+	if (numlines > buf.get_remain() / 2)
+		return 1;
+	uint32_t curr_line = 0;
+	uint32_t curr_pc = offset;
+	while (numlines)
+	{
+		uint32_t line, pc;
+		if (read_hcln_long(buf, line))
+			return 1;
+		if (read_hcln_long(buf, pc))
+			return 1;
+		// Accumulate current position
+		curr_line += line;
+		curr_pc += pc;
+		lines.add(file_index, curr_line, curr_pc);
+		--numlines;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Work out which section an address falls in
+static symbol::section_type get_section(const tos_header& header, uint32_t base, uint32_t address)
+{
+	uint32_t offset = address - base;
+	if (offset < header.ph_tlen)
+		return symbol::section_type::TEXT;
+	if (offset - header.ph_tlen < header.ph_dlen)
+		return symbol::section_type::DATA;
+	return symbol::section_type::BSS;
+}
+
+// ----------------------------------------------------------------------------
+// Decode the relocation stream into a flat list of offsets from the start
+// of the text section.
+static int read_reloc_offsets(hop68::buffer_reader& buf, std::vector<uint32_t>& offsets)
+{
+	uint32_t addr;
+	if (buf.read_long(addr))
+		return 1;
+
+	// 0 at start meeans "no reloc info"
+	if (addr == 0)
+		return 0;
+
+	offsets.push_back(addr);
+	while (1)
+	{
+		uint8_t offset;
+		if (buf.read_byte(offset))
+			return 1;
+		if (offset == 0)
+			break;
+
+		if (offset == 1)
+		{
+			addr += 254;
+			continue;
+		}
+		addr += offset;
+		offsets.push_back(addr);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Add "base" to every relocated longword in the text+data image.
+static void apply_relocs(uint8_t* image, uint32_t image_size,
+	const std::vector<uint32_t>& offsets, uint32_t base)
+{
+	if (image_size < 4)
+		return;
+	const uint32_t max_offset = image_size - 4;
+	const uint32_t* pOffset = offsets.data();
+	const uint32_t* pEnd = pOffset + offsets.size();
+	for (; pOffset != pEnd; ++pOffset)
+	{
+		if (*pOffset > max_offset)
+			continue;
+		uint8_t* p = image + *pOffset;
+		uint32_t val = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		val += base;
+		p[0] = (uint8_t)(val >> 24);
+		p[1] = (uint8_t)(val >> 16);
+		p[2] = (uint8_t)(val >> 8);
+		p[3] = (uint8_t)val;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Record every relocated longword, and if "labels" is set create a label for
+// its value. "image_buf" contains the (already relocated) text and data.
+static int add_reloc_labels(const std::vector<uint32_t>& offsets, hop68::buffer_reader& image_buf,
+	const tos_header& header, uint32_t base, bool labels, symbols& symbols)
+{
+	for (size_t i = 0; i < offsets.size(); ++i)
+	{
+		uint32_t offset = offsets[i];
+		if (offset > image_buf.get_remain() || image_buf.get_remain() - offset < 4)
+			continue;
+
+		// This longword is relocated, so can be treated as a symbol.
+		// Read the longword value, then create a symbol in the matching section
+		uint32_t data;
+		image_buf.set_pos(offset);
+		if (image_buf.read_long(data))
+			return 1;
+		image_buf.set_pos(0);
+
+		// Flag that a relocation address existed
+		symbols.relocs[base + offset] = data;
+		if (!labels)
+			continue;
+
+		symbol sym;
+		sym.address = data;
+		sym.section = get_section(header, base, data);
+		sym.label = "";
+		add_symbol(symbols, sym);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Read debug line number information, which follows the relocation data.
+static int read_debug_hunks(hop68::buffer_reader& buf, line_numbers& lines, uint32_t base)
+{
+	// Align to word
+	if (buf.get_pos() & 1)
+		buf.advance(1);
+
+	// Debug information is a set of blocks ("hunks"?) with a
+	// type and size, similar to IFF.
+	bool got_header = false;
+	while (buf.get_remain() >= 4)
+	{
+		uint32_t hunk_header;
+		uint32_t hlen, hstart, offset, htype;
+
+		if (buf.read_long(hunk_header))
+			return 1;
+		if ( (hunk_header==0) && got_header)
+			break;			// zero might mean padded, so stop without error
+
+		// Expect the magic "this is a hunk" value
+		if (hunk_header != 0x3F1)
+			return 1;			// (bad file)
+
+		// Read hunk length, which is number of 32-byte longs
+		if (buf.read_long(hlen))
+			return 1;
+		// The hunk must fit in the file
+		if (hlen > buf.get_remain() / 4)
+			return 1;
+		// Convert header length to bytes
+		hlen <<= 2;
+		hstart = buf.get_pos();	// record position for jumping
+
+		// Create a sub-reader so we don't read off end of the hunk
+		hop68::buffer_reader hunk_buffer(buf.get_data(), hlen, buf.get_address());
+		// This appears to be an offset to apply to the PC values
+		if (hunk_buffer.read_long(offset))
+			return 1;
+		if (hunk_buffer.read_long(htype))
+			return 1;
+
+		switch (htype)
+		{
+			// NOTE: the X-Debug example does stricter checks on format here.
+			// We just record that a header is found before the per-file hunks
+			// are encountered.
+			case 0x48454144: // "HEAD"
+				got_header = true;
+				break;
+			case 0x4c494e45: // "LINE"
+				read_debug_line_info(hunk_buffer, lines, base + offset);
+				break;
+			case 0x48434c4e: // "HCLN"
+				read_debug_hcln_info(hunk_buffer, lines, base + offset);
+				break;
+			default:
+				return 1;
+		}
+
+		// Jump to next hunk
+		buf.set_pos(hstart + hlen);
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Find the part of the text section to decode for the window in osettings.
+// A symbol's window runs up to the next named symbol.
+// Returns 0 for success, 1 for failure.
+static int find_window(const output_settings& osettings, const symbols& symbols,
+	uint32_t text_address, uint32_t text_size, uint32_t& start, uint32_t& end)
+{
+	const uint32_t text_end = text_address + text_size;
+	start = osettings.window_start;
+	end = osettings.window_end;
+	if (osettings.window_symbol)
+	{
+		symbols::sym_map::const_iterator it = symbols.table.begin();
+		while (it != symbols.table.end() && it->second.label != osettings.window_symbol)
+			++it;
+		if (it == symbols.table.end())
+		{
+			fprintf(stderr, "Error: Symbol not found: %s\n", osettings.window_symbol);
+			return 1;
+		}
+		start = it->first;
+		end = text_end;
+		for (++it; it != symbols.table.end(); ++it)
+		{
+			if (it->first > start && !it->second.label.empty())
+			{
+				end = it->first;
+				break;
+			}
+		}
+	}
+
+	if (start < text_address)
+		start = text_address;
+	if (end > text_end)
+		end = text_end;
+	if (start >= end)
+	{
+		fprintf(stderr, "Error: Window $%x-$%x is outside the text section\n", start, end);
+		return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Decode only the lines from "start" up to "end". Decoding starts from the
+// nearest symbol at or before "start", which should be on an instruction
+// boundary, so the rest of the text section is never decoded.
+static void decode_window(const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	uint32_t start, uint32_t end, const symbols& symbols, const hop68::decode_settings& dsettings,
+	disassembly& disasm)
+{
+	uint32_t from = text_address;
+	symbols::sym_map::const_iterator it = symbols.table.upper_bound(start);
+	while (it != symbols.table.begin())
+	{
+		--it;
+		if (it->first < text_address)
+			break;
+		if ((it->first & 1) == 0)
+		{
+			from = it->first;
+			break;
+		}
+	}
+
+	hop68::buffer_reader buf(text + (from - text_address), text_size - (from - text_address), from);
+	while (buf.get_remain() >= 2 && buf.get_address() < end)
+	{
+		disassembly::line line;
+		line.address = buf.get_address();
+		hop68::buffer_reader buf_copy(buf);
+		hop68::decode(line.inst, buf_copy, dsettings);
+		if (line.address >= start)
+			disasm.lines.push_back(line);
+		buf.advance(line.inst.byte_count);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Decode the text section: all of it, only the window in osettings, or only
+// the executed parts when there is coverage in osettings. "symbols" finds
+// where to start decoding a window.
+// Returns 0 for success, 1 for failure.
+static int decode_text(const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	const hop68::decode_settings& dsettings, const output_settings& osettings, const symbols& symbols,
+	disassembly& disasm)
+{
+	if (osettings.window)
+	{
+		uint32_t start, end;
+		if (find_window(osettings, symbols, text_address, text_size, start, end))
+			return 1;
+		decode_window(text, text_size, text_address, start, end, symbols, dsettings, disasm);
+		stats_add_count(osettings.pStats, "window bytes", end - start);
+		return 0;
+	}
+	if (!osettings.coverage_filename)
+	{
+		hop68::buffer_reader text_buf(text, text_size, text_address);
+		return decode_buf(text_buf, dsettings, disasm);
+	}
+
+	coverage_map coverage;
+	int ret = osettings.coverage_bitmap ?
+		read_coverage_bitmap(osettings.coverage_filename, text_size, coverage) :
+		read_coverage_ranges(osettings.coverage_filename, text_address, text_size, coverage);
+	if (ret)
+		return ret;
+	if (osettings.coverage_follow)
+	{
+		size_t reached = follow_coverage_flow(text, text_address, dsettings, coverage);
+		stats_add_count(osettings.pStats, "reached instructions", reached);
+	}
+	return decode_coverage(text, text_address, dsettings, coverage, disasm);
+}
+
+// ----------------------------------------------------------------------------
+// Profile the text section with the trace in osettings, if there is one,
+// adding the per-instruction totals to "comments".
+// Returns 0 for success, 1 for failure.
+static int read_profile(const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	const hop68::decode_settings& dsettings, const output_settings& osettings,
+	trace_profile& profile, line_comments& comments)
+{
+	if (!osettings.trace_filename)
+		return 0;
+	stats_start_phase(osettings.pStats, "read trace");
+	if (read_trace_profile(osettings.trace_filename, osettings.trace_little_endian,
+			text, text_size, text_address, dsettings, profile))
+		return 1;
+	stats_add_count(osettings.pStats, "trace addresses", profile.trace_count);
+	stats_add_count(osettings.pStats, "traced instructions", profile.entries.size());
+	add_profile_comments(profile, comments);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Print the hot-spot table for a profile made by read_profile().
+static void print_profile(const trace_profile& profile, const disassembly& disasm,
+	const symbols& symbols, const output_settings& osettings, FILE* pOutput)
+{
+	if (!osettings.trace_filename)
+		return;
+	stats_start_phase(osettings.pStats, "hot spots");
+	basic_blocks blocks;
+	find_basic_blocks(disasm, symbols, blocks);
+	print_hotspots(profile, blocks, symbols, osettings.hotspot_count, pOutput);
+}
+
+// ----------------------------------------------------------------------------
+// Record the number of instructions decoded, and how many were invalid.
+static void add_decode_counts(run_stats* pStats, const disassembly& disasm)
+{
+	if (!pStats)
+		return;
+	uint64_t invalid = 0;
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+		invalid += (disasm.lines[i].inst.opcode == hop68::Opcode::NONE);
+	pStats->add_count("instructions", disasm.lines.size());
+	pStats->add_count("invalid opcodes", invalid);
+}
+
+// ----------------------------------------------------------------------------
+// Name the functions found by the signatures in osettings, if there are any.
+// This runs before rename_auto_labels() so the auto-labels they replace
+// don't use up numbers.
+static void apply_signatures(const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	const output_settings& osettings, symbols& symbols)
+{
+	if (!osettings.pSignatures)
+		return;
+	stats_start_phase(osettings.pStats, "signatures");
+	size_t named = osettings.pSignatures->apply(text, text_size, text_address, symbols);
+	stats_add_count(osettings.pStats, "signature matches", named);
+}
+
+// ----------------------------------------------------------------------------
+int load_tos_program(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, loaded_program& program, FILE* pOutput)
+{
+	run_stats* pStats = osettings.pStats;
+	stats_start_phase(pStats, "header");
+	stats_add_count(pStats, "input bytes", size);
+
+	hop68::buffer_reader buf(data_ptr, size, 0);
+	tos_header header = {};
+
+	if (buf.read_word(header.ph_branch))
+		return 1;
+	if (buf.read_long(header.ph_tlen))
+		return 1;
+	if (buf.read_long(header.ph_dlen))
+		return 1;
+	if (buf.read_long(header.ph_blen))
+		return 1;
+	if (buf.read_long(header.ph_slen))
+		return 1;
+	if (buf.read_long(header.ph_res1))
+		return 1;
+	if (buf.read_long(header.ph_prgflags))
+		return 1;
+	if (buf.read_word(header.ph_absflag))
+		return 1;
+
+	if (header.ph_branch != 0x601a)
+		return 1;
+
+	if (pOutput)
+	{
+		fprintf(pOutput, "; Text size %d...\n", header.ph_tlen);
+		fprintf(pOutput, "; Data size %d...\n", header.ph_dlen);
+		fprintf(pOutput, "; BSS size  %d...\n", header.ph_blen);
+		fprintf(pOutput, "; Symbol size  %d...\n", header.ph_slen);
+
+		fprintf(pOutput, "; Reading text section\n");
+	}
+
+	// Sections are loaded one after the other from the base address
+	const uint32_t base = osettings.base_address;
+	const uint32_t image_size = header.ph_tlen + header.ph_dlen;
+	const uint8_t* image_ptr = buf.get_data();
+	if (header.ph_tlen > buf.get_remain() || header.ph_dlen > buf.get_remain() - header.ph_tlen)
+	{
+		fprintf(stderr, "Error: text and data sections are larger than the file\n");
+		return 1;
+	}
+	program.text_address = base;
+	program.text_size = header.ph_tlen;
+	program.data_size = header.ph_dlen;
+	program.bss_size = header.ph_blen;
+
+	// Skip the text and data. (No BSS in the file, so symbols should be next)
+	buf.advance(image_size);
+	if (header.ph_slen > buf.get_remain())
+	{
+		fprintf(stderr, "Error: symbol table is larger than the file\n");
+		return 1;
+	}
+	hop68::buffer_reader symbol_buf(buf.get_data(), header.ph_slen, 0);
+
+	symbols& exe_symbols = program.exe_symbols;
+	line_numbers& lines = program.lines;
+
+	stats_start_phase(pStats, "read_symbols");
+	if (pOutput)
+		fprintf(pOutput, "; Reading symbols...\n");
+	int ret = read_symbols(symbol_buf, header, base, exe_symbols, pOutput);
+	if (ret)
+	{
+		fprintf(stderr, "Error reading symbol table\n");
+		return ret;
+	}
+
+	buf.advance(header.ph_slen);
+	hop68::buffer_reader reloc_buf(buf.get_data(), buf.get_remain(), 0);
+
+	// Read relocations, then the line-information data from Hisoft tools
+	stats_start_phase(pStats, "read_reloc");
+	std::vector<uint32_t>& reloc_offsets = program.reloc_offsets;
+	int reloc_ret = read_reloc_offsets(reloc_buf, reloc_offsets);
+	stats_add_count(pStats, "relocations", reloc_offsets.size());
+	stats_start_phase(pStats, "debug hunks");
+	if (reloc_ret == 0)
+		read_debug_hunks(reloc_buf, lines, base);
+	stats_add_count(pStats, "line numbers", lines.lines.size());
+
+	// Relocate a copy of the text and data, if not loading at 0
+	stats_start_phase(pStats, "relocate");
+	if (base != 0)
+	{
+		program.relocated.assign(image_ptr, image_ptr + image_size);
+		apply_relocs(program.relocated.data(), image_size, reloc_offsets, base);
+		image_ptr = program.relocated.data();
+	}
+	program.image_ptr = image_ptr;
+
+	hop68::buffer_reader image_buf(image_ptr, image_size, 0);
+	add_reloc_labels(reloc_offsets, image_buf, header, base, osettings.autolabel, exe_symbols);
+
+	// Next section is text
+	stats_start_phase(pStats, "decode_buf");
+	disassembly& disasm = program.disasm;
+	if (decode_text(image_ptr, header.ph_tlen, base, dsettings, osettings, exe_symbols, disasm))
+		return 1;
+	program.text_has_data = (osettings.coverage_filename != NULL);
+	add_decode_counts(pStats, disasm);
+
+	// Scan decoded instructions and add labels from operands
+	stats_start_phase(pStats, "add_reference_symbols");
+	if (osettings.autolabel)
+	{
+		add_reference_symbols(disasm, exe_symbols);
+		const uint32_t data_address = base + header.ph_tlen;
+		const uint32_t bss_address = data_address + header.ph_dlen;
+		add_base_reference_symbols(disasm, base, data_address, bss_address, bss_address + header.ph_blen,
+			exe_symbols);
+	}
+	apply_signatures(image_ptr, header.ph_tlen, base, osettings, exe_symbols);
+
+	// Rename auto-labelled symbols to be in address-order
+	stats_start_phase(pStats, "rename labels");
+	rename_auto_labels(osettings, exe_symbols);
+	stats_add_count(pStats, "symbols", exe_symbols.table.size());
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int load_bin_program(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, loaded_program& program)
+{
+	run_stats* pStats = osettings.pStats;
+	stats_add_count(pStats, "input bytes", size);
+	program.image_ptr = data_ptr;
+	program.text_address = osettings.base_address;
+	program.text_size = (uint32_t)size;
+	program.data_size = 0;
+	program.bss_size = 0;
+
+	stats_start_phase(pStats, "decode_buf");
+	if (decode_text(data_ptr, (uint32_t)size, osettings.base_address, dsettings, osettings,
+			program.exe_symbols, program.disasm))
+		return 1;
+	program.text_has_data = (osettings.coverage_filename != NULL);
+	add_decode_counts(pStats, program.disasm);
+
+	stats_start_phase(pStats, "add_reference_symbols");
+	if (osettings.autolabel)
+	{
+		add_reference_symbols(program.disasm, program.exe_symbols);
+		const uint32_t end_address = program.text_address + program.text_size;
+		add_base_reference_symbols(program.disasm, program.text_address, end_address, end_address, end_address,
+			program.exe_symbols);
+	}
+	apply_signatures(data_ptr, (uint32_t)size, osettings.base_address, osettings, program.exe_symbols);
+	stats_start_phase(pStats, "rename labels");
+	rename_auto_labels(osettings, program.exe_symbols);
+	stats_add_count(pStats, "symbols", program.exe_symbols.table.size());
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int load_database_program(const uint8_t* data_ptr, long size, const output_settings& osettings,
+		loaded_program& program, hop68::decode_settings& dsettings)
+{
+	run_stats* pStats = osettings.pStats;
+	stats_start_phase(pStats, "read database");
+	stats_add_count(pStats, "input bytes", size);
+	analysis_db db;
+	if (db.open(data_ptr, (size_t)size))
+		return 1;
+
+	const db_header& header = db.get_header();
+	size_t count;
+	program.image_ptr = db.get_array<uint8_t>(DB_IMAGE, count);
+	program.text_address = header.text_address;
+	program.text_size = header.text_size;
+	program.data_size = header.data_size;
+	program.bss_size = header.bss_size;
+	program.text_has_data = (header.flags & DB_FLAG_TEXT_HAS_DATA) != 0;
+
+	// The maps are filled in order, so each insert is constant time
+	symbols& exe_symbols = program.exe_symbols;
+	const db_symbol* syms = db.get_array<db_symbol>(DB_SYMBOLS, count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		symbol sym;
+		sym.address = syms[i].address;
+		sym.label = db.get_string(syms[i].label);
+		sym.section = syms[i].section <= symbol::section_type::UNKNOWN ?
+			(symbol::section_type)syms[i].section : symbol::section_type::UNKNOWN;
+		exe_symbols.table.insert(exe_symbols.table.end(), symbols::sym_map::value_type(sym.address, sym));
+	}
+	const db_reloc* relocs = db.get_array<db_reloc>(DB_RELOCS, count);
+	for (size_t i = 0; i < count; ++i)
+		exe_symbols.relocs.insert(exe_symbols.relocs.end(), symbols::reloc_map::value_type(relocs[i].address, relocs[i].target));
+
+	// Decode only the saved instruction starts, or the ones in the window
+	uint32_t start = 0, end = UINT32_MAX;
+	if (osettings.window &&
+		find_window(osettings, exe_symbols, program.text_address, program.text_size, start, end))
+		return 1;
+
+	// Line numbers are only looked up for printed lines
+	const uint32_t* filenames = db.get_array<uint32_t>(DB_FILENAMES, count);
+	for (size_t i = 0; i < count; ++i)
+		program.lines.add_filename(db.get_string(filenames[i]));
+	const db_line_number* numbers = db.get_array<db_line_number>(DB_LINE_NUMBERS, count);
+	for (size_t i = 0; i < count; ++i)
+		if (numbers[i].address >= start && numbers[i].address < end &&
+			numbers[i].file_index < program.lines.filenames.size())
+			program.lines.add(numbers[i].file_index, numbers[i].line, numbers[i].address);
+
+	// The cross-references are large, so are only copied when printed
+	if (osettings.show_xrefs || osettings.xref_report)
+	{
+		const uint32_t* targets = db.get_array<uint32_t>(DB_XREF_TARGETS, count);
+		program.xrefs.targets.assign(targets, targets + count);
+		const uint32_t* offsets = db.get_array<uint32_t>(DB_XREF_OFFSETS, count);
+		program.xrefs.offsets.assign(offsets, offsets + count);
+		const db_xref* refs = db.get_array<db_xref>(DB_XREF_REFS, count);
+		program.xrefs.refs.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			program.xrefs.refs[i].source = refs[i].source;
+			program.xrefs.refs[i].slot = refs[i].slot;
+			program.xrefs.refs[i].kind = refs[i].kind;
+		}
+		bool valid = program.xrefs.offsets.back() == count;
+		for (size_t i = 1; i < program.xrefs.offsets.size(); ++i)
+			valid &= program.xrefs.offsets[i - 1] <= program.xrefs.offsets[i];
+		if (!valid)
+		{
+			fprintf(stderr, "Error: Analysis database is damaged\n");
+			return 1;
+		}
+	}
+	program.has_xrefs = true;
+
+	stats_start_phase(pStats, "decode_buf");
+	dsettings.cpu_type = header.cpu_type;
+	const uint32_t* lines = db.get_array<uint32_t>(DB_LINES, count);
+	const uint32_t* first = std::lower_bound(lines, lines + count, start);
+	const uint32_t* last = std::lower_bound(first, lines + count, end);
+	program.disasm.lines.resize(last - first);
+	for (const uint32_t* it = first; it != last; ++it)
+	{
+		const uint32_t offset = *it - program.text_address;
+		if (*it < program.text_address || offset >= program.text_size)
+		{
+			fprintf(stderr, "Error: Analysis database is damaged\n");
+			return 1;
+		}
+		disassembly::line& line = program.disasm.lines[it - first];
+		line.address = *it;
+		hop68::buffer_reader buf(program.image_ptr + offset, program.text_size - offset, *it);
+		hop68::decode(line.inst, buf, dsettings);
+	}
+	add_decode_counts(pStats, program.disasm);
+	stats_add_count(pStats, "symbols", exe_symbols.table.size());
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int load_program(program_format format, const uint8_t* data_ptr, long size,
+		const hop68::decode_settings& dsettings, const output_settings& osettings, loaded_program& program)
+{
+	hop68::decode_settings db_dsettings = dsettings;
+	switch (format)
+	{
+		case PROGRAM_TOS:
+			return load_tos_program(data_ptr, size, dsettings, osettings, program, NULL);
+		case PROGRAM_BIN:
+			return load_bin_program(data_ptr, size, dsettings, osettings, program);
+		case PROGRAM_DATABASE:
+			return load_database_program(data_ptr, size, osettings, program, db_dsettings);
+	}
+	return 1;
+}
+
+// ----------------------------------------------------------------------------
+// Print a loaded program, with any profile and reports. "sections" prints the
+// DATA and BSS sections, and any labels after the end of the program.
+static int print_program(const loaded_program& program, bool sections,
+		const hop68::decode_settings& dsettings, const output_settings& osettings, FILE* pOutput)
+{
+	run_stats* pStats = osettings.pStats;
+	const symbols& exe_symbols = program.exe_symbols;
+	const disassembly& disasm = program.disasm;
+
+	// A database already has the cross-references
+	stats_start_phase(pStats, "xrefs");
+	hop68::xref_index built_xrefs;
+	if (!program.has_xrefs && (osettings.show_xrefs || osettings.xref_report))
+		add_xrefs(disasm, built_xrefs);
+	const hop68::xref_index& xrefs = program.has_xrefs ? program.xrefs : built_xrefs;
+
+	trace_profile profile;
+	line_comments comments;
+	if (read_profile(program.image_ptr, program.text_size, program.text_address, dsettings, osettings,
+			profile, comments))
+		return 1;
+
+	liveness_counts live_counts = {};
+	if (osettings.liveness)
+	{
+		stats_start_phase(pStats, "liveness");
+		basic_blocks blocks;
+		find_basic_blocks(disasm, exe_symbols, blocks);
+		register_liveness liveness;
+		calc_liveness(disasm, blocks, liveness);
+		add_liveness_comments(disasm, blocks, liveness, comments, live_counts);
+		stats_add_count(pStats, "dead stores", live_counts.dead_stores);
+		stats_add_count(pStats, "redundant tests", live_counts.redundant_tests);
+	}
+
+	stats_start_phase(pStats, "print");
+	const line_comments* pComments = (osettings.trace_filename || osettings.liveness) ? &comments : NULL;
+	if (program.text_has_data)
+		print_code_and_data(exe_symbols, program.lines, xrefs, disasm, osettings, program.image_ptr,
+			program.text_size, program.text_address, pComments, pOutput);
+	else
+		print(exe_symbols, program.lines, xrefs, disasm, osettings, pOutput, pComments);
+
+	if (sections)
+	{
+		stats_start_phase(pStats, "print data");
+		const uint32_t data_address = program.text_address + program.text_size;
+		const uint32_t bss_address = data_address + program.data_size;
+		print_data(exe_symbols, xrefs, osettings, program.image_ptr + program.text_size, program.data_size,
+			data_address, pOutput);
+		print_bss(exe_symbols, xrefs, osettings, program.bss_size, bss_address, pOutput);
+		print_trailing_labels(exe_symbols, xrefs, osettings, bss_address + program.bss_size, pOutput);
+	}
+
+	if (osettings.xref_report)
+		print_xref_report(exe_symbols, xrefs, pOutput);
+	if (osettings.liveness)
+		fprintf(pOutput, "; %llu dead stores, %llu redundant tests\n",
+			(unsigned long long)live_counts.dead_stores, (unsigned long long)live_counts.redundant_tests);
+	print_profile(profile, disasm, exe_symbols, osettings, pOutput);
+	stats_end_phase(pStats);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int process_tos_file(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput)
+{
+	// A window only prints its own lines, without the header and symbol table
+	loaded_program program;
+	if (load_tos_program(data_ptr, size, dsettings, osettings, program, osettings.window ? NULL : pOutput))
+		return 1;
+	return print_program(program, !osettings.window, dsettings, osettings, pOutput);
+}
+
+// ----------------------------------------------------------------------------
+int process_bin_file(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput)
+{
+	loaded_program program;
+	if (load_bin_program(data_ptr, size, dsettings, osettings, program))
+		return 1;
+	return print_program(program, false, dsettings, osettings, pOutput);
+}
+
+// ----------------------------------------------------------------------------
+int process_database_file(const uint8_t* data_ptr, long size, const output_settings& osettings, FILE* pOutput)
+{
+	loaded_program program;
+	hop68::decode_settings dsettings = {};
+	if (load_database_program(data_ptr, size, osettings, program, dsettings))
+		return 1;
+	return print_program(program, !osettings.window, dsettings, osettings, pOutput);
+}
+
+// ----------------------------------------------------------------------------
+//	STREAMING DISASSEMBLY
+// ----------------------------------------------------------------------------
+// Input is read through a window of this size
+static const uint32_t STREAM_WINDOW_SIZE = 256 * 1024;
+// Longest possible instruction (68020+ full extension words on both operands)
+static const uint32_t MAX_INSTRUCTION_SIZE = 22;
+
+// Called for every line decoded by stream_decode()
+typedef void (*pfnStreamLineFunc)(const disassembly::line& line, void* user);
+
+// ----------------------------------------------------------------------------
+// Decode a whole file through a fixed-size window, so memory use does not
+// depend on the size of the input. Instructions split across the end of the
+// window are carried over to the start of the next one.
+static int stream_decode(FILE* pInfile, const hop68::decode_settings& dsettings,
+	uint32_t base_address, pfnStreamLineFunc func, void* user)
+{
+	std::vector<uint8_t> window(STREAM_WINDOW_SIZE);
+	uint32_t filled = 0;
+	uint32_t window_address = base_address;
+	bool eof = false;
+	while (!eof)
+	{
+		filled += (uint32_t)fread(window.data() + filled, 1, window.size() - filled, pInfile);
+		if (ferror(pInfile))
+			return 1;
+		eof = feof(pInfile) != 0;
+
+		// Only decode while a whole instruction is guaranteed to be in the
+		// window, unless there is no more data to come
+		const uint32_t keep = eof ? 0 : MAX_INSTRUCTION_SIZE;
+		hop68::buffer_reader buf(window.data(), filled, window_address);
+		while (buf.get_remain() >= 2 && buf.get_remain() >= keep)
+		{
+			disassembly::line line;
+			line.address = buf.get_address();
+
+			// decode uses a copy of the buffer state
+			hop68::buffer_reader buf_copy(buf);
+			hop68::decode(line.inst, buf_copy, dsettings);
+			func(line, user);
+
+			buf.advance(line.inst.byte_count);
+		}
+
+		// Carry the undecoded tail over to the start of the window
+		uint32_t used = buf.get_pos();
+		memmove(window.data(), window.data() + used, filled - used);
+		filled -= used;
+		window_address += used;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Context for the label-collecting pass of process_bin_stream()
+struct stream_label_pass
+{
+	uint32_t first_address;
+	uint32_t last_address;
+	symbols* pSymbols;
+};
+
+static void stream_add_labels(const disassembly::line& line, void* user)
+{
+	stream_label_pass* pPass = (stream_label_pass*)user;
+	add_line_reference_symbols(line, pPass->first_address, pPass->last_address, *pPass->pSymbols);
+}
+
+// ----------------------------------------------------------------------------
+// Context for the printing pass of process_bin_stream()
+struct stream_print_pass
+{
+	const symbols* pSymbols;
+	const line_numbers* pLines;
+	const hop68::xref_index* pXrefs;
+	const output_settings* pSettings;
+	print_state* pState;
+	FILE* pOutput;
+	uint64_t num_insts;			// counts for --stats
+	uint64_t num_invalid;
+};
+
+static void stream_print_line(const disassembly::line& line, void* user)
+{
+	stream_print_pass* pPass = (stream_print_pass*)user;
+	++pPass->num_insts;
+	pPass->num_invalid += (line.inst.opcode == hop68::Opcode::NONE);
+	print_line(*pPass->pSymbols, *pPass->pLines, *pPass->pXrefs, line,
+		*pPass->pSettings, *pPass->pState, pPass->pOutput);
+}
+
+// ----------------------------------------------------------------------------
+// Disassemble a binary file with constant memory use.
+// Labels are found with a first pass that only records the referenced
+// addresses. If the input can't be rewound, no labels are created.
+int process_bin_stream(FILE* pInfile, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput)
+{
+	run_stats* pStats = osettings.pStats;
+	symbols bin_symbols;
+	line_numbers dummy_lines;
+	hop68::xref_index dummy_xrefs;
+
+	long size = 0;
+	if (osettings.autolabel && fseek(pInfile, 0, SEEK_END) == 0 && (size = ftell(pInfile)) > 0)
+	{
+		stats_start_phase(pStats, "label pass");
+		rewind(pInfile);
+		stream_label_pass label_pass;
+		label_pass.first_address = osettings.base_address;
+		label_pass.last_address = osettings.base_address + (uint32_t)size - 2;
+		label_pass.pSymbols = &bin_symbols;
+		if (stream_decode(pInfile, dsettings, osettings.base_address, stream_add_labels, &label_pass))
+			return 1;
+		rename_auto_labels(osettings, bin_symbols);
+		if (fseek(pInfile, 0, SEEK_SET) != 0)
+			return 1;
+	}
+
+	print_state state(bin_symbols);
+	stream_print_pass print_pass;
+	print_pass.pSymbols = &bin_symbols;
+	print_pass.pLines = &dummy_lines;
+	print_pass.pXrefs = &dummy_xrefs;
+	print_pass.pSettings = &osettings;
+	print_pass.pState = &state;
+	print_pass.pOutput = pOutput;
+	print_pass.num_insts = 0;
+	print_pass.num_invalid = 0;
+	stats_start_phase(pStats, "print pass");
+	int ret = stream_decode(pInfile, dsettings, osettings.base_address, stream_print_line, &print_pass);
+	stats_end_phase(pStats);
+	stats_add_count(pStats, "instructions", print_pass.num_insts);
+	stats_add_count(pStats, "invalid opcodes", print_pass.num_invalid);
+	stats_add_count(pStats, "symbols", bin_symbols.table.size());
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+//	DISK IMAGES
+// ----------------------------------------------------------------------------
+static bool has_extension(const std::string& name, const char* const* extensions, size_t count)
+{
+	size_t dot = name.rfind('.');
+	if (dot == std::string::npos)
+		return false;
+	std::string ext = name.substr(dot);
+	for (size_t i = 0; i < ext.size(); ++i)
+		ext[i] = (char)tolower((unsigned char)ext[i]);
+	for (size_t i = 0; i < count; ++i)
+		if (ext == extensions[i])
+			return true;
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+bool is_tos_filename(const std::string& name)
+{
+	static const char* const extensions[] = { ".prg", ".tos", ".ttp", ".app", ".acc", ".gtp" };
+	return has_extension(name, extensions, sizeof(extensions) / sizeof(extensions[0]));
+}
+
+// ----------------------------------------------------------------------------
+bool is_disk_filename(const std::string& name)
+{
+	static const char* const extensions[] = { ".st", ".msa" };
+	return has_extension(name, extensions, sizeof(extensions) / sizeof(extensions[0]));
+}
+
+// ----------------------------------------------------------------------------
+int process_disk_image(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput)
+{
+	disk_image disk;
+	if (size < 0 || disk.open(data_ptr, (uint32_t)size))
+	{
+		fprintf(stderr, "Error: Not a readable .ST or .MSA disk image\n");
+		return 1;
+	}
+
+	std::vector<disk_entry> entries;
+	int ret = 0;
+	if (disk.list_files(entries))
+	{
+		fprintf(stderr, "Error: Disk directory is damaged, some files may be missing\n");
+		ret = 1;
+	}
+
+	std::vector<uint8_t> storage;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const disk_entry& entry = entries[i];
+		if (entry.is_dir || !is_tos_filename(entry.path))
+			continue;
+
+		fprintf(pOutput, "; ----------------------------------------------------------------------------\n");
+		fprintf(pOutput, "; File: A:\\%s (%u bytes)\n", entry.path.c_str(), entry.size);
+		const uint8_t* file_ptr;
+		if (disk.read_file(entry, storage, file_ptr))
+		{
+			fprintf(stderr, "Error: A:\\%s: can't read file from disk\n", entry.path.c_str());
+			ret = 1;
+			continue;
+		}
+		if (process_tos_file(file_ptr, entry.size, dsettings, osettings, pOutput))
+		{
+			fprintf(stderr, "Error: A:\\%s: failed to disassemble\n", entry.path.c_str());
+			ret = 1;
+		}
+		fprintf(pOutput, "\n");
+	}
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+static bool get_hex_value(char c, uint8_t& val)
+{
+	if (c >= '0' && c <= '9')
+	{
+		val = c - '0';
+		return true;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		val = 10 + c - 'A';
+		return true;
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		val = 10 + c - 'a';
+		return true;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+static bool is_whitespace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+// ----------------------------------------------------------------------------
+int process_hex_string(const char* hex_string, const hop68::decode_settings& dsettings, const output_settings& osettings, FILE* pOutput)
+{
+	size_t strsize = strlen(hex_string);
+	// Allocate maximum bound for data
+	size_t max_byte_count = strsize / 2;
+	uint8_t* data_ptr = (uint8_t*)malloc(max_byte_count);
+
+	size_t num_written = 0;
+	size_t read_index = 0;
+	// We need at least 2 chars left to parse a hex byte.
+	while (read_index + 2 <= strsize)
+	{
+		uint8_t val1, val2;
+		// Get the next two bytes
+		bool success = get_hex_value(hex_string[read_index], val1);
+		success &= get_hex_value(hex_string[read_index + 1], val2);
+		read_index += 2;
+
+		if (!success)
+		{
+			fprintf(stderr, "Not a valid hex string '%s'\n", hex_string);
+			free(data_ptr);
+			return 1;
+		}
+		data_ptr[num_written++] = (val1 << 4) | val2;
+		// Skip any trailing whitespace
+		while (read_index < strsize && is_whitespace(hex_string[read_index]))
+			++read_index;
+	}
+	if (read_index != strsize)
+	{
+		// characters left at end of buffer
+		fprintf(stderr, "Not a valid hex string '%s'\n", hex_string);
+		free(data_ptr);
+		return 1;
+	}
+
+	// Wrap it up and decode
+	hop68::buffer_reader buf(data_ptr, num_written, osettings.base_address);
+	disassembly disasm;
+	int ret = decode_buf(buf, dsettings, disasm);
+	free(data_ptr);
+
+	if (ret)
+		return ret;
+
+	// Print it out
+	symbols dummy_symbols;
+	line_numbers dummy_lines;
+	hop68::xref_index dummy_xrefs;
+
+	print(dummy_symbols, dummy_lines, dummy_xrefs, disasm, osettings, pOutput);
+	return 0;
+}
+
@@ -0,0 +1,290 @@
+// Higher-level disassembly of whole programs: decoding, labelling and
+// printing TOS executables, binary files and hex strings.
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <map>
+
+#include "lib/decode68.h"
+#include "lib/instruction68.h"
+#include "lib/xref68.h"
+#include "symbols.h"
+
+namespace hop68
+{
+class buffer_reader;
+}
+class run_stats;
+class signature_db;
+
+// ----------------------------------------------------------------------------
+// User options for output.
+struct output_settings
+{
+	bool show_address;			// print address for each line before opcode
+	bool show_timings;			// print (guessed) timings for each line (valid for 68000 only)
+	bool autolabel;				// autolabelling on/off
+	bool show_xrefs;			// print "; xref:" comments under each label
+	bool xref_report;			// print a cross-reference report after the disassembly
+	std::string label_prefix;	// prefix for all auto-labels, normally "L"
+	uint32_t label_start_id;	// starting number of label prefix, normally 0
+	uint32_t base_address;		// address the program is loaded (and relocated) to, normally 0
+	bool stream;				// decode binary files in fixed-size windows
+	const char* trace_filename;	// PC trace to profile against the program, or NULL
+	bool trace_little_endian;	// trace addresses are little-endian rather than 68000 order
+	uint32_t hotspot_count;		// number of blocks in the profile's hot-spot table
+	const char* coverage_filename;	// executed ranges or bitmap, to only decode executed code, or NULL
+	bool coverage_bitmap;		// coverage file is a bitmap rather than a list of ranges
+	bool coverage_follow;		// also decode code reached from the executed code
+	const signature_db* pSignatures;	// functions to find and name, or NULL
+	bool liveness;				// comment dead stores and redundant tests
+	bool window;				// only decode and print part of the text section
+	uint32_t window_start;		// first address of the window...
+	uint32_t window_end;		// ...and the address after it
+	const char* window_symbol;	// symbol to print as the window instead of the addresses, or NULL
+	run_stats* pStats;			// timings and counters for --stats, or NULL
+};
+
+// ----------------------------------------------------------------------------
+//	HIGHER-LEVEL DISASSEMBLY CREATION
+// ----------------------------------------------------------------------------
+
+// Storage for line numbers
+class line_numbers
+{
+public:
+	struct line
+	{
+		size_t file_index;
+		uint32_t line;
+	};
+
+	std::vector<std::string>	filenames;
+
+	typedef std::pair<uint32_t, line> pair;
+	std::map<uint32_t, line>	lines;
+
+	void add(size_t file_index, uint32_t line_num, uint32_t pc)
+	{
+		pair p;
+		p.first = pc;
+		p.second.file_index = file_index;
+		p.second.line = line_num;
+		lines.insert(p);
+	}
+
+	bool find(uint32_t address, line& result) const
+	{
+		std::map<uint32_t, line>::const_iterator it = lines.find(address);
+		if (it != lines.end())
+		{
+			result = it->second;
+			return true;
+		}
+		return false;
+	}
+
+	size_t add_filename(const char* filename)
+	{
+		size_t index = filenames.size();
+		filenames.push_back(filename);
+		return index;
+	}
+};
+
+// ----------------------------------------------------------------------------
+// Storage for an attempt at tokenising the memory
+class disassembly
+{
+public:
+	struct line
+	{
+		uint32_t address;
+		hop68::instruction inst;
+	};
+
+	std::vector<line>    lines;
+};
+
+// ----------------------------------------------------------------------------
+// A whole program, decoded and labelled, ready to print or analyse.
+// "image_ptr" can point into the input data, which must outlive this.
+class loaded_program
+{
+public:
+	loaded_program() :
+		image_ptr(NULL), text_address(0), text_size(0), data_size(0), bss_size(0),
+		text_has_data(false), has_xrefs(false)
+	{}
+
+	const uint8_t* image_ptr;				// text then data, relocated
+	std::vector<uint8_t> relocated;			// storage for image_ptr, when relocated to a base address
+	uint32_t text_address;					// the data and BSS sections follow the text
+	uint32_t text_size;
+	uint32_t data_size;
+	uint32_t bss_size;
+	std::vector<uint32_t> reloc_offsets;	// relocated longwords, as offsets from text_address
+	symbols exe_symbols;
+	line_numbers lines;
+	disassembly disasm;
+	bool text_has_data;						// disasm only covers parts of the text, e.g. from coverage
+	hop68::xref_index xrefs;				// only valid if has_xrefs, e.g. from a database
+	bool has_xrefs;
+
+private:
+	loaded_program(const loaded_program&);
+	loaded_program& operator=(const loaded_program&);
+};
+
+// ----------------------------------------------------------------------------
+// Extra text printed as a comment at the end of a line, keyed by address.
+class line_comments
+{
+public:
+	std::map<uint32_t, std::string>	comments;
+
+	void add(uint32_t address, const std::string& text)
+	{
+		comments[address] = text;
+	}
+
+	// Add to the end of any comment already at the address.
+	void append(uint32_t address, const std::string& text)
+	{
+		std::string& comment = comments[address];
+		if (!comment.empty())
+			comment += ", ";
+		comment += text;
+	}
+
+	const std::string* find(uint32_t address) const
+	{
+		std::map<uint32_t, std::string>::const_iterator it = comments.find(address);
+		return it != comments.end() ? &it->second : NULL;
+	}
+};
+
+// ----------------------------------------------------------------------------
+// State carried from one printed line to the next.
+struct print_state
+{
+	print_state(const symbols& symbols, const line_comments* pComments = NULL) :
+		prev_flag(0),
+		last_file_index((size_t)-1),
+		sym_it(symbols.table.begin()),
+		pComments(pComments)
+	{}
+
+	uint8_t prev_flag;								// previous flag for timing pairs
+	size_t last_file_index;							// last file printed from line numbers
+	symbols::sym_map::const_iterator sym_it;		// next label to print
+	const line_comments* pComments;					// extra comments for lines, or NULL
+};
+
+
+// ----------------------------------------------------------------------------
+//	DECODING AND LABELLING
+// ----------------------------------------------------------------------------
+// Read the buffer in a simple single pass.
+extern int decode_buf(hop68::buffer_reader& buf, const hop68::decode_settings& dsettings, disassembly& disasm);
+
+// Add symbols for the addresses referenced by a single line. Absolute
+// addresses are only used if they are between "first_address" and "last_address".
+extern void add_line_reference_symbols(const disassembly::line& line, uint32_t first_address,
+	uint32_t last_address, symbols& symbols);
+
+// Find addresses referenced by disasm instructions and add them to the symbol table
+extern void add_reference_symbols(const disassembly& disasm, symbols& symbols);
+
+// Add symbols for (d16,An) and (d8,An,Xn) operands whose base register holds
+// a known address, set earlier in the same block by LEA, MOVEA.L from An or
+// an immediate, or ADDA/SUBA. Bases must come from PC-relative or relocated
+// addresses. Only targets between "first_address" and "end_address"
+// (inclusive) are labelled, in the section given by "data_address" and
+// "bss_address".
+extern void add_base_reference_symbols(const disassembly& disasm, uint32_t first_address, uint32_t data_address,
+	uint32_t bss_address, uint32_t end_address, symbols& symbols);
+
+// Give auto-labelled symbols names, in address order
+extern void rename_auto_labels(const output_settings& osettings, symbols& symbols);
+
+// Build the cross-reference index for all decoded instructions.
+extern void add_xrefs(const disassembly& disasm, hop68::xref_index& xrefs);
+
+// ----------------------------------------------------------------------------
+//	PRINTING
+// ----------------------------------------------------------------------------
+// Print a single disassembled line, plus any labels and line numbers.
+extern void print_line(const symbols& symbols, const line_numbers& lines, const hop68::xref_index& xrefs,
+	const disassembly::line& line, const output_settings& osettings, print_state& state, FILE* pOutput);
+
+// Print a set of diassembled lines, with optional extra comments.
+extern int print(const symbols& symbols, const line_numbers& lines, const hop68::xref_index& xrefs,
+	const disassembly& disasm, const output_settings& osettings, FILE* pOutput,
+	const line_comments* pComments = NULL);
+
+// Print an address as an offset from the nearest preceding symbol, if possible.
+extern void print_symbol_offset(const symbols& symbols, uint32_t address, FILE* pOutput);
+
+// ----------------------------------------------------------------------------
+//	WHOLE-FILE PROCESSING
+// ----------------------------------------------------------------------------
+// Load, decode and label a program without printing the disassembly.
+// The TOS header and symbol table are described to pOutput, if it is not NULL.
+// Returns 0 for success, 1 for failure.
+extern int load_tos_program(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, loaded_program& program, FILE* pOutput);
+
+extern int load_bin_program(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, loaded_program& program);
+
+// Load a program from an analysis database saved by save_analysis_db(). The
+// image is used in place, so the data must outlive the program. Only the
+// saved instruction starts are decoded: all of them, or those in the window
+// in osettings. "dsettings" is set to the settings the database was made with.
+extern int load_database_program(const uint8_t* data_ptr, long size, const output_settings& osettings,
+		loaded_program& program, hop68::decode_settings& dsettings);
+
+// Inputs which load into a loaded_program
+enum program_format
+{
+	PROGRAM_TOS,
+	PROGRAM_BIN,
+	PROGRAM_DATABASE			// dsettings are ignored, and taken from the database
+};
+
+// Load any program_format, without printing anything.
+extern int load_program(program_format format, const uint8_t* data_ptr, long size,
+		const hop68::decode_settings& dsettings, const output_settings& osettings, loaded_program& program);
+
+// Each of these disassembles the input and prints it to pOutput.
+// Returns 0 for success, 1 for failure.
+extern int process_tos_file(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput);
+
+extern int process_bin_file(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput);
+
+extern int process_database_file(const uint8_t* data_ptr, long size, const output_settings& osettings,
+		FILE* pOutput);
+
+// Disassemble a binary file with constant memory use.
+extern int process_bin_stream(FILE* pInfile, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput);
+
+extern int process_hex_string(const char* hex_string, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput);
+
+// Disassemble every TOS executable in an .ST or .MSA floppy disk image.
+extern int process_disk_image(const uint8_t* data_ptr, long size, const hop68::decode_settings& dsettings,
+		const output_settings& osettings, FILE* pOutput);
+
+// Check for the extensions used by TOS executables, and disk images
+extern bool is_tos_filename(const std::string& name);
+extern bool is_disk_filename(const std::string& name);
+
+#endif
@@ -0,0 +1,202 @@
+// Execution profiles from emulator PC traces. See profile.h.
+#include "profile.h"
+
+#include <algorithm>
+#include <string>
+
+#include "lib/buffer68.h"
+#include "lib/instruction68.h"
+#include "lib/timing68.h"
+#include "blocks.h"
+#include "mapfile.h"
+#include "process.h"
+
+// ----------------------------------------------------------------------------
+trace_profile::trace_profile() :
+	trace_count(0),
+	outside_count(0),
+	total_cycles(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+// Decode the instruction at "address" and find its timing.
+static void decode_entry(const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	uint32_t address, const hop68::decode_settings& dsettings, profile_entry& entry)
+{
+	hop68::buffer_reader buf(text, text_size, text_address);
+	buf.set_pos(address - text_address);
+	hop68::instruction inst;
+	hop68::decode(inst, buf, dsettings);
+
+	entry.address = address;
+	entry.count = 0;
+	entry.cycles = 0;
+	entry.time = 0;
+	entry.flags = 0;
+	entry.timed = false;
+
+	hop68::timing timing;
+	if (inst.opcode != hop68::Opcode::NONE && calc_timing(inst, timing) == 0)
+	{
+		// Same rounding as the --timings output
+		entry.time = (timing.min + 3) & 0xfffc;
+		entry.flags = timing.flags;
+		entry.timed = true;
+	}
+}
+
+// ----------------------------------------------------------------------------
+int read_trace_profile(const char* filename, bool little_endian, const uint8_t* text,
+	uint32_t text_size, uint32_t text_address, const hop68::decode_settings& dsettings,
+	trace_profile& profile)
+{
+	mapped_file trace;
+	if (trace.open(filename))
+	{
+		fprintf(stderr, "Error: Can't read trace file: %s\n", filename);
+		return 1;
+	}
+	if (trace.get_size() % 4)
+	{
+		fprintf(stderr, "Error: trace file size is not a multiple of 4: %s\n", filename);
+		return 1;
+	}
+
+	// Index of each address's entry plus one, for every word in the text
+	// section, so each address is only decoded the first time it is seen.
+	std::vector<uint32_t> slots((text_size + 1) / 2, 0);
+	std::vector<profile_entry>& entries = profile.entries;
+	entries.clear();
+
+	const uint8_t* pData = trace.get_data();
+	const uint8_t* pEnd = pData + trace.get_size();
+	uint8_t prev_flags = 0;
+	for (; pData != pEnd; pData += 4)
+	{
+		uint32_t pc = little_endian ?
+			((uint32_t)pData[3] << 24) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[1] << 8) | pData[0] :
+			((uint32_t)pData[0] << 24) | ((uint32_t)pData[1] << 16) | ((uint32_t)pData[2] << 8) | pData[3];
+
+		uint32_t offset = pc - text_address;
+		if (offset >= text_size || (offset & 1))
+		{
+			// Code outside the program, e.g. in TOS. It can't pair with us.
+			++profile.outside_count;
+			prev_flags = 0;
+			continue;
+		}
+
+		uint32_t& slot = slots[offset / 2];
+		if (slot == 0)
+		{
+			profile_entry new_entry;
+			decode_entry(text, text_size, text_address, pc, dsettings, new_entry);
+			entries.push_back(new_entry);
+			slot = (uint32_t)entries.size();
+		}
+
+		profile_entry& entry = entries[slot - 1];
+		uint16_t time = entry.time;
+		if ((prev_flags & PAIR_BACK) && (entry.flags & PAIR_FRONT))
+			time -= 4;
+		++entry.count;
+		entry.cycles += time;
+		profile.total_cycles += time;
+		prev_flags = entry.flags;
+	}
+	profile.trace_count = trace.get_size() / 4;
+
+	struct compare
+	{
+		bool operator()(const profile_entry& a, const profile_entry& b) const { return a.address < b.address; }
+	};
+	std::sort(entries.begin(), entries.end(), compare());
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+void add_profile_comments(const trace_profile& profile, line_comments& comments)
+{
+	for (size_t i = 0; i < profile.entries.size(); ++i)
+	{
+		const profile_entry& entry = profile.entries[i];
+		char text[64];
+		if (entry.timed)
+			snprintf(text, sizeof(text), "%llux, %llu cycles",
+				(unsigned long long)entry.count, (unsigned long long)entry.cycles);
+		else
+			snprintf(text, sizeof(text), "%llux, ? cycles", (unsigned long long)entry.count);
+		comments.add(entry.address, text);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Totals for one basic block
+struct block_profile
+{
+	size_t block_index;
+	uint64_t executions;		// most executions of any instruction in the block
+	uint64_t cycles;
+};
+
+// ----------------------------------------------------------------------------
+void print_hotspots(const trace_profile& profile, const basic_blocks& blocks,
+	const symbols& symbols, uint32_t count, FILE* pOutput)
+{
+	std::vector<block_profile> totals(blocks.blocks.size());
+	for (size_t i = 0; i < totals.size(); ++i)
+	{
+		totals[i].block_index = i;
+		totals[i].executions = 0;
+		totals[i].cycles = 0;
+	}
+
+	// Traced addresses in the middle of a listed instruction (where the
+	// listing decoded the bytes differently) count towards the containing block.
+	uint64_t unlisted = 0;
+	for (size_t i = 0; i < profile.entries.size(); ++i)
+	{
+		const profile_entry& entry = profile.entries[i];
+		size_t block_index;
+		if (!blocks.find(entry.address, block_index))
+		{
+			++unlisted;
+			continue;
+		}
+		block_profile& total = totals[block_index];
+		total.executions = std::max(total.executions, entry.count);
+		total.cycles += entry.cycles;
+	}
+
+	struct compare
+	{
+		bool operator()(const block_profile& a, const block_profile& b) const
+		{
+			if (a.cycles != b.cycles)
+				return a.cycles > b.cycles;
+			return a.block_index < b.block_index;
+		}
+	};
+	std::sort(totals.begin(), totals.end(), compare());
+
+	fprintf(pOutput, "\n; Hot spots\n");
+	fprintf(pOutput, "; %llu addresses traced, %llu outside the text section, %llu cycles\n",
+		(unsigned long long)profile.trace_count, (unsigned long long)profile.outside_count,
+		(unsigned long long)profile.total_cycles);
+	if (unlisted)
+		fprintf(pOutput, "; %llu traced addresses are outside the decoded lines\n", (unsigned long long)unlisted);
+	fprintf(pOutput, "; rank      cycles       %%  executions  block\n");
+	for (size_t i = 0; i < totals.size() && i < count; ++i)
+	{
+		const block_profile& total = totals[i];
+		if (total.cycles == 0 && total.executions == 0)
+			break;
+		const basic_block& block = blocks.blocks[total.block_index];
+		double percent = profile.total_cycles ? 100.0 * total.cycles / profile.total_cycles : 0.0;
+		fprintf(pOutput, "; %4u  %10llu  %5.1f%%  %10llu  ", (unsigned int)(i + 1),
+			(unsigned long long)total.cycles, percent, (unsigned long long)total.executions);
+		print_symbol_offset(symbols, block.address, pOutput);
+		fprintf(pOutput, " ($%x-$%x)\n", block.address, block.end_address);
+	}
+}
@@ -0,0 +1,57 @@
+// Execution profiles from emulator PC traces.
+//
+// A trace is a binary file of 32-bit program counter values, one for each
+// instruction executed, in 68000 (big-endian) byte order unless little-endian
+// is requested. Addresses must match the load address given with --base.
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "lib/decode68.h"
+
+class basic_blocks;
+class line_comments;
+class symbols;
+
+// ----------------------------------------------------------------------------
+// Totals for one traced instruction address.
+struct profile_entry
+{
+	uint32_t address;
+	uint64_t count;				// times executed
+	uint64_t cycles;			// total estimated cycles, including pairing
+	uint16_t time;				// cycles for one execution, rounded up to a multiple of 4
+	uint8_t flags;				// timing flags, for pairing with the next instruction
+	bool timed;					// false if there is no timing for the instruction
+};
+
+class trace_profile
+{
+public:
+	trace_profile();
+
+	std::vector<profile_entry>	entries;	// one per unique traced address, in address order
+	uint64_t trace_count;					// number of addresses in the trace
+	uint64_t outside_count;					// addresses outside the text section, or odd
+	uint64_t total_cycles;
+};
+
+// ----------------------------------------------------------------------------
+// Read a trace of the text section at "text_address", decoding each unique
+// address once to find its timing.
+// Returns 0 for success, 1 for failure.
+extern int read_trace_profile(const char* filename, bool little_endian, const uint8_t* text,
+	uint32_t text_size, uint32_t text_address, const hop68::decode_settings& dsettings,
+	trace_profile& profile);
+
+// Add "<count>x, <cycles> cycles" comments for every traced instruction.
+extern void add_profile_comments(const trace_profile& profile, line_comments& comments);
+
+// Print the "count" blocks which used the most cycles, as comments.
+extern void print_hotspots(const trace_profile& profile, const basic_blocks& blocks,
+	const symbols& symbols, uint32_t count, FILE* pOutput);
+
+#endif
@@ -0,0 +1,652 @@
+// Searching decoded programs for instruction sequences. See query.h.
+#include "query.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+#include "print.h"
+#include "process.h"
+#include "stats.h"
+
+// Repeat count for "{n,}"
+static const uint32_t UNLIMITED_COUNT = 0xffffffff;
+
+// ----------------------------------------------------------------------------
+//	INDEX
+// ----------------------------------------------------------------------------
+uint32_t instruction_index::make_key(const hop68::instruction& inst)
+{
+	return ((uint32_t)inst.opcode << 18) |
+		((uint32_t)inst.suffix << 15) |
+		((uint32_t)inst.op0.type << 10) |
+		((uint32_t)inst.op1.type << 5) |
+		(uint32_t)inst.op2.type;
+}
+
+// ----------------------------------------------------------------------------
+void instruction_index::build(const disassembly& disasm)
+{
+	// Count the lines for each key, then place each line after the ones
+	// before it with the same key, so every row is in address order.
+	std::unordered_map<uint32_t, uint32_t> counts;
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+		++counts[make_key(disasm.lines[i].inst)];
+
+	keys.clear();
+	keys.reserve(counts.size());
+	for (std::unordered_map<uint32_t, uint32_t>::const_iterator it = counts.begin(); it != counts.end(); ++it)
+		keys.push_back(it->first);
+	std::sort(keys.begin(), keys.end());
+
+	// Turn the counts into each row's next free position
+	offsets.resize(keys.size() + 1);
+	uint32_t total = 0;
+	for (size_t row = 0; row < keys.size(); ++row)
+	{
+		offsets[row] = total;
+		uint32_t& count = counts[keys[row]];
+		total += count;
+		count = offsets[row];
+	}
+	offsets[keys.size()] = total;
+
+	lines.resize(disasm.lines.size());
+	for (size_t i = 0; i < disasm.lines.size(); ++i)
+		lines[counts[make_key(disasm.lines[i].inst)]++] = (uint32_t)i;
+}
+
+// ----------------------------------------------------------------------------
+//	PARSING
+// ----------------------------------------------------------------------------
+// Match a string against a pattern with '*' and '?' wildcards
+static bool match_glob(const char* pattern, const char* text)
+{
+	if (*pattern == 0)
+		return *text == 0;
+	if (*pattern == '*')
+		return match_glob(pattern + 1, text) || (*text && match_glob(pattern, text + 1));
+	if (*text && (*pattern == '?' || *pattern == *text))
+		return match_glob(pattern + 1, text + 1);
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+static std::string trim(const std::string& text)
+{
+	size_t start = text.find_first_not_of(" \t");
+	if (start == std::string::npos)
+		return "";
+	size_t end = text.find_last_not_of(" \t");
+	return text.substr(start, end - start + 1);
+}
+
+// ----------------------------------------------------------------------------
+// Parse "*" (no value), or a decimal or hex number with an optional '-'.
+static bool parse_value(const std::string& text, bool& has_value, uint32_t& value)
+{
+	has_value = false;
+	if (text == "*")
+		return true;
+
+	const char* pText = text.c_str();
+	bool negative = (*pText == '-');
+	if (negative)
+		++pText;
+	char* end = NULL;
+	if (*pText == '$')
+		value = (uint32_t)strtoul(pText + 1, &end, 16);
+	else
+		value = (uint32_t)strtoul(pText, &end, 0);
+	if (end == pText || (*pText == '$' && end == pText + 1) || *end != 0)
+		return false;
+	if (negative)
+		value = 0 - value;
+	has_value = true;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Parse a register as "d?", "a3", "r?", "sp" etc. "kinds" lists the allowed
+// first letters. "kind" is set to the letter used.
+static bool parse_register(const std::string& text, const char* kinds, char& kind, int& reg)
+{
+	if (text == "sp" && strchr(kinds, 'a'))
+	{
+		kind = 'a';
+		reg = 7;
+		return true;
+	}
+	if (text.size() != 2 || !strchr(kinds, text[0]))
+		return false;
+	kind = text[0];
+	if (text[1] == '?')
+		reg = -1;
+	else if (text[1] >= '0' && text[1] <= '7' && kind != 'r')
+		reg = text[1] - '0';
+	else
+		return false;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+static uint32_t type_bit(hop68::OpType type)
+{
+	return 1U << type;
+}
+
+// ----------------------------------------------------------------------------
+// Parse one operand pattern, which has no spaces and is in lower case.
+static bool parse_operand(const std::string& text, instruction_query::operand_pattern& pattern)
+{
+	pattern.type_mask = 0;
+	pattern.reg = -1;
+	pattern.has_value = false;
+	pattern.value = 0;
+
+	char kind;
+	if (text == "*")
+		return true;
+	if (text == "sr" || text == "ccr" || text == "usp")
+	{
+		pattern.type_mask = type_bit(text == "sr" ? hop68::SR : text == "ccr" ? hop68::CCR : hop68::USP);
+		return true;
+	}
+	if (parse_register(text, "dar", kind, pattern.reg))
+	{
+		pattern.type_mask = (kind != 'a' ? type_bit(hop68::D_DIRECT) : 0) |
+			(kind != 'd' ? type_bit(hop68::A_DIRECT) : 0);
+		return true;
+	}
+	if (text[0] == '#')
+	{
+		pattern.type_mask = type_bit(hop68::IMMEDIATE);
+		return parse_value(text.substr(1), pattern.has_value, pattern.value);
+	}
+
+	// Absolute addresses
+	size_t len = text.size();
+	if (len > 2 && (text.compare(len - 2, 2, ".w") == 0 || text.compare(len - 2, 2, ".l") == 0))
+	{
+		pattern.type_mask = type_bit(text[len - 1] == 'w' ? hop68::ABSOLUTE_WORD : hop68::ABSOLUTE_LONG);
+		return parse_value(text.substr(0, len - 2), pattern.has_value, pattern.value);
+	}
+
+	// Modes with an address register or PC in brackets
+	size_t open = text.find('(');
+	size_t close = text.rfind(')');
+	if (open == std::string::npos || close == std::string::npos || close < open)
+		return false;
+	std::string prefix = text.substr(0, open);
+	std::string inner = text.substr(open + 1, close - open - 1);
+	std::string postfix = text.substr(close + 1);
+
+	size_t comma = inner.find(',');
+	std::string index;
+	if (comma != std::string::npos)
+	{
+		index = inner.substr(comma + 1);
+		inner = inner.substr(0, comma);
+		if (index != "*")
+			return false;
+	}
+
+	if (inner == "pc")
+	{
+		if (!postfix.empty() || prefix.empty())
+			return false;
+		pattern.type_mask = type_bit(index.empty() ? hop68::PC_DISP : hop68::PC_DISP_INDEX);
+		return parse_value(prefix, pattern.has_value, pattern.value);
+	}
+
+	if (!parse_register(inner, "a", kind, pattern.reg))
+		return false;
+	if (index.empty() && prefix.empty() && postfix.empty())
+		pattern.type_mask = type_bit(hop68::INDIRECT);
+	else if (index.empty() && prefix.empty() && postfix == "+")
+		pattern.type_mask = type_bit(hop68::INDIRECT_POSTINC);
+	else if (index.empty() && prefix == "-" && postfix.empty())
+		pattern.type_mask = type_bit(hop68::INDIRECT_PREDEC);
+	else if (!prefix.empty() && postfix.empty())
+	{
+		pattern.type_mask = type_bit(index.empty() ? hop68::INDIRECT_DISP : hop68::INDIRECT_INDEX);
+		return parse_value(prefix, pattern.has_value, pattern.value);
+	}
+	else
+		return false;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Parse a repeat count "{n}", "{n,}" or "{n,m}" without the brackets
+static bool parse_repeat(const std::string& text, uint32_t& min_count, uint32_t& max_count)
+{
+	char* end = NULL;
+	const char* pText = text.c_str();
+	min_count = (uint32_t)strtoul(pText, &end, 10);
+	if (end == pText)
+		return false;
+	if (*end == 0)
+	{
+		max_count = min_count;
+		return max_count > 0;
+	}
+	if (*end != ',')
+		return false;
+	pText = end + 1;
+	if (*pText == 0)
+	{
+		max_count = UNLIMITED_COUNT;
+		return true;
+	}
+	max_count = (uint32_t)strtoul(pText, &end, 10);
+	return end != pText && *end == 0 && max_count >= min_count && max_count > 0;
+}
+
+// ----------------------------------------------------------------------------
+// Parse one instruction pattern, which is in lower case.
+static bool parse_step(std::string text, instruction_query::step& s)
+{
+	s.min_count = 1;
+	s.max_count = 1;
+	if (!text.empty() && text[text.size() - 1] == '}')
+	{
+		size_t open = text.rfind('{');
+		if (open == std::string::npos ||
+			!parse_repeat(trim(text.substr(open + 1, text.size() - open - 2)), s.min_count, s.max_count))
+			return false;
+		text = trim(text.substr(0, open));
+	}
+
+	size_t space = text.find_first_of(" \t");
+	std::string mnemonic = text.substr(0, space);
+	std::string operands;
+	if (space != std::string::npos)
+	{
+		// Operands can't contain spaces, so remove them all
+		for (size_t i = space; i < text.size(); ++i)
+			if (text[i] != ' ' && text[i] != '\t')
+				operands += text[i];
+	}
+
+	// Split off the suffix
+	s.any_suffix = true;
+	s.suffix = hop68::Suffix::NONE;
+	size_t dot = mnemonic.rfind('.');
+	if (dot != std::string::npos)
+	{
+		std::string suffix = mnemonic.substr(dot + 1);
+		mnemonic = mnemonic.substr(0, dot);
+		if (suffix == "b")
+			s.suffix = hop68::Suffix::BYTE;
+		else if (suffix == "w")
+			s.suffix = hop68::Suffix::WORD;
+		else if (suffix == "l")
+			s.suffix = hop68::Suffix::LONG;
+		else if (suffix == "s")
+			s.suffix = hop68::Suffix::SHORT;
+		else if (suffix != "*" && suffix != "?")
+			return false;
+		s.any_suffix = (suffix == "*" || suffix == "?");
+	}
+	if (mnemonic == "dbra")
+		mnemonic = "dbf";
+
+	bool any_opcode = false;
+	s.opcodes.assign(hop68::Opcode::COUNT, false);
+	for (int op = hop68::Opcode::NONE + 1; op < hop68::Opcode::COUNT; ++op)
+	{
+		s.opcodes[op] = match_glob(mnemonic.c_str(), hop68::get_opcode_string((hop68::Opcode)op));
+		any_opcode |= s.opcodes[op];
+	}
+	if (!any_opcode)
+		return false;
+
+	// Split operands at the commas outside brackets
+	s.any_operands = operands.empty();
+	s.operands.clear();
+	int depth = 0;
+	size_t start = 0;
+	for (size_t i = 0; i <= operands.size() && !s.any_operands; ++i)
+	{
+		char c = i < operands.size() ? operands[i] : ',';
+		depth += (c == '(') - (c == ')');
+		if (c != ',' || depth != 0)
+			continue;
+		instruction_query::operand_pattern pattern;
+		if (s.operands.size() == 3 || !parse_operand(operands.substr(start, i - start), pattern))
+			return false;
+		s.operands.push_back(pattern);
+		start = i + 1;
+	}
+	return depth == 0;
+}
+
+// ----------------------------------------------------------------------------
+int instruction_query::parse(const char* text)
+{
+	std::string lower;
+	for (const char* pText = text; *pText; ++pText)
+		lower += (char)tolower((unsigned char)*pText);
+
+	m_steps.clear();
+	bool needs_line = false;
+	size_t start = 0;
+	while (start <= lower.size())
+	{
+		size_t end = lower.find(';', start);
+		if (end == std::string::npos)
+			end = lower.size();
+		std::string part = trim(lower.substr(start, end - start));
+		step s;
+		if (part.empty() || !parse_step(part, s))
+		{
+			fprintf(stderr, "Error: bad query pattern: '%s'\n", part.c_str());
+			return 1;
+		}
+		needs_line |= (s.min_count > 0);
+		m_steps.push_back(s);
+		start = end + 1;
+	}
+	if (!needs_line)
+	{
+		fprintf(stderr, "Error: query must match at least one instruction\n");
+		return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+//	MATCHING
+// ----------------------------------------------------------------------------
+// Check the operand types of a key or instruction against a step
+static bool match_types(const instruction_query::step& s, const hop68::OpType types[3])
+{
+	if (s.any_operands)
+		return true;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		if (i >= s.operands.size())
+		{
+			if (types[i] != hop68::INVALID)
+				return false;
+		}
+		else if (types[i] == hop68::INVALID)
+			return false;
+		else if (s.operands[i].type_mask && !(s.operands[i].type_mask & type_bit(types[i])))
+			return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Check register numbers and values, once the types are known to match.
+static bool match_operand(const instruction_query::operand_pattern& pattern, const hop68::operand& op,
+	uint32_t inst_address)
+{
+	int reg = -1;
+	bool has_value = false;
+	uint32_t value = 0;
+	switch (op.type)
+	{
+		case hop68::D_DIRECT:			reg = op.d_register.reg; break;
+		case hop68::A_DIRECT:			reg = op.a_register.reg; break;
+		case hop68::INDIRECT:			reg = op.indirect.reg; break;
+		case hop68::INDIRECT_POSTINC:	reg = op.indirect_postinc.reg; break;
+		case hop68::INDIRECT_PREDEC:	reg = op.indirect_predec.reg; break;
+		case hop68::INDIRECT_DISP:
+			reg = op.indirect_disp.reg;
+			value = (uint32_t)(int32_t)op.indirect_disp.disp;
+			has_value = true;
+			break;
+		case hop68::INDIRECT_INDEX:
+			reg = op.indirect_index.a_reg;
+			value = (uint32_t)(int32_t)op.indirect_index.disp;
+			has_value = true;
+			break;
+		case hop68::PC_DISP:
+			value = inst_address + op.pc_disp.inst_disp;
+			has_value = true;
+			break;
+		case hop68::PC_DISP_INDEX:
+			value = inst_address + op.pc_disp_index.inst_disp;
+			has_value = true;
+			break;
+		case hop68::ABSOLUTE_WORD:
+			value = op.absolute_word.wordaddr;
+			has_value = true;
+			break;
+		case hop68::ABSOLUTE_LONG:
+			value = op.absolute_long.longaddr;
+			has_value = true;
+			break;
+		case hop68::IMMEDIATE:
+			// Allow "#-1" to match a byte or word immediate of $ff or $ffff
+			if (pattern.has_value && op.imm.size == hop68::Size::BYTE)
+				return (pattern.value & 0xff) == op.imm.val0 || pattern.value == op.imm.val0;
+			if (pattern.has_value && op.imm.size == hop68::Size::WORD)
+				return (pattern.value & 0xffff) == op.imm.val0 || pattern.value == op.imm.val0;
+			value = op.imm.val0;
+			has_value = true;
+			break;
+		default:
+			break;
+	}
+	if (pattern.reg >= 0 && reg != pattern.reg)
+		return false;
+	if (pattern.has_value && (!has_value || value != pattern.value))
+		return false;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool instruction_query::match_key(const step& s, uint32_t key) const
+{
+	hop68::Opcode opcode = instruction_index::get_key_opcode(key);
+	if (!s.opcodes[opcode])
+		return false;
+	if (!s.any_suffix && instruction_index::get_key_suffix(key) != s.suffix)
+		return false;
+	hop68::OpType types[3];
+	for (int i = 0; i < 3; ++i)
+		types[i] = instruction_index::get_key_type(key, i);
+	return match_types(s, types);
+}
+
+// ----------------------------------------------------------------------------
+bool instruction_query::match_line(const step& s, const hop68::instruction& inst, uint32_t inst_address) const
+{
+	if (!match_key(s, instruction_index::make_key(inst)))
+		return false;
+	if (s.any_operands)
+		return true;
+	const hop68::operand* ops[3] = { &inst.op0, &inst.op1, &inst.op2 };
+	for (size_t i = 0; i < s.operands.size(); ++i)
+		if (!match_operand(s.operands[i], *ops[i], inst_address))
+			return false;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Match the steps from "step_index" onwards, starting at "line_index".
+// Repeats take as many lines as they can, giving lines back if later steps
+// then fail. Lines after "first_line" must follow on from the line before,
+// so gaps in a coverage-guided disassembly are never crossed.
+bool instruction_query::match_steps(const disassembly& disasm, size_t first_line, size_t step_index,
+	size_t line_index, size_t& end_line) const
+{
+	if (step_index == m_steps.size())
+	{
+		end_line = line_index;
+		return true;
+	}
+
+	const step& s = m_steps[step_index];
+	size_t count = 0;
+	while (count < s.max_count && line_index + count < disasm.lines.size())
+	{
+		size_t i = line_index + count;
+		const disassembly::line& line = disasm.lines[i];
+		if (i > first_line)
+		{
+			const disassembly::line& prev = disasm.lines[i - 1];
+			if (prev.address + prev.inst.byte_count != line.address)
+				break;
+		}
+		if (!match_line(s, line.inst, line.address))
+			break;
+		++count;
+	}
+
+	for (; count >= s.min_count; --count)
+	{
+		if (match_steps(disasm, first_line, step_index + 1, line_index + count, end_line))
+			return true;
+		if (count == 0)
+			break;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+void instruction_query::search(const disassembly& disasm, const instruction_index& index,
+	std::vector<match>& matches) const
+{
+	// Anchor the search on the step with the fewest candidate lines, out of
+	// the ones at a fixed distance from the start of a match.
+	size_t anchor_offset = 0;
+	size_t anchor_count = disasm.lines.size();
+	std::vector<size_t> anchor_rows;
+	bool anchored = false;
+	size_t offset = 0;
+	for (size_t i = 0; i < m_steps.size(); ++i)
+	{
+		const step& s = m_steps[i];
+		if (s.min_count > 0)
+		{
+			std::vector<size_t> rows;
+			size_t count = 0;
+			for (size_t row = 0; row < index.keys.size(); ++row)
+			{
+				if (match_key(s, index.keys[row]))
+				{
+					rows.push_back(row);
+					count += index.offsets[row + 1] - index.offsets[row];
+				}
+			}
+			if (!anchored || count < anchor_count)
+			{
+				anchored = true;
+				anchor_offset = offset;
+				anchor_count = count;
+				anchor_rows.swap(rows);
+			}
+		}
+		if (s.min_count != s.max_count)
+			break;
+		offset += s.min_count;
+	}
+
+	// Without an anchor (when the first step can be empty), try every line
+	std::vector<uint32_t> candidates;
+	if (anchored)
+	{
+		candidates.reserve(anchor_count);
+		for (size_t i = 0; i < anchor_rows.size(); ++i)
+		{
+			size_t row = anchor_rows[i];
+			candidates.insert(candidates.end(), index.lines.begin() + index.offsets[row],
+				index.lines.begin() + index.offsets[row + 1]);
+		}
+		std::sort(candidates.begin(), candidates.end());
+	}
+	else
+	{
+		candidates.resize(disasm.lines.size());
+		for (size_t i = 0; i < candidates.size(); ++i)
+			candidates[i] = (uint32_t)i;
+	}
+
+	size_t next_free = 0;
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		if (candidates[i] < anchor_offset)
+			continue;
+		size_t start = candidates[i] - anchor_offset;
+		size_t end;
+		if (start < next_free || !match_steps(disasm, start, 0, start, end) || end == start)
+			continue;
+		match m;
+		m.first_line = start;
+		m.line_count = end - start;
+		matches.push_back(m);
+		next_free = end;
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	OUTPUT
+// ----------------------------------------------------------------------------
+void print_query_matches(const disassembly& disasm, const symbols& symbols,
+	const std::vector<instruction_query::match>& matches, const char* filename, FILE* pOutput)
+{
+	char text[256];
+	for (size_t i = 0; i < matches.size(); ++i)
+	{
+		const instruction_query::match& m = matches[i];
+		uint32_t address = disasm.lines[m.first_line].address;
+		if (filename)
+			fprintf(pOutput, "%s:", filename);
+		fprintf(pOutput, "$%06x", address);
+		if (symbols.table.upper_bound(address) != symbols.table.begin())
+		{
+			fprintf(pOutput, " ");
+			print_symbol_offset(symbols, address, pOutput);
+		}
+		fprintf(pOutput, ":");
+
+		for (size_t j = 0; j < m.line_count; ++j)
+		{
+			const disassembly::line& line = disasm.lines[m.first_line + j];
+			format(line.inst, symbols, line.address, text, sizeof(text));
+
+			// Squeeze the padding after the mnemonic
+			fprintf(pOutput, j ? "; " : " ");
+			bool space = false;
+			for (const char* pText = text; *pText; ++pText)
+			{
+				bool is_space = (*pText == ' ' || *pText == '\t');
+				if (!is_space || !space)
+					fputc(is_space ? ' ' : *pText, pOutput);
+				space = is_space;
+			}
+		}
+		fprintf(pOutput, "\n");
+	}
+}
+
+// ----------------------------------------------------------------------------
+int query_file(const uint8_t* data_ptr, long size, program_format format, const instruction_query& query,
+	const hop68::decode_settings& dsettings, const output_settings& osettings,
+	const char* filename, size_t& match_count, FILE* pOutput)
+{
+	loaded_program program;
+	int ret = load_program(format, data_ptr, size, dsettings, osettings, program);
+	if (ret)
+		return ret;
+
+	stats_start_phase(osettings.pStats, "query index");
+	instruction_index index;
+	index.build(program.disasm);
+	stats_start_phase(osettings.pStats, "query");
+	std::vector<instruction_query::match> matches;
+	query.search(program.disasm, index, matches);
+	stats_add_count(osettings.pStats, "query matches", matches.size());
+	print_query_matches(program.disasm, program.exe_symbols, matches, filename, pOutput);
+	stats_end_phase(osettings.pStats);
+	match_count += matches.size();
+	return 0;
+}
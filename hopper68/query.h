@@ -0,0 +1,115 @@
+// Searching decoded programs for instruction sequences.
+//
+// A query is a list of instruction patterns separated by ';', which must
+// match consecutive instructions. Each pattern is a mnemonic, an optional
+// size suffix and optional operands, for example:
+//
+//	move.l (a?)+,(a?)+ {4,}
+//	lea *,a0; move.w #*,d0; dbf
+//
+// The mnemonic can use '*' and '?' wildcards, and "*" alone matches any
+// instruction. Without a suffix (or with ".*" or ".?") any size matches;
+// without operands any operands match. Operand patterns are:
+//
+//	*						anything
+//	d?  a?  r?  sp			data, address or any register, '?' or a number
+//	(a?)  (a?)+  -(a?)		indirect, postincrement, predecrement
+//	X(a?)  X(a?,*)			displacement, and indexed with any index
+//	X(pc)  X(pc,*)			PC-relative
+//	#X						immediate
+//	X.w  X.l				absolute
+//	sr  ccr  usp
+//
+// where X is '*' or a number (decimal, or hex with "$" or "0x"). A pattern
+// followed by {n}, {n,} or {n,m} repeats, as many times as possible.
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "lib/decode68.h"
+#include "lib/instruction68.h"
+#include "process.h"
+
+// ----------------------------------------------------------------------------
+// Lines of a disassembly grouped by the shape of the instruction: opcode,
+// suffix and the types of its three operands. "lines" holds the line indices
+// for keys[i] from offsets[i] to offsets[i + 1] - 1, in address order.
+class instruction_index
+{
+public:
+	void build(const disassembly& disasm);
+
+	static uint32_t make_key(const hop68::instruction& inst);
+	static hop68::Opcode get_key_opcode(uint32_t key)	{ return (hop68::Opcode)(key >> 18); }
+	static hop68::Suffix get_key_suffix(uint32_t key)	{ return (hop68::Suffix)((key >> 15) & 7); }
+	static hop68::OpType get_key_type(uint32_t key, int slot)
+														{ return (hop68::OpType)((key >> (10 - slot * 5)) & 31); }
+
+	std::vector<uint32_t>	keys;			// unique keys, sorted
+	std::vector<uint32_t>	offsets;		// row starts in "lines", plus a final end marker
+	std::vector<uint32_t>	lines;			// indices into disassembly::lines
+};
+
+// ----------------------------------------------------------------------------
+// A parsed query.
+class instruction_query
+{
+public:
+	// Returns 0 for success, 1 for failure (with the error printed).
+	int parse(const char* text);
+
+	// Find all non-overlapping matches, returning the first line index and
+	// line count of each.
+	struct match
+	{
+		size_t first_line;
+		size_t line_count;
+	};
+	void search(const disassembly& disasm, const instruction_index& index, std::vector<match>& matches) const;
+
+	// The parts of a parsed query
+	struct operand_pattern
+	{
+		uint32_t	type_mask;		// bit for each accepted OpType, or 0 for any
+		int			reg;			// register number, or -1 for any
+		bool		has_value;		// check "value" against the immediate, displacement or address
+		uint32_t	value;
+	};
+
+	struct step
+	{
+		std::vector<bool>		opcodes;		// accepted opcodes, indexed by hop68::Opcode
+		bool					any_suffix;
+		hop68::Suffix			suffix;
+		bool					any_operands;
+		std::vector<operand_pattern> operands;
+		uint32_t				min_count;
+		uint32_t				max_count;
+	};
+
+private:
+	bool match_key(const step& s, uint32_t key) const;
+	bool match_line(const step& s, const hop68::instruction& inst, uint32_t inst_address) const;
+	bool match_steps(const disassembly& disasm, size_t first_line, size_t step_index, size_t line_index,
+		size_t& end_line) const;
+
+	std::vector<step>	m_steps;
+};
+
+// ----------------------------------------------------------------------------
+// Print each match on one line: the address, the nearest symbol and the
+// instructions. "filename" is printed first if it is not NULL.
+extern void print_query_matches(const disassembly& disasm, const symbols& symbols,
+	const std::vector<instruction_query::match>& matches, const char* filename, FILE* pOutput);
+
+// Load a TOS executable, binary file or analysis database, then search it
+// and print the matches. "match_count" is increased by the number found.
+// Returns 0 for success, 1 for failure.
+extern int query_file(const uint8_t* data_ptr, long size, program_format format, const instruction_query& query,
+	const hop68::decode_settings& dsettings, const output_settings& osettings,
+	const char* filename, size_t& match_count, FILE* pOutput);
+
+#endif
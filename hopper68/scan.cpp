@@ -0,0 +1,75 @@
+// Fast scanning functions used to classify data sections.
+#include "scan.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+#ifdef SCAN_USE_SSE2
+// Index of the lowest set bit. "mask" must be non-zero.
+static inline unsigned int lowest_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// ----------------------------------------------------------------------------
+size_t scan_string_run(const uint8_t* data, size_t size)
+{
+	size_t pos = 0;
+#ifdef SCAN_USE_SSE2
+	// Signed compares: bytes >= $80 are negative, so fail the "> $1f" test
+	const __m128i low = _mm_set1_epi8(0x1f);
+	const __m128i high = _mm_set1_epi8(0x7f);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	while (pos + 16 <= size)
+	{
+		__m128i chars = _mm_loadu_si128((const __m128i*)(data + pos));
+		__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(chars, low), _mm_cmplt_epi8(chars, high));
+		ok = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)), ok);
+		unsigned int fail = ~(unsigned int)_mm_movemask_epi8(ok) & 0xffff;
+		if (fail)
+			return pos + lowest_bit(fail);
+		pos += 16;
+	}
+#endif
+	while (pos < size && is_string_char(data[pos]))
+		++pos;
+	return pos;
+}
+
+// ----------------------------------------------------------------------------
+size_t scan_fill_run(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return 0;
+	size_t pos = 0;
+	const uint8_t val = data[0];
+#ifdef SCAN_USE_SSE2
+	const __m128i fill = _mm_set1_epi8((char)val);
+	while (pos + 16 <= size)
+	{
+		__m128i chars = _mm_loadu_si128((const __m128i*)(data + pos));
+		unsigned int fail = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, fill)) & 0xffff;
+		if (fail)
+			return pos + lowest_bit(fail);
+		pos += 16;
+	}
+#endif
+	while (pos < size && data[pos] == val)
+		++pos;
+	return pos;
+}
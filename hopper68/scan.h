@@ -0,0 +1,23 @@
+// Fast scanning functions used to classify data sections.
+// These use SSE2 where available, with a plain C fallback.
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Returns true if the character can be printed inside a quoted "dc.b" string.
+// Assemblers such as vasm treat a backslash as an escape, so it is left out too.
+inline bool is_string_char(uint8_t c)
+{
+	return c >= 0x20 && c < 0x7f && c != '"' && c != '\\';
+}
+
+// Returns the number of bytes at the start of "data" which can be printed
+// inside a quoted string.
+extern size_t scan_string_run(const uint8_t* data, size_t size);
+
+// Returns the number of bytes at the start of "data" which are equal to data[0].
+extern size_t scan_fill_run(const uint8_t* data, size_t size);
+
+#endif
@@ -0,0 +1,375 @@
+// Long-running mode which answers decode requests. See server.h.
+#include "server.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "lib/buffer68.h"
+#include "lib/decode68.h"
+#include "lib/format68.h"
+#include "lib/instruction68.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SERVER_USE_SOCKETS 1
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+// Size of the fixed part of a request, after the length
+static const uint32_t REQUEST_HEADER_SIZE = 8;
+
+// ----------------------------------------------------------------------------
+//	RESPONSE CACHE
+// ----------------------------------------------------------------------------
+// Recently-sent responses, keyed by the request contents, since UIs tend to
+// ask for the same windows repeatedly. Shared by all connections.
+class response_cache
+{
+public:
+	static const size_t MAX_ENTRIES = 1024;
+	static const size_t MAX_REQUEST_SIZE = 4096;		// larger requests are not cached
+
+	bool find(const std::string& request, std::string& response)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		map_t::iterator it = m_map.find(request);
+		if (it == m_map.end())
+			return false;
+		// Move to the front, as most recently used
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		response = it->second->second;
+		return true;
+	}
+
+	void add(const std::string& request, const std::string& response)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_map.find(request) != m_map.end())
+			return;
+		m_entries.push_front(entry(request, response));
+		m_map[request] = m_entries.begin();
+		if (m_entries.size() > MAX_ENTRIES)
+		{
+			m_map.erase(m_entries.back().first);
+			m_entries.pop_back();
+		}
+	}
+
+private:
+	typedef std::pair<std::string, std::string> entry;
+	typedef std::unordered_map<std::string, std::list<entry>::iterator> map_t;
+
+	std::mutex			m_mutex;
+	std::list<entry>	m_entries;				// most recently used first
+	map_t				m_map;
+};
+
+static response_cache g_cache;
+
+// ----------------------------------------------------------------------------
+//	RESPONSE GENERATION
+// ----------------------------------------------------------------------------
+static uint32_t read_u32(const uint8_t* pData)
+{
+	return ((uint32_t)pData[0] << 24) | ((uint32_t)pData[1] << 16) |
+		((uint32_t)pData[2] << 8) | pData[3];
+}
+
+// ----------------------------------------------------------------------------
+static void write_u32(uint8_t* pData, uint32_t val)
+{
+	pData[0] = (uint8_t)(val >> 24);
+	pData[1] = (uint8_t)(val >> 16);
+	pData[2] = (uint8_t)(val >> 8);
+	pData[3] = (uint8_t)val;
+}
+
+// ----------------------------------------------------------------------------
+static void append_format(std::string& str, const char* pFormat, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf, 2, 3)))
+#endif
+	;
+
+static void append_format(std::string& str, const char* pFormat, ...)
+{
+	char text[1024];
+	va_list args;
+	va_start(args, pFormat);
+	int len = vsnprintf(text, sizeof(text), pFormat, args);
+	va_end(args);
+	if (len > 0)
+		str.append(text, (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1);
+}
+
+// ----------------------------------------------------------------------------
+static void append_json_string(std::string& str, const char* text)
+{
+	str += '"';
+	for (; *text; ++text)
+	{
+		char c = *text;
+		if (c == '"' || c == '\\')
+		{
+			str += '\\';
+			str += c;
+		}
+		else if ((unsigned char)c < 0x20)
+			append_format(str, "\\u%04x", (unsigned char)c);
+		else
+			str += c;
+	}
+	str += '"';
+}
+
+// ----------------------------------------------------------------------------
+// Disassemble the body of a request (everything after the length) into "text".
+// Returns 0 for success, 1 if the request is invalid, with "text" holding the error.
+static int decode_request(const uint8_t* pBody, uint32_t size, std::string& text)
+{
+	text.clear();
+	if (size < REQUEST_HEADER_SIZE)
+	{
+		text = "Error: request is too short";
+		return 1;
+	}
+	uint32_t base_address = read_u32(pBody);
+	uint8_t cpu_type = pBody[4];
+	uint8_t format = pBody[5];
+	if (cpu_type > hop68::CPU_TYPE_68030 - hop68::CPU_TYPE_68000)
+	{
+		text = "Error: unknown CPU type";
+		return 1;
+	}
+	if (format >= SERVER_FORMAT_COUNT)
+	{
+		text = "Error: unknown output format";
+		return 1;
+	}
+
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000 + cpu_type;
+	const uint8_t* pData = pBody + REQUEST_HEADER_SIZE;
+	hop68::buffer_reader buf(pData, size - REQUEST_HEADER_SIZE, base_address);
+
+	if (format == SERVER_FORMAT_JSON)
+		text += '[';
+	bool first = true;
+	char inst_text[512];
+	while (buf.get_remain() >= 2)
+	{
+		uint32_t offset = buf.get_pos();
+		hop68::instruction inst;
+		// decode uses a copy of the buffer state
+		hop68::buffer_reader buf_copy(buf);
+		hop68::decode(inst, buf_copy, dsettings);
+		buf.advance(inst.byte_count);
+		hop68::format(inst, inst.address, NULL, inst_text, sizeof(inst_text));
+
+		switch (format)
+		{
+			case SERVER_FORMAT_TEXT:
+				text += '\t';
+				text += inst_text;
+				text += '\n';
+				break;
+			case SERVER_FORMAT_LISTING:
+			{
+				char bytes[64];
+				size_t pos = 0;
+				for (uint32_t i = 0; i < inst.byte_count && pos + 3 <= sizeof(bytes); ++i)
+					pos += snprintf(bytes + pos, sizeof(bytes) - pos, "%02x", pData[offset + i]);
+				bytes[pos] = 0;
+				append_format(text, "%08x  %-20s  %s\n", inst.address, bytes, inst_text);
+				break;
+			}
+			case SERVER_FORMAT_JSON:
+			{
+				if (!first)
+					text += ',';
+				append_format(text, "{\"address\":%u,\"size\":%u,\"bytes\":\"", inst.address, inst.byte_count);
+				for (uint32_t i = 0; i < inst.byte_count; ++i)
+					append_format(text, "%02x", pData[offset + i]);
+				text += "\",\"text\":";
+				append_json_string(text, inst_text);
+				text += '}';
+				break;
+			}
+		}
+		first = false;
+	}
+	if (format == SERVER_FORMAT_JSON)
+		text += ']';
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int write_response(FILE* pOutput, uint32_t status, const std::string& text)
+{
+	uint8_t header[8];
+	write_u32(header, (uint32_t)(4 + text.size()));
+	write_u32(header + 4, status);
+	if (fwrite(header, 1, sizeof(header), pOutput) != sizeof(header))
+		return 1;
+	if (!text.empty() && fwrite(text.data(), 1, text.size(), pOutput) != text.size())
+		return 1;
+	return fflush(pOutput) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//	REQUEST HANDLING
+// ----------------------------------------------------------------------------
+// Decoding builds each CPU's lookup table on first use. Do that up front, so
+// the first requests aren't slow.
+static void build_decode_tables()
+{
+	static const uint8_t nop[2] = { 0x4e, 0x71 };
+	for (int cpu = hop68::CPU_TYPE_68000; cpu <= hop68::CPU_TYPE_68030; ++cpu)
+	{
+		hop68::instruction inst;
+		hop68::buffer_reader buf(nop, sizeof(nop), 0);
+		hop68::decode_settings dsettings = {};
+		dsettings.cpu_type = cpu;
+		hop68::decode(inst, buf, dsettings);
+	}
+}
+
+// ----------------------------------------------------------------------------
+int serve_stream(FILE* pInput, FILE* pOutput)
+{
+	// Reused between requests, so there is no allocation once they are big enough
+	std::string request;
+	std::string response;
+	build_decode_tables();
+	for (;;)
+	{
+		uint8_t length_data[4];
+		size_t count = fread(length_data, 1, sizeof(length_data), pInput);
+		if (count == 0 && feof(pInput))
+			return 0;			// closed between requests
+		if (count != sizeof(length_data))
+		{
+			fprintf(stderr, "Error: truncated request\n");
+			return 1;
+		}
+
+		uint32_t length = read_u32(length_data);
+		if (length > SERVER_MAX_REQUEST_SIZE)
+		{
+			write_response(pOutput, 1, "Error: request is too large");
+			return 1;
+		}
+		request.resize(length);
+		if (length && fread(&request[0], 1, length, pInput) != length)
+		{
+			fprintf(stderr, "Error: truncated request\n");
+			return 1;
+		}
+
+		bool cacheable = length <= response_cache::MAX_REQUEST_SIZE;
+		uint32_t status = 0;
+		if (!cacheable || !g_cache.find(request, response))
+		{
+			status = decode_request((const uint8_t*)request.data(), length, response);
+			if (cacheable && status == 0)
+				g_cache.add(request, response);
+		}
+		if (write_response(pOutput, status, response))
+			return 1;
+	}
+}
+
+// ----------------------------------------------------------------------------
+#ifdef SERVER_USE_SOCKETS
+static void serve_connection(int fd)
+{
+	FILE* pInput = fdopen(fd, "rb");
+	int out_fd = dup(fd);
+	FILE* pOutput = out_fd >= 0 ? fdopen(out_fd, "wb") : NULL;
+	if (pInput && pOutput)
+		serve_stream(pInput, pOutput);
+
+	if (pOutput)
+		fclose(pOutput);
+	else if (out_fd >= 0)
+		close(out_fd);
+	if (pInput)
+		fclose(pInput);
+	else
+		close(fd);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+int serve_socket(const char* path)
+{
+#ifdef SERVER_USE_SOCKETS
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Error: socket path is too long: %s\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+
+	// Only replace a socket left by an earlier server, never another file
+	struct stat st;
+	if (lstat(path, &st) == 0)
+	{
+		if (!S_ISSOCK(st.st_mode))
+		{
+			fprintf(stderr, "Error: path exists and is not a socket: %s\n", path);
+			return 1;
+		}
+		unlink(path);
+	}
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+	{
+		fprintf(stderr, "Error: can't create socket\n");
+		return 1;
+	}
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0)
+	{
+		fprintf(stderr, "Error: can't listen on socket: %s\n", path);
+		close(listen_fd);
+		return 1;
+	}
+
+	// Clients closing early should end their connection, not the server
+	signal(SIGPIPE, SIG_IGN);
+
+	build_decode_tables();
+	for (;;)
+	{
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			// e.g. out of file descriptors, which retrying won't fix
+			fprintf(stderr, "Error: can't accept connection: %s\n", strerror(errno));
+			close(listen_fd);
+			return 1;
+		}
+		std::thread(serve_connection, fd).detach();
+	}
+#else
+	(void)path;
+	fprintf(stderr, "Error: sockets are not supported on this platform, use stdin\n");
+	return 1;
+#endif
+}
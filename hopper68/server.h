@@ -0,0 +1,49 @@
+// Long-running mode which answers decode requests, so that callers making many
+// small requests avoid paying process startup for each one.
+//
+// Requests and responses are framed. All values are big-endian.
+//
+// Request:
+//	uint32	length of the rest of the request (8 + byte count)
+//	uint32	base address of the first byte
+//	uint8	CPU type (0-3 for 68000-68030)
+//	uint8	output format (server_format)
+//	uint16	reserved, must be 0
+//	uint8[]	instruction bytes
+//
+// Response:
+//	uint32	length of the rest of the response (4 + text length)
+//	uint32	status: 0 for success, otherwise the text is an error message
+//	char[]	text (not null-terminated)
+//
+// See tools/hopper_client/hopper_client.py for a client.
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+
+// ----------------------------------------------------------------------------
+enum server_format
+{
+	SERVER_FORMAT_TEXT = 0,		// one instruction per line, as with --hex --no-labels
+	SERVER_FORMAT_LISTING = 1,	// address, instruction bytes and text on each line
+	SERVER_FORMAT_JSON = 2,		// array of {"address", "size", "bytes", "text"} objects
+	SERVER_FORMAT_COUNT
+};
+
+// Largest request accepted. Bigger requests are answered with an error, and
+// the connection is closed.
+static const unsigned int SERVER_MAX_REQUEST_SIZE = 16 * 1024 * 1024;
+
+// Answer requests read from "pInput" until it is closed.
+// Returns 0 for success, 1 for a malformed request or write failure.
+extern int serve_stream(FILE* pInput, FILE* pOutput);
+
+// Listen on a Unix domain socket at "path", serving each connection on its
+// own thread. Any existing socket file at "path" is replaced; any other file
+// there is an error.
+// Only returns if the socket can't be created or connections can't be
+// accepted, returning 1.
+extern int serve_socket(const char* path);
+
+#endif
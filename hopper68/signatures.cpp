@@ -0,0 +1,431 @@
+// Function signature matching. See signatures.h.
+#include "signatures.h"
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+#include "lib/instruction68.h"
+#include "process.h"
+#include "symbols.h"
+
+// Shortest run of fixed bytes a signature must have, so that the automaton
+// isn't flooded with matches of common instructions.
+static const uint32_t MIN_KEY_LENGTH = 4;
+
+// Limits for signatures made by write_signatures()
+static const uint32_t MIN_SIGNATURE_LENGTH = 8;
+static const uint32_t MAX_SIGNATURE_LENGTH = 32;
+
+// ----------------------------------------------------------------------------
+//	PATTERNS
+// ----------------------------------------------------------------------------
+static bool get_hex_digit(char c, uint8_t& val)
+{
+	if (c >= '0' && c <= '9')
+		val = c - '0';
+	else if (c >= 'a' && c <= 'f')
+		val = c - 'a' + 10;
+	else if (c >= 'A' && c <= 'F')
+		val = c - 'A' + 10;
+	else
+		return false;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Find the longest run of bytes without wildcards. The first is used if
+// several are the same length.
+static void find_key(const std::vector<uint8_t>& mask, uint32_t& key_offset, uint32_t& key_length)
+{
+	key_offset = 0;
+	key_length = 0;
+	uint32_t run_start = 0;
+	for (uint32_t i = 0; i <= mask.size(); ++i)
+	{
+		if (i < mask.size() && mask[i])
+			continue;
+		if (i - run_start > key_length)
+		{
+			key_offset = run_start;
+			key_length = i - run_start;
+		}
+		run_start = i + 1;
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	SIGNATURE DATABASE
+// ----------------------------------------------------------------------------
+signature_db::signature_db()
+{
+	memset(m_root_next, 0, sizeof(m_root_next));
+}
+
+// ----------------------------------------------------------------------------
+// Parse one line of a signature file. Returns 1 for a bad line, -1 for a blank
+// or comment line, and 0 for a signature.
+int signature_db::parse_line(const char* pLine, signature& sig) const
+{
+	while (*pLine == ' ' || *pLine == '\t')
+		++pLine;
+	if (*pLine == 0 || *pLine == '\n' || *pLine == '\r' || *pLine == '#')
+		return -1;
+
+	const char* pName = pLine;
+	while (*pLine && *pLine != ' ' && *pLine != '\t' && *pLine != '\n' && *pLine != '\r')
+		++pLine;
+	sig.name.assign(pName, pLine - pName);
+
+	while (*pLine && *pLine != '\n' && *pLine != '\r' && *pLine != '#')
+	{
+		if (*pLine == ' ' || *pLine == '\t')
+		{
+			++pLine;
+			continue;
+		}
+		uint8_t hi, lo;
+		if (pLine[0] == '.' && pLine[1] == '.')
+		{
+			sig.bytes.push_back(0);
+			sig.mask.push_back(0);
+		}
+		else if (get_hex_digit(pLine[0], hi) && get_hex_digit(pLine[1], lo))
+		{
+			sig.bytes.push_back((hi << 4) | lo);
+			sig.mask.push_back(0xff);
+		}
+		else
+			return 1;
+		pLine += 2;
+	}
+
+	find_key(sig.mask, sig.key_offset, sig.key_length);
+	return sig.key_length < MIN_KEY_LENGTH ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+int signature_db::load(const char* filename)
+{
+	FILE* pFile = fopen(filename, "r");
+	if (!pFile)
+	{
+		fprintf(stderr, "Error: Can't read signature file: %s\n", filename);
+		return 1;
+	}
+
+	char line[1024];
+	unsigned int line_num = 0;
+	int ret = 0;
+	while (fgets(line, sizeof(line), pFile))
+	{
+		++line_num;
+		if (!strchr(line, '\n') && !feof(pFile))
+		{
+			fprintf(stderr, "Error: signature too long at %s line %u\n", filename, line_num);
+			ret = 1;
+			break;
+		}
+		signature sig;
+		int line_ret = parse_line(line, sig);
+		if (line_ret > 0)
+		{
+			fprintf(stderr, "Error: bad signature at %s line %u (needs a name, hex bytes and "
+				"a run of %u bytes without \"..\")\n", filename, line_num, MIN_KEY_LENGTH);
+			ret = 1;
+			break;
+		}
+		if (line_ret == 0)
+			m_signatures.push_back(sig);
+	}
+	fclose(pFile);
+
+	if (ret == 0)
+		build();
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+// Find the state reached from "state_index" by "byte", or 0 if there is no edge.
+// (The root is never a target, so 0 can't be a real result.)
+uint32_t signature_db::find_edge(uint32_t state_index, uint8_t byte) const
+{
+	const state& s = m_states[state_index];
+	const edge* first = m_edges.data() + s.edge_first;
+	const edge* last = first + s.edge_count;
+	while (first < last)
+	{
+		const edge* mid = first + (last - first) / 2;
+		if (mid->byte == byte)
+			return mid->next;
+		if (mid->byte < byte)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Build the automaton from the keys of all signatures.
+void signature_db::build()
+{
+	// Make a trie of the keys. The edges are collected in (state, byte) order
+	// so they can be stored as sorted runs afterwards.
+	std::map<uint64_t, uint32_t> trie_edges;
+	std::vector<std::pair<uint32_t, uint32_t> > key_ends;		// (state, signature index)
+	uint32_t state_count = 1;
+	for (uint32_t i = 0; i < m_signatures.size(); ++i)
+	{
+		const signature& sig = m_signatures[i];
+		uint32_t current = 0;
+		for (uint32_t j = 0; j < sig.key_length; ++j)
+		{
+			uint64_t key = ((uint64_t)current << 8) | sig.bytes[sig.key_offset + j];
+			std::map<uint64_t, uint32_t>::iterator it = trie_edges.find(key);
+			if (it == trie_edges.end())
+				it = trie_edges.insert(std::make_pair(key, state_count++)).first;
+			current = it->second;
+		}
+		key_ends.push_back(std::make_pair(current, i));
+	}
+
+	m_states.assign(state_count, state());
+	m_edges.clear();
+	m_edges.reserve(trie_edges.size());
+	for (std::map<uint64_t, uint32_t>::const_iterator it = trie_edges.begin(); it != trie_edges.end(); ++it)
+	{
+		state& s = m_states[it->first >> 8];
+		if (s.edge_count == 0)
+			s.edge_first = (uint32_t)m_edges.size();
+		++s.edge_count;
+		edge e;
+		e.byte = (uint8_t)it->first;
+		e.next = it->second;
+		m_edges.push_back(e);
+	}
+
+	std::sort(key_ends.begin(), key_ends.end());
+	m_outputs.clear();
+	for (size_t i = 0; i < key_ends.size(); ++i)
+	{
+		state& s = m_states[key_ends[i].first];
+		if (s.output_count == 0)
+			s.output_first = (uint32_t)m_outputs.size();
+		++s.output_count;
+		m_outputs.push_back(key_ends[i].second);
+	}
+
+	// Breadth-first, so each fail state is finished before it is used
+	std::vector<uint32_t> queue;
+	queue.reserve(state_count);
+	queue.push_back(0);
+	for (size_t head = 0; head < queue.size(); ++head)
+	{
+		uint32_t parent = queue[head];
+		const state& p = m_states[parent];
+		for (uint32_t e = p.edge_first; e < p.edge_first + p.edge_count; ++e)
+		{
+			uint8_t byte = m_edges[e].byte;
+			uint32_t child = m_edges[e].next;
+			uint32_t fail = 0;
+			if (parent != 0)
+			{
+				uint32_t f = p.fail;
+				while (true)
+				{
+					fail = find_edge(f, byte);
+					if (fail || f == 0)
+						break;
+					f = m_states[f].fail;
+				}
+			}
+			state& c = m_states[child];
+			c.fail = fail;
+			c.output_link = m_states[fail].output_count ? fail : m_states[fail].output_link;
+			queue.push_back(child);
+		}
+	}
+
+	for (uint32_t b = 0; b < 256; ++b)
+		m_root_next[b] = find_edge(0, (uint8_t)b);
+}
+
+// ----------------------------------------------------------------------------
+size_t signature_db::apply(const uint8_t* text, uint32_t text_size, uint32_t text_address,
+	symbols& symbols) const
+{
+	if (m_signatures.empty())
+		return 0;
+
+	// Best signature for each matched offset
+	std::map<uint32_t, uint32_t> matches;
+	uint32_t current = 0;
+	for (uint32_t pos = 0; pos < text_size; ++pos)
+	{
+		uint8_t byte = text[pos];
+		while (true)
+		{
+			if (current == 0)
+			{
+				current = m_root_next[byte];
+				break;
+			}
+			uint32_t next = find_edge(current, byte);
+			if (next)
+			{
+				current = next;
+				break;
+			}
+			current = m_states[current].fail;
+		}
+
+		uint32_t out = m_states[current].output_count ? current : m_states[current].output_link;
+		for (; out; out = m_states[out].output_link)
+		{
+			const state& s = m_states[out];
+			for (uint32_t i = s.output_first; i < s.output_first + s.output_count; ++i)
+			{
+				uint32_t sig_index = m_outputs[i];
+				const signature& sig = m_signatures[sig_index];
+
+				// Check the whole pattern around the key
+				uint32_t key_start = pos + 1 - sig.key_length;
+				if (key_start < sig.key_offset)
+					continue;
+				uint32_t start = key_start - sig.key_offset;
+				if ((start & 1) || sig.bytes.size() > text_size - start)
+					continue;
+				bool match = true;
+				for (uint32_t j = 0; j < sig.bytes.size() && match; ++j)
+					match = (text[start + j] & sig.mask[j]) == sig.bytes[j];
+				if (!match)
+					continue;
+
+				std::map<uint32_t, uint32_t>::iterator it = matches.find(start);
+				if (it == matches.end())
+					matches[start] = sig_index;
+				else if (sig.bytes.size() > m_signatures[it->second].bytes.size() ||
+						(sig.bytes.size() == m_signatures[it->second].bytes.size() && sig_index < it->second))
+					it->second = sig_index;
+			}
+		}
+	}
+
+	// Name the functions. A function found more than once gets a numbered
+	// suffix after the first, so the labels stay unique.
+	std::map<std::string, uint32_t> name_counts;
+	size_t named = 0;
+	for (std::map<uint32_t, uint32_t>::const_iterator it = matches.begin(); it != matches.end(); ++it)
+	{
+		uint32_t address = text_address + it->first;
+		symbols::sym_map::iterator sym_it = symbols.table.find(address);
+		if (sym_it != symbols.table.end() && !sym_it->second.label.empty())
+			continue;
+
+		std::string label = m_signatures[it->second].name;
+		uint32_t count = ++name_counts[label];
+		if (count > 1)
+			label += "_" + std::to_string(count);
+
+		if (sym_it != symbols.table.end())
+			sym_it->second.label = label;
+		else
+		{
+			symbol sym;
+			sym.label = label;
+			sym.section = symbol::section_type::TEXT;
+			sym.address = address;
+			add_symbol(symbols, sym);
+		}
+		++named;
+	}
+	return named;
+}
+
+// ----------------------------------------------------------------------------
+//	SIGNATURE CREATION
+// ----------------------------------------------------------------------------
+static bool is_pc_relative(const hop68::operand& op)
+{
+	return op.type == hop68::PC_DISP || op.type == hop68::PC_DISP_INDEX ||
+		op.type == hop68::RELATIVE_BRANCH;
+}
+
+// ----------------------------------------------------------------------------
+// Clear the mask for bytes of the text section which change when the code
+// is linked at a different place: relocated longs, and the displacements of
+// PC-relative instructions.
+static void mask_variable_bytes(const loaded_program& program, std::vector<uint8_t>& mask)
+{
+	const uint32_t text_size = program.text_size;
+	for (size_t i = 0; i < program.reloc_offsets.size(); ++i)
+	{
+		uint32_t offset = program.reloc_offsets[i];
+		for (uint32_t j = offset; j < offset + 4 && j < text_size; ++j)
+			mask[j] = 0;
+	}
+
+	for (size_t i = 0; i < program.disasm.lines.size(); ++i)
+	{
+		const disassembly::line& line = program.disasm.lines[i];
+		const hop68::instruction& inst = line.inst;
+		if (!is_pc_relative(inst.op0) && !is_pc_relative(inst.op1) && !is_pc_relative(inst.op2))
+			continue;
+
+		// The extension words hold the displacement. Short branches keep it
+		// in the low byte of the opcode word.
+		uint32_t offset = line.address - program.text_address;
+		uint32_t first = inst.byte_count == 2 ? 1 : 2;
+		for (uint32_t j = offset + first; j < offset + inst.byte_count && j < text_size; ++j)
+			mask[j] = 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+int write_signatures(const loaded_program& program, FILE* pOutput)
+{
+	std::vector<uint8_t> mask(program.text_size, 0xff);
+	mask_variable_bytes(program, mask);
+
+	const uint32_t text_address = program.text_address;
+	const symbols::sym_map& table = program.exe_symbols.table;
+	for (symbols::sym_map::const_iterator it = table.begin(); it != table.end(); ++it)
+	{
+		const symbol& sym = it->second;
+		if (sym.section != symbol::section_type::TEXT || sym.label.empty())
+			continue;
+		uint32_t start = sym.address - text_address;
+		if (start >= program.text_size || (start & 1))
+			continue;
+
+		// Stop at the next symbol, which is probably the next function
+		uint32_t end = program.text_size;
+		symbols::sym_map::const_iterator next_it = it;
+		++next_it;
+		if (next_it != table.end() && next_it->second.address - text_address < end)
+			end = next_it->second.address - text_address;
+		uint32_t length = std::min(end - start, MAX_SIGNATURE_LENGTH);
+		if (length < MIN_SIGNATURE_LENGTH)
+			continue;
+
+		std::vector<uint8_t> sig_mask(mask.begin() + start, mask.begin() + start + length);
+		uint32_t key_offset, key_length;
+		find_key(sig_mask, key_offset, key_length);
+		if (key_length < MIN_KEY_LENGTH)
+			continue;
+
+		fprintf(pOutput, "%s\t", sym.label.c_str());
+		for (uint32_t i = 0; i < length; ++i)
+		{
+			if (i && (i & 1) == 0)
+				fprintf(pOutput, " ");
+			if (sig_mask[i])
+				fprintf(pOutput, "%02x", program.image_ptr[start + i]);
+			else
+				fprintf(pOutput, "..");
+		}
+		fprintf(pOutput, "\n");
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+// Naming library functions in programs without symbols, by matching the
+// bytes of known functions.
+//
+// A signature file has one function per line: the name, then its first bytes
+// as hex, with ".." for any byte which can vary, such as relocated addresses
+// and PC-relative displacements. Spaces between bytes are optional, and '#'
+// starts a comment. For example:
+//
+//	strlen	2048 4a18 66fc 5388 91c8 2008 4e75
+//	memcpy	4e56 0000 206e .... 226e ....
+//
+// write_signatures() creates a file like this from a program with symbols.
+#ifndef SIGNATURES_H
+#define SIGNATURES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class loaded_program;
+class symbols;
+
+// ----------------------------------------------------------------------------
+// All the signatures, with a multi-pattern automaton to find them in one pass.
+// Once loaded this is read-only, so it can be shared between threads.
+class signature_db
+{
+public:
+	signature_db();
+
+	// Returns 0 for success, 1 for failure.
+	int load(const char* filename);
+
+	size_t get_count() const		{ return m_signatures.size(); }
+
+	// Find every signature at an even address in the text section, and name
+	// the function there, unless it already has a name from the symbol table.
+	// When several signatures match the same address, the longest is used.
+	// Returns the number of functions named.
+	size_t apply(const uint8_t* text, uint32_t text_size, uint32_t text_address, symbols& symbols) const;
+
+private:
+	struct signature
+	{
+		std::string				name;
+		std::vector<uint8_t>	bytes;
+		std::vector<uint8_t>	mask;			// 0xff for bytes which must match, 0 for ".."
+		uint32_t				key_offset;		// longest run without wildcards, which is
+		uint32_t				key_length;		// the part found by the automaton
+	};
+
+	// A state of the automaton. Transitions are sorted runs in m_edges.
+	struct state
+	{
+		uint32_t fail;				// longest proper suffix which is also a state
+		uint32_t output_link;		// next state along the fail links with outputs, or 0
+		uint32_t edge_first;
+		uint16_t edge_count;
+		uint16_t output_count;		// signatures whose key ends here
+		uint32_t output_first;		// index in m_outputs
+	};
+
+	struct edge
+	{
+		uint8_t byte;
+		uint32_t next;
+	};
+
+	int parse_line(const char* pLine, signature& sig) const;
+	void build();
+	uint32_t find_edge(uint32_t state_index, uint8_t byte) const;
+
+	std::vector<signature>	m_signatures;
+	std::vector<state>		m_states;			// state 0 is the root
+	std::vector<edge>		m_edges;
+	std::vector<uint32_t>	m_outputs;			// signature indices
+	uint32_t				m_root_next[256];	// root transitions, 0 to stay at the root
+};
+
+// ----------------------------------------------------------------------------
+// Write a signature for each named function in the text section of a
+// program, with relocated and PC-relative bytes as wildcards. Functions too
+// short to identify reliably are skipped. Returns 0 for success, 1 for failure.
+extern int write_signatures(const loaded_program& program, FILE* pOutput);
+
+#endif
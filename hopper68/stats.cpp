@@ -0,0 +1,104 @@
+// Timings and counters for each stage of a run, printed with --stats.
+#include "stats.h"
+
+#include <string.h>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STATS_USE_RUSAGE 1
+#include <sys/resource.h>
+#endif
+
+// ----------------------------------------------------------------------------
+static double get_seconds()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ----------------------------------------------------------------------------
+// Returns the peak resident set size so far, or 0 if unknown
+static long get_peak_rss_kb()
+{
+#ifdef STATS_USE_RUSAGE
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (long)(usage.ru_maxrss / 1024);		// bytes on macOS
+#else
+	return (long)usage.ru_maxrss;				// kilobytes on Linux
+#endif
+#else
+	return 0;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+run_stats::run_stats() :
+	m_current(-1),
+	m_start(0.0)
+{
+}
+
+// ----------------------------------------------------------------------------
+void run_stats::start_phase(const char* name)
+{
+	end_phase();
+	size_t i = 0;
+	while (i < m_phases.size() && strcmp(m_phases[i].name, name) != 0)
+		++i;
+	if (i == m_phases.size())
+	{
+		phase new_phase = { name, 0.0, 0 };
+		m_phases.push_back(new_phase);
+	}
+	m_current = (int)i;
+	m_start = get_seconds();
+}
+
+// ----------------------------------------------------------------------------
+void run_stats::end_phase()
+{
+	if (m_current < 0)
+		return;
+	phase& curr = m_phases[m_current];
+	curr.seconds += get_seconds() - m_start;
+	curr.peak_rss_kb = get_peak_rss_kb();
+	m_current = -1;
+}
+
+// ----------------------------------------------------------------------------
+void run_stats::add_count(const char* name, uint64_t count)
+{
+	for (size_t i = 0; i < m_counts.size(); ++i)
+	{
+		if (strcmp(m_counts[i].name, name) == 0)
+		{
+			m_counts[i].count += count;
+			return;
+		}
+	}
+	counter new_counter = { name, count };
+	m_counts.push_back(new_counter);
+}
+
+// ----------------------------------------------------------------------------
+void run_stats::print(FILE* pOutput) const
+{
+	double total = 0.0;
+	fprintf(pOutput, "Stats: %-24s %12s %14s\n", "phase", "time (ms)", "peak RSS (KB)");
+	for (size_t i = 0; i < m_phases.size(); ++i)
+	{
+		const phase& curr = m_phases[i];
+		fprintf(pOutput, "Stats: %-24s %12.3f %14ld\n", curr.name, curr.seconds * 1000.0, curr.peak_rss_kb);
+		total += curr.seconds;
+	}
+	fprintf(pOutput, "Stats: %-24s %12.3f %14ld\n", "total", total * 1000.0, get_peak_rss_kb());
+
+	for (size_t i = 0; i < m_counts.size(); ++i)
+	{
+		fprintf(pOutput, "Stats: %-24s %12llu\n", m_counts[i].name,
+			(unsigned long long)m_counts[i].count);
+	}
+}
@@ -0,0 +1,73 @@
+""" Test of the labels added for (d16,An) operands with a known base register.
+
+    Each case is a short --bin program followed by NOPs, and lists the
+    addresses which should be labelled. Only LEA, and MOVEA.L from an address
+    register or an immediate, give a register a known address; MOVEA.L from
+    memory loads the longword stored there.
+
+    Usage: base_labels_test.py [--hopper path]
+    Returns 0 if all checks pass.
+"""
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+NOPS = "4e71" * 16
+CASES = [
+    # (name, code, labelled addresses)
+    ("lea; movea.l (a0)", "41fa000e" "2250" "30290008" "4e75", [0x10]),
+    ("movea.l d(pc)", "207a000e" "30280008" "4e75", [0x10]),
+    ("movea.l d(a1)", "43fa000e" "20690004" "30280008" "4e75", [0x10, 0x14]),
+    ("movea.l abs.l", "207900000010" "30280008" "4e75", [0x10]),
+    ("lea; movea.l a0", "41fa000e" "2248" "30290008" "4e75", [0x10, 0x18]),
+    ("movea.l #imm", "207c00000010" "30280008" "4e75", [0x18]),
+    ("lea d(a0)", "41fa000e" "43e80004" "30290002" "4e75", [0x10, 0x14, 0x16]),
+    ("lea; adda.w d0", "47fa000e" "d6c0" "322b0008" "4e75", [0x10]),
+    ("lea; suba.l a1", "47fa000e" "97c9" "322b0008" "4e75", [0x10]),
+    ("lea; addq.l #4", "47fa000e" "588b" "322b0008" "4e75", [0x10, 0x1c]),
+]
+
+
+def get_labels(hopper, code):
+    """ Returns the addresses of the labels in the listing of "code" """
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path = os.path.join(tmpdir, "test.bin")
+        with open(path, "wb") as f:
+            f.write(bytes.fromhex(code + NOPS))
+        text = subprocess.run([hopper, "--bin", "--address", path], stdout=subprocess.PIPE,
+                              check=True).stdout.decode("latin-1")
+    labels = []
+    pending = False
+    for line in text.splitlines():
+        if re.match(r"^\w+:$", line):
+            pending = True
+            continue
+        match = re.search(r";\s*([0-9a-f]+)$", line)
+        if pending and match:
+            labels.append(int(match.group(1), 16))
+            pending = False
+    return labels
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--hopper", default=os.path.join(SCRIPT_DIR, "..", "hopper68"))
+    args = parser.parse_args()
+
+    failures = 0
+    for name, code, expected in CASES:
+        actual = get_labels(args.hopper, code)
+        if actual != expected:
+            print("FAIL %s: expected %s, got %s" % (name, [hex(a) for a in expected], [hex(a) for a in actual]))
+            failures += 1
+    print("base_labels_test: %d failures" % failures)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
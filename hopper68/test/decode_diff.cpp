@@ -0,0 +1,203 @@
+// Differential test of hop68::decode against hop68::decode_reference.
+//
+// Decodes every 16-bit header word, followed by a set of fixed and random
+// extension word patterns, for each CPU type, with both decoders. Any
+// difference in the resulting instruction (all fields, including byte_count)
+// or in the reader position is reported. Work is split across threads.
+//
+// Usage: decode_diff [--random <n>] [--jobs <n>]
+// Returns 0 if both decoders agree everywhere.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "../lib/buffer68.h"
+#include "../lib/decode68.h"
+#include "../lib/instruction68.h"
+
+static const int NUM_EXTENSION_WORDS = 10;
+static const uint32_t INST_BUFFER_SIZE = 2 + NUM_EXTENSION_WORDS * 2;
+static const int NUM_CPUS = 4;
+static const int NUM_TABLES = 16;
+
+// Stop reporting after this many differences
+static const uint32_t MAX_REPORTED_DIFFS = 20;
+
+static const char* g_cpu_names[NUM_CPUS] = { "68000", "68010", "68020", "68030" };
+
+// ----------------------------------------------------------------------------
+struct extension_pattern
+{
+	uint16_t words[NUM_EXTENSION_WORDS];
+};
+
+// Patterns that reach the different extension word and operand paths
+static const extension_pattern g_fixed_patterns[] =
+{
+	{ { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 } },
+	{ { 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff } },
+	{ { 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010, 0x0010 } },
+	{ { 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804, 0x7804 } },
+	{ { 0x0131, 0x0000, 0x1000, 0x0131, 0x0000, 0x1000, 0x0131, 0x0000, 0x1000, 0x0000 } },
+	{ { 0x0170, 0x1234, 0x5678, 0x9abc, 0xdef0, 0x0170, 0x1234, 0x5678, 0x9abc, 0xdef0 } },
+	{ { 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000 } },
+	{ { 0x4e75, 0x4e71, 0x4e75, 0x4e71, 0x4e75, 0x4e71, 0x4e75, 0x4e71, 0x4e75, 0x4e71 } },
+};
+
+// ----------------------------------------------------------------------------
+struct job
+{
+	int cpu_type;
+	int table;
+	size_t pattern;
+};
+
+struct shared_state
+{
+	std::vector<extension_pattern>	patterns;
+	std::vector<job>				jobs;
+	std::atomic<size_t>				next_job;
+	std::atomic<uint64_t>			num_decodes;
+	std::atomic<uint32_t>			num_diffs;
+	std::mutex						report_mutex;
+};
+
+// ----------------------------------------------------------------------------
+static void report_diff(shared_state& state, const job& curr, uint32_t header,
+	const hop68::instruction& ref, const hop68::instruction& cand,
+	uint32_t ref_pos, uint32_t cand_pos)
+{
+	uint32_t count = ++state.num_diffs;
+	if (count > MAX_REPORTED_DIFFS)
+		return;
+
+	const uint16_t* words = state.patterns[curr.pattern].words;
+	std::lock_guard<std::mutex> lock(state.report_mutex);
+	printf("DIFF cpu=%s header=$%04x pattern=%u ext=$%04x,$%04x,$%04x:"
+		" reference %s (%u bytes, pos %u) candidate %s (%u bytes, pos %u)\n",
+		g_cpu_names[curr.cpu_type], header, (unsigned int)curr.pattern,
+		words[0], words[1], words[2],
+		hop68::get_opcode_string(ref.opcode), ref.byte_count, ref_pos,
+		hop68::get_opcode_string(cand.opcode), cand.byte_count, cand_pos);
+}
+
+// ----------------------------------------------------------------------------
+static void run_job(shared_state& state, const job& curr)
+{
+	hop68::decode_settings dsettings = {};
+	dsettings.cpu_type = hop68::CPU_TYPE_68000 + curr.cpu_type;
+
+	uint8_t data[INST_BUFFER_SIZE];
+	const uint16_t* words = state.patterns[curr.pattern].words;
+	for (int i = 0; i < NUM_EXTENSION_WORDS; ++i)
+	{
+		data[2 + i * 2] = (uint8_t)(words[i] >> 8);
+		data[3 + i * 2] = (uint8_t)words[i];
+	}
+
+	// Both instructions start with identical bytes, so any field (or padding)
+	// left unwritten by one path but not the other shows up in the comparison
+	alignas(hop68::instruction) uint8_t ref_storage[sizeof(hop68::instruction)];
+	alignas(hop68::instruction) uint8_t cand_storage[sizeof(hop68::instruction)];
+	hop68::instruction& ref = *new (ref_storage) hop68::instruction;
+	hop68::instruction& cand = *new (cand_storage) hop68::instruction;
+
+	const uint32_t first = curr.table << 12;
+	for (uint32_t header = first; header < first + 0x1000; ++header)
+	{
+		data[0] = (uint8_t)(header >> 8);
+		data[1] = (uint8_t)header;
+
+		// Also vary the length, so truncated instructions are covered
+		uint32_t length = INST_BUFFER_SIZE - (header & 7) * 2;
+
+		memset(ref_storage, 0xcd, sizeof(ref_storage));
+		memset(cand_storage, 0xcd, sizeof(cand_storage));
+		hop68::buffer_reader ref_buf(data, length, 0x1000);
+		hop68::buffer_reader cand_buf(data, length, 0x1000);
+		hop68::decode_reference(ref, ref_buf, dsettings);
+		hop68::decode(cand, cand_buf, dsettings);
+
+		if (ref.byte_count != cand.byte_count || ref_buf.get_pos() != cand_buf.get_pos() ||
+			memcmp(ref_storage, cand_storage, sizeof(ref_storage)) != 0)
+		{
+			report_diff(state, curr, header, ref, cand, ref_buf.get_pos(), cand_buf.get_pos());
+		}
+	}
+	state.num_decodes += 0x1000;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	uint32_t num_random = 64;
+	unsigned int num_threads = std::max(1U, std::thread::hardware_concurrency());
+	for (int arg = 1; arg + 1 < argc; arg += 2)
+	{
+		if (strcmp(argv[arg], "--random") == 0)
+			num_random = (uint32_t)atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "--jobs") == 0)
+			num_threads = std::max(1, atoi(argv[arg + 1]));
+		else
+		{
+			fprintf(stderr, "Error: Unknown option: '%s'\n", argv[arg]);
+			return 1;
+		}
+	}
+
+	shared_state state;
+	state.patterns.assign(g_fixed_patterns, g_fixed_patterns +
+		sizeof(g_fixed_patterns) / sizeof(g_fixed_patterns[0]));
+
+	// Random patterns from a fixed seed, so runs are repeatable
+	uint32_t seed = 0x12345678;
+	for (uint32_t i = 0; i < num_random; ++i)
+	{
+		extension_pattern pattern;
+		for (int w = 0; w < NUM_EXTENSION_WORDS; ++w)
+		{
+			seed = seed * 1103515245U + 12345U;
+			pattern.words[w] = (uint16_t)(seed >> 16);
+		}
+		state.patterns.push_back(pattern);
+	}
+
+	for (int cpu = 0; cpu < NUM_CPUS; ++cpu)
+		for (size_t p = 0; p < state.patterns.size(); ++p)
+			for (int table = 0; table < NUM_TABLES; ++table)
+			{
+				job curr = { cpu, table, p };
+				state.jobs.push_back(curr);
+			}
+	state.next_job = 0;
+	state.num_decodes = 0;
+	state.num_diffs = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < num_threads; ++t)
+	{
+		workers.push_back(std::thread([&state]()
+		{
+			size_t index;
+			while ((index = state.next_job++) < state.jobs.size())
+				run_job(state, state.jobs[index]);
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("decode_diff: %llu decodes, %u patterns, %u threads, %.2f seconds, %u differences\n",
+		(unsigned long long)state.num_decodes.load(), (unsigned int)state.patterns.size(),
+		num_threads, seconds, state.num_diffs.load());
+	return state.num_diffs.load() ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#!/usr/bin/env sh
+# Build and run the differential test of the dispatch-table decoder against
+# the reference matcher-table decoder.
+set -e
+CC=g++
+CFLAGS="-DNDEBUG -std=c++11 -g -Wextra -Wall -O2 -pthread ${EXTRA_CFLAGS}"
+
+${CC} ${CFLAGS} -o decode_diff decode_diff.cpp ../lib/decode68.cpp ../lib/instruction68.cpp
+./decode_diff "$@"
@@ -0,0 +1,74 @@
+""" Test of --disk with small generated .ST and .MSA images.
+
+    A valid image must list its program, and damaged ones must fail with an
+    error message rather than crashing or reading outside the image.
+
+    Usage: disk_test.py [--hopper path]
+    Returns 0 if all checks pass.
+"""
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+SECTOR_SIZE = 512
+FAT_START = 1 * SECTOR_SIZE
+ROOT_START = FAT_START + 2 * 5 * SECTOR_SIZE
+PROGRAM = struct.pack(">HIIIIIIH", 0x601a, 4, 0, 0, 0, 0, 0, 0) + bytes.fromhex("4e714e75") + bytes(4)
+
+
+def make_st(total_sectors=1440, start_cluster=2):
+    """ Returns a 720KB image holding one program, TEST.PRG """
+    image = bytearray(737280)
+    image[11:24] = struct.pack("<HBHBHHBH", SECTOR_SIZE, 2, 1, 2, 112, total_sectors, 0xf9, 5)
+    image[ROOT_START:ROOT_START + 32] = struct.pack("<11sB14xHI", b"TEST    PRG", 0, start_cluster, len(PROGRAM))
+    image[FAT_START + 3:FAT_START + 5] = b"\xff\x0f"        # cluster 2 ends the chain
+    data_start = ROOT_START + 112 * 32
+    image[data_start:data_start + len(PROGRAM)] = PROGRAM
+    return bytes(image)
+
+
+def make_msa(sectors, sides, start_track, end_track, tracks=b""):
+    return struct.pack(">HHHHH", 0x0e0f, sectors, sides - 1, start_track, end_track) + tracks
+
+
+CASES = [
+    # (name, image, expected return code)
+    ("valid .st", make_st(), 0),
+    ("data area past the end", make_st(total_sectors=10, start_cluster=1700), 1),
+    ("msa sectors and tracks $ffff", make_msa(0xffff, 1, 0, 0xffff, bytes(16)), 1),
+    ("msa 41 sectors", make_msa(41, 1, 0, 0), 1),
+    ("msa 255 tracks", make_msa(9, 2, 0, 255), 1),
+    ("msa truncated track", make_msa(9, 1, 0, 0, struct.pack(">H", 9 * SECTOR_SIZE)), 1),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--hopper", default=os.path.join(SCRIPT_DIR, "..", "hopper68"))
+    args = parser.parse_args()
+
+    failures = 0
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for name, image, expected in CASES:
+            path = os.path.join(tmpdir, "test.msa" if image[:2] == b"\x0e\x0f" else "test.st")
+            with open(path, "wb") as f:
+                f.write(image)
+            result = subprocess.run([args.hopper, "--disk", path], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            stderr = result.stderr.decode("latin-1")
+            if result.returncode != expected or (expected and not stderr.startswith("Error:")):
+                print("FAIL %s: returned %d, expected %d\n%s" % (name, result.returncode, expected, stderr))
+                failures += 1
+            elif not expected and b"TEST.PRG" not in result.stdout:
+                print("FAIL %s: TEST.PRG not listed" % name)
+                failures += 1
+    print("disk_test: %d failures" % failures)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,172 @@
+/* Test of the C interface in lib/libhop68.h.
+ *
+ * Written in C, so it also checks the header compiles as C. On glibc the
+ * allocator functions are replaced with counting versions, to check that
+ * decoding and formatting never allocate once the tables are built.
+ *
+ * Returns 0 if all checks pass.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/libhop68.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); ++g_failures; } } while (0)
+
+/* ------------------------------------------------------------------------- */
+/* Allocation counting */
+#ifdef __GLIBC__
+#define COUNT_ALLOCATIONS 1
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static volatile long g_allocations = 0;
+
+void* malloc(size_t size)					{ ++g_allocations; return __libc_malloc(size); }
+void* calloc(size_t count, size_t size)		{ ++g_allocations; return __libc_calloc(count, size); }
+void* realloc(void* ptr, size_t size)		{ ++g_allocations; return __libc_realloc(ptr, size); }
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* move.l d0,16(a0) / bsr.w +$10 / nop / (invalid) / rts / move.l #$12345678,d0 */
+static const uint8_t g_code[] =
+{
+	0x21, 0x40, 0x00, 0x10,
+	0x61, 0x00, 0x00, 0x10,
+	0x4e, 0x71,
+	0xff, 0xff,
+	0x4e, 0x75,
+	0x20, 0x3c, 0x12, 0x34, 0x56, 0x78
+};
+
+static const char* g_expected[] =
+{
+	"move.l   d0,16(a0)",
+	"bsr.w    $1016",
+	"nop",
+	"dc.w     $ffff  ; ..",
+	"rts",
+	"move.l   #$12345678,d0"
+};
+
+#define CODE_ADDRESS	0x1000
+#define NUM_EXPECTED	(sizeof(g_expected) / sizeof(g_expected[0]))
+
+/* ------------------------------------------------------------------------- */
+struct range_state
+{
+	unsigned	count;
+	unsigned	stop_after;
+	int			check_text;
+	char		text[64];
+};
+
+static int range_callback(const hop68_inst* inst, void* user_data)
+{
+	struct range_state* state = (struct range_state*)user_data;
+	hop68_format(inst, NULL, state->text, sizeof(state->text));
+	if (state->check_text && state->count < NUM_EXPECTED && strcmp(state->text, g_expected[state->count]) != 0)
+	{
+		fprintf(stderr, "FAIL: instruction %u is '%s', expected '%s'\n",
+			state->count, state->text, g_expected[state->count]);
+		++g_failures;
+	}
+	++state->count;
+	return state->count == state->stop_after;
+}
+
+/* ------------------------------------------------------------------------- */
+static const char* find_label(void* user_data, uint32_t address)
+{
+	(void)user_data;
+	return address == 0x1016 ? "my_function" : NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+int main(void)
+{
+	hop68_inst inst;
+	char text[64];
+	struct range_state state;
+	hop68_symbols symbols = { find_label, NULL, NULL };
+	static const uint8_t bfextu[4] = { 0xe9, 0xc0, 0x10, 0x04 };
+	uint32_t size;
+
+	CHECK(hop68_get_api_version() == HOP68_API_VERSION);
+	CHECK(hop68_init(HOP68_CPU_68000) == 0);
+	CHECK(hop68_init(HOP68_CPU_68030) == 0);
+	CHECK(hop68_init(99) == 1);
+
+#ifdef COUNT_ALLOCATIONS
+	g_allocations = 0;
+#endif
+
+	/* Single decode and the public fields */
+	CHECK(hop68_decode(g_code + 4, 4, CODE_ADDRESS + 4, HOP68_CPU_68000, &inst) == 0);
+	CHECK(inst.address == CODE_ADDRESS + 4);
+	CHECK(inst.byte_count == 4);
+	CHECK(inst.valid == 1);
+	CHECK(strcmp(inst.opcode, "bsr") == 0);
+	CHECK(strcmp(inst.suffix, ".w") == 0);
+	CHECK(inst.target_kind == HOP68_TARGET_CALL);
+	CHECK(inst.target == 0x1016);
+
+	/* Labels */
+	CHECK(hop68_format(&inst, &symbols, text, sizeof(text)) == strlen("bsr.w    my_function"));
+	CHECK(strcmp(text, "bsr.w    my_function") == 0);
+
+	/* Truncation returns the full length, and still terminates */
+	CHECK(hop68_format(&inst, NULL, text, 6) == strlen("bsr.w    $1016"));
+	CHECK(strcmp(text, "bsr.w") == 0);
+
+	/* Invalid data */
+	CHECK(hop68_decode(g_code + 10, 2, 0, HOP68_CPU_68000, &inst) == 0);
+	CHECK(inst.valid == 0);
+	CHECK(inst.byte_count == 2);
+	CHECK(strcmp(inst.opcode, "dc.w") == 0);
+
+	/* CPU-specific instructions */
+	CHECK(hop68_decode(bfextu, 4, 0, HOP68_CPU_68000, &inst) == 0);
+	CHECK(inst.valid == 0);
+	CHECK(hop68_decode(bfextu, 4, 0, HOP68_CPU_68030, &inst) == 0);
+	CHECK(inst.valid == 1);
+	hop68_format(&inst, NULL, text, sizeof(text));
+	CHECK(strcmp(text, "bfextu   d0{0:4},d1") == 0);
+
+	/* Not enough data, or bad arguments */
+	CHECK(hop68_decode(g_code, 1, 0, HOP68_CPU_68000, &inst) == 1);
+	CHECK(hop68_decode(g_code, 4, 0, -1, &inst) == 1);
+
+	/* Ranges, including stopping early */
+	memset(&state, 0, sizeof(state));
+	state.check_text = 1;
+	size = hop68_decode_range(g_code, sizeof(g_code), CODE_ADDRESS, HOP68_CPU_68000, range_callback, &state);
+	CHECK(size == sizeof(g_code));
+	CHECK(state.count == NUM_EXPECTED);
+
+	memset(&state, 0, sizeof(state));
+	state.check_text = 1;
+	state.stop_after = 2;
+	size = hop68_decode_range(g_code, sizeof(g_code), CODE_ADDRESS, HOP68_CPU_68000, range_callback, &state);
+	CHECK(size == 8);
+	CHECK(state.count == 2);
+
+	/* A truncated final instruction is decoded as data */
+	memset(&state, 0, sizeof(state));
+	size = hop68_decode_range(g_code, 3, CODE_ADDRESS, HOP68_CPU_68000, range_callback, &state);
+	CHECK(size == 2);
+	CHECK(state.count == 1);
+	CHECK(strcmp(state.text, "dc.w     $2140  ; !@") == 0);
+
+#ifdef COUNT_ALLOCATIONS
+	CHECK(g_allocations == 0);
+	printf("libhop68_test: %ld allocations\n", (long)g_allocations);
+#endif
+	printf("libhop68_test: %d failures\n", g_failures);
+	return g_failures ? 1 : 0;
+}
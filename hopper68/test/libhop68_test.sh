@@ -0,0 +1,11 @@
+#!/usr/bin/env sh
+# Build and run the test of the C library interface, against the static
+# library from ../build.sh.
+set -e
+CC=${CC:-gcc}
+CXX=${CXX:-g++}
+CFLAGS="-std=c99 -g -Wextra -Wall ${EXTRA_CFLAGS}"
+
+${CC} ${CFLAGS} -c -o libhop68_test.o libhop68_test.c
+${CXX} -o libhop68_test libhop68_test.o ../libhop68.a -pthread
+./libhop68_test
@@ -0,0 +1,121 @@
+""" Test of hopper68's server mode, using the client in tools/hopper_client.
+
+    Checks that responses match "hopper68 --no-labels --hex" for random
+    windows of bytes, over stdin and over a Unix socket with several clients,
+    and that invalid requests get an error without ending the connection.
+
+    Usage: server_test.py [--hopper path] [--requests N]
+    Returns 0 if all checks pass.
+"""
+import argparse
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(SCRIPT_DIR, "..", "..", "tools", "hopper_client"))
+import hopper_client    # noqa: E402
+
+CPU_OPTIONS = {"68000": [], "68010": ["--m68010"], "68020": ["--m68020"], "68030": ["--m68030"]}
+
+
+def make_requests(count, seed):
+    """ Returns [(data, base, cpu)] of random windows; some are repeated, to hit the cache """
+    rng = random.Random(seed)
+    requests = []
+    for _ in range(count):
+        if requests and rng.random() < 0.2:
+            requests.append(rng.choice(requests))
+            continue
+        data = bytes(rng.randrange(256) for _ in range(rng.randrange(2, 64)))
+        requests.append((data, rng.randrange(0, 0x1000000, 2), rng.choice(sorted(CPU_OPTIONS))))
+    return requests
+
+
+def expected_text(hopper, data, base, cpu):
+    cmd = [hopper, "--no-labels", "--base", "$%x" % base] + CPU_OPTIONS[cpu] + ["--hex", data.hex()]
+    return subprocess.run(cmd, stdout=subprocess.PIPE, check=True).stdout.decode("latin-1")
+
+
+def check_requests(client, requests, expected, name):
+    failures = 0
+    for (data, base, cpu), text in zip(requests, expected):
+        actual = client.decode(data, base, cpu)
+        if actual != text:
+            print("FAIL %s: %s base $%x cpu %s\n--- expected\n%s--- actual\n%s" %
+                  (name, data.hex(), base, cpu, text, actual))
+            failures += 1
+    return failures
+
+
+def check_errors(client):
+    failures = 0
+    for cpu, fmt in ((7, 0), (0, 9)):
+        status, message = client.send(struct.pack(">IBBH", 0, cpu, fmt, 0) + b"\x4e\x75")
+        if status == 0 or not message.startswith("Error:"):
+            print("FAIL: invalid request (cpu %d, format %d) was accepted" % (cpu, fmt))
+            failures += 1
+    if client.send(b"\x00")[0] == 0:
+        print("FAIL: short request was accepted")
+        failures += 1
+    # The connection still works afterwards
+    if client.decode(b"\x4e\x75") != "\trts\n":
+        print("FAIL: connection broken after an invalid request")
+        failures += 1
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--hopper", default=os.path.join(SCRIPT_DIR, "..", "hopper68"))
+    parser.add_argument("--requests", type=int, default=200)
+    args = parser.parse_args()
+
+    requests = make_requests(args.requests, 1)
+    expected = [expected_text(args.hopper, *r) for r in requests]
+    failures = 0
+
+    # stdin/stdout
+    with hopper_client.HopperClient.spawn(args.hopper) as client:
+        start = time.perf_counter()
+        failures += check_requests(client, requests, expected, "stdin")
+        elapsed = time.perf_counter() - start
+        failures += check_errors(client)
+    print("server_test: stdin: %d requests, %.0f requests/s" % (len(requests), len(requests) / elapsed))
+
+    # Unix socket, several clients at once
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path = os.path.join(tmpdir, "hopper.sock")
+        server = subprocess.Popen([args.hopper, "--server", path])
+        try:
+            for _ in range(100):
+                if os.path.exists(path):
+                    break
+                time.sleep(0.05)
+            results = [0] * 4
+
+            def run_client(index):
+                with hopper_client.HopperClient.connect(path) as client:
+                    results[index] = check_requests(client, requests, expected, "socket %d" % index)
+            threads = [threading.Thread(target=run_client, args=(i,)) for i in range(len(results))]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            failures += sum(results)
+            with hopper_client.HopperClient.connect(path) as client:
+                failures += check_errors(client)
+        finally:
+            server.kill()
+            server.wait()
+    print("server_test: %d failures" % failures)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,121 @@
+""" Client for hopper68's server mode (hopper68 --server).
+
+    Sends framed decode requests over a Unix socket, or to a hopper68 process
+    started with "--server -" which reads requests on stdin. See
+    hopper68/server.h for the protocol.
+
+    Usage as a program:
+      hopper_client.py (--socket path | --spawn path/to/hopper68)
+                       [--base address] [--cpu 68000|68010|68020|68030]
+                       [--format text|listing|json] hexstring...
+"""
+import argparse
+import socket
+import struct
+import subprocess
+import sys
+
+CPU_TYPES = {"68000": 0, "68010": 1, "68020": 2, "68030": 3}
+FORMATS = {"text": 0, "listing": 1, "json": 2}
+
+
+class ServerError(Exception):
+    """ An error status returned by the server """
+
+
+def encode_request(data, base=0, cpu="68000", fmt="text"):
+    """ Returns the body of a request (without the length) for "data" as bytes """
+    return struct.pack(">IBBH", base & 0xffffffff, CPU_TYPES[cpu], FORMATS[fmt], 0) + bytes(data)
+
+
+class HopperClient:
+    """ Connection to a running server. Use connect() or spawn() to create one. """
+
+    def __init__(self, reader, writer, closer):
+        self._reader = reader
+        self._writer = writer
+        self._closer = closer
+
+    @classmethod
+    def connect(cls, path):
+        """ Connect to a server listening on the Unix socket at "path" """
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(path)
+        stream = sock.makefile("rwb")
+
+        def close():
+            stream.close()
+            sock.close()
+        return cls(stream, stream, close)
+
+    @classmethod
+    def spawn(cls, hopper_path):
+        """ Start "hopper68 --server -" and talk to it over stdin and stdout """
+        proc = subprocess.Popen([hopper_path, "--server", "-"],
+                                stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+        def close():
+            proc.stdin.close()
+            proc.stdout.close()
+            proc.wait()
+        return cls(proc.stdout, proc.stdin, close)
+
+    def decode(self, data, base=0, cpu="68000", fmt="text"):
+        """ Returns the disassembly of "data" as a string.
+            Raises ServerError if the server rejects the request. """
+        status, text = self.send(encode_request(data, base, cpu, fmt))
+        if status != 0:
+            raise ServerError(text)
+        return text
+
+    def send(self, body):
+        """ Send a request body, and return the response as (status, text) """
+        self._writer.write(struct.pack(">I", len(body)) + body)
+        self._writer.flush()
+        length, status = struct.unpack(">II", self._read_exact(8))
+        return status, self._read_exact(length - 4).decode("latin-1")
+
+    def close(self):
+        self._closer()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def _read_exact(self, count):
+        data = b""
+        while len(data) < count:
+            chunk = self._reader.read(count - len(data))
+            if not chunk:
+                raise EOFError("server closed the connection")
+            data += chunk
+        return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="hopper68 server client")
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("--socket", help="Unix socket of a running 'hopper68 --server <path>'")
+    group.add_argument("--spawn", help="path to hopper68, started with '--server -'")
+    parser.add_argument("--base", type=lambda s: int(s.replace("$", "0x"), 0), default=0)
+    parser.add_argument("--cpu", choices=sorted(CPU_TYPES), default="68000")
+    parser.add_argument("--format", choices=sorted(FORMATS), default="text")
+    parser.add_argument("hex", nargs="+", help="instruction bytes as hex, one request each")
+    args = parser.parse_args()
+
+    client = HopperClient.connect(args.socket) if args.socket else HopperClient.spawn(args.spawn)
+    with client:
+        for hexstring in args.hex:
+            try:
+                sys.stdout.write(client.decode(bytes.fromhex(hexstring), args.base, args.cpu, args.format))
+                sys.stdout.write("\n" if args.format == "json" else "")
+            except ServerError as e:
+                print(e, file=sys.stderr)
+                return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
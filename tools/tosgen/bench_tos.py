@@ -0,0 +1,95 @@
+""" End-to-end throughput benchmark for hopper68 on synthetic TOS executables.
+
+    Generates inputs with tosgen.py (cached in the work directory), runs
+    hopper68 on each with output discarded, and reports throughput in MB/s of
+    input and the peak resident set size of the process. The breakdown for
+    each pipeline stage comes from hopper68's --stats output.
+
+    Usage: bench_tos.py [--hopper path] [--workdir dir] [--runs N] [sizes...]
+      default sizes: 10K 100K 1M 10M 100M
+"""
+import argparse
+import os
+import subprocess
+import sys
+import time
+
+import tosgen
+
+DEFAULT_SIZES = ["10K", "100K", "1M", "10M", "100M"]
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_HOPPER = os.path.join(SCRIPT_DIR, "..", "..", "hopper68", "hopper68")
+
+
+def get_input(workdir, size):
+    path = os.path.join(workdir, "tosgen_%s.prg" % size)
+    if not os.path.exists(path):
+        with open(path, 'wb') as f:
+            f.write(tosgen.generate(tosgen.parse_size(size), 1))
+    return path
+
+
+def run_once(cmd):
+    """ Returns (wall seconds, peak RSS in KB, exit code, stderr text) for one run """
+    with open(os.devnull, 'wb') as devnull:
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdout=devnull, stderr=subprocess.PIPE)
+        errors = proc.stderr.read().decode(errors='replace')
+        # wait4 gives the resource usage of this child alone
+        _, status, usage = os.wait4(proc.pid, 0)
+        elapsed = time.perf_counter() - start
+    return elapsed, usage.ru_maxrss, os.waitstatus_to_exitcode(status), errors
+
+
+def parse_stats(text):
+    """ Returns [(phase, ms, peak RSS KB)] from hopper68 --stats output """
+    phases = []
+    for line in text.splitlines():
+        if not line.startswith("Stats: "):
+            continue
+        fields = line[7:].rsplit(None, 2)
+        if len(fields) == 3 and fields[0] not in ("phase", "total"):
+            try:
+                phases.append((fields[0].strip(), float(fields[1]), int(fields[2])))
+            except ValueError:
+                pass
+    return phases
+
+
+def main():
+    parser = argparse.ArgumentParser(description="hopper68 throughput benchmark")
+    parser.add_argument("--hopper", default=DEFAULT_HOPPER)
+    parser.add_argument("--workdir", default=".")
+    parser.add_argument("--runs", type=int, default=3, help="runs per size (best is reported)")
+    parser.add_argument("sizes", nargs="*", default=DEFAULT_SIZES)
+    args = parser.parse_args()
+
+    results = []
+    print("%-6s %12s %10s %10s %12s" % ("size", "bytes", "seconds", "MB/s", "peak RSS KB"))
+    for size in args.sizes:
+        path = get_input(args.workdir, size)
+        nbytes = os.path.getsize(path)
+        best = None
+        for _ in range(args.runs):
+            elapsed, rss, code, errors = run_once([args.hopper, "--stats", path])
+            if code != 0:
+                print("Error: hopper68 failed on %s (exit code %d)" % (path, code), file=sys.stderr)
+                return 1
+            if best is None or elapsed < best[0]:
+                best = (elapsed, rss, parse_stats(errors))
+        results.append((size, nbytes, best[2]))
+        print("%-6s %12d %10.3f %10.2f %12d" % (size, nbytes, best[0],
+              nbytes / (1024 * 1024) / best[0], best[1]))
+
+    # Per-stage breakdown, with throughput relative to the input size
+    for size, nbytes, phases in results:
+        print("\n%s:" % size)
+        print("  %-24s %10s %10s %12s" % ("stage", "ms", "MB/s", "peak RSS KB"))
+        for name, ms, rss in phases:
+            rate = nbytes / (1024 * 1024) / (ms / 1000.0) if ms > 0 else 0.0
+            print("  %-24s %10.3f %10.2f %12d" % (name, ms, rate, rss))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,318 @@
+""" Generate synthetic Atari TOS executables for benchmarking hopper68.
+
+    The output is a valid .prg with:
+      - a text section of functions made from a weighted instruction mix,
+        including branches, pc-relative accesses and relocated absolute longs
+      - a data section of strings, tables and relocated pointers
+      - a DRI symbol table (including extended-length names)
+      - a relocation stream
+      - HEAD/LINE/HCLN debug hunks after the relocations
+
+    Large files are built by tiling a few distinct "chunks" of code, with the
+    relocated longs patched per tile, so 100MB files only take a few seconds.
+
+    Usage: tosgen.py [--seed N] <size> <output.prg>
+      size is in bytes, with optional K or M suffix e.g. 10K, 100M
+"""
+import argparse
+import random
+import struct
+
+TOS_HEADER_SIZE = 28
+CHUNK_SIZE = 64 * 1024          # text size of each distinct chunk
+NUM_VARIANTS = 8                # number of distinct chunks
+TEXT_FRACTION = 0.70            # share of the file used for each section
+DATA_FRACTION = 0.15
+BSS_SIZE = 64 * 1024
+
+DRI_SECT_TEXT = 0x0200
+DRI_SECT_DATA = 0x0400
+DRI_SYM_DEFINED = 0x8000
+DRI_EXT_SYMBOL_FLAG = 0x0048
+
+HUNK_ID = 0x3F1
+HUNK_HEAD = 0x48454144
+HUNK_LINE = 0x4c494e45
+HUNK_HCLN = 0x48434c4e
+
+# Space needed after the cursor for the longest template
+MAX_TEMPLATE_SIZE = 8
+
+
+class Chunk:
+    """ A block of code at offset 0, ready to be placed anywhere """
+    def __init__(self):
+        self.code = bytearray()
+        self.relocs = []        # offsets of relocated longs
+        self.functions = []     # offsets of function starts
+        self.lines = []         # (line, offset) pairs for debug info
+
+
+class Emitter:
+    def __init__(self, rng, chunk):
+        self.rng = rng
+        self.chunk = chunk
+        self.func_start = 0
+        self.inst_starts = []   # instruction offsets in the current function
+
+    def words(self, *words):
+        for w in words:
+            self.chunk.code += struct.pack('>H', w & 0xffff)
+
+    def reloc_long(self):
+        """ Placeholder long, patched with a real address per tile """
+        self.chunk.relocs.append(len(self.chunk.code))
+        self.chunk.code += b'\0\0\0\0'
+
+    def back_target(self):
+        """ Displacement from the next word to an earlier instruction """
+        target = self.rng.choice(self.inst_starts)
+        return target - (len(self.chunk.code) + 2)
+
+    def reg(self):
+        return self.rng.randrange(8)
+
+    def areg(self):
+        return self.rng.randrange(7)     # avoid sp
+
+
+# Each template writes one instruction. (weight, function)
+def t_moveq(e):      e.words(0x7000 | e.reg() << 9 | e.rng.randrange(256))
+def t_move_dd(e):    e.words(0x2000 | e.reg() << 9 | e.reg())
+def t_move_disp(e):  e.words(0x3028 | e.reg() << 9 | e.areg(), e.rng.randrange(0, 256, 2))
+def t_move_post(e):  e.words(0x2018 | e.reg() << 9 | e.areg())
+def t_move_pc(e):    e.words(0x203a | e.reg() << 9, e.back_target())
+def t_addq(e):       e.words(0x5080 | (e.rng.randrange(8) << 9) | e.reg())
+def t_add(e):        e.words(0xd080 | e.reg() << 9 | e.reg())
+def t_cmpi(e):       e.words(0x0c40 | e.reg(), e.rng.randrange(0x10000))
+def t_tst(e):        e.words(0x4a80 | e.reg())
+def t_lsl(e):        e.words(0xe148 | (e.rng.randrange(8) << 9) | e.reg())
+def t_bne(e):        e.words(0x6600, e.back_target())
+def t_dbf(e):        e.words(0x51c8 | e.reg(), e.back_target())
+def t_bsr(e):
+    target = e.rng.choice(e.chunk.functions)
+    e.words(0x6100, target - (len(e.chunk.code) + 2))
+def t_lea_abs(e):
+    e.words(0x41f9 | e.areg() << 9)
+    e.reloc_long()
+def t_jsr_abs(e):
+    e.words(0x4eb9)
+    e.reloc_long()
+def t_nop(e):        e.words(0x4e71)
+
+TEMPLATES = [
+    (10, t_moveq), (10, t_move_dd), (8, t_move_disp), (6, t_move_post),
+    (2, t_move_pc), (6, t_addq), (5, t_add), (4, t_cmpi), (4, t_tst),
+    (3, t_lsl), (3, t_bne), (2, t_dbf), (3, t_bsr), (4, t_lea_abs),
+    (3, t_jsr_abs), (1, t_nop),
+]
+
+
+def make_chunk(rng, size):
+    """ Build a chunk of "size" bytes of text made of functions """
+    chunk = Chunk()
+    e = Emitter(rng, chunk)
+    weights = [w for w, _ in TEMPLATES]
+    funcs = [f for _, f in TEMPLATES]
+    line = 1
+    while size - len(chunk.code) >= 2 * MAX_TEMPLATE_SIZE + 8:
+        # Prologue: movem.l d2-d7/a2-a6,-(sp)
+        chunk.functions.append(len(chunk.code))
+        e.inst_starts = [len(chunk.code)]
+        e.words(0x48e7, 0x3f3e)
+        line += 2
+        for _ in range(rng.randrange(8, 64)):
+            if size - len(chunk.code) < MAX_TEMPLATE_SIZE + 6:
+                break
+            e.inst_starts.append(len(chunk.code))
+            if rng.randrange(4) == 0:
+                chunk.lines.append((line, len(chunk.code)))
+            rng.choices(funcs, weights)[0](e)
+            line += 1
+        # Epilogue: movem.l (sp)+,d2-d7/a2-a6 / rts
+        e.words(0x4cdf, 0x7cfc, 0x4e75)
+        line += 3
+    # Pad with nops
+    while len(chunk.code) < size:
+        e.words(0x4e71)
+    return chunk
+
+
+def make_data(rng, size):
+    """ Data section with strings, word tables and pointer slots """
+    data = bytearray()
+    relocs = []
+    words = ["hopper", "atari", "falcon", "error", "file", "loading", "sprite", "sound"]
+    while size - len(data) >= 64:
+        kind = rng.randrange(3)
+        if kind == 0:
+            text = " ".join(rng.choice(words) for _ in range(rng.randrange(2, 8)))
+            data += text.encode() + b'\r\n\0'
+        elif kind == 1:
+            for _ in range(rng.randrange(4, 16)):
+                data += struct.pack('>H', rng.randrange(0x10000))
+        else:
+            if len(data) & 1:
+                data += b'\0'
+            for _ in range(rng.randrange(2, 8)):
+                relocs.append(len(data))
+                data += b'\0\0\0\0'
+    data += bytes(size - len(data))
+    return data, relocs
+
+
+def encode_relocs(offsets):
+    """ TOS relocation stream for sorted, even offsets """
+    if not offsets:
+        return struct.pack('>I', 0)
+    out = bytearray(struct.pack('>I', offsets[0]))
+    prev = offsets[0]
+    for off in offsets[1:]:
+        delta = off - prev
+        while delta > 254:
+            out.append(1)
+            delta -= 254
+        out.append(delta)
+        prev = off
+    out.append(0)
+    # Debug hunks start on a word boundary
+    if len(out) & 1:
+        out.append(0)
+    return out
+
+
+def dri_symbol(name, sym_type, value):
+    name = name.encode()
+    if len(name) <= 8:
+        return name.ljust(8, b'\0') + struct.pack('>HI', sym_type, value)
+    return (name[:8] + struct.pack('>HI', sym_type | DRI_EXT_SYMBOL_FLAG, value) +
+            name[8:22].ljust(14, b'\0'))
+
+
+def hunk(offset, htype, body):
+    if len(body) & 3:
+        body += bytes(4 - (len(body) & 3))
+    payload = struct.pack('>II', offset, htype) + body
+    return struct.pack('>II', HUNK_ID, len(payload) // 4) + payload
+
+
+def padded_name(name):
+    name = name.encode()
+    name += bytes(4 - (len(name) & 3))
+    return struct.pack('>I', len(name) // 4) + name
+
+
+def hcln_value(val):
+    if 0 < val < 0x100:
+        return bytes([val])
+    if 0 < val < 0x10000:
+        return b'\0' + struct.pack('>H', val)
+    return b'\0\0\0' + struct.pack('>I', val)
+
+
+def line_body(chunk):
+    body = bytearray()
+    for line, off in chunk.lines:
+        body += struct.pack('>II', line, off)
+    return body
+
+
+def hcln_body(chunk):
+    body = bytearray(struct.pack('>I', len(chunk.lines)))
+    prev_line, prev_off = 0, 0
+    for line, off in chunk.lines:
+        body += hcln_value(line - prev_line) + hcln_value(off - prev_off)
+        prev_line, prev_off = line, off
+    return body
+
+
+def generate(size, seed):
+    rng = random.Random(seed)
+    text_size = max(256, int(size * TEXT_FRACTION)) & ~1
+    data_size = max(64, int(size * DATA_FRACTION)) & ~1
+    chunk_size = min(CHUNK_SIZE, text_size)
+    num_tiles = text_size // chunk_size
+    text_size = num_tiles * chunk_size
+
+    variants = [make_chunk(rng, chunk_size) for _ in range(NUM_VARIANTS)]
+    data_chunk, data_chunk_relocs = make_data(rng, min(CHUNK_SIZE, data_size))
+    num_data_tiles = max(1, data_size // len(data_chunk))
+    data_size = num_data_tiles * len(data_chunk)
+
+    # Text: tile the variants, patching each relocated long with a pointer
+    # to a function somewhere else in the text
+    text = bytearray(text_size)
+    relocs = []
+    func_addrs = []
+    tile_variants = []
+    for t in range(num_tiles):
+        chunk = variants[rng.randrange(NUM_VARIANTS)]
+        tile_variants.append(chunk)
+        base = t * chunk_size
+        text[base:base + chunk_size] = chunk.code
+        func_addrs.extend(base + f for f in chunk.functions)
+    for t, chunk in enumerate(tile_variants):
+        base = t * chunk_size
+        for off in chunk.relocs:
+            struct.pack_into('>I', text, base + off, rng.choice(func_addrs))
+            relocs.append(base + off)
+
+    # Data: pointer slots refer to text functions or other data
+    data = bytearray(data_chunk) * num_data_tiles
+    for t in range(num_data_tiles):
+        base = t * len(data_chunk)
+        for off in data_chunk_relocs:
+            if rng.randrange(4) == 0:
+                target = text_size + rng.randrange(0, data_size, 2)
+            else:
+                target = rng.choice(func_addrs)
+            struct.pack_into('>I', data, base + off, target)
+            relocs.append(text_size + base + off)
+
+    # Symbols: every function, plus some data labels
+    symtab = bytearray()
+    for i, addr in enumerate(func_addrs):
+        name = "fn%06d" % i if i % 8 else "function_%08d" % i
+        symtab += dri_symbol(name, DRI_SYM_DEFINED | DRI_SECT_TEXT, addr)
+    for i in range(0, data_size, 4096):
+        symtab += dri_symbol("dat%05d" % (i // 4096), DRI_SYM_DEFINED | DRI_SECT_DATA, i)
+
+    # Debug hunks: a HEAD, then one "source file" per tile, alternating
+    # between the LINE and HCLN formats. The line data is relative to the
+    # hunk offset, so each variant's encoded body can be reused.
+    bodies = {}
+    debug = bytearray(hunk(0, HUNK_HEAD, bytearray()))
+    for t, chunk in enumerate(tile_variants):
+        use_hcln = (t & 1) == 0
+        key = (id(chunk), use_hcln)
+        if key not in bodies:
+            bodies[key] = hcln_body(chunk) if use_hcln else line_body(chunk)
+        name = padded_name("src%05d.s" % t)
+        if use_hcln:
+            debug += hunk(t * chunk_size, HUNK_HCLN, name + bodies[key])
+        else:
+            debug += hunk(t * chunk_size, HUNK_LINE, name + bodies[key])
+
+    relocs.sort()
+    header = struct.pack('>HIIIIIIH', 0x601a, text_size, data_size, BSS_SIZE,
+                         len(symtab), 0, 0, 0)
+    return b''.join([header, text, data, symtab, encode_relocs(relocs), debug])
+
+
+def parse_size(text):
+    mult = 1
+    if text[-1] in 'kK':
+        mult, text = 1024, text[:-1]
+    elif text[-1] in 'mM':
+        mult, text = 1024 * 1024, text[:-1]
+    return int(text) * mult
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Generate a synthetic TOS executable")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("size", help="approximate file size, e.g. 10K or 100M")
+    parser.add_argument("output")
+    args = parser.parse_args()
+    with open(args.output, 'wb') as f:
+        f.write(generate(parse_size(args.size), args.seed))